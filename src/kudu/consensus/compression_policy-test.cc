@@ -0,0 +1,122 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "kudu/consensus/compression_policy.h"
+
+#include <gflags/gflags_declare.h>
+#include <gtest/gtest.h>
+
+#include "kudu/util/test_util.h"
+
+DECLARE_bool(compression_adaptive);
+DECLARE_int32(compression_adaptive_min_payload_bytes);
+DECLARE_double(compression_adaptive_max_ratio);
+DECLARE_double(compression_adaptive_max_cpu_utilization);
+DECLARE_int32(compression_adaptive_probe_every_n);
+
+namespace kudu {
+namespace consensus {
+
+class CompressionPolicyTest : public KuduTest {
+ public:
+  void SetUp() override {
+    KuduTest::SetUp();
+    FLAGS_compression_adaptive = true;
+    FLAGS_compression_adaptive_min_payload_bytes = 256;
+    FLAGS_compression_adaptive_max_ratio = 0.9;
+    // Keep the test independent of the load on the machine.
+    FLAGS_compression_adaptive_max_cpu_utilization = 1000;
+    FLAGS_compression_adaptive_probe_every_n = 4;
+  }
+};
+
+TEST_F(CompressionPolicyTest, TestDisabled) {
+  FLAGS_compression_adaptive = false;
+  CompressionPolicy policy;
+  policy.SetHasRemotePeers(false);
+  EXPECT_TRUE(policy.ShouldCompress(ZSTD, 1));
+  // Without the policy, compressed payloads are kept even when larger.
+  EXPECT_TRUE(policy.RecordCompression(ZSTD, 100, 120));
+}
+
+TEST_F(CompressionPolicyTest, TestSmallPayloads) {
+  CompressionPolicy policy;
+  for (int i = 0; i < 10; i++) {
+    EXPECT_FALSE(policy.ShouldCompress(ZSTD, 255));
+    EXPECT_TRUE(policy.ShouldCompress(ZSTD, 256));
+  }
+}
+
+TEST_F(CompressionPolicyTest, TestLocalPeers) {
+  CompressionPolicy policy;
+  policy.SetHasRemotePeers(false);
+  for (int i = 0; i < 10; i++) {
+    EXPECT_FALSE(policy.ShouldCompress(ZSTD, 4096));
+  }
+  policy.SetHasRemotePeers(true);
+  EXPECT_TRUE(policy.ShouldCompress(ZSTD, 4096));
+}
+
+TEST_F(CompressionPolicyTest, TestPoorRatio) {
+  CompressionPolicy policy;
+  ASSERT_TRUE(policy.RecordCompression(ZSTD, 1000, 950));
+  ASSERT_DOUBLE_EQ(0.95, policy.recent_ratio(ZSTD));
+
+  // Only probes get compressed.
+  int compressed = 0;
+  for (int i = 0; i < 40; i++) {
+    if (policy.ShouldCompress(ZSTD, 4096)) {
+      compressed++;
+    }
+  }
+  EXPECT_EQ(10, compressed);
+
+  // Another codec starts with a clean slate.
+  EXPECT_EQ(0, policy.recent_ratio(LZ4));
+  ASSERT_TRUE(policy.RecordCompression(LZ4, 1000, 300));
+  compressed = 0;
+  for (int i = 0; i < 40; i++) {
+    if (policy.ShouldCompress(LZ4, 4096)) {
+      compressed++;
+    }
+  }
+  EXPECT_EQ(40, compressed);
+}
+
+TEST_F(CompressionPolicyTest, TestRatioRecovers) {
+  CompressionPolicy policy;
+  ASSERT_TRUE(policy.RecordCompression(ZSTD, 1000, 950));
+  ASSERT_FALSE(policy.ShouldCompress(ZSTD, 4096) &&
+               policy.ShouldCompress(ZSTD, 4096));
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(policy.RecordCompression(ZSTD, 1000, 200));
+  }
+  EXPECT_LT(policy.recent_ratio(ZSTD), FLAGS_compression_adaptive_max_ratio);
+  for (int i = 0; i < 10; i++) {
+    EXPECT_TRUE(policy.ShouldCompress(ZSTD, 4096));
+  }
+}
+
+TEST_F(CompressionPolicyTest, TestNoGain) {
+  CompressionPolicy policy;
+  EXPECT_FALSE(policy.RecordCompression(ZSTD, 100, 100));
+  EXPECT_FALSE(policy.RecordCompression(ZSTD, 100, 120));
+  EXPECT_TRUE(policy.RecordCompression(ZSTD, 100, 99));
+}
+
+} // namespace consensus
+} // namespace kudu
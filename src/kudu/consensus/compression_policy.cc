@@ -0,0 +1,240 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "kudu/consensus/compression_policy.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <mutex>
+
+#include <gflags/gflags.h>
+
+#include "kudu/gutil/sysinfo.h"
+#include "kudu/util/flag_tags.h"
+#include "kudu/util/jsonwriter.h"
+
+DEFINE_bool(
+    compression_adaptive,
+    false,
+    "Whether the leader decides, payload by payload, whether compressing is "
+    "worth it, based on payload size, recent compression ratio, CPU usage and "
+    "peer locality. When false, every write payload is compressed with the "
+    "current codec.");
+TAG_FLAG(compression_adaptive, experimental);
+TAG_FLAG(compression_adaptive, runtime);
+
+DEFINE_int32(
+    compression_adaptive_min_payload_bytes,
+    256,
+    "Payloads smaller than this are not compressed when --compression_adaptive "
+    "is set");
+TAG_FLAG(compression_adaptive_min_payload_bytes, experimental);
+TAG_FLAG(compression_adaptive_min_payload_bytes, runtime);
+
+DEFINE_double(
+    compression_adaptive_max_ratio,
+    0.9,
+    "Payloads are not compressed when --compression_adaptive is set and the "
+    "recent payloads compressed to more than this fraction of their size");
+TAG_FLAG(compression_adaptive_max_ratio, experimental);
+TAG_FLAG(compression_adaptive_max_ratio, runtime);
+
+DEFINE_double(
+    compression_adaptive_max_cpu_utilization,
+    0.8,
+    "Payloads are not compressed when --compression_adaptive is set and the "
+    "process uses more than this fraction of the machine's CPUs");
+TAG_FLAG(compression_adaptive_max_cpu_utilization, experimental);
+TAG_FLAG(compression_adaptive_max_cpu_utilization, runtime);
+
+DEFINE_bool(
+    compression_adaptive_skip_local_peers,
+    true,
+    "Payloads are not compressed when --compression_adaptive is set and every "
+    "peer is in the leader's region");
+TAG_FLAG(compression_adaptive_skip_local_peers, experimental);
+TAG_FLAG(compression_adaptive_skip_local_peers, runtime);
+
+DEFINE_int32(
+    compression_adaptive_probe_every_n,
+    32,
+    "When --compression_adaptive is set, one payload out of this many is "
+    "compressed regardless of the recent ratio and of CPU usage, to keep "
+    "those estimates current");
+TAG_FLAG(compression_adaptive_probe_every_n, experimental);
+TAG_FLAG(compression_adaptive_probe_every_n, runtime);
+
+namespace kudu::consensus {
+
+namespace {
+
+// Weight of the latest payload in the moving average of the ratio.
+const double kRatioSmoothing = 0.05;
+
+const MonoDelta kCpuSampleInterval = MonoDelta::FromSeconds(1);
+
+int64_t TimevalToMicros(const struct timeval& tv) {
+  return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+} // anonymous namespace
+
+CompressionPolicy::CompressionPolicy()
+    : has_remote_peers_(true),
+      ratio_codec_type_(NO_COMPRESSION),
+      ratio_(0),
+      last_cpu_micros_(0),
+      cpu_utilization_(0),
+      num_decisions_(0),
+      num_compressed_(0),
+      num_probes_(0),
+      num_skipped_too_small_(0),
+      num_skipped_local_peers_(0),
+      num_skipped_poor_ratio_(0),
+      num_skipped_cpu_bound_(0),
+      num_discarded_no_gain_(0) {}
+
+bool CompressionPolicy::ShouldCompress(
+    CompressionType codec_type,
+    size_t size) {
+  if (!FLAGS_compression_adaptive) {
+    return true;
+  }
+  const uint64_t decision =
+      num_decisions_.fetch_add(1, std::memory_order_relaxed);
+
+  if (size <
+      static_cast<size_t>(
+          std::max(FLAGS_compression_adaptive_min_payload_bytes, 0))) {
+    num_skipped_too_small_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (FLAGS_compression_adaptive_skip_local_peers &&
+      !has_remote_peers_.load(std::memory_order_relaxed)) {
+    num_skipped_local_peers_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  const int probe_every_n =
+      std::max(FLAGS_compression_adaptive_probe_every_n, 1);
+  if (decision % probe_every_n == 0) {
+    num_probes_.fetch_add(1, std::memory_order_relaxed);
+  } else if (
+      recent_ratio(codec_type) > FLAGS_compression_adaptive_max_ratio) {
+    num_skipped_poor_ratio_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  } else if (
+      CpuUtilization() > FLAGS_compression_adaptive_max_cpu_utilization) {
+    num_skipped_cpu_bound_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  num_compressed_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool CompressionPolicy::RecordCompression(
+    CompressionType codec_type,
+    size_t uncompressed_size,
+    size_t compressed_size) {
+  if (uncompressed_size > 0) {
+    const double ratio =
+        static_cast<double>(compressed_size) / uncompressed_size;
+    std::lock_guard<simple_spinlock> l(lock_);
+    if (codec_type != ratio_codec_type_) {
+      // The history of another codec says nothing about this one.
+      ratio_codec_type_ = codec_type;
+      ratio_ = ratio;
+    } else {
+      ratio_ += kRatioSmoothing * (ratio - ratio_);
+    }
+  }
+  if (FLAGS_compression_adaptive && compressed_size >= uncompressed_size) {
+    num_discarded_no_gain_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+void CompressionPolicy::SetHasRemotePeers(bool has_remote_peers) {
+  has_remote_peers_.store(has_remote_peers, std::memory_order_relaxed);
+}
+
+double CompressionPolicy::recent_ratio(CompressionType codec_type) const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  return codec_type == ratio_codec_type_ ? ratio_ : 0;
+}
+
+double CompressionPolicy::CpuUtilization() {
+  const MonoTime now = MonoTime::Now();
+  std::lock_guard<simple_spinlock> l(lock_);
+  if (last_cpu_sample_time_.Initialized() &&
+      now - last_cpu_sample_time_ < kCpuSampleInterval) {
+    return cpu_utilization_;
+  }
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return cpu_utilization_;
+  }
+  const int64_t cpu_micros =
+      TimevalToMicros(usage.ru_utime) + TimevalToMicros(usage.ru_stime);
+  if (last_cpu_sample_time_.Initialized()) {
+    const int64_t wall_micros =
+        (now - last_cpu_sample_time_).ToMicroseconds();
+    cpu_utilization_ = static_cast<double>(cpu_micros - last_cpu_micros_) /
+        (wall_micros * std::max(base::NumCPUs(), 1));
+  }
+  last_cpu_sample_time_ = now;
+  last_cpu_micros_ = cpu_micros;
+  return cpu_utilization_;
+}
+
+void CompressionPolicy::AppendStats(JsonWriter* jw) const {
+  jw->String("adaptive_policy");
+  jw->StartObject();
+  jw->String("enabled");
+  jw->Bool(FLAGS_compression_adaptive);
+  jw->String("decisions");
+  jw->Uint64(num_decisions_);
+  jw->String("compressed");
+  jw->Uint64(num_compressed_);
+  jw->String("probes");
+  jw->Uint64(num_probes_);
+  jw->String("skipped_too_small");
+  jw->Uint64(num_skipped_too_small_);
+  jw->String("skipped_local_peers");
+  jw->Uint64(num_skipped_local_peers_);
+  jw->String("skipped_poor_ratio");
+  jw->Uint64(num_skipped_poor_ratio_);
+  jw->String("skipped_cpu_bound");
+  jw->Uint64(num_skipped_cpu_bound_);
+  jw->String("discarded_no_gain");
+  jw->Uint64(num_discarded_no_gain_);
+  {
+    std::lock_guard<simple_spinlock> l(lock_);
+    jw->String("recent_ratio");
+    jw->Double(ratio_);
+    jw->String("cpu_utilization");
+    jw->Double(cpu_utilization_);
+  }
+  jw->String("has_remote_peers");
+  jw->Bool(has_remote_peers_);
+  jw->EndObject();
+}
+
+} // namespace kudu::consensus
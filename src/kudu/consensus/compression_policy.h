@@ -0,0 +1,107 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "kudu/gutil/macros.h"
+#include "kudu/util/compression/compression.pb.h"
+#include "kudu/util/locks.h"
+#include "kudu/util/monotime.h"
+
+namespace kudu {
+
+class JsonWriter;
+
+namespace consensus {
+
+// Decides, payload by payload, whether the leader should compress what it's
+// about to replicate. Compression costs leader CPU plus follower CPU and
+// only pays off if it saves bandwidth that is actually scarce, so with
+// --compression_adaptive set, a payload is left uncompressed if:
+//
+//  - it's too small to shrink meaningfully,
+//  - every peer is in the leader's region, so no cross-region bandwidth is
+//    at stake,
+//  - recent payloads compressed poorly, or
+//  - the leader is short on CPU.
+//
+// The last two are estimates, so one payload out of
+// --compression_adaptive_probe_every_n is compressed regardless, to keep
+// them fresh. Payloads whose compressed form is no smaller are sent
+// uncompressed.
+//
+// This class is thread-safe.
+class CompressionPolicy {
+ public:
+  CompressionPolicy();
+
+  // Returns true if a payload of 'size' bytes should be compressed with a
+  // codec of type 'codec_type'.
+  bool ShouldCompress(CompressionType codec_type, size_t size);
+
+  // Records that compressing a payload with a codec of type 'codec_type'
+  // turned 'uncompressed_size' bytes into 'compressed_size' bytes. Returns
+  // false if the compressed payload should be discarded because it isn't
+  // any smaller.
+  bool RecordCompression(
+      CompressionType codec_type,
+      size_t uncompressed_size,
+      size_t compressed_size);
+
+  // Sets whether some peer is outside of the leader's region.
+  void SetHasRemotePeers(bool has_remote_peers);
+
+  // Writes the policy's decisions and estimates as a JSON object field.
+  void AppendStats(JsonWriter* jw) const;
+
+  // Returns the moving average of the compression ratio (compressed size
+  // over uncompressed size) of recent payloads, or 0 if there is none yet.
+  double recent_ratio(CompressionType codec_type) const;
+
+ private:
+  // Returns the fraction of the machine's CPUs used by this process,
+  // resampled at most once per second.
+  double CpuUtilization();
+
+  std::atomic<bool> has_remote_peers_;
+
+  mutable simple_spinlock lock_;
+  CompressionType ratio_codec_type_;
+  double ratio_;
+  MonoTime last_cpu_sample_time_;
+  // CPU time used by the process as of 'last_cpu_sample_time_'.
+  int64_t last_cpu_micros_;
+  double cpu_utilization_;
+
+  // Decisions made so far.
+  std::atomic<uint64_t> num_decisions_;
+  std::atomic<uint64_t> num_compressed_;
+  std::atomic<uint64_t> num_probes_;
+  std::atomic<uint64_t> num_skipped_too_small_;
+  std::atomic<uint64_t> num_skipped_local_peers_;
+  std::atomic<uint64_t> num_skipped_poor_ratio_;
+  std::atomic<uint64_t> num_skipped_cpu_bound_;
+  std::atomic<uint64_t> num_discarded_no_gain_;
+
+  DISALLOW_COPY_AND_ASSIGN(CompressionPolicy);
+};
+
+} // namespace consensus
+} // namespace kudu
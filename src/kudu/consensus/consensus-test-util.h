@@ -337,7 +337,7 @@ class DelayablePeerProxy : public TestPeerProxy {
 class MockedPeerProxy : public TestPeerProxy {
  public:
   explicit MockedPeerProxy(ThreadPool* pool)
-      : TestPeerProxy(pool), update_count_(0) {}
+      : TestPeerProxy(pool), update_count_(0), heartbeat_count_(0) {}
 
   virtual void set_update_response(const ConsensusResponsePB& update_response) {
     CHECK(update_response.IsInitialized())
@@ -368,6 +368,19 @@ class MockedPeerProxy : public TestPeerProxy {
     return RegisterCallbackAndRespond(kUpdate, callback);
   }
 
+  void HeartbeatAsync(
+      const ConsensusRequestPB* request,
+      ConsensusResponsePB* response,
+      rpc::RpcController* controller,
+      StdStatusCallback callback) override {
+    {
+      std::lock_guard<simple_spinlock> l(lock_);
+      heartbeat_count_++;
+    }
+    PeerProxy::HeartbeatAsync(
+        request, response, controller, std::move(callback));
+  }
+
   virtual void RequestConsensusVoteAsync(
       const VoteRequestPB* request,
       VoteResponsePB* response,
@@ -390,8 +403,15 @@ class MockedPeerProxy : public TestPeerProxy {
     return update_count_;
   }
 
+  // Return the number of times that HeartbeatAsync() has been called.
+  int heartbeat_count() const {
+    std::lock_guard<simple_spinlock> l(lock_);
+    return heartbeat_count_;
+  }
+
  protected:
   int update_count_;
+  int heartbeat_count_;
 
   ConsensusResponsePB update_response_;
   VoteResponsePB vote_response_;
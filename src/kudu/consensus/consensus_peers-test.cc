@@ -27,6 +27,7 @@
 #include <type_traits>
 #include <utility>
 
+#include <gflags/gflags_declare.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
@@ -45,6 +46,7 @@
 #include "kudu/consensus/metadata.pb.h"
 #include "kudu/consensus/opid.pb.h"
 #include "kudu/consensus/opid_util.h"
+#include "kudu/consensus/peer_manager.h"
 #include "kudu/consensus/routing.h"
 #include "kudu/consensus/time_manager.h"
 #include "kudu/fs/fs_manager.h"
@@ -60,6 +62,11 @@
 #include "kudu/util/test_util.h"
 #include "kudu/util/threadpool.h"
 
+DECLARE_bool(raft_fan_out_requests_in_one_task);
+DECLARE_int32(raft_heartbeat_interval_ms);
+DECLARE_int32(raft_quiescence_idle_ms);
+DECLARE_int32(raft_quiescent_heartbeat_interval_ms);
+
 METRIC_DECLARE_entity(tablet);
 
 namespace kudu {
@@ -290,6 +297,108 @@ TEST_F(ConsensusPeersTest, TestRemotePeers) {
   WaitForCommitIndex(2);
 }
 
+// Tests that requests fanned out to all peers from a single task reach all
+// of them.
+TEST_F(ConsensusPeersTest, TestFanOutRequestsInOneTask) {
+  FLAGS_raft_fan_out_requests_in_one_task = true;
+  RaftConfigPB raft_config = BuildRaftConfigPBForTests(3);
+  ASSERT_OK(routing_table_->UpdateRaftConfig(raft_config));
+  message_queue_->SetLeaderMode(
+      kMinimumOpIdIndex, kMinimumTerm, raft_config);
+
+  NoOpTestPeerProxyFactory proxy_factory;
+  PeerManager peer_manager(
+      kTabletId,
+      kLeaderUuid,
+      &proxy_factory,
+      message_queue_.get(),
+      raft_pool_token_.get());
+  ASSERT_OK(peer_manager.UpdateRaftConfig(raft_config));
+
+  for (int i = 1; i <= 3; i++) {
+    AppendReplicateMessagesToQueue(message_queue_.get(), clock_, i, 1);
+    peer_manager.SignalRequest();
+    ASSERT_EVENTUALLY([&]() {
+      // The first requests only negotiate the peers' positions, so keep
+      // signaling until the op reaches both of them.
+      peer_manager.SignalRequest();
+      ASSERT_EQ(i, message_queue_->GetAllReplicatedIndex());
+    });
+  }
+  peer_manager.Close();
+}
+
+// Hands out the same proxy for every peer.
+class MockedPeerProxyFactory : public PeerProxyFactory {
+ public:
+  MockedPeerProxyFactory(
+      shared_ptr<PeerProxy> proxy,
+      shared_ptr<rpc::Messenger> messenger)
+      : proxy_(std::move(proxy)), messenger_(std::move(messenger)) {}
+
+  Status NewProxy(const RaftPeerPB& /*peer_pb*/, shared_ptr<PeerProxy>* proxy)
+      override {
+    *proxy = proxy_;
+    return Status::OK();
+  }
+
+  const shared_ptr<rpc::Messenger>& messenger() const override {
+    return messenger_;
+  }
+
+ private:
+  const shared_ptr<PeerProxy> proxy_;
+  const shared_ptr<rpc::Messenger> messenger_;
+};
+
+// Requests fanned out from a single task still bring a quiescent peer back to
+// regular heartbeats.
+TEST_F(ConsensusPeersTest, TestQuiescenceWithFanOut) {
+  FLAGS_raft_fan_out_requests_in_one_task = true;
+  FLAGS_raft_heartbeat_interval_ms = 10;
+  FLAGS_raft_quiescence_idle_ms = 50;
+  FLAGS_raft_quiescent_heartbeat_interval_ms = 60000;
+  RaftConfigPB raft_config = BuildRaftConfigPBForTests(2);
+  ASSERT_OK(routing_table_->UpdateRaftConfig(raft_config));
+  message_queue_->SetLeaderMode(
+      kMinimumOpIdIndex, kMinimumTerm, raft_config);
+
+  auto mock_proxy = make_shared<MockedPeerProxy>(raft_pool_.get());
+  ConsensusResponsePB resp;
+  resp.set_responder_uuid(kFollowerUuid);
+  resp.set_responder_term(0);
+  resp.mutable_status()->mutable_last_received()->CopyFrom(MakeOpId(1, 1));
+  resp.mutable_status()->mutable_last_received_current_leader()->CopyFrom(
+      MakeOpId(1, 1));
+  resp.mutable_status()->set_last_committed_idx(1);
+  mock_proxy->set_update_response(resp);
+
+  MockedPeerProxyFactory proxy_factory(mock_proxy, messenger_);
+  PeerManager peer_manager(
+      kTabletId,
+      kLeaderUuid,
+      &proxy_factory,
+      message_queue_.get(),
+      raft_pool_token_.get());
+  ASSERT_OK(peer_manager.UpdateRaftConfig(raft_config));
+  AppendReplicateMessagesToQueue(message_queue_.get(), clock_, 1, 1);
+  peer_manager.SignalRequest(true);
+  WaitForCommitIndex(1);
+
+  ASSERT_EVENTUALLY([&]() {
+    int updates = mock_proxy->update_count();
+    SleepFor(MonoDelta::FromMilliseconds(200));
+    ASSERT_EQ(updates, mock_proxy->update_count());
+  });
+
+  int updates = mock_proxy->update_count();
+  AppendReplicateMessagesToQueue(message_queue_.get(), clock_, 2, 1);
+  peer_manager.SignalRequest(false);
+  ASSERT_EVENTUALLY(
+      [&]() { ASSERT_GE(mock_proxy->update_count(), updates + 5); });
+  peer_manager.Close();
+}
+
 // Regression test for KUDU-699: even if a peer isn't making progress,
 // and thus always has data pending, we should be able to close the peer.
 TEST_F(ConsensusPeersTest, TestCloseWhenRemotePeerDoesntMakeProgress) {
@@ -394,5 +503,98 @@ TEST_F(ConsensusPeersTest, TestDontSendOneRpcPerWriteWhenPeerIsDown) {
   ASSERT_LT(mock_proxy->update_count(), 5);
 }
 
+// Heartbeats, and only heartbeats, go through PeerProxy::HeartbeatAsync(),
+// which may coalesce them with those of other groups.
+TEST_F(ConsensusPeersTest, TestHeartbeatsGoThroughHeartbeatAsync) {
+  FLAGS_raft_heartbeat_interval_ms = 10;
+  message_queue_->SetLeaderMode(
+      kMinimumOpIdIndex, kMinimumTerm, BuildRaftConfigPBForTests(3));
+
+  auto mock_proxy = make_shared<MockedPeerProxy>(raft_pool_.get());
+  peer_proxy_pool_.Put(kFollowerUuid, mock_proxy);
+  ConsensusResponsePB resp;
+  resp.set_responder_uuid(kFollowerUuid);
+  resp.set_responder_term(0);
+  resp.mutable_status()->mutable_last_received()->CopyFrom(MakeOpId(1, 1));
+  resp.mutable_status()->mutable_last_received_current_leader()->CopyFrom(
+      MakeOpId(1, 1));
+  resp.mutable_status()->set_last_committed_idx(1);
+  mock_proxy->set_update_response(resp);
+
+  shared_ptr<Peer> peer;
+  ASSERT_OK(Peer::NewRemotePeer(
+      FakeRaftPeerPB(kFollowerUuid),
+      kTabletId,
+      kLeaderUuid,
+      message_queue_.get(),
+      &peer_proxy_pool_,
+      raft_pool_token_.get(),
+      mock_proxy,
+      messenger_,
+      &peer));
+  AppendReplicateMessagesToQueue(message_queue_.get(), clock_, 1, 1);
+  peer->SignalRequest(true);
+  WaitForCommitIndex(1);
+
+  ASSERT_EVENTUALLY([&]() { ASSERT_GE(mock_proxy->heartbeat_count(), 3); });
+  // HeartbeatAsync() also counts as an update, so the difference is the
+  // request that carried the op.
+  int heartbeats = mock_proxy->heartbeat_count();
+  ASSERT_GT(mock_proxy->update_count(), heartbeats);
+  peer->Close();
+}
+
+// Heartbeats to a caught-up peer of an idle group slow down, and speed up
+// again as soon as there are ops to send.
+TEST_F(ConsensusPeersTest, TestQuiescence) {
+  FLAGS_raft_heartbeat_interval_ms = 10;
+  FLAGS_raft_quiescence_idle_ms = 50;
+  FLAGS_raft_quiescent_heartbeat_interval_ms = 60000;
+  message_queue_->SetLeaderMode(
+      kMinimumOpIdIndex, kMinimumTerm, BuildRaftConfigPBForTests(3));
+
+  auto mock_proxy = make_shared<MockedPeerProxy>(raft_pool_.get());
+  peer_proxy_pool_.Put(kFollowerUuid, mock_proxy);
+  ConsensusResponsePB resp;
+  resp.set_responder_uuid(kFollowerUuid);
+  resp.set_responder_term(0);
+  resp.mutable_status()->mutable_last_received()->CopyFrom(MakeOpId(1, 1));
+  resp.mutable_status()->mutable_last_received_current_leader()->CopyFrom(
+      MakeOpId(1, 1));
+  resp.mutable_status()->set_last_committed_idx(1);
+  mock_proxy->set_update_response(resp);
+
+  shared_ptr<Peer> peer;
+  ASSERT_OK(Peer::NewRemotePeer(
+      FakeRaftPeerPB(kFollowerUuid),
+      kTabletId,
+      kLeaderUuid,
+      message_queue_.get(),
+      &peer_proxy_pool_,
+      raft_pool_token_.get(),
+      mock_proxy,
+      messenger_,
+      &peer));
+  AppendReplicateMessagesToQueue(message_queue_.get(), clock_, 1, 1);
+  peer->SignalRequest(true);
+  WaitForCommitIndex(1);
+
+  // Once quiescent, the peer stops getting heartbeats.
+  ASSERT_EVENTUALLY([&]() {
+    int updates = mock_proxy->update_count();
+    SleepFor(MonoDelta::FromMilliseconds(200));
+    ASSERT_EQ(updates, mock_proxy->update_count());
+  });
+
+  // The next op is sent right away, and the peer, which doesn't get it, keeps
+  // hearing from the leader at the regular pace.
+  int updates = mock_proxy->update_count();
+  AppendReplicateMessagesToQueue(message_queue_.get(), clock_, 2, 1);
+  ASSERT_OK(peer->SignalRequest(false));
+  ASSERT_EVENTUALLY(
+      [&]() { ASSERT_GE(mock_proxy->update_count(), updates + 5); });
+  peer->Close();
+}
+
 } // namespace consensus
 } // namespace kudu
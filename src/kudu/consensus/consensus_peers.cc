@@ -45,13 +45,17 @@
 #include "kudu/consensus/metadata.pb.h"
 #include "kudu/consensus/opid_util.h"
 #include "kudu/consensus/routing.h"
+#include "kudu/consensus/serialized_ops_cache.h"
 #include "kudu/gutil/macros.h"
 #include "kudu/gutil/map-util.h"
 #include "kudu/gutil/port.h"
 #include "kudu/gutil/strings/substitute.h"
+#include "kudu/rpc/messenger.h"
 #include "kudu/rpc/periodic.h"
 #include "kudu/rpc/response_callback.h"
 #include "kudu/rpc/rpc_controller.h"
+#include "kudu/rpc/rpc_header.pb.h"
+#include "kudu/util/compression/compression_codec.h"
 #include "kudu/util/fault_injection.h"
 #include "kudu/util/flag_tags.h"
 #include "kudu/util/logging.h"
@@ -110,6 +114,84 @@ DEFINE_bool(
     "Should enforce that requests and reponses to this instance must "
     "have a matching token as what we have stored.");
 
+DEFINE_bool(
+    consensus_serialize_ops_once,
+    false,
+    "Whether the leader serializes each run of ops it sends to its peers "
+    "once, and splices the encoding into the requests to every peer, instead "
+    "of serializing the ops again for each peer.");
+TAG_FLAG(consensus_serialize_ops_once, experimental);
+
+DEFINE_bool(
+    consensus_compress_ops_batch,
+    false,
+    "Whether the leader compresses the ops it sends to a peer as a whole, "
+    "with the current compression codec, instead of sending them as they "
+    "are. Many small ops compress much better together than one by one. "
+    "Requires --consensus_serialize_ops_once, and every replica to be able to "
+    "uncompress such requests.");
+TAG_FLAG(consensus_compress_ops_batch, experimental);
+TAG_FLAG(consensus_compress_ops_batch, runtime);
+
+DEFINE_int32(
+    consensus_num_connections_per_peer,
+    1,
+    "Number of connections over which the requests to each peer are spread. "
+    "More than one keeps a large request from holding up the requests to the "
+    "same server for other tablets, and spreads the traffic over several TCP "
+    "flows.");
+TAG_FLAG(consensus_num_connections_per_peer, experimental);
+
+DEFINE_bool(
+    consensus_use_control_connection,
+    false,
+    "Whether heartbeats and vote requests go through a connection of their "
+    "own to each peer, so that they don't queue behind requests that carry "
+    "ops.");
+TAG_FLAG(consensus_use_control_connection, experimental);
+TAG_FLAG(consensus_use_control_connection, runtime);
+
+DEFINE_int32(
+    raft_adaptive_batching_max_delay_us,
+    0,
+    "Upper bound of the time the leader holds back a request to a peer with "
+    "no request in flight, so that ops appended in the meantime are sent "
+    "along. The delay is derived from the rate at which ops were recently "
+    "appended and from the peer's round-trip time, and is zero when ops "
+    "arrive too rarely for waiting to pay off. 0 disables the delay.");
+TAG_FLAG(raft_adaptive_batching_max_delay_us, experimental);
+TAG_FLAG(raft_adaptive_batching_max_delay_us, runtime);
+
+DEFINE_int32(
+    raft_heartbeat_coalesce_window_ms,
+    0,
+    "If positive, heartbeats sent by the raft groups hosted by a server to "
+    "the same remote server within this many milliseconds of each other go "
+    "out as a single RPC. Heartbeats are delayed by up to this much. 0 sends "
+    "each heartbeat on its own.");
+TAG_FLAG(raft_heartbeat_coalesce_window_ms, experimental);
+
+DEFINE_int32(
+    raft_quiescence_idle_ms,
+    0,
+    "Once the leader has sent no ops nor commit index to a caught-up peer "
+    "for this many milliseconds, it heartbeats the peer only every "
+    "--raft_quiescent_heartbeat_interval_ms, until it has ops to send again. "
+    "Meanwhile the peer waits as many of those periods before suspecting "
+    "the leader, so failing over an idle group takes longer. Ignored with "
+    "leader leases or a bounded data loss window, which rely on regular "
+    "heartbeats. Requires every replica to understand quiescent heartbeats. "
+    "0 disables quiescence.");
+TAG_FLAG(raft_quiescence_idle_ms, experimental);
+TAG_FLAG(raft_quiescence_idle_ms, runtime);
+
+DEFINE_int32(
+    raft_quiescent_heartbeat_interval_ms,
+    5000,
+    "The heartbeat interval of quiescent groups. See "
+    "--raft_quiescence_idle_ms.");
+TAG_FLAG(raft_quiescent_heartbeat_interval_ms, experimental);
+
 METRIC_DEFINE_counter(
     server,
     raft_rpc_token_num_response_mismatches,
@@ -130,6 +212,23 @@ using std::vector;
 using std::weak_ptr;
 using strings::Substitute;
 
+namespace {
+
+// Weight of the latest sample in the moving averages used to batch requests.
+constexpr double kBatchingEwmaWeight = 0.2;
+
+// A request is only held back if at least this many more ops are expected
+// in the meantime, and never for longer than it takes this many to arrive.
+constexpr double kBatchingMinOps = 2;
+constexpr double kBatchingMaxOps = 16;
+
+double UpdateEwma(double average, double sample) {
+  return average < 0 ? sample
+                     : average + kBatchingEwmaWeight * (sample - average);
+}
+
+} // anonymous namespace
+
 namespace kudu::consensus {
 
 Status Peer::NewRemotePeer(
@@ -173,6 +272,7 @@ Peer::Peer(
       peer_proxy_pool_(peer_proxy_pool),
       failed_attempts_(0),
       last_request_time_(MonoTime::Now()),
+      last_ops_request_time_(last_request_time_),
       messenger_(std::move(messenger)),
       raft_pool_token_(raft_pool_token),
       rpc_start_(MonoTime::Min()) {
@@ -205,8 +305,73 @@ Status Peer::SignalRequest(
     bool from_heartbeater,
     bool is_leader_lease_revoke,
     ReplicateRefPtr latest_appended_replicate) {
-  // Only allow one request at a time. No sense waking up the
-  // raft thread pool if the task will just abort anyway.
+  bool send_now;
+  RETURN_NOT_OK(PrepareRequest(
+      even_if_queue_empty,
+      from_heartbeater,
+      is_leader_lease_revoke,
+      latest_appended_replicate,
+      &send_now));
+  if (!send_now) {
+    return Status::OK();
+  }
+
+  // Capture a weak_ptr reference into the submitted functor so that we can
+  // safely handle the functor outliving its peer.
+  weak_ptr<Peer> w_this = shared_from_this();
+  RETURN_NOT_OK(raft_pool_token_->SubmitFunc(
+      [even_if_queue_empty,
+       from_heartbeater,
+       is_leader_lease_revoke,
+       latest_rep = std::move(latest_appended_replicate),
+       w_this]() mutable {
+        if (auto p = w_this.lock()) {
+          p->SendNextRequest(
+              even_if_queue_empty,
+              from_heartbeater,
+              is_leader_lease_revoke,
+              std::move(latest_rep));
+        }
+      }));
+  return Status::OK();
+}
+
+Status Peer::PrepareRequest(
+    bool even_if_queue_empty,
+    bool from_heartbeater,
+    bool is_leader_lease_revoke,
+    const ReplicateRefPtr& latest_appended_replicate,
+    bool* send_now) {
+  *send_now = false;
+  MonoDelta batching_delay;
+  if (!from_heartbeater && !even_if_queue_empty) {
+    batching_delay = RecordAppendSignal(MonoTime::Now());
+  }
+  if (!from_heartbeater && quiescent_.exchange(false)) {
+    // Back to regular heartbeats as soon as there's something to send.
+    heartbeater_->Snooze();
+  }
+
+  // No sense waking up the raft thread pool if the task will just abort
+  // anyway.
+  bool needed;
+  RETURN_NOT_OK(CheckRequestNeeded(from_heartbeater, &needed));
+  if (!needed) {
+    return Status::OK();
+  }
+
+  if (batching_delay.Initialized()) {
+    ScheduleBatchedRequest(
+        batching_delay, is_leader_lease_revoke, latest_appended_replicate);
+    return Status::OK();
+  }
+  *send_now = true;
+  return Status::OK();
+}
+
+Status Peer::CheckRequestNeeded(bool from_heartbeater, bool* needed) {
+  *needed = false;
+  // Only allow one request at a time.
   //
   // "request_pending_" is an atomic, hence no need to take peer_lock_ here.
   // This allows to return early without blocking on "peer_lock_". Note that
@@ -224,28 +389,93 @@ Status Peer::SignalRequest(
 
   // For proxied peers we only send requests every FLAGS_proxy_batch_duration_ms
   // milliseconds
-  if (!from_heartbeater && !ProxyBatchDurationHasPassed()) {
-    return Status::OK();
+  *needed = from_heartbeater || ProxyBatchDurationHasPassed();
+  return Status::OK();
+}
+
+MonoDelta Peer::RecordAppendSignal(MonoTime now) {
+  std::lock_guard<simple_spinlock> l(batching_lock_);
+  if (last_append_signal_time_.Initialized()) {
+    append_signal_interval_us_ = UpdateEwma(
+        append_signal_interval_us_,
+        (now - last_append_signal_time_).ToMicroseconds());
   }
+  last_append_signal_time_ = now;
 
-  // Capture a weak_ptr reference into the submitted functor so that we can
-  // safely handle the functor outliving its peer.
+  const int32_t max_delay_us = FLAGS_raft_adaptive_batching_max_delay_us;
+  if (max_delay_us <= 0 || append_signal_interval_us_ < 0 ||
+      round_trip_us_ < 0) {
+    return MonoDelta();
+  }
+  // Holding a request back for longer than half a round trip delays its ops
+  // by more than sending them in the next request would.
+  const double window_us =
+      std::min<double>(max_delay_us, round_trip_us_ / 2);
+  if (window_us < kBatchingMinOps * append_signal_interval_us_) {
+    // Light load: ops wouldn't arrive fast enough to be worth waiting for.
+    return MonoDelta();
+  }
+  return MonoDelta::FromMicroseconds(static_cast<int64_t>(
+      std::min(window_us, kBatchingMaxOps * append_signal_interval_us_)));
+}
+
+void Peer::ScheduleBatchedRequest(
+    MonoDelta delay,
+    bool is_leader_lease_revoke,
+    ReplicateRefPtr latest_appended_replicate) {
+  {
+    std::lock_guard<simple_spinlock> l(batching_lock_);
+    if (batched_request_scheduled_) {
+      // The ops will be picked up by the scheduled request.
+      return;
+    }
+    batched_request_scheduled_ = true;
+    batched_request_start_ = MonoTime::Now();
+  }
   weak_ptr<Peer> w_this = shared_from_this();
-  RETURN_NOT_OK(raft_pool_token_->SubmitFunc(
-      [even_if_queue_empty,
-       from_heartbeater,
-       is_leader_lease_revoke,
+  messenger_->ScheduleOnReactor(
+      [w_this, is_leader_lease_revoke, latest_appended_replicate](
+          const Status& s) {
+        if (auto p = w_this.lock()) {
+          p->SendBatchedRequest(
+              s, is_leader_lease_revoke, latest_appended_replicate);
+        }
+      },
+      delay);
+}
+
+void Peer::SendBatchedRequest(
+    const Status& status,
+    bool is_leader_lease_revoke,
+    ReplicateRefPtr latest_appended_replicate) {
+  {
+    std::lock_guard<simple_spinlock> l(batching_lock_);
+    DCHECK(batched_request_scheduled_);
+    batched_request_scheduled_ = false;
+    queue_->metrics().peer_request_batching_delay->Increment(
+        (MonoTime::Now() - batched_request_start_).ToMicroseconds());
+  }
+  if (PREDICT_FALSE(!status.ok())) {
+    // The messenger is shutting down.
+    return;
+  }
+  weak_ptr<Peer> w_this = shared_from_this();
+  Status s = raft_pool_token_->SubmitFunc(
+      [is_leader_lease_revoke,
        latest_rep = std::move(latest_appended_replicate),
        w_this]() mutable {
         if (auto p = w_this.lock()) {
           p->SendNextRequest(
-              even_if_queue_empty,
-              from_heartbeater,
+              /*even_if_queue_empty=*/false,
+              /*from_heartbeater=*/false,
               is_leader_lease_revoke,
               std::move(latest_rep));
         }
-      }));
-  return Status::OK();
+      });
+  if (PREDICT_FALSE(!s.ok())) {
+    VLOG_WITH_PREFIX_UNLOCKED(1)
+        << "Unable to send batched request: " << s.ToString();
+  }
 }
 
 bool Peer::ProxyBatchDurationHasPassed() {
@@ -390,6 +620,23 @@ void Peer::SendNextRequest(
   if (req_has_ops) {
     // If we're actually sending ops there's no need to heartbeat for a while.
     heartbeater_->Snooze();
+    last_ops_request_time_ = last_request_time_;
+  }
+  const bool quiescent = from_heartbeater && !req_has_ops &&
+      next_hop_uuid == peer_pb_.permanent_uuid() && CanQuiesceUnlocked();
+  if (quiescent != quiescent_.exchange(quiescent)) {
+    VLOG_WITH_PREFIX_UNLOCKED(1)
+        << (quiescent ? "Quiescing" : "Leaving quiescence");
+  }
+  if (quiescent) {
+    request_.set_quiescent(true);
+    heartbeater_->Snooze(MonoDelta::FromMilliseconds(
+        FLAGS_raft_quiescent_heartbeat_interval_ms));
+  } else {
+    request_.clear_quiescent();
+  }
+  if (request_.ops_size() > 0) {
+    queue_->metrics().ops_per_peer_request->Increment(request_.ops_size());
   }
 
   MAYBE_FAULT(FLAGS_fault_crash_on_leader_request_fraction);
@@ -418,11 +665,40 @@ void Peer::SendNextRequest(
                                     << " not found in peer proxy pool";
   }
 
+  if (FLAGS_consensus_use_control_connection && request_.ops_size() == 0) {
+    controller_.set_connection_class(rpc::ConnectionClass::CONTROL);
+  }
+
+  if (FLAGS_consensus_serialize_ops_once && request_.ops_size() > 0 &&
+      next_hop_uuid == peer_pb().permanent_uuid() &&
+      next_hop_proxy->SupportsSerializedRequestFields()) {
+    // Send the ops through the encoding shared by all peers. They are owned by
+    // 'replicate_msg_refs_', and aren't needed in 'request_' once it's sent.
+    shared_ptr<CompressionCodec> codec;
+    if (FLAGS_consensus_compress_ops_batch) {
+      codec = CompressionCodecManager::GetCurrentCodec();
+    }
+    controller_.SetSerializedRequestFields(
+        codec ? queue_->serialized_ops_cache()->GetCompressed(
+                    replicate_msg_refs_, codec.get())
+              : queue_->serialized_ops_cache()->Get(replicate_msg_refs_));
+    request_.mutable_ops()->UnsafeArenaExtractSubrange(
+        0, request_.ops_size(), nullptr);
+  }
+
   if (FLAGS_enable_raft_leader_lease || FLAGS_enable_bounded_dataloss_window) {
     s_this->SetUpdateConsensusRpcStart(MonoTime::Now());
   }
+  if (from_heartbeater && !req_has_ops &&
+      next_hop_uuid == peer_pb().permanent_uuid()) {
+    next_hop_proxy->HeartbeatAsync(
+        &request_, &response_, &controller_, [s_this](const Status& s) {
+          s_this->ProcessResponse(s);
+        });
+    return;
+  }
   next_hop_proxy->UpdateAsync(&request_, &response_, &controller_, [s_this]() {
-    s_this->ProcessResponse();
+    s_this->ProcessResponse(s_this->controller_.status());
   });
 }
 
@@ -440,7 +716,7 @@ Status Peer::StartElection(
   return Status::OK();
 }
 
-void Peer::ProcessResponse() {
+void Peer::ProcessResponse(const Status& rpc_status) {
   // Note: This method runs on the reactor thread.
   std::unique_lock<simple_spinlock> lock(peer_lock_);
   if (closed_) {
@@ -450,13 +726,19 @@ void Peer::ProcessResponse() {
 
   MAYBE_FAULT(FLAGS_fault_crash_after_leader_request_fraction);
 
-  // Process RpcController errors.
-  const auto controller_status = controller_.status();
-  if (!controller_status.ok()) {
-    auto ps = controller_status.IsRemoteError() ? PeerStatus::REMOTE_ERROR
-                                                : PeerStatus::RPC_LAYER_ERROR;
-    queue_->UpdatePeerStatus(peer_pb_.permanent_uuid(), ps, controller_status);
-    ProcessResponseError(controller_status);
+  if (rpc_status.ok()) {
+    std::lock_guard<simple_spinlock> l(batching_lock_);
+    round_trip_us_ = UpdateEwma(
+        round_trip_us_,
+        (MonoTime::Now() - last_request_time_).ToMicroseconds());
+  }
+
+  // Process RPC errors.
+  if (!rpc_status.ok()) {
+    auto ps = rpc_status.IsRemoteError() ? PeerStatus::REMOTE_ERROR
+                                         : PeerStatus::RPC_LAYER_ERROR;
+    queue_->UpdatePeerStatus(peer_pb_.permanent_uuid(), ps, rpc_status);
+    ProcessResponseError(rpc_status);
     return;
   }
 
@@ -554,6 +836,10 @@ void Peer::ProcessResponseError(const Status& status) {
   // Increment failed attempts only when this is not an expected rejection by a
   // peer due to file rotation
   failed_attempts_++;
+  if (quiescent_.exchange(false)) {
+    // Find out soon whether the peer is back.
+    heartbeater_->Snooze();
+  }
   KLOG_EVERY_N_SECS(WARNING, 300)
       << LogPrefixUnlocked() << "Couldn't send request to peer "
       << peer_pb_.permanent_uuid() << " for tablet " << tablet_id_ << "."
@@ -562,6 +848,27 @@ void Peer::ProcessResponseError(const Status& status) {
       << failed_attempts_ << " times.";
 }
 
+bool Peer::CanQuiesceUnlocked() const {
+  DCHECK(peer_lock_.is_locked());
+  if (FLAGS_raft_quiescence_idle_ms <= 0 || FLAGS_enable_raft_leader_lease ||
+      FLAGS_enable_bounded_dataloss_window) {
+    return false;
+  }
+  if (failed_attempts_ > 0 || !response_.has_status() ||
+      response_.has_error()) {
+    return false;
+  }
+  // The peer must have every op, and know up to where they're committed, so
+  // that it has nothing to learn from regular heartbeats.
+  const ConsensusStatusPB& status = response_.status();
+  if (status.last_received().index() != request_.preceding_id().index() ||
+      status.last_committed_idx() < request_.committed_index()) {
+    return false;
+  }
+  return MonoTime::Now() - last_ops_request_time_ >=
+      MonoDelta::FromMilliseconds(FLAGS_raft_quiescence_idle_ms);
+}
+
 string Peer::LogPrefixUnlocked() const {
   return Substitute(
       "T $0 P $1 -> Peer $2 ($3:$4): ",
@@ -657,19 +964,11 @@ void CheckAndEnforceResponseToken(
   error->set_code(ServerErrorPB::RING_TOKEN_MISMATCH);
 }
 
-RpcPeerProxy::RpcPeerProxy(
-    unique_ptr<HostPort> hostport,
-    shared_ptr<ConsensusServiceProxy> consensus_proxy,
-    scoped_refptr<Counter> num_rpc_token_mismatches)
-    : hostport_(std::move(hostport)),
-      consensus_proxy_(std::move(consensus_proxy)),
-      num_rpc_token_mismatches_(std::move(num_rpc_token_mismatches)) {
-  DCHECK(hostport_ != nullptr);
-  DCHECK(consensus_proxy_ != nullptr);
-  DCHECK(num_rpc_token_mismatches_ != nullptr);
-}
+namespace {
 
-void RpcPeerProxy::UpdateAsync(
+void SendUpdateAsync(
+    ConsensusServiceProxy* consensus_proxy,
+    const scoped_refptr<Counter>& num_rpc_token_mismatches,
     const ConsensusRequestPB* request,
     ConsensusResponsePB* response,
     rpc::RpcController* controller,
@@ -680,7 +979,7 @@ void RpcPeerProxy::UpdateAsync(
   std::optional<std::string> rpc_token = request->has_raft_rpc_token()
       ? request->raft_rpc_token()
       : std::optional<std::string>();
-  consensus_proxy_->UpdateConsensusAsync(
+  consensus_proxy->UpdateConsensusAsync(
       *request,
       response,
       controller,
@@ -688,7 +987,7 @@ void RpcPeerProxy::UpdateAsync(
        response,
        controller,
        request_token = std::move(rpc_token),
-       mismatch_counter = num_rpc_token_mismatches_]() {
+       mismatch_counter = num_rpc_token_mismatches]() {
         // Should not need to lock here since only one request can happen at any
         // time
         if (controller->status().ok()) {
@@ -699,6 +998,170 @@ void RpcPeerProxy::UpdateAsync(
       });
 }
 
+// The state of a MultiUpdateConsensus RPC, which must outlive the call.
+struct MultiUpdateCall {
+  MultiConsensusRequestPB request;
+  MultiConsensusResponsePB response;
+  RpcController controller;
+};
+
+} // anonymous namespace
+
+HeartbeatCoalescer::HeartbeatCoalescer(
+    shared_ptr<Messenger> messenger,
+    MonoDelta window)
+    : messenger_(std::move(messenger)), window_(window) {}
+
+void HeartbeatCoalescer::Add(
+    const string& remote,
+    shared_ptr<ConsensusServiceProxy> proxy,
+    const ConsensusRequestPB* request,
+    ConsensusResponsePB* response,
+    StdStatusCallback callback) {
+  {
+    std::lock_guard<simple_spinlock> l(lock_);
+    Batch& batch = batches_[remote];
+    batch.entries.push_back({request, response, std::move(callback)});
+    if (batch.entries.size() > 1) {
+      // The first request of the batch already scheduled the flush.
+      return;
+    }
+    batch.proxy = std::move(proxy);
+  }
+  weak_ptr<HeartbeatCoalescer> w = shared_from_this();
+  messenger_->ScheduleOnReactor(
+      [w, remote](const Status& /* s */) {
+        // Flush even if the messenger is shutting down, so that every
+        // callback runs.
+        if (auto c = w.lock()) {
+          c->Flush(remote);
+        }
+      },
+      window_);
+}
+
+void HeartbeatCoalescer::Flush(const string& remote) {
+  Batch batch;
+  {
+    std::lock_guard<simple_spinlock> l(lock_);
+    auto it = batches_.find(remote);
+    if (it == batches_.end()) {
+      return;
+    }
+    batch = std::move(it->second);
+    batches_.erase(it);
+  }
+
+  auto call = std::make_shared<MultiUpdateCall>();
+  for (const Entry& entry : batch.entries) {
+    call->request.add_requests()->CopyFrom(*entry.request);
+  }
+  call->controller.set_timeout(
+      MonoDelta::FromMilliseconds(FLAGS_consensus_rpc_timeout_ms));
+  if (FLAGS_consensus_use_control_connection) {
+    call->controller.set_connection_class(rpc::ConnectionClass::CONTROL);
+  }
+  batch.proxy->MultiUpdateConsensusAsync(
+      call->request,
+      &call->response,
+      &call->controller,
+      [call, entries = std::move(batch.entries)]() {
+        Status s = call->controller.status();
+        const rpc::ErrorStatusPB* err = call->controller.error_response();
+        if (err && err->code() == rpc::ErrorStatusPB::ERROR_NO_SUCH_METHOD) {
+          s = Status::NotSupported(
+              "server doesn't implement MultiUpdateConsensus", s.ToString());
+        } else if (
+            s.ok() &&
+            call->response.responses_size() !=
+                static_cast<int>(entries.size())) {
+          s = Status::RemoteError(Substitute(
+              "MultiUpdateConsensus returned $0 responses for $1 requests",
+              call->response.responses_size(),
+              entries.size()));
+        }
+        for (int i = 0; i < static_cast<int>(entries.size()); i++) {
+          if (s.ok()) {
+            entries[i].response->Swap(call->response.mutable_responses(i));
+          }
+          entries[i].callback(s);
+        }
+      });
+}
+
+RpcPeerProxy::RpcPeerProxy(
+    unique_ptr<HostPort> hostport,
+    shared_ptr<ConsensusServiceProxy> consensus_proxy,
+    scoped_refptr<Counter> num_rpc_token_mismatches,
+    shared_ptr<HeartbeatCoalescer> coalescer)
+    : hostport_(std::move(hostport)),
+      consensus_proxy_(std::move(consensus_proxy)),
+      num_rpc_token_mismatches_(std::move(num_rpc_token_mismatches)),
+      coalescer_(std::move(coalescer)) {
+  DCHECK(hostport_ != nullptr);
+  DCHECK(consensus_proxy_ != nullptr);
+  DCHECK(num_rpc_token_mismatches_ != nullptr);
+}
+
+void RpcPeerProxy::UpdateAsync(
+    const ConsensusRequestPB* request,
+    ConsensusResponsePB* response,
+    rpc::RpcController* controller,
+    const rpc::ResponseCallback& callback) {
+  SendUpdateAsync(
+      consensus_proxy_.get(),
+      num_rpc_token_mismatches_,
+      request,
+      response,
+      controller,
+      callback);
+}
+
+void RpcPeerProxy::HeartbeatAsync(
+    const ConsensusRequestPB* request,
+    ConsensusResponsePB* response,
+    rpc::RpcController* controller,
+    StdStatusCallback callback) {
+  if (!coalescer_) {
+    PeerProxy::HeartbeatAsync(
+        request, response, controller, std::move(callback));
+    return;
+  }
+  coalescer_->Add(
+      hostport_->ToString(),
+      consensus_proxy_,
+      request,
+      response,
+      [request,
+       response,
+       controller,
+       callback = std::move(callback),
+       consensus_proxy = consensus_proxy_,
+       mismatch_counter = num_rpc_token_mismatches_](const Status& s) {
+        if (PREDICT_FALSE(s.IsNotSupported())) {
+          // Keep heartbeats flowing to servers that don't implement
+          // MultiUpdateConsensus by sending the request on its own.
+          SendUpdateAsync(
+              consensus_proxy.get(),
+              mismatch_counter,
+              request,
+              response,
+              controller,
+              [controller, callback]() { callback(controller->status()); });
+          return;
+        }
+        if (s.ok()) {
+          CheckAndEnforceResponseToken(
+              "HeartbeatAsync",
+              response,
+              request->has_raft_rpc_token() ? request->raft_rpc_token()
+                                            : std::optional<std::string>(),
+              mismatch_counter);
+        }
+        callback(s);
+      });
+}
+
 Status RpcPeerProxy::StartElection(
     const RunLeaderElectionRequestPB* request,
     RunLeaderElectionResponsePB* response,
@@ -716,6 +1179,9 @@ void RpcPeerProxy::RequestConsensusVoteAsync(
   std::optional<std::string> rpc_token = request->has_raft_rpc_token()
       ? request->raft_rpc_token()
       : std::optional<std::string>();
+  if (FLAGS_consensus_use_control_connection) {
+    controller->set_connection_class(rpc::ConnectionClass::CONTROL);
+  }
   consensus_proxy_->RequestConsensusVoteAsync(
       *request,
       response,
@@ -755,6 +1221,8 @@ Status CreateConsensusServiceProxyForHost(
   }
   new_proxy->reset(
       new ConsensusServiceProxy(messenger, addrs[0], hostport.host()));
+  (*new_proxy)->set_num_connections(
+      std::max(FLAGS_consensus_num_connections_per_peer, 1));
   return Status::OK();
 }
 
@@ -762,10 +1230,12 @@ Status CreateConsensusServiceProxyForHost(
 
 RpcPeerProxyFactory::RpcPeerProxyFactory(
     shared_ptr<Messenger> messenger,
-    const scoped_refptr<MetricEntity>& metric_entity)
+    const scoped_refptr<MetricEntity>& metric_entity,
+    shared_ptr<HeartbeatCoalescer> coalescer)
     : messenger_(std::move(messenger)),
       num_rpc_token_mismatches_(metric_entity->FindOrCreateCounter(
-          &METRIC_raft_rpc_token_num_response_mismatches)) {}
+          &METRIC_raft_rpc_token_num_response_mismatches)),
+      coalescer_(std::move(coalescer)) {}
 
 Status RpcPeerProxyFactory::NewProxy(
     const RaftPeerPB& peer_pb,
@@ -776,7 +1246,10 @@ Status RpcPeerProxyFactory::NewProxy(
   RETURN_NOT_OK(
       CreateConsensusServiceProxyForHost(messenger_, *hostport, &new_proxy));
   proxy->reset(new RpcPeerProxy(
-      std::move(hostport), std::move(new_proxy), num_rpc_token_mismatches_));
+      std::move(hostport),
+      std::move(new_proxy),
+      num_rpc_token_mismatches_,
+      coalescer_));
   return Status::OK();
 }
 
@@ -28,6 +28,7 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <glog/logging.h>
@@ -40,8 +41,10 @@
 #include "kudu/rpc/rpc_controller.h"
 #include "kudu/util/locks.h"
 #include "kudu/util/metrics.h"
+#include "kudu/util/monotime.h"
 #include "kudu/util/net/net_util.h"
 #include "kudu/util/status.h"
+#include "kudu/util/status_callback.h"
 
 DECLARE_bool(raft_enforce_rpc_token);
 
@@ -91,6 +94,26 @@ class Peer : public std::enable_shared_from_this<Peer> {
       bool is_leader_lease_revoke = false,
       ReplicateRefPtr latest_appended_replicate = nullptr);
 
+  // Does everything SignalRequest() does short of sending the request: feeds
+  // adaptive batching, leaves quiescence and, if the request is to be batched,
+  // schedules it. Sets 'send_now' to whether the caller should go on to call
+  // SendNextRequest(). Returns IllegalState if the peer was closed.
+  Status PrepareRequest(
+      bool even_if_queue_empty,
+      bool from_heartbeater,
+      bool is_leader_lease_revoke,
+      const ReplicateRefPtr& latest_appended_replicate,
+      bool* send_now);
+
+  // Builds and sends the next request to this peer on the calling thread.
+  // SignalRequest() does this on 'raft_pool_token', while PeerManager may
+  // call it for several peers from a single task on that token.
+  void SendNextRequest(
+      bool even_if_queue_empty,
+      bool from_heartbeater = false,
+      bool is_leader_lease_revoke = false,
+      ReplicateRefPtr latest_appended_replicate = nullptr);
+
   // Synchronously starts a leader election on this peer.
   // This method is ad hoc, using this instance's PeerProxy to send the
   // StartElection request.
@@ -149,18 +172,13 @@ class Peer : public std::enable_shared_from_this<Peer> {
       std::shared_ptr<PeerProxy> proxy,
       std::shared_ptr<rpc::Messenger> messenger);
 
-  void SendNextRequest(
-      bool even_if_queue_empty,
-      bool from_heartbeater = false,
-      bool is_leader_lease_revoke = false,
-      ReplicateRefPtr latest_appended_replicate = nullptr);
-
-  // Signals that a response was received from the peer.
+  // Signals that a response was received from the peer. 'rpc_status' is the
+  // status of the RPC that carried the request.
   //
   // This method is called from the reactor thread and calls
   // DoProcessResponse() on raft_pool_token_ to do any work that requires IO or
   // lock-taking.
-  void ProcessResponse();
+  void ProcessResponse(const Status& rpc_status);
 
   // Run on 'raft_pool_token'. Does response handling that requires IO or may
   // block.
@@ -169,6 +187,32 @@ class Peer : public std::enable_shared_from_this<Peer> {
   // Signals there was an error sending the request to the peer.
   void ProcessResponseError(const Status& status);
 
+  // Sets 'needed' to whether a request should be sent to this peer at all.
+  // Returns IllegalState if the peer was closed.
+  Status CheckRequestNeeded(bool from_heartbeater, bool* needed);
+
+  // Records that ops were appended at 'now' and returns how long to hold the
+  // request back to batch more ops into it, if at all. See
+  // --raft_adaptive_batching_max_delay_us.
+  MonoDelta RecordAppendSignal(MonoTime now);
+
+  // Sends the next request after 'delay', unless a delayed request is already
+  // scheduled.
+  void ScheduleBatchedRequest(
+      MonoDelta delay,
+      bool is_leader_lease_revoke,
+      ReplicateRefPtr latest_appended_replicate);
+
+  // Run on the reactor once the delay of a batched request has elapsed.
+  void SendBatchedRequest(
+      const Status& status,
+      bool is_leader_lease_revoke,
+      ReplicateRefPtr latest_appended_replicate);
+
+  // Returns true if the group is idle and the peer caught up, so that
+  // heartbeats to it may slow down. See --raft_quiescence_idle_ms.
+  bool CanQuiesceUnlocked() const;
+
   // Has FLAGS_proxy_batch_duration_ms passed since the last request was sent?
   // Only relavant for proxied peers
   // We don't send requests to proxied peers until the batch duration has passed
@@ -194,6 +238,9 @@ class Peer : public std::enable_shared_from_this<Peer> {
   // Time when the last request was sent
   MonoTime last_request_time_;
 
+  // Time when the last request carrying ops or a commit index was sent.
+  MonoTime last_ops_request_time_;
+
   // The latest consensus update request and response.
   ConsensusRequestPB request_;
   ConsensusResponsePB response_;
@@ -227,6 +274,20 @@ class Peer : public std::enable_shared_from_this<Peer> {
   std::atomic<int> cached_is_peer_proxied_{-1};
   // Leader Leases: captures UpdateConsensus rpc start time for each peer
   MonoTime rpc_start_;
+  // Whether heartbeats to the peer are slowed down because the group is
+  // quiescent.
+  std::atomic<bool> quiescent_{false};
+
+  // State of the adaptive batching of requests, protected by 'batching_lock_'.
+  // The moving averages are in microseconds, and negative until the first
+  // sample.
+  simple_spinlock batching_lock_;
+  MonoTime last_append_signal_time_;
+  double append_signal_interval_us_ = -1;
+  double round_trip_us_ = -1;
+  // Whether a batched request is scheduled, and since when.
+  bool batched_request_scheduled_ = false;
+  MonoTime batched_request_start_;
 };
 
 // A proxy to another peer. Usually a thin wrapper around an rpc proxy but can
@@ -242,6 +303,21 @@ class PeerProxy {
       rpc::RpcController* controller,
       const rpc::ResponseCallback& callback) = 0;
 
+  // Sends a status-only request, asynchronously, to a remote peer. Unlike
+  // UpdateAsync(), the request may be held back briefly, to be sent along with
+  // those of other groups for the same server, in which case 'controller'
+  // isn't used: 'callback' gets the status of the RPC that carried it.
+  virtual void HeartbeatAsync(
+      const ConsensusRequestPB* request,
+      ConsensusResponsePB* response,
+      rpc::RpcController* controller,
+      StdStatusCallback callback) {
+    UpdateAsync(
+        request, response, controller, [controller, callback]() {
+          callback(controller->status());
+        });
+  }
+
   // Sends a RequestConsensusVote to a remote peer.
   virtual void RequestConsensusVoteAsync(
       const VoteRequestPB* request,
@@ -256,6 +332,14 @@ class PeerProxy {
 
   // Remote endpoint or description of the peer.
   virtual std::string PeerName() const = 0;
+
+  // Whether UpdateAsync() sends the fields set with
+  // rpc::RpcController::SetSerializedRequestFields() along with the request.
+  // If so, callers may leave ops out of the request and set their encoding on
+  // the controller instead.
+  virtual bool SupportsSerializedRequestFields() const {
+    return false;
+  }
 };
 
 // A peer proxy factory. Usually just obtains peers through the rpc
@@ -291,13 +375,64 @@ class PeerProxyPool {
   std::unordered_map<std::string, std::shared_ptr<PeerProxy>> peer_proxy_map_;
 };
 
+// Gathers the status-only requests sent to the same server by the groups
+// hosted here within a short window, and sends them as one
+// MultiUpdateConsensus RPC. Once many groups share a server, idle heartbeats
+// would otherwise make up most of the RPCs between servers.
+//
+// This class is thread-safe.
+class HeartbeatCoalescer
+    : public std::enable_shared_from_this<HeartbeatCoalescer> {
+ public:
+  HeartbeatCoalescer(
+      std::shared_ptr<rpc::Messenger> messenger,
+      MonoDelta window);
+
+  // Queues 'request' for the server at 'remote', to be sent through 'proxy'
+  // along with the other requests queued for it within the window. 'callback'
+  // runs on a reactor thread with the status of the coalesced RPC, once
+  // 'response' is filled in if it's OK. The status is NotSupported if the
+  // server doesn't implement MultiUpdateConsensus. 'request' and 'response'
+  // must stay valid until then.
+  void Add(
+      const std::string& remote,
+      std::shared_ptr<ConsensusServiceProxy> proxy,
+      const ConsensusRequestPB* request,
+      ConsensusResponsePB* response,
+      StdStatusCallback callback);
+
+ private:
+  struct Entry {
+    const ConsensusRequestPB* request;
+    ConsensusResponsePB* response;
+    StdStatusCallback callback;
+  };
+
+  struct Batch {
+    std::shared_ptr<ConsensusServiceProxy> proxy;
+    std::vector<Entry> entries;
+  };
+
+  // Sends the requests queued for 'remote'.
+  void Flush(const std::string& remote);
+
+  const std::shared_ptr<rpc::Messenger> messenger_;
+  const MonoDelta window_;
+
+  simple_spinlock lock_;
+  // Requests queued for each remote server, keyed by its address.
+  std::unordered_map<std::string, Batch> batches_;
+};
+
 // PeerProxy implementation that does RPC calls
 class RpcPeerProxy : public PeerProxy {
  public:
+  // If 'coalescer' is set, heartbeats go through it.
   RpcPeerProxy(
       std::unique_ptr<HostPort> hostport,
       std::shared_ptr<ConsensusServiceProxy> consensus_proxy,
-      scoped_refptr<Counter> num_rpc_token_mismatches);
+      scoped_refptr<Counter> num_rpc_token_mismatches,
+      std::shared_ptr<HeartbeatCoalescer> coalescer = nullptr);
 
   void UpdateAsync(
       const ConsensusRequestPB* request,
@@ -305,6 +440,12 @@ class RpcPeerProxy : public PeerProxy {
       rpc::RpcController* controller,
       const rpc::ResponseCallback& callback) override;
 
+  void HeartbeatAsync(
+      const ConsensusRequestPB* request,
+      ConsensusResponsePB* response,
+      rpc::RpcController* controller,
+      StdStatusCallback callback) override;
+
   void RequestConsensusVoteAsync(
       const VoteRequestPB* request,
       VoteResponsePB* response,
@@ -318,19 +459,28 @@ class RpcPeerProxy : public PeerProxy {
 
   std::string PeerName() const override;
 
+  bool SupportsSerializedRequestFields() const override {
+    return true;
+  }
+
  private:
   std::unique_ptr<HostPort> hostport_;
   std::shared_ptr<ConsensusServiceProxy> consensus_proxy_;
 
   scoped_refptr<Counter> num_rpc_token_mismatches_;
+
+  const std::shared_ptr<HeartbeatCoalescer> coalescer_;
 };
 
 // PeerProxyFactory implementation that generates RPCPeerProxies
 class RpcPeerProxyFactory : public PeerProxyFactory {
  public:
+  // If 'coalescer' is set, the proxies send heartbeats through it. Factories
+  // of the groups hosted by a server share it.
   explicit RpcPeerProxyFactory(
       std::shared_ptr<rpc::Messenger> messenger,
-      const scoped_refptr<MetricEntity>& metric_entity);
+      const scoped_refptr<MetricEntity>& metric_entity,
+      std::shared_ptr<HeartbeatCoalescer> coalescer = nullptr);
 
   Status NewProxy(const RaftPeerPB& peer_pb, std::shared_ptr<PeerProxy>* proxy)
       override;
@@ -345,6 +495,8 @@ class RpcPeerProxyFactory : public PeerProxyFactory {
   std::shared_ptr<rpc::Messenger> messenger_;
 
   scoped_refptr<Counter> num_rpc_token_mismatches_;
+
+  std::shared_ptr<HeartbeatCoalescer> coalescer_;
 };
 
 // Query the consensus service at last known host/port that is
@@ -52,6 +52,7 @@
 #include "kudu/gutil/dynamic_annotations.h"
 #include "kudu/gutil/macros.h"
 #include "kudu/gutil/map-util.h"
+#include "kudu/gutil/mathlimits.h"
 #include "kudu/gutil/port.h"
 #include "kudu/gutil/stl_util.h"
 #include "kudu/gutil/strings/join.h"
@@ -99,7 +100,16 @@ DEFINE_int32(
     "Timeout used for all consensus internal RPC communications.");
 TAG_FLAG(consensus_rpc_timeout_ms, advanced);
 
+DEFINE_int32(
+    consensus_serialized_ops_cache_size,
+    8,
+    "Number of runs of ops whose wire encoding the leader keeps, so that a "
+    "run sent to several peers is serialized only once. See "
+    "--consensus_serialize_ops_once.");
+TAG_FLAG(consensus_serialized_ops_cache_size, advanced);
+
 DECLARE_bool(safe_time_advancement_without_writes);
+DECLARE_bool(log_cache_peer_aware_eviction);
 
 // Enable improved re-replication (KUDU-1097).
 DEFINE_bool(
@@ -226,6 +236,7 @@ using std::unique_ptr;
 using std::unordered_map;
 using std::vector;
 using strings::Substitute;
+using strings::SubstituteAndAppend;
 
 namespace kudu::consensus {
 
@@ -274,6 +285,25 @@ METRIC_DEFINE_counter(
     MetricUnit::kOperations,
     "Number of times we determined corruption from repeated append failures of "
     "a single peer.");
+METRIC_DEFINE_histogram(
+    server,
+    ops_per_peer_request,
+    "Ops per Peer Request",
+    MetricUnit::kOperations,
+    "Number of ops in each request sent by the leader to a peer, for the "
+    "requests that have ops.",
+    100000,
+    2);
+METRIC_DEFINE_histogram(
+    server,
+    peer_request_batching_delay,
+    "Peer Request Batching Delay",
+    MetricUnit::kMicroseconds,
+    "Time the leader held back requests to peers to batch more ops into them, "
+    "for the requests that were held back. See "
+    "--raft_adaptive_batching_max_delay_us.",
+    10000000,
+    2);
 METRIC_DEFINE_gauge_int64(
     server,
     available_commit_peers,
@@ -335,6 +365,7 @@ PeerMessageQueue::TrackedPeer::TrackedPeer(
       last_overall_health_status(HealthReportPB::UNKNOWN),
       status_log_throttler(std::make_shared<logging::LogThrottler>()),
       peer_msg_buffer(std::make_shared<PeerMessageBuffer>()),
+      read_stats(std::make_shared<PeerReadStats>()),
       last_seen_term_(0),
       // We initialize to max to ensure that a peer, that was never
       // successfully contacted, is considered unhealthy.
@@ -424,7 +455,7 @@ void PeerMessageQueue::TrackedPeer::SnoozeProxying(MonoDelta delta) {
 }
 
 std::string PeerMessageQueue::TrackedPeer::ToString() const {
-  return Substitute(
+  std::string str = Substitute(
       "Peer: $0, Status: $1, Last received: $2, Next index: $3, "
       "Last known committed idx: $4, Time since last communication: $5",
       SecureShortDebugString(peer_pb),
@@ -433,6 +464,18 @@ std::string PeerMessageQueue::TrackedPeer::ToString() const {
       next_index,
       last_known_committed_index,
       (MonoTime::Now() - last_communication_time).ToString());
+  if (read_stats) {
+    const int64_t from_cache = read_stats->ops_from_cache;
+    const int64_t from_disk = read_stats->ops_from_disk;
+    const int64_t total = from_cache + from_disk;
+    SubstituteAndAppend(
+        &str,
+        ", Ops read from cache/disk: $0/$1 ($2% from cache)",
+        from_cache,
+        from_disk,
+        total == 0 ? 100 : from_cache * 100 / total);
+  }
+  return str;
 }
 
 #define INSTANTIATE_METRIC(x) x.Instantiate(metric_entity, 0)
@@ -455,6 +498,10 @@ PeerMessageQueue::Metrics::Metrics(
       metric_entity->FindOrCreateCounter(&METRIC_corruption_cache_drops);
   single_corruption_cache_drops =
       metric_entity->FindOrCreateCounter(&METRIC_single_corruption_cache_drops);
+  ops_per_peer_request =
+      metric_entity->FindOrCreateHistogram(&METRIC_ops_per_peer_request);
+  peer_request_batching_delay =
+      metric_entity->FindOrCreateHistogram(&METRIC_peer_request_batching_delay);
 }
 #undef INSTANTIATE_METRIC
 
@@ -482,6 +529,7 @@ PeerMessageQueue::PeerMessageQueue(
           std::move(log),
           local_peer_pb_.permanent_uuid(),
           tablet_id_),
+      serialized_ops_cache_(FLAGS_consensus_serialized_ops_cache_size),
       metrics_(metric_entity),
       time_manager_(std::move(time_manager)),
       leader_lease_until_(MonoTime::Min()),
@@ -607,6 +655,8 @@ void PeerMessageQueue::SetNonLeaderMode(const RaftConfigPB& active_config) {
       << "Queue going to NON_LEADER mode. State: " << queue_state_.ToString();
 
   time_manager_->SetNonLeaderMode();
+  serialized_ops_cache_.Clear();
+  UpdateLogCacheRetentionUnlocked();
 }
 
 void PeerMessageQueue::TrackPeer(const RaftPeerPB& peer_pb) {
@@ -1146,6 +1196,12 @@ Status PeerMessageQueue::FindPeer(const std::string& uuid, TrackedPeer* peer) {
   return Status::OK();
 }
 
+bool PeerMessageQueue::PeerNeedsLogRead(const string& uuid) const {
+  std::lock_guard<simple_mutexlock> lock(queue_lock_);
+  const TrackedPeer* peer = FindPtrOrNull(peers_map_, uuid);
+  return peer != nullptr && log_cache_.NeedsLogReadForOp(peer->next_index);
+}
+
 Status PeerMessageQueue::RequestForPeer(
     const string& uuid,
     bool read_ops,
@@ -1331,13 +1387,15 @@ Status PeerMessageQueue::RequestForPeer(
     // catchup is possible.
     wal_catchup_progress = true;
 
-    // We use AddAllocated rather than copy, because we pin the log cache at the
-    // "all replicated" point. At some point we may want to allow partially
-    // loading (and not pinning) earlier messages. At that point we'll need to
-    // do something smarter here, like copy or ref-count.
+    // We use UnsafeArenaAddAllocated rather than copy, because we pin the log
+    // cache at the "all replicated" point. At some point we may want to allow
+    // partially loading (and not pinning) earlier messages. At that point
+    // we'll need to do something smarter here, like copy or ref-count. The
+    // messages may live on the arena of the request that delivered them to
+    // this replica, so plain AddAllocated() would copy them.
     if (!route_via_proxy) {
       for (const ReplicateRefPtr& msg : messages) {
-        request->mutable_ops()->AddAllocated(msg->get());
+        request->mutable_ops()->UnsafeArenaAddAllocated(msg->get());
       }
       msg_refs->swap(messages);
     } else {
@@ -1348,7 +1406,7 @@ Status PeerMessageQueue::RequestForPeer(
         *proxy_op->get()->mutable_id() = msg->get()->id();
         proxy_op->get()->set_timestamp(msg->get()->timestamp());
         proxy_op->get()->set_op_type(PROXY_OP);
-        request->mutable_ops()->AddAllocated(proxy_op->get());
+        request->mutable_ops()->UnsafeArenaAddAllocated(proxy_op->get());
         proxy_ops.emplace_back(std::move(proxy_op));
       }
       msg_refs->swap(proxy_ops);
@@ -1414,6 +1472,9 @@ Status PeerMessageQueue::ReadMessagesForRequest(
   read_context.for_peer_host = &peer_copy.peer_pb.last_known_addr().host();
   read_context.for_peer_port = peer_copy.peer_pb.last_known_addr().port();
   read_context.route_via_proxy = route_via_proxy;
+  read_context.read_ahead =
+      FLAGS_log_cache_peer_aware_eviction && !peer_copy.is_healthy();
+  read_context.read_stats = peer_copy.read_stats.get();
 
   // We try to get the follower's next_index from our log.
   LogCache::ReadOpsStatus s = log_cache_.ReadOps(
@@ -1456,6 +1517,9 @@ Status PeerMessageQueue::ExtractBuffer(
       read_context.for_peer_host = &peer_copy.peer_pb.last_known_addr().host();
       read_context.for_peer_port = peer_copy.peer_pb.last_known_addr().port();
       read_context.route_via_proxy = route_via_proxy;
+      read_context.read_ahead =
+          FLAGS_log_cache_peer_aware_eviction && !peer_copy.is_healthy();
+      read_context.read_stats = peer_copy.read_stats.get();
       auto peer_msg_buffer_ptr = peer_copy.peer_msg_buffer;
       FillBuffer(read_context, std::move(handle));
     }
@@ -1507,6 +1571,7 @@ void PeerMessageQueue::FillBufferForPeer(
   read_context.for_peer_host = &peer_copy.peer_pb.last_known_addr().host();
   read_context.for_peer_port = peer_copy.peer_pb.last_known_addr().port();
   read_context.route_via_proxy = route_via_proxy;
+  read_context.read_stats = peer_copy.read_stats.get();
   FillBuffer(
       read_context,
       peer_copy.peer_msg_buffer,
@@ -2320,6 +2385,7 @@ void PeerMessageQueue::UpdatePeerStatus(
       DCHECK(status.ok());
       break;
   }
+  UpdateLogCacheRetentionUnlocked();
 }
 
 void PeerMessageQueue::UpdateExchangeStatus(
@@ -2405,6 +2471,24 @@ void PeerMessageQueue::UpdatePeerAppendFailure(
   }
 }
 
+void PeerMessageQueue::UpdateLogCacheRetentionUnlocked() {
+  DCHECK(queue_lock_.is_locked());
+  if (!FLAGS_log_cache_peer_aware_eviction) {
+    return;
+  }
+  int64_t retention_index = MathLimits<int64_t>::kMax;
+  if (queue_state_.mode == LEADER) {
+    for (const auto& entry : peers_map_) {
+      const TrackedPeer* peer = entry.second;
+      if (peer->uuid() != local_peer_pb_.permanent_uuid() &&
+          peer->is_healthy()) {
+        retention_index = std::min(retention_index, peer->next_index);
+      }
+    }
+  }
+  log_cache_.SetPeerRetentionIndex(retention_index);
+}
+
 bool PeerMessageQueue::CorruptionLikely(TrackedPeer* peer) const {
   DCHECK(queue_lock_.is_locked());
 
@@ -2900,6 +2984,8 @@ bool PeerMessageQueue::DoResponseFromPeer(
         peer->last_known_committed_index < queue_state_.committed_index ||
         log_cache_.HasOpBeenWritten(peer->next_index);
 
+    UpdateLogCacheRetentionUnlocked();
+
     // Evict ops from log_cache only if:
     // 1. This is not a leader node OR
     // 2. 'all_replicated_index' has changed after processing this response
@@ -3171,17 +3257,37 @@ void PeerMessageQueue::NotifyObserversOfCommitIndexChange(
     });
     return;
   }
+  // Coalesce with the notification that is already scheduled, if any: the
+  // observers only need to hear about the highest commit index.
+  int64_t pending = pending_commit_index_.load();
+  while (pending < new_commit_index &&
+         !pending_commit_index_.compare_exchange_weak(
+             pending, new_commit_index)) {
+  }
+  if (commit_index_notification_scheduled_.exchange(true)) {
+    return;
+  }
   // NOTE: if we're scheduling this to run async we always need to lock, so we
   // ignore the needs_lock param
-  WARN_NOT_OK(
-      raft_pool_observers_token_->SubmitClosure(Bind(
-          &PeerMessageQueue::NotifyObserversTask,
-          Unretained(this),
-          [=](PeerMessageQueueObserver* observer) {
-            observer->NotifyCommitIndex(new_commit_index, true);
-          })),
-      LogPrefixUnlocked() +
-          "Unable to notify RaftConsensus of commit index change.");
+  Status s = raft_pool_observers_token_->SubmitClosure(Bind(
+      &PeerMessageQueue::NotifyObserversOfPendingCommitIndex, Unretained(this)));
+  if (PREDICT_FALSE(!s.ok())) {
+    commit_index_notification_scheduled_.store(false);
+    WARN_NOT_OK(
+        s,
+        LogPrefixUnlocked() +
+            "Unable to notify RaftConsensus of commit index change.");
+  }
+}
+
+void PeerMessageQueue::NotifyObserversOfPendingCommitIndex() {
+  // Clear the flag before reading the index: an advance that lands after the
+  // read then schedules a notification of its own rather than being lost.
+  commit_index_notification_scheduled_.store(false);
+  int64_t commit_index = pending_commit_index_.load();
+  NotifyObserversTask([=](PeerMessageQueueObserver* observer) {
+    observer->NotifyCommitIndex(commit_index, true);
+  });
 }
 
 void PeerMessageQueue::NotifyObserversOfTermChange(int64_t term) {
@@ -23,6 +23,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <iosfwd>
@@ -44,6 +45,7 @@
 #include "kudu/consensus/persistent_vars.h"
 #include "kudu/consensus/persistent_vars_manager.h"
 #include "kudu/consensus/ref_counted_replicate.h"
+#include "kudu/consensus/serialized_ops_cache.h"
 #include "kudu/consensus/routing.h"
 #include "kudu/consensus/time_manager.h"
 #include "kudu/gutil/ref_counted.h"
@@ -83,6 +85,7 @@ class ConsensusResponsePB;
 class ConsensusStatusPB;
 class PeerMessageQueueObserver;
 class ReplicateMsgWrapper;
+struct PeerReadStats;
 
 // The id for the server-wide consensus queue MemTracker.
 extern const char kConsensusQueueParentTrackerId[];
@@ -227,6 +230,10 @@ class PeerMessageQueue {
 
     std::shared_ptr<PeerMessageBuffer> peer_msg_buffer;
 
+    // Where the ops sent to this peer were read from. Shared by the copies
+    // of the peer that ops are read for.
+    std::shared_ptr<PeerReadStats> read_stats;
+
     void PopulateIsPeerInLocalRegion();
     void PopulateIsPeerInLocalQuorum();
 
@@ -398,6 +405,10 @@ class PeerMessageQueue {
   // nullptr)
   Status FindPeer(const std::string& uuid, TrackedPeer* peer);
 
+  // Returns true if the next request to the peer with 'uuid' would read ops
+  // from the log on disk because they are no longer in the log cache.
+  bool PeerNeedsLogRead(const std::string& uuid) const;
+
   // Assembles a request for a peer, adding entries past 'op_id' up to
   // 'consensus_max_batch_size_bytes'.
   // Returns OK if the request was assembled, or Status::NotFound() if the
@@ -406,7 +417,8 @@ class PeerMessageQueue {
   // log that has not been written.
   //
   // WARNING: In order to avoid copying the same messages to every peer,
-  // entries are added to 'request' via AddAllocated() methods.
+  // entries are added to 'request' via UnsafeArenaAddAllocated(). The
+  // entries may live on the arena of the request they were received in.
   // The owner of 'request' is expected not to delete the request prior
   // to removing the entries through ExtractSubRange() or any other method
   // that does not delete the entries. The simplest way is to pass the same
@@ -564,12 +576,20 @@ class PeerMessageQueue {
     scoped_refptr<Counter> corruption_cache_drops;
     // Number of cache drops from errors of a single peer
     scoped_refptr<Counter> single_corruption_cache_drops;
+    // Number of ops in each request sent to a peer with ops.
+    scoped_refptr<Histogram> ops_per_peer_request;
+    // Time requests to peers were held back to batch more ops into them.
+    scoped_refptr<Histogram> peer_request_batching_delay;
 
     explicit Metrics(const scoped_refptr<MetricEntity>& metric_entity);
   };
 
   ~PeerMessageQueue();
 
+  const Metrics& metrics() const {
+    return metrics_;
+  }
+
   // Begin or end the watch for an eligible successor. If 'successor_uuid' is
   // not {}, the queue will notify its observers when 'successor_uuid'
   // is caught up to the leader. Otherwise, it will notify its observers with
@@ -601,6 +621,12 @@ class PeerMessageQueue {
     return &log_cache_;
   }
 
+  // Encodings of the runs of ops recently sent to peers, shared by all the
+  // peers of this queue.
+  SerializedOpsCache* serialized_ops_cache() {
+    return &serialized_ops_cache_;
+  }
+
   Status SetCompressionDictionary(const std::string& dict);
 
   // Set the threshold (in milliseconds) that is used to determine the health of
@@ -768,6 +794,10 @@ class PeerMessageQueue {
   // notifications.
   void UpdatePeerHealthUnlocked(TrackedPeer* peer);
 
+  // Tells the log cache which ops healthy peers still need, so that it can
+  // evict the others first under memory pressure.
+  void UpdateLogCacheRetentionUnlocked();
+
   // Update the peer's last exchange status, and other fields, based on the
   // response. Sets 'lmp_mismatch' to true if the given response indicates
   // there was a log-matching property mismatch on the remote, otherwise sets
@@ -853,6 +883,10 @@ class PeerMessageQueue {
   void NotifyObserversTask(
       const std::function<void(PeerMessageQueueObserver*)>& func);
 
+  // Notifies the observers of 'pending_commit_index_', the highest commit
+  // index reported since the last notification ran.
+  void NotifyObserversOfPendingCommitIndex();
+
   using PeersMap = std::unordered_map<std::string, TrackedPeer*>;
 
   std::string ToStringUnlocked() const;
@@ -1056,6 +1090,13 @@ class PeerMessageQueue {
   // The pool token which executes observer notifications.
   std::unique_ptr<ThreadPoolToken> raft_pool_observers_token_;
 
+  // Commit index advances that haven't been passed on to the observers yet.
+  // At most one notification is scheduled at a time, and it reports the
+  // highest index seen by the time it runs, so a burst of advances results
+  // in a single notification.
+  std::atomic<int64_t> pending_commit_index_{-1};
+  std::atomic<bool> commit_index_notification_scheduled_{false};
+
   // PB containing identifying information about the local peer.
   RaftPeerPB local_peer_pb_;
 
@@ -1086,6 +1127,8 @@ class PeerMessageQueue {
 
   LogCache log_cache_;
 
+  SerializedOpsCache serialized_ops_cache_;
+
   Metrics metrics_;
 
   scoped_refptr<ITimeManager> time_manager_;
@@ -30,6 +30,7 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -75,6 +76,18 @@ DECLARE_double(log_inject_io_error_on_preallocate_fraction);
 DECLARE_int64(fs_wal_dir_reserved_bytes);
 DECLARE_int64(disk_reserved_bytes_free_for_testing);
 DECLARE_string(log_compression_codec);
+DECLARE_bool(log_pipeline_sync);
+DECLARE_bool(log_use_direct_io);
+DECLARE_bool(log_async_segment_deletion);
+DECLARE_bool(log_drop_replicated_segments_from_cache);
+DECLARE_bool(log_prefetch_cold_segments);
+DECLARE_int32(log_segment_delete_truncate_step_mb);
+
+METRIC_DECLARE_counter(log_segments_deleted);
+METRIC_DECLARE_counter(log_segments_truncated);
+METRIC_DECLARE_counter(log_segment_bytes_deleted);
+METRIC_DECLARE_counter(log_segments_dropped_from_cache);
+METRIC_DECLARE_counter(log_reader_segments_prefetched);
 
 namespace kudu {
 namespace log {
@@ -87,6 +100,7 @@ using consensus::ReplicateMsg;
 using consensus::WRITE_OP;
 using std::shared_ptr;
 using std::string;
+using std::thread;
 using std::unique_ptr;
 using std::vector;
 using strings::Substitute;
@@ -449,6 +463,67 @@ TEST_P(LogTestOptionalCompression, TestSegmentRollover) {
   ASSERT_EQ(num_entries, entries_.size());
 }
 
+// Tests that with the sync pipelined behind the appends, every entry is
+// acknowledged and readable, including across segment rolls.
+TEST_P(LogTestOptionalCompression, TestPipelinedSync) {
+  FLAGS_log_pipeline_sync = true;
+  options_.force_fsync_all = true;
+  ASSERT_OK(BuildLog());
+  log_->SetMaxSegmentSizeForTests(4096);
+  const int kNumBatches = 500;
+
+  for (int i = 1; i <= kNumBatches; i++) {
+    ASSERT_OK(AppendReplicateBatch(MakeOpId(1, i), APPEND_ASYNC));
+  }
+  ASSERT_OK(log_->WaitUntilAllFlushed());
+  ASSERT_OK(log_->Close());
+
+  shared_ptr<LogReader> reader;
+  ASSERT_OK(LogReader::Open(
+      fs_manager_.get(), nullptr, kTestTablet, nullptr, &reader));
+  SegmentSequence segments;
+  ASSERT_OK(reader->GetSegmentsSnapshot(&segments));
+  ASSERT_GT(segments.size(), 1);
+  for (const scoped_refptr<ReadableLogSegment>& entry : segments) {
+    ASSERT_OK(entry->ReadEntries(&entries_));
+  }
+  ASSERT_EQ(kNumBatches, entries_.size());
+}
+
+// Tests that with direct I/O, every batch is padded to a block boundary, so
+// that appends never rewrite a block holding earlier entries, and that the
+// padding is skipped when reading. Where direct I/O isn't supported, this
+// exercises the regular path.
+TEST_P(LogTestOptionalCompression, TestDirectIOPadding) {
+  FLAGS_log_use_direct_io = true;
+  options_.force_fsync_all = true;
+  ASSERT_OK(BuildLog());
+  log_->SetMaxSegmentSizeForTests(64 * 1024);
+  const size_t alignment = log_->active_segment_->direct_io_alignment();
+  const int kNumBatches = 100;
+
+  for (int i = 1; i <= kNumBatches; i++) {
+    ASSERT_OK(AppendReplicateBatch(MakeOpId(1, i), APPEND_SYNC));
+    if (alignment > 0) {
+      ASSERT_EQ(0, log_->active_segment_->written_offset() % alignment);
+    }
+  }
+  ASSERT_OK(log_->Close());
+
+  shared_ptr<LogReader> reader;
+  ASSERT_OK(LogReader::Open(
+      fs_manager_.get(), nullptr, kTestTablet, nullptr, &reader));
+  SegmentSequence segments;
+  ASSERT_OK(reader->GetSegmentsSnapshot(&segments));
+  for (const scoped_refptr<ReadableLogSegment>& entry : segments) {
+    ASSERT_OK(entry->ReadEntries(&entries_));
+  }
+  ASSERT_EQ(kNumBatches, entries_.size());
+  for (int i = 0; i < kNumBatches; i++) {
+    ASSERT_EQ(i + 1, entries_[i]->replicate().id().index());
+  }
+}
+
 TEST_F(LogTest, TestWriteAndReadToAndFromInProgressSegment) {
   FLAGS_log_compression_codec = "none";
 
@@ -533,6 +608,113 @@ TEST_F(LogTest, TestWriteAndReadToAndFromInProgressSegment) {
   ASSERT_EQ(written_entries_size, log_->active_segment_->written_offset());
 }
 
+// Tests that GC'd segments can be deleted in the background.
+TEST_P(LogTestOptionalCompression, TestBackgroundSegmentDeletion) {
+  FLAGS_log_min_segments_to_retain = 1;
+  FLAGS_log_async_segment_deletion = true;
+  FLAGS_log_drop_replicated_segments_from_cache = true;
+  ASSERT_OK(BuildLog());
+
+  vector<LogAnchor*> anchors;
+  ElementDeleter deleter(&anchors);
+  OpId op_id = MakeOpId(1, 1);
+  ASSERT_OK(AppendMultiSegmentSequence(4, 5, &op_id, &anchors));
+
+  SegmentSequence segments;
+  ASSERT_OK(log_->reader()->GetSegmentsSnapshot(&segments));
+  vector<string> paths;
+  for (const auto& segment : segments) {
+    paths.push_back(segment->path());
+  }
+
+  // Nothing needs to be retained.
+  RetentionIndexes retention;
+  int num_gced_segments;
+  ASSERT_OK(log_->GC(retention, &num_gced_segments));
+  ASSERT_EQ(3, num_gced_segments);
+  ASSERT_OK(log_->reader()->GetSegmentsSnapshot(&segments));
+  ASSERT_EQ(1, segments.size()) << DumpSegmentsToString(segments);
+
+  // Closing the log waits for the deletions.
+  ASSERT_OK(log_->Close());
+  for (int i = 0; i < num_gced_segments; i++) {
+    ASSERT_FALSE(env_->FileExists(paths[i])) << paths[i];
+  }
+  ASSERT_TRUE(env_->FileExists(paths.back()));
+}
+
+// Tests the page cache advice about closed segments, and that GC'd segments
+// are only truncated before deletion once no reader holds them.
+TEST_P(LogTestOptionalCompression, TestSegmentHousekeepingMetrics) {
+  FLAGS_log_min_segments_to_retain = 1;
+  FLAGS_log_segment_delete_truncate_step_mb = 1;
+  FLAGS_log_prefetch_cold_segments = true;
+  ASSERT_OK(BuildLog());
+  scoped_refptr<Counter> deleted =
+      METRIC_log_segments_deleted.Instantiate(metric_entity_);
+  scoped_refptr<Counter> truncated =
+      METRIC_log_segments_truncated.Instantiate(metric_entity_);
+  scoped_refptr<Counter> bytes_deleted =
+      METRIC_log_segment_bytes_deleted.Instantiate(metric_entity_);
+  scoped_refptr<Counter> dropped =
+      METRIC_log_segments_dropped_from_cache.Instantiate(metric_entity_);
+  scoped_refptr<Counter> prefetched =
+      METRIC_log_reader_segments_prefetched.Instantiate(metric_entity_);
+  auto read_ops = [&](int64_t from, int64_t to) {
+    vector<ReplicateMsg*> repls;
+    ElementDeleter d(&repls);
+    return log_->reader()->ReadReplicatesInRange(
+        from, to, LogReader::kNoSizeLimit, &repls);
+  };
+
+  vector<LogAnchor*> anchors;
+  ElementDeleter deleter(&anchors);
+  OpId op_id = MakeOpId(1, 1);
+  ASSERT_OK(AppendMultiSegmentSequence(4, 5, &op_id, &anchors));
+
+  // A closed segment is prefetched once, however many times it's read from.
+  ASSERT_OK(read_ops(1, 5));
+  ASSERT_OK(read_ops(2, 5));
+  ASSERT_EQ(1, prefetched->value());
+
+  // Grow the closed segments so that each spans several truncation steps.
+  const int64_t kSegmentSize = 3 * 1024 * 1024;
+  SegmentSequence segments;
+  ASSERT_OK(log_->reader()->GetSegmentsSnapshot(&segments));
+  for (int i = 0; i < 3; i++) {
+    RWFileOptions opts;
+    opts.mode = Env::OPEN_EXISTING;
+    unique_ptr<RWFile> file;
+    ASSERT_OK(env_->NewRWFile(opts, segments[i]->path(), &file));
+    ASSERT_OK(file->Truncate(kSegmentSize));
+    ASSERT_OK(file->Close());
+  }
+
+  // The first segment is still held by a reader, so it's deleted without
+  // being truncated.
+  scoped_refptr<ReadableLogSegment> held = segments[0];
+  segments.clear();
+  int num_gced_segments;
+  ASSERT_OK(log_->GC(RetentionIndexes(), &num_gced_segments));
+  ASSERT_EQ(3, num_gced_segments);
+  ASSERT_EQ(3, deleted->value());
+  ASSERT_EQ(2, truncated->value());
+  ASSERT_EQ(3 * kSegmentSize, bytes_deleted->value());
+  held.reset();
+
+  // Once every peer has received the ops of the closed segments, they're
+  // dropped from the page cache, after which they're prefetched again.
+  ASSERT_OK(AppendMultiSegmentSequence(4, 5, &op_id, &anchors));
+  ASSERT_OK(read_ops(16, 20));
+  ASSERT_EQ(2, prefetched->value());
+  FLAGS_log_drop_replicated_segments_from_cache = true;
+  ASSERT_OK(log_->GC(RetentionIndexes(1, op_id.index()), &num_gced_segments));
+  ASSERT_EQ(0, num_gced_segments);
+  ASSERT_EVENTUALLY([&]() { ASSERT_EQ(3, dropped->value()); });
+  ASSERT_OK(read_ops(16, 20));
+  ASSERT_EQ(3, prefetched->value());
+}
+
 // Tests that segments can be GC'd while the log is running.
 TEST_P(LogTestOptionalCompression, TestGCWithLogRunning) {
   FLAGS_log_min_segments_to_retain = 2;
@@ -1194,6 +1376,46 @@ TEST_F(LogTest, TestAutoStopIdleAppendThread) {
       [&]() { ASSERT_FALSE(log_->append_thread_active_for_tests()); });
 }
 
+// Tests that logs sharing a LogSyncCoalescer sync through it, and that syncs
+// from many threads at once all complete.
+TEST_F(LogTest, TestSyncCoalescer) {
+  LogSyncCoalescer coalescer;
+  options_.force_fsync_all = true;
+  options_.sync_coalescer = &coalescer;
+  ASSERT_OK(BuildLog());
+  OpId opid = MakeOpId(1, 1);
+  AppendNoOpsToLogSync(clock_, log_.get(), &opid, 2);
+  ASSERT_GT(coalescer.num_syncs(), 0);
+  ASSERT_GT(coalescer.num_rounds(), 0);
+  ASSERT_OK(log_->Close());
+  const int64_t log_syncs = coalescer.num_syncs();
+
+  const int kNumThreads = 8;
+  const int kNumSyncsPerThread = 20;
+  vector<unique_ptr<WritableFile>> files(kNumThreads);
+  for (int i = 0; i < kNumThreads; i++) {
+    ASSERT_OK(env_->NewWritableFile(
+        GetTestPath(Substitute("file-$0", i)), &files[i]));
+  }
+  uint64_t fs_id;
+  ASSERT_OK(env_->GetFileSystemId(GetTestDataDirectory(), &fs_id));
+  vector<thread> threads;
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&, i]() {
+      for (int j = 0; j < kNumSyncsPerThread; j++) {
+        CHECK_OK(files[i]->Append("x"));
+        CHECK_OK(coalescer.Sync(fs_id, files[i].get()));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(log_syncs + kNumThreads * kNumSyncsPerThread,
+            coalescer.num_syncs());
+  ASSERT_LE(coalescer.num_rounds(), coalescer.num_syncs());
+}
+
 // Test that Log::TotalSize() captures creation, addition, and deletion of log
 // segments.
 TEST_P(LogTestOptionalCompression, TestTotalSize) {
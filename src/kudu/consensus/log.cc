@@ -23,11 +23,14 @@
 
 #include "kudu/consensus/log.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <ostream>
+#include <thread>
 #include <utility>
 
 #include <boost/range/adaptor/reversed.hpp>
@@ -51,17 +54,22 @@
 #include "kudu/gutil/strings/substitute.h"
 #include "kudu/gutil/walltime.h"
 #include "kudu/util/async_util.h"
+#include "kudu/util/buffer_pool.h"
 #include "kudu/util/compression/compression.pb.h"
 #include "kudu/util/compression/compression_codec.h"
+#include "kudu/util/condition_variable.h"
 #include "kudu/util/debug/trace_event.h"
 #include "kudu/util/env.h"
 #include "kudu/util/env_util.h"
 #include "kudu/util/fault_injection.h"
 #include "kudu/util/flag_tags.h"
+#include "kudu/util/io_uring.h"
 #include "kudu/util/kernel_stack_watchdog.h"
 #include "kudu/util/logging.h"
+#include "kudu/util/mem_tracker.h"
 #include "kudu/util/metrics.h"
 #include "kudu/util/monotime.h"
+#include "kudu/util/mutex.h"
 #include "kudu/util/path_util.h"
 #include "kudu/util/pb_util.h"
 #include "kudu/util/random.h"
@@ -98,6 +106,16 @@ DEFINE_int32(
     "Maximum size of the group commit queue in bytes");
 TAG_FLAG(group_commit_queue_size_bytes, advanced);
 
+DEFINE_int32(
+    log_batch_buffer_pool_mb,
+    64,
+    "Maximum amount of memory, in MB, kept in a process-wide pool of buffers "
+    "that batches of log entries are serialized into, so that they can be "
+    "reused by later batches rather than allocated for each one. The pooled "
+    "buffers are tracked by the 'log_batch_buffer_pool' memory tracker. Read "
+    "once at startup. 0 disables pooling.");
+TAG_FLAG(log_batch_buffer_pool_mb, advanced);
+
 DEFINE_int32(
     log_thread_idle_threshold_ms,
     1000,
@@ -106,6 +124,40 @@ DEFINE_int32(
 TAG_FLAG(log_thread_idle_threshold_ms, experimental);
 TAG_FLAG(log_thread_idle_threshold_ms, hidden);
 
+DEFINE_bool(
+    log_use_io_uring,
+    false,
+    "Whether to sync WAL segments through io_uring, so that the append thread "
+    "can keep writing the next group of entries while the previous group is "
+    "being synced. Falls back to regular syncs if io_uring is not available.");
+TAG_FLAG(log_use_io_uring, experimental);
+
+DEFINE_int32(
+    log_io_uring_queue_depth,
+    64,
+    "Number of syncs the io_uring instance of each log can have in flight, "
+    "for all of its segments. Only used if --log_use_io_uring is set.");
+TAG_FLAG(log_io_uring_queue_depth, advanced);
+TAG_FLAG(log_io_uring_queue_depth, experimental);
+
+DEFINE_bool(
+    log_pipeline_sync,
+    false,
+    "Whether the log append thread hands the sync of each group of entries to "
+    "a separate thread and keeps writing the groups that arrive meanwhile. A "
+    "single sync then covers every group written before it started. Ignored "
+    "if --log_use_io_uring is set.");
+TAG_FLAG(log_pipeline_sync, experimental);
+
+DEFINE_bool(
+    log_use_direct_io,
+    false,
+    "Whether to write WAL segments with O_DIRECT, so that they don't evict "
+    "other data from the page cache and syncs don't have to flush unrelated "
+    "dirty pages. Falls back to buffered writes if the filesystem doesn't "
+    "support direct I/O.");
+TAG_FLAG(log_use_direct_io, experimental);
+
 // Compression configuration.
 // -----------------------------
 DEFINE_string(
@@ -156,6 +208,33 @@ DEFINE_int32(
 TAG_FLAG(log_inject_thread_lifecycle_latency_ms, unsafe);
 TAG_FLAG(log_inject_thread_lifecycle_latency_ms, runtime);
 
+DEFINE_bool(
+    log_async_segment_deletion,
+    false,
+    "Whether GC'd log segments are deleted on a background housekeeping "
+    "thread, rather than by the thread running the log GC.");
+TAG_FLAG(log_async_segment_deletion, advanced);
+TAG_FLAG(log_async_segment_deletion, runtime);
+
+DEFINE_int32(
+    log_segment_delete_truncate_step_mb,
+    0,
+    "If positive, GC'd log segments are truncated this many MB at a time "
+    "before being unlinked, so that no single call frees all of their "
+    "extents at once. Spreads out the stalls some filesystems have when "
+    "freeing large files.");
+TAG_FLAG(log_segment_delete_truncate_step_mb, advanced);
+TAG_FLAG(log_segment_delete_truncate_step_mb, runtime);
+
+DEFINE_bool(
+    log_drop_replicated_segments_from_cache,
+    false,
+    "Whether the log GC advises the kernel to drop from the page cache the "
+    "closed log segments that every peer has received, so that they don't "
+    "compete for memory with the data they were replicated for.");
+TAG_FLAG(log_drop_replicated_segments_from_cache, advanced);
+TAG_FLAG(log_drop_replicated_segments_from_cache, runtime);
+
 DEFINE_double(
     fault_crash_before_append_commit,
     0.0,
@@ -226,6 +305,25 @@ using std::unique_ptr;
 using std::vector;
 using strings::Substitute;
 
+namespace {
+
+// Batches are serialized into pooled buffers of 4KB to 16MB. Larger batches
+// are rare enough to be allocated on their own.
+const size_t kMinPooledBatchBytes = 4 * 1024;
+const size_t kMaxPooledBatchBytes = 16 * 1024 * 1024;
+
+BufferPool* GetBatchBufferPool() {
+  static BufferPool* pool = new BufferPool(
+      kMinPooledBatchBytes,
+      kMaxPooledBatchBytes,
+      static_cast<int64_t>(std::max(FLAGS_log_batch_buffer_pool_mb, 0)) *
+          1024 * 1024,
+      MemTracker::FindOrCreateGlobalTracker(-1, "log_batch_buffer_pool"));
+  return pool;
+}
+
+} // anonymous namespace
+
 // Manages the thread which drains groups of batches from the log's queue and
 // appends them to the underlying log instance.
 //
@@ -285,14 +383,42 @@ class Log::AppendThread {
 
   // Handle the actual appending of a group of entries. Responsible for deleting
   // the LogEntryBatch* pointers.
+  //
+  // The group's callbacks run once its sync completes. If the active segment
+  // syncs asynchronously, this returns as soon as the sync is issued, so that
+  // the next group can be written while this one's sync is in flight. The
+  // callbacks then run on 'sync_token_', never on the thread completing the
+  // sync. A sync that completes synchronously has its callbacks run inline.
   void HandleGroup(vector<LogEntryBatch*> entry_batches);
 
+  // Runs the callbacks of the batches in 'entry_batches' with 's', the status
+  // of their sync, and deletes them. 'start' is when the group started being
+  // appended: the group commit latency covers the append, the sync and the
+  // callbacks.
+  void FinishGroup(
+      const vector<LogEntryBatch*>& entry_batches,
+      const Status& s,
+      MonoTime start);
+
+  // Decrements 'num_groups_in_flight_' by 'num_groups' and wakes up the
+  // threads waiting for it.
+  void GroupsFinished(int num_groups);
+
+  // Waits until the callbacks of every group whose sync was issued have run,
+  // but those of the last 'num_groups_to_ignore' groups.
+  void WaitForGroupsInFlight(int num_groups_to_ignore = 0);
+
+  // The task submitted to 'sync_token_' when --log_pipeline_sync is set. Syncs
+  // the log and finishes every group in 'groups_to_sync_', until there are no
+  // groups left.
+  void DoSync();
+
   string LogPrefix() const;
 
   Log* const log_;
 
   // Atomic state machine for whether there is any worker task currently
-  // queued or running on append_pool_. See Wake() and GoIdle() for more
+  // queued or running on append_token_. See Wake() and GoIdle() for more
   // details.
   enum WorkerState {
     // No worker task is queued or running.
@@ -302,34 +428,84 @@ class Log::AppendThread {
   };
   Atomic32 worker_state_ = WORKER_STOPPED;
 
-  // Pool with a single thread, which handles shutting down the thread
-  // when idle.
+  // Pools with a single thread each, built unless the log options provide
+  // pools shared with other logs.
   std::unique_ptr<ThreadPool> append_pool_;
+  std::unique_ptr<ThreadPool> sync_pool_;
+
+  // Whether the tokens below run on pools shared with other logs. If so,
+  // DoWork() goes idle as soon as the queue is empty rather than holding on to
+  // a thread other logs may need.
+  bool shared_pools_ = false;
+
+  // Token which handles shutting down the task when idle.
+  std::unique_ptr<ThreadPoolToken> append_token_;
+
+  // Token which runs DoSync() while there are groups waiting to be synced.
+  std::unique_ptr<ThreadPoolToken> sync_token_;
+
+  // Protects the members below.
+  Mutex in_flight_lock_;
+  ConditionVariable in_flight_cond_;
+
+  // Number of groups whose sync was issued but whose callbacks haven't run yet.
+  int num_groups_in_flight_ = 0;
+
+  // A group of batches and when it started being appended.
+  struct PendingGroup {
+    vector<LogEntryBatch*> entry_batches;
+    MonoTime start;
+  };
+
+  // Groups written to the log but not synced yet, in log order.
+  std::deque<PendingGroup> groups_to_sync_;
+
+  // Whether a DoSync() task is submitted to 'sync_token_'.
+  bool sync_task_running_ = false;
 };
 
-Log::AppendThread::AppendThread(Log* log) : log_(log) {}
+Log::AppendThread::AppendThread(Log* log)
+    : log_(log), in_flight_cond_(&in_flight_lock_) {}
 
 Status Log::AppendThread::Init() {
-  DCHECK(!append_pool_) << "Already initialized";
+  DCHECK(!append_token_) << "Already initialized";
   VLOG_WITH_PREFIX(1) << "Starting log append thread";
-  RETURN_NOT_OK(ThreadPoolBuilder("wal-append")
-                    .set_min_threads(0)
-                    // Only need one thread since we'll only schedule one
-                    // task at a time.
-                    .set_max_threads(1)
-                    // No need for keeping idle threads, since the task itself
-                    // handles waiting for work while idle.
-                    .set_idle_timeout(MonoDelta::FromSeconds(0))
-                    .Build(&append_pool_));
+  ThreadPool* append_pool = log_->options_.append_pool;
+  ThreadPool* sync_pool = log_->options_.sync_pool;
+  // Both or neither pool is shared, so that a log never ends up syncing on a
+  // thread of its own while appending on a shared one.
+  DCHECK_EQ(append_pool == nullptr, sync_pool == nullptr);
+  shared_pools_ = append_pool != nullptr;
+  if (!shared_pools_) {
+    RETURN_NOT_OK(ThreadPoolBuilder("wal-append")
+                      .set_min_threads(0)
+                      // Only need one thread since we'll only schedule one
+                      // task at a time.
+                      .set_max_threads(1)
+                      // No need for keeping idle threads, since the task
+                      // itself handles waiting for work while idle.
+                      .set_idle_timeout(MonoDelta::FromSeconds(0))
+                      .Build(&append_pool_));
+    RETURN_NOT_OK(ThreadPoolBuilder("wal-sync")
+                      .set_min_threads(0)
+                      .set_max_threads(1)
+                      .set_idle_timeout(MonoDelta::FromSeconds(0))
+                      .Build(&sync_pool_));
+    append_pool = append_pool_.get();
+    sync_pool = sync_pool_.get();
+  }
+  // Serial tokens keep the tasks of this log in order even on shared pools.
+  append_token_ = append_pool->NewToken(ThreadPool::ExecutionMode::SERIAL);
+  sync_token_ = sync_pool->NewToken(ThreadPool::ExecutionMode::SERIAL);
   return Status::OK();
 }
 
 void Log::AppendThread::Wake() {
-  DCHECK(append_pool_);
+  DCHECK(append_token_);
   auto old_status = base::subtle::NoBarrier_CompareAndSwap(
       &worker_state_, WORKER_STOPPED, WORKER_ACTIVE);
   if (old_status == WORKER_STOPPED) {
-    CHECK_OK(append_pool_->SubmitClosure(
+    CHECK_OK(append_token_->SubmitClosure(
         Bind(&Log::AppendThread::DoWork, Unretained(this))));
   }
 }
@@ -381,8 +557,11 @@ void Log::AppendThread::DoWork() {
   VLOG_WITH_PREFIX(2) << "WAL Appender going active";
   while (true) {
     CHECK(!FLAGS_raft_derived_log_mode);
-    MonoTime deadline = MonoTime::Now() +
-        MonoDelta::FromMilliseconds(FLAGS_log_thread_idle_threshold_ms);
+    MonoTime deadline = MonoTime::Now();
+    if (!shared_pools_) {
+      deadline +=
+          MonoDelta::FromMilliseconds(FLAGS_log_thread_idle_threshold_ms);
+    }
     vector<LogEntryBatch*> entry_batches;
     Status s = log_->entry_queue()->BlockingDrainTo(&entry_batches, deadline);
     if (PREDICT_FALSE(s.IsAborted())) {
@@ -405,7 +584,7 @@ void Log::AppendThread::HandleGroup(vector<LogEntryBatch*> entry_batches) {
   }
   TRACE_EVENT1("log", "batch", "batch_size", entry_batches.size());
 
-  SCOPED_LATENCY_METRIC(log_->metrics_, group_commit_latency);
+  const MonoTime start = MonoTime::Now();
 
   bool is_all_commits = true;
   for (LogEntryBatch* entry_batch : entry_batches) {
@@ -427,10 +606,69 @@ void Log::AppendThread::HandleGroup(vector<LogEntryBatch*> entry_batches) {
     }
   }
 
-  Status s;
-  if (!is_all_commits) {
-    s = log_->Sync();
+  if (is_all_commits) {
+    // Nothing to sync, but the callbacks must not overtake those of earlier
+    // groups that are still being synced.
+    WaitForGroupsInFlight();
+    FinishGroup(entry_batches, Status::OK(), start);
+    return;
+  }
+
+  if (FLAGS_log_pipeline_sync && !log_->io_uring_) {
+    MutexLock l(in_flight_lock_);
+    num_groups_in_flight_++;
+    groups_to_sync_.push_back({std::move(entry_batches), start});
+    if (!sync_task_running_) {
+      sync_task_running_ = true;
+      CHECK_OK(sync_token_->SubmitFunc([this]() { DoSync(); }));
+    }
+    return;
+  }
+
+  {
+    MutexLock l(in_flight_lock_);
+    num_groups_in_flight_++;
+  }
+  auto group =
+      std::make_shared<vector<LogEntryBatch*>>(std::move(entry_batches));
+  // Set if the sync completes on this thread, before SyncAsync() returns.
+  // Only ever accessed from this thread.
+  std::optional<Status> sync_status;
+  const std::thread::id append_thread_id = std::this_thread::get_id();
+  log_->SyncAsync(
+      [this, group, start, append_thread_id, &sync_status](const Status& s) {
+        if (std::this_thread::get_id() == append_thread_id) {
+          sync_status = s;
+          return;
+        }
+        // This runs on the thread reaping io_uring completions, which must
+        // not block, while the callbacks take locks and may evict from the
+        // log cache. The serial token keeps the groups in the order their
+        // syncs completed.
+        CHECK_OK(sync_token_->SubmitFunc([this, group, start, s]() {
+          FinishGroup(*group, s, start);
+          GroupsFinished(1);
+        }));
+      });
+  if (sync_status) {
+    // No need for a trip through 'sync_token_', once the earlier groups are
+    // finished.
+    WaitForGroupsInFlight(1);
+    FinishGroup(*group, *sync_status, start);
+    GroupsFinished(1);
   }
+}
+
+void Log::AppendThread::FinishGroup(
+    const vector<LogEntryBatch*>& entry_batches,
+    const Status& s,
+    MonoTime start) {
+  SCOPED_CLEANUP({
+    if (log_->metrics_) {
+      log_->metrics_->group_commit_latency->Increment(
+          (MonoTime::Now() - start).ToMicroseconds());
+    }
+  });
   if (PREDICT_FALSE(!s.ok())) {
     LOG_WITH_PREFIX(ERROR) << "Error syncing log: " << s.ToString();
     for (LogEntryBatch* entry_batch : entry_batches) {
@@ -456,12 +694,59 @@ void Log::AppendThread::HandleGroup(vector<LogEntryBatch*> entry_batches) {
   }
 }
 
+void Log::AppendThread::DoSync() {
+  while (true) {
+    std::deque<PendingGroup> groups;
+    {
+      MutexLock l(in_flight_lock_);
+      if (groups_to_sync_.empty()) {
+        sync_task_running_ = false;
+        return;
+      }
+      groups.swap(groups_to_sync_);
+    }
+    // Everything in 'groups' was written before the sync starts, so one sync
+    // makes all of it durable, while the append thread keeps writing.
+    Status s = log_->Sync();
+    for (const auto& group : groups) {
+      FinishGroup(group.entry_batches, s, group.start);
+    }
+    GroupsFinished(groups.size());
+  }
+}
+
+void Log::AppendThread::GroupsFinished(int num_groups) {
+  MutexLock l(in_flight_lock_);
+  num_groups_in_flight_ -= num_groups;
+  in_flight_cond_.Broadcast();
+}
+
+void Log::AppendThread::WaitForGroupsInFlight(int num_groups_to_ignore) {
+  MutexLock l(in_flight_lock_);
+  while (num_groups_in_flight_ > num_groups_to_ignore) {
+    in_flight_cond_.Wait();
+  }
+}
+
 void Log::AppendThread::Shutdown() {
   log_->entry_queue()->Shutdown();
+  if (append_token_) {
+    append_token_->Wait();
+    append_token_->Shutdown();
+  }
+  WaitForGroupsInFlight();
+  if (sync_token_) {
+    sync_token_->Shutdown();
+  }
+  // The tokens must be gone before the pools they were created from.
+  append_token_.reset();
+  sync_token_.reset();
   if (append_pool_) {
-    append_pool_->Wait();
     append_pool_->Shutdown();
   }
+  if (sync_pool_) {
+    sync_pool_->Shutdown();
+  }
 }
 
 string Log::AppendThread::LogPrefix() const {
@@ -530,14 +815,19 @@ Log::Log(
       append_thread_(new AppendThread(this)),
       force_sync_all_(options_.force_fsync_all),
       sync_disabled_(false),
+      wal_fs_id_(0),
       allocation_state_(kAllocationNotStarted),
       codec_(nullptr),
       metric_entity_(std::move(metric_entity)),
       on_disk_size_(0),
-      bootstrap_(std::make_shared<consensus::ConsensusBootstrapInfo>()) {
+      bootstrap_(std::make_shared<consensus::ConsensusBootstrapInfo>()),
+      last_segment_dropped_from_cache_(-1) {
   CHECK_OK(ThreadPoolBuilder("log-alloc")
                .set_max_threads(1)
                .Build(&allocation_pool_));
+  CHECK_OK(ThreadPoolBuilder("wal-housekeeping")
+               .set_max_threads(1)
+               .Build(&housekeeping_pool_));
   if (metric_entity_) {
     metrics_.reset(new LogMetrics(metric_entity_));
   }
@@ -571,8 +861,28 @@ Status Log::Init() {
         "could not instantiate compression codec");
   }
 
+  if (options_.sync_coalescer) {
+    RETURN_NOT_OK_PREPEND(
+        fs_manager_->env()->GetFileSystemId(log_dir_, &wal_fs_id_),
+        "could not identify the filesystem of the log");
+  }
+
+  // All the segments of the log share a ring, and its reaper thread.
+  if (FLAGS_log_use_io_uring) {
+    unique_ptr<IoUring> ring;
+    Status s = IoUring::Create(FLAGS_log_io_uring_queue_depth, &ring);
+    if (s.ok()) {
+      io_uring_ = std::move(ring);
+    } else {
+      KLOG_FIRST_N(WARNING, 1) << LogPrefix()
+                               << "Could not set up io_uring, falling back to "
+                               << "synchronous syncs: " << s.ToString();
+    }
+  }
+
   // Init the index
   log_index_.reset(new LogIndex(log_dir_));
+  RETURN_NOT_OK(log_index_->Init());
 
   // Reader for previous segments.
   RETURN_NOT_OK(LogReader::Open(
@@ -590,6 +900,17 @@ Status Log::Init() {
     RETURN_NOT_OK(reader_->GetSegmentsSnapshot(&segments));
     active_segment_sequence_number_ =
         segments.back()->header().sequence_number();
+
+    std::lock_guard<simple_spinlock> l(segment_dict_refs_lock_);
+    for (const auto& segment : segments) {
+      if (!segment->HasFooter()) {
+        continue;
+      }
+      auto& refs = segment_dict_refs_[segment->header().sequence_number()];
+      for (unsigned int dict_id : segment->footer().compression_dict_ids()) {
+        refs.emplace_back(dict_id);
+      }
+    }
   }
 
   if (force_sync_all_) {
@@ -649,9 +970,12 @@ Status Log::RollOver() {
   DCHECK_EQ(allocation_state(), kAllocationFinished);
 
   RETURN_NOT_OK(Sync());
-  RETURN_NOT_OK(CloseCurrentSegment());
-
-  RETURN_NOT_OK(SwitchToAllocatedSegment());
+  {
+    // Syncs of the active segment may be running on the sync thread.
+    MutexLock l(active_segment_sync_lock_);
+    RETURN_NOT_OK(CloseCurrentSegment());
+    RETURN_NOT_OK(SwitchToAllocatedSegment());
+  }
 
   LOG_WITH_PREFIX(INFO) << "Rolled over to a new log segment at "
                         << active_segment_->path();
@@ -836,10 +1160,22 @@ void Log::UpdateFooterForBatch(LogEntryBatch* batch) {
   // we roll over to a new segment, we set the first operation in the footer
   // immediately.
   if (batch->type_ == REPLICATE) {
+    const int num_dict_ids = footer_builder_.compression_dict_ids_size();
     // Update the index bounds for the current segment.
     for (const LogEntryPB& entry_pb : batch->entry_batch_pb_->entry()) {
       UpdateFooterForReplicateEntry(entry_pb, &footer_builder_);
     }
+    // The segment keeps the dictionaries new to it until it's GC'd.
+    if (PREDICT_FALSE(
+            footer_builder_.compression_dict_ids_size() > num_dict_ids)) {
+      std::lock_guard<simple_spinlock> l(segment_dict_refs_lock_);
+      auto& refs = segment_dict_refs_[active_segment_sequence_number_];
+      const auto& dict_ids = footer_builder_.compression_dict_ids();
+      for (auto it = dict_ids.begin() + num_dict_ids; it != dict_ids.end();
+           ++it) {
+        refs.emplace_back(*it);
+      }
+    }
   }
 }
 
@@ -872,7 +1208,15 @@ Status Log::Sync() {
   if (force_sync_all_ && !sync_disabled_) {
     LOG_SLOW_EXECUTION(
         WARNING, 50, Substitute("$0Fsync log took a long time", LogPrefix())) {
-      RETURN_NOT_OK(active_segment_->Sync());
+      {
+        MutexLock l(active_segment_sync_lock_);
+        if (options_.sync_coalescer) {
+          RETURN_NOT_OK(
+              active_segment_->SyncWith(options_.sync_coalescer, wal_fs_id_));
+        } else {
+          RETURN_NOT_OK(active_segment_->Sync());
+        }
+      }
 
       if (log_hooks_) {
         RETURN_NOT_OK_PREPEND(
@@ -888,6 +1232,41 @@ Status Log::Sync() {
   return Status::OK();
 }
 
+void Log::SyncAsync(const StdStatusCallback& callback) {
+  CHECK(!FLAGS_raft_derived_log_mode);
+  TRACE_EVENT0("log", "SyncAsync");
+
+  // Latency injection, the sync hooks and syncing with other logs are only
+  // supported by the synchronous path. Without io_uring, syncs happen inline
+  // anyway, so they go through Sync() too.
+  if (PREDICT_FALSE(FLAGS_log_inject_latency || log_hooks_) ||
+      options_.sync_coalescer || !io_uring_) {
+    callback(Sync());
+    return;
+  }
+  if (!force_sync_all_ || sync_disabled_) {
+    callback(Status::OK());
+    return;
+  }
+
+  MonoTime start = MonoTime::Now();
+  scoped_refptr<Histogram> sync_latency =
+      metrics_ ? metrics_->sync_latency : nullptr;
+  const string prefix = LogPrefix();
+  active_segment_->SyncAsync(
+      [callback, start, sync_latency, prefix](const Status& s) {
+        const MonoDelta elapsed = MonoTime::Now() - start;
+        if (sync_latency) {
+          sync_latency->Increment(elapsed.ToMicroseconds());
+        }
+        if (elapsed.ToMilliseconds() >= 50) {
+          LOG(WARNING) << prefix << "Fsync log took a long time: "
+                       << elapsed.ToString();
+        }
+        callback(s);
+      });
+}
+
 int GetPrefixSizeToGC(
     RetentionIndexes retention_indexes,
     const SegmentSequence& segments) {
@@ -981,6 +1360,12 @@ Status Log::GC(RetentionIndexes retention_indexes, int32_t* num_gced) {
                       << " for durability, "
                          "ops >= "
                       << retention_indexes.for_peers << " for peers";
+  if (FLAGS_log_drop_replicated_segments_from_cache) {
+    const int64_t replicated_index = retention_indexes.for_peers;
+    RETURN_NOT_OK(housekeeping_pool_->SubmitFunc([this, replicated_index]() {
+      DropReplicatedSegmentsFromCache(replicated_index);
+    }));
+  }
   VLOG_TIMING(1, Substitute("$0Log GC", LogPrefix())) {
     SegmentSequence segments_to_delete;
 
@@ -998,16 +1383,22 @@ Status Log::GC(RetentionIndexes retention_indexes, int32_t* num_gced) {
       }
       // Trim the prefix of segments from the reader so that they are no longer
       // referenced by the log.
-      RETURN_NOT_OK(reader_->TrimSegmentsUpToAndIncluding(
-          segments_to_delete[segments_to_delete.size() - 1]
-              ->header()
-              .sequence_number()));
+      const uint64_t last_deleted =
+          segments_to_delete.back()->header().sequence_number();
+      RETURN_NOT_OK(reader_->TrimSegmentsUpToAndIncluding(last_deleted));
+
+      std::lock_guard<simple_spinlock> refs_lock(segment_dict_refs_lock_);
+      segment_dict_refs_.erase(
+          segment_dict_refs_.begin(),
+          segment_dict_refs_.upper_bound(last_deleted));
     }
+    // The dictionaries no segment nor cached payload needs anymore can go.
+    CompressionCodecManager::PruneDictionaries();
 
     // Now that they are no longer referenced by the Log, delete the files.
+    const bool async_deletion = FLAGS_log_async_segment_deletion;
     *num_gced = 0;
-    for (const scoped_refptr<ReadableLogSegment>& segment :
-         segments_to_delete) {
+    for (scoped_refptr<ReadableLogSegment>& segment : segments_to_delete) {
       string ops_str;
       if (segment->HasFooter() && segment->footer().has_min_replicate_index()) {
         DCHECK(segment->footer().has_max_replicate_index());
@@ -1018,7 +1409,17 @@ Status Log::GC(RetentionIndexes retention_indexes, int32_t* num_gced) {
       }
       LOG_WITH_PREFIX(INFO)
           << "Deleting log segment in path: " << segment->path() << ops_str;
-      RETURN_NOT_OK(fs_manager_->env()->DeleteFile(segment->path()));
+      if (async_deletion) {
+        // The task holds the segment, and its descriptor, until it's done.
+        RETURN_NOT_OK(housekeeping_pool_->SubmitFunc(
+            [this, segment = std::move(segment)]() {
+              WARN_NOT_OK(
+                  DeleteSegment(segment),
+                  Substitute("$0Unable to delete log segment", LogPrefix()));
+            }));
+      } else {
+        RETURN_NOT_OK(DeleteSegment(segment));
+      }
       (*num_gced)++;
     }
 
@@ -1032,6 +1433,79 @@ Status Log::GC(RetentionIndexes retention_indexes, int32_t* num_gced) {
   return Status::OK();
 }
 
+Status Log::DeleteSegment(const scoped_refptr<ReadableLogSegment>& segment) {
+  MonoTime start = MonoTime::Now();
+  Env* env = fs_manager_->env();
+  const string& path = segment->path();
+  uint64_t size = 0;
+  RETURN_NOT_OK(env->GetFileSize(path, &size));
+
+  const uint64_t step =
+      static_cast<uint64_t>(FLAGS_log_segment_delete_truncate_step_mb) * 1024 *
+      1024;
+  // Readers that took a snapshot of the segments before the GC may still be
+  // reading this one, so it's only truncated once it's no longer shared.
+  // Unlinking it is safe either way: its blocks are freed when the last
+  // descriptor is closed.
+  if (step > 0 && size > step && segment->HasOneRef()) {
+    RWFileOptions opts;
+    opts.mode = Env::OPEN_EXISTING;
+    unique_ptr<RWFile> file;
+    RETURN_NOT_OK(env->NewRWFile(opts, path, &file));
+    for (uint64_t length = size - step; length > 0;
+         length = length > step ? length - step : 0) {
+      RETURN_NOT_OK(file->Truncate(length));
+    }
+    RETURN_NOT_OK(file->Close());
+    if (metrics_) {
+      metrics_->segments_truncated->Increment();
+    }
+  }
+  RETURN_NOT_OK(env->DeleteFile(path));
+
+  if (metrics_) {
+    metrics_->segments_deleted->Increment();
+    metrics_->segment_bytes_deleted->IncrementBy(size);
+    metrics_->segment_delete_latency->Increment(
+        (MonoTime::Now() - start).ToMicroseconds());
+  }
+  return Status::OK();
+}
+
+void Log::DropReplicatedSegmentsFromCache(int64_t replicated_index) {
+  SegmentSequence segments;
+  {
+    shared_lock<rw_spinlock> l(state_lock_.get_lock());
+    if (log_state_ != kLogWriting ||
+        !reader_->GetSegmentsSnapshot(&segments).ok()) {
+      return;
+    }
+  }
+  for (const scoped_refptr<ReadableLogSegment>& segment : segments) {
+    // The segment being written has no footer, and neither do the ones after
+    // the first one a peer still needs.
+    if (!segment->HasFooter() ||
+        segment->footer().max_replicate_index() >= replicated_index) {
+      break;
+    }
+    const int64_t seqno = segment->header().sequence_number();
+    if (seqno <= last_segment_dropped_from_cache_) {
+      continue;
+    }
+    Status s = segment->DropFromPageCache();
+    if (!s.ok()) {
+      WARN_NOT_OK(
+          s,
+          Substitute("$0Unable to drop log segment from cache", LogPrefix()));
+      return;
+    }
+    last_segment_dropped_from_cache_ = seqno;
+    if (metrics_) {
+      metrics_->segments_dropped_from_cache->Increment();
+    }
+  }
+}
+
 int64_t Log::GetGCableDataSize(RetentionIndexes retention_indexes) const {
   CHECK(!FLAGS_raft_derived_log_mode);
   CHECK_GE(retention_indexes.for_durability, 0);
@@ -1098,10 +1572,10 @@ Status Log::ReadReplicatesInRange(
     int64_t starting_at,
     int64_t up_to,
     int64_t max_bytes_to_read,
-    const consensus::ReadContext& /* context */,
+    const consensus::ReadContext& context,
     std::vector<consensus::ReplicateMsg*>* replicates) const {
   return reader()->ReadReplicatesInRange(
-      starting_at, up_to, max_bytes_to_read, replicates);
+      starting_at, up_to, max_bytes_to_read, replicates, context.read_ahead);
 }
 
 Status Log::LookupOpId(int64_t op_index, OpId* op_id) const {
@@ -1112,6 +1586,10 @@ Status Log::Close() {
   CHECK(!FLAGS_raft_derived_log_mode);
   allocation_pool_->Shutdown();
   append_thread_->Shutdown();
+  // Let pending segment deletions finish, rather than leaving their files
+  // behind.
+  housekeeping_pool_->Wait();
+  housekeeping_pool_->Shutdown();
 
   std::lock_guard<percpu_rwlock> l(state_lock_);
   switch (log_state_) {
@@ -1225,6 +1703,8 @@ Status Log::PreAllocateNewSegment() {
 
   WritableFileOptions opts;
   opts.sync_on_close = force_sync_all_;
+  opts.io_uring = io_uring_;
+  opts.use_direct_io = FLAGS_log_use_direct_io;
   RETURN_NOT_OK(
       CreatePlaceholderSegment(opts, &next_segment_path_, &next_segment_file_));
 
@@ -1381,20 +1861,31 @@ LogEntryBatch::~LogEntryBatch() {
     for (LogEntryPB& entry : *entry_batch_pb_->mutable_entry()) {
       // ReplicateMsg elements are owned by and must be freed by the caller
       // (e.g. the LogCache).
-      std::ignore = entry.release_replicate();
+      std::ignore = entry.unsafe_arena_release_replicate();
     }
   }
 }
 
 void LogEntryBatch::Serialize() {
-  DCHECK_EQ(buffer_.size(), 0);
+  DCHECK(!buffer_);
   // FLUSH_MARKER LogEntries are markers and are not serialized.
   if (PREDICT_FALSE(
           count() == 1 && entry_batch_pb_->entry(0).type() == FLUSH_MARKER)) {
     return;
   }
-  buffer_.reserve(total_size_bytes_);
-  pb_util::AppendToString(*entry_batch_pb_, &buffer_);
+  DCHECK(entry_batch_pb_->IsInitialized())
+      << pb_util::SecureShortDebugString(*entry_batch_pb_);
+  // The sizes cached when computing 'total_size_bytes_' are stale if an entry
+  // changed since, so they're computed again to size the buffer.
+  const size_t size = entry_batch_pb_->ByteSizeLong();
+  DCHECK_EQ(total_size_bytes_, size)
+      << "Log entry batch changed since it was created";
+  buffer_ = GetBatchBufferPool()->Acquire(size);
+  buffer_->resize(size);
+  const uint8_t* end =
+      entry_batch_pb_->SerializeWithCachedSizesToArray(buffer_->data());
+  CHECK_EQ(end - buffer_->data(), static_cast<ptrdiff_t>(size))
+      << "Log entry batch changed while being serialized";
 }
 
 } // namespace kudu::log
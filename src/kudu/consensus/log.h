@@ -46,8 +46,10 @@
 #include "kudu/gutil/macros.h"
 #include "kudu/gutil/ref_counted.h"
 #include "kudu/util/blocking_queue.h"
+#include "kudu/util/compression/compression_codec.h"
 #include "kudu/util/faststring.h"
 #include "kudu/util/locks.h"
+#include "kudu/util/mutex.h"
 #include "kudu/util/promise.h"
 #include "kudu/util/rw_mutex.h"
 #include "kudu/util/slice.h"
@@ -58,8 +60,8 @@ DECLARE_bool(raft_derived_log_mode);
 
 namespace kudu {
 
-class CompressionCodec;
 class FsManager;
+class IoUring;
 class MetricEntity;
 class ThreadPool;
 class WritableFile;
@@ -93,6 +95,12 @@ struct ConsensusBootstrapInfo {
   DISALLOW_COPY_AND_ASSIGN(ConsensusBootstrapInfo);
 };
 
+// The number of ops read for a peer from the log cache and from disk.
+struct PeerReadStats {
+  std::atomic<int64_t> ops_from_cache{0};
+  std::atomic<int64_t> ops_from_disk{0};
+};
+
 struct ReadContext {
   const std::string* for_peer_uuid = nullptr;
   const std::string* for_peer_host = nullptr;
@@ -100,6 +108,11 @@ struct ReadContext {
   bool route_via_proxy = false;
   // Whether to report errors to error manager.
   bool report_errors = true;
+  // Whether ops read from disk should also read ahead the rest of their
+  // segment, because the peer isn't expected to be served from the cache.
+  bool read_ahead = false;
+  // If set, updated with where the ops were read from.
+  PeerReadStats* read_stats = nullptr;
 };
 
 } // namespace consensus
@@ -411,6 +424,20 @@ class Log : public RefCountedThreadSafe<Log> {
 
   Status Sync();
 
+  // Like Sync(), but invokes 'callback' once the sync completes instead of
+  // waiting for it. Callbacks are invoked in the order the syncs were issued.
+  void SyncAsync(const StdStatusCallback& callback);
+
+  // Deletes the file of a GC'd segment, truncating it in steps first if
+  // --log_segment_delete_truncate_step_mb is set and 'segment' is the only
+  // reference left to it.
+  Status DeleteSegment(const scoped_refptr<ReadableLogSegment>& segment);
+
+  // Advises the kernel to drop from the page cache the closed segments whose
+  // ops are all below 'replicated_index', i.e. received by every peer. Runs
+  // on 'housekeeping_pool_'.
+  void DropReplicatedSegmentsFromCache(int64_t replicated_index);
+
   // Helper method to get the segment sequence to GC based on the provided
   // 'retention' struct.
   Status GetSegmentsToGCUnlocked(
@@ -468,6 +495,12 @@ class Log : public RefCountedThreadSafe<Log> {
   // When the segment is closed, it will be written.
   LogSegmentFooterPB footer_builder_;
 
+  // References to the compression dictionaries that the payloads of each
+  // retained segment, the active one included, were compressed with, keyed
+  // by segment sequence number. Released as the segments are GC'd.
+  std::map<uint64_t, std::vector<CompressionDictRef>> segment_dict_refs_;
+  simple_spinlock segment_dict_refs_lock_;
+
   // The maximum segment size, in bytes.
   uint64_t max_segment_size_;
 
@@ -480,6 +513,11 @@ class Log : public RefCountedThreadSafe<Log> {
 
   std::unique_ptr<ThreadPool> allocation_pool_;
 
+  // Pool with a single thread, which deletes GC'd segments when
+  // --log_async_segment_deletion is set, and advises the kernel about cached
+  // segments.
+  std::unique_ptr<ThreadPool> housekeeping_pool_;
+
   // If true, sync on all appends.
   bool force_sync_all_;
 
@@ -492,8 +530,21 @@ class Log : public RefCountedThreadSafe<Log> {
 
   // Read-write lock to protect 'allocation_state_'.
   mutable RWMutex allocation_lock_;
+
+  // Serializes syncs of 'active_segment_', which may run on the append
+  // thread's sync thread, with the segment being closed and replaced.
+  Mutex active_segment_sync_lock_;
+
+  // The filesystem the log's segments reside on, if it syncs through
+  // 'options_.sync_coalescer'. See Env::GetFileSystemId().
+  uint64_t wal_fs_id_;
+
   SegmentAllocationState allocation_state_;
 
+  // The ring the segments are synced through if --log_use_io_uring is set
+  // and io_uring is available, null otherwise.
+  std::shared_ptr<IoUring> io_uring_;
+
   // The codec used to compress entries, or nullptr if not configured.
   std::shared_ptr<CompressionCodec> codec_;
 
@@ -508,6 +559,10 @@ class Log : public RefCountedThreadSafe<Log> {
 
   std::shared_ptr<kudu::consensus::ConsensusBootstrapInfo> bootstrap_;
 
+  // Sequence number of the last segment dropped from the page cache. Only
+  // accessed on 'housekeeping_pool_'.
+  int64_t last_segment_dropped_from_cache_;
+
   DISALLOW_COPY_AND_ASSIGN(Log);
 };
 
@@ -602,7 +657,7 @@ class LogEntryBatch {
   // Returns a Slice representing the serialized contents of the
   // entry.
   Slice data() const {
-    return Slice(buffer_);
+    return buffer_ ? Slice(*buffer_) : Slice();
   }
 
   size_t count() const {
@@ -651,8 +706,9 @@ class LogEntryBatch {
   StatusCallback callback_;
 
   // Buffer to which 'phys_entries_' are serialized by call to
-  // 'Serialize()'
-  faststring buffer_;
+  // 'Serialize()'. It comes from a process-wide pool, and goes back to it
+  // when the batch is destroyed.
+  std::shared_ptr<faststring> buffer_;
 
   DISALLOW_COPY_AND_ASSIGN(LogEntryBatch);
 };
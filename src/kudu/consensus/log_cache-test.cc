@@ -63,6 +63,7 @@ using strings::Substitute;
 
 DECLARE_int32(log_cache_size_limit_mb);
 DECLARE_int32(global_log_cache_size_limit_mb);
+DECLARE_bool(log_cache_peer_aware_eviction);
 
 // METRIC_DECLARE_entity(tablet);
 
@@ -257,9 +258,14 @@ TEST_F(LogCacheTest, TestCacheEdgeCases) {
 
   messages.clear();
 
+  ASSERT_FALSE(cache_->NeedsLogReadForOp(1));
+  ASSERT_FALSE(cache_->NeedsLogReadForOp(2));
+
   // Evict entries from the cache, and ensure that we can still read
   // entries at the beginning of the log.
   cache_->EvictThroughOp(50);
+  ASSERT_TRUE(cache_->NeedsLogReadForOp(1));
+  ASSERT_FALSE(cache_->NeedsLogReadForOp(2));
   status = cache_->ReadOps(0, 100, ReadContext(), &messages);
   ASSERT_OK(status.status);
   ASSERT_EQ(1, messages.size());
@@ -336,6 +342,42 @@ TEST_F(LogCacheTest, TestGlobalMemoryLimit) {
   ASSERT_LE(cache_->BytesUsed(), 1024 * 1024);
 }
 
+// Ops healthy peers still need are kept past the per-tablet limit, and the
+// others are evicted first.
+TEST_F(LogCacheTest, TestPeerAwareEviction) {
+  FLAGS_log_cache_size_limit_mb = 1;
+  FLAGS_log_cache_peer_aware_eviction = true;
+  CloseAndReopenCache(MinimumOpId());
+
+  const int kPayloadSize = 400 * 1024;
+  ASSERT_OK(AppendReplicateMessagesToCache(1, 2, kPayloadSize));
+  log_->WaitUntilAllFlushed();
+  ASSERT_EQ(2, cache_->num_cached_ops());
+
+  // A healthy peer still needs op 1, so nothing gets evicted.
+  cache_->SetPeerRetentionIndex(1);
+  ASSERT_OK(AppendReplicateMessagesToCache(3, 1, kPayloadSize));
+  log_->WaitUntilAllFlushed();
+  ASSERT_EQ(3, cache_->num_cached_ops());
+
+  // Once the healthy peers only need op 3 on, ops 1 and 2 make room for op 4.
+  cache_->SetPeerRetentionIndex(3);
+  ASSERT_OK(AppendReplicateMessagesToCache(4, 1, kPayloadSize));
+  log_->WaitUntilAllFlushed();
+  ASSERT_EQ(2, cache_->num_cached_ops());
+
+  // The ops that were evicted are read back from disk.
+  PeerReadStats stats;
+  ReadContext context;
+  context.read_stats = &stats;
+  vector<ReplicateRefPtr> messages;
+  auto status = cache_->ReadOps(0, 8 * 1024 * 1024, context, &messages);
+  ASSERT_OK(status.status);
+  ASSERT_EQ(4, messages.size());
+  ASSERT_EQ(2, stats.ops_from_disk);
+  ASSERT_EQ(2, stats.ops_from_cache);
+}
+
 // Test that the log cache properly replaces messages when an index
 // is reused. This is a regression test for a bug where the memtracker's
 // consumption wasn't properly managed when messages were replaced.
@@ -435,5 +477,29 @@ TEST_F(LogCacheTest, TestMTReadAndWrite) {
   SleepFor(MonoDelta::FromSeconds(AllowSlowTests() ? 10 : 2));
 }
 
+// The cache accounts for messages without reflection, but must agree with it.
+TEST(ReplicateMsgSpaceUsedTest, TestMatchesSpaceUsedLong) {
+  ReplicateMsg msg;
+  *msg.mutable_id() = MakeOpId(2, 3);
+  msg.set_timestamp(1);
+  msg.set_op_type(WRITE_OP_EXT);
+  EXPECT_EQ(msg.SpaceUsedLong(), ReplicateMsgSpaceUsed(msg));
+
+  // Payloads stored inline in the string and on the heap.
+  for (int size : {1, 100, 10000}) {
+    SCOPED_TRACE(size);
+    msg.mutable_write_payload()->set_payload(std::string(size, 'x'));
+    msg.mutable_write_payload()->set_crc32(1234);
+    EXPECT_EQ(msg.SpaceUsedLong(), ReplicateMsgSpaceUsed(msg));
+  }
+
+  ReplicateMsg noop;
+  *noop.mutable_id() = MakeOpId(2, 4);
+  noop.set_timestamp(1);
+  noop.set_op_type(NO_OP);
+  noop.mutable_noop_request()->set_payload_for_tests(std::string(1000, 'x'));
+  EXPECT_EQ(noop.SpaceUsedLong(), ReplicateMsgSpaceUsed(noop));
+}
+
 } // namespace consensus
 } // namespace kudu
@@ -32,6 +32,7 @@
 #include "kudu/consensus/consensus.pb.h"
 #include "kudu/consensus/log.h"
 #include "kudu/consensus/log_reader.h"
+#include "kudu/consensus/log_util.h"
 #include "kudu/consensus/opid.pb.h"
 #include "kudu/consensus/opid_util.h"
 #include "kudu/consensus/ref_counted_replicate.h"
@@ -69,6 +70,17 @@ DEFINE_int32(
     "caching log entries across all tablets is kept under this threshold.");
 TAG_FLAG(global_log_cache_size_limit_mb, advanced);
 
+DEFINE_bool(
+    log_cache_peer_aware_eviction,
+    false,
+    "Whether the log cache, when over 'log_cache_size_limit_mb', only evicts "
+    "the entries that no healthy peer still needs, letting the tablet go over "
+    "its limit to keep the others for as long as the server-wide "
+    "'global_log_cache_size_limit_mb' isn't exceeded. Peers that are only "
+    "served from disk read ahead of the entries they are sent.");
+TAG_FLAG(log_cache_peer_aware_eviction, advanced);
+TAG_FLAG(log_cache_peer_aware_eviction, runtime);
+
 using kudu::pb_util::SecureShortDebugString;
 using std::string;
 using std::vector;
@@ -121,6 +133,7 @@ LogCache::LogCache(
       next_index_cond_(&lock_),
       next_sequential_op_index_(0),
       min_pinned_op_index_(0),
+      peer_retention_index_(MathLimits<int64_t>::kMax),
       metrics_(metric_entity),
       enable_compression_on_cache_miss_(false) {
   const int64_t max_ops_size_bytes =
@@ -146,7 +159,7 @@ LogCache::LogCache(
   InsertOrDie(
       &cache_,
       0,
-      {make_scoped_refptr_replicate(zero_op), zero_op->SpaceUsed()});
+      {make_scoped_refptr_replicate(zero_op), ReplicateMsgSpaceUsed(*zero_op)});
 }
 
 LogCache::~LogCache() {
@@ -225,15 +238,18 @@ Status LogCache::AppendOperations(
     const StatusCallback& callback) {
   CHECK_GT(msgs.size(), 0);
 
-  // SpaceUsed is relatively expensive, so do calculations outside the lock
-  // and cache the result with each message.
+  // Compute the sizes outside the lock and cache them with each message.
   int64_t mem_required = 0;
   vector<CacheEntry> entries_to_insert;
   entries_to_insert.reserve(msgs.size());
 
   for (const auto& msg : msgs) {
-    int64_t msg_size = static_cast<int64_t>(msg->get()->SpaceUsedLong());
-    CacheEntry e = {msg, msg_size, msg_size};
+    int64_t msg_size = ReplicateMsgSpaceUsed(*msg->get());
+    CacheEntry e = {
+        msg,
+        msg_size,
+        msg_size,
+        CompressionDictRef(log::GetPayloadDictionaryID(*msg->get()))};
     mem_required += e.mem_usage;
     entries_to_insert.emplace_back(std::move(e));
   }
@@ -262,7 +278,7 @@ Status LogCache::AppendOperations(
     // TODO: we should also try to evict from other tablets - probably better to
     // evict really old ops from another tablet than evict recent ops from this
     // one.
-    EvictSomeUnlocked(min_pinned_op_index_, need_to_free);
+    EvictForMemoryUnlocked(need_to_free);
 
     // Force consuming, so that we don't refuse appending data. We might
     // blow past our limit a little bit (as much as the number of tablets times
@@ -317,8 +333,7 @@ Status LogCache::AppendOperations(
     const StatusCallback& callback) {
   CHECK_GT(msg_wrappers.size(), 0);
 
-  // SpaceUsed is relatively expensive, so do calculations outside the lock
-  // and cache the result with each message.
+  // Compute the sizes outside the lock and cache them with each message.
   int64_t mem_required = 0;
   int64_t total_msg_size = 0;
   int64_t compressed_size = 0;
@@ -331,16 +346,18 @@ Status LogCache::AppendOperations(
     auto compressed_msg = msg_wrapper.GetCompressedMsg();
 
     CacheEntry e;
-    e.msg_size = ApproxMsgSize(msg);
+    e.msg_size = ReplicateMsgSpaceUsed(*msg->get());
 
-    uncompressed_size += e.msg_size;
+    uncompressed_size += ApproxMsgSize(msg);
 
     // We use the compressed msg if available. The compressed msg might
     // not be avaiblable if compression is disabled or the msg doesn't
     // support compression e.g. non write op
     if (compressed_msg) {
-      e.mem_usage = ApproxMsgSize(compressed_msg);
+      e.mem_usage = ReplicateMsgSpaceUsed(*compressed_msg->get());
       e.msg = compressed_msg;
+      e.dict_ref = CompressionDictRef(
+          log::GetPayloadDictionaryID(*compressed_msg->get()));
     } else {
       e.mem_usage = e.msg_size;
       e.msg = msg;
@@ -386,7 +403,7 @@ Status LogCache::AppendOperations(
     // TODO: we should also try to evict from other tablets - probably better to
     // evict really old ops from another tablet than evict recent ops from this
     // one.
-    EvictSomeUnlocked(min_pinned_op_index_, need_to_free);
+    EvictForMemoryUnlocked(need_to_free);
 
     // Force consuming, so that we don't refuse appending data. We might
     // blow past our limit a little bit (as much as the number of tablets times
@@ -459,7 +476,7 @@ void LogCache::LogCallback(
     if (borrowed_memory) {
       int64_t spare_capacity = parent_tracker_->SpareCapacity();
       if (spare_capacity < 0) {
-        EvictSomeUnlocked(min_pinned_op_index_, -spare_capacity);
+        EvictForMemoryUnlocked(-spare_capacity);
       }
     }
   }
@@ -471,6 +488,11 @@ bool LogCache::HasOpBeenWritten(int64_t index) const {
   return index < next_sequential_op_index_;
 }
 
+bool LogCache::NeedsLogReadForOp(int64_t index) const {
+  std::lock_guard<Mutex> l(lock_);
+  return index < next_sequential_op_index_ && !ContainsKey(cache_, index);
+}
+
 Status LogCache::LookupOpId(int64_t op_index, OpId* op_id) const {
   // First check the log cache itself.
   {
@@ -580,6 +602,7 @@ LogCache::ReadOpsStatus LogCache::ReadOps(
 
   std::unique_lock<Mutex> l(lock_);
   int64_t next_index = after_op_index + 1;
+  int64_t ops_from_disk = 0;
 
   // Return as many operations as we can, up to the limit
   int64_t remaining_space = max_size_bytes;
@@ -657,6 +680,7 @@ LogCache::ReadOpsStatus LogCache::ReadOps(
         if (remaining_space > 0 || messages->empty()) {
           messages->push_back(msg);
           next_index++;
+          ops_from_disk++;
         }
       }
     } else {
@@ -683,6 +707,11 @@ LogCache::ReadOpsStatus LogCache::ReadOps(
       }
     }
   }
+  if (context.read_stats) {
+    const int64_t ops_read = next_index - after_op_index - 1;
+    context.read_stats->ops_from_disk += ops_from_disk;
+    context.read_stats->ops_from_cache += ops_read - ops_from_disk;
+  }
   return {
       Status::OK(),
       std::move(preceding_id),
@@ -718,7 +747,40 @@ void LogCache::EvictThroughOp(int64_t index, bool force) {
   EvictSomeUnlocked(index, MathLimits<int64_t>::kMax, force);
 }
 
-void LogCache::EvictSomeUnlocked(
+void LogCache::SetPeerRetentionIndex(int64_t index) {
+  std::lock_guard<Mutex> lock(lock_);
+  peer_retention_index_ = index;
+}
+
+void LogCache::EvictForMemoryUnlocked(int64_t bytes_to_evict) {
+  if (!FLAGS_log_cache_peer_aware_eviction ||
+      peer_retention_index_ >= min_pinned_op_index_) {
+    EvictSomeUnlocked(min_pinned_op_index_, bytes_to_evict);
+    return;
+  }
+
+  // Ops below the retention index are only needed by unhealthy peers, which
+  // would have to read them from disk anyway once they come back.
+  int64_t remaining = bytes_to_evict -
+      EvictSomeUnlocked(peer_retention_index_ - 1, bytes_to_evict);
+  if (remaining <= 0) {
+    return;
+  }
+
+  // Keep the ops healthy peers still need unless that would take the server
+  // over its global limit.
+  if (parent_tracker_->SpareCapacity() >= remaining) {
+    VLOG_WITH_PREFIX_UNLOCKED(1)
+        << "Keeping ops from index " << peer_retention_index_
+        << " for healthy peers, "
+        << HumanReadableNumBytes::ToString(remaining)
+        << " over the log cache limit";
+    return;
+  }
+  EvictSomeUnlocked(min_pinned_op_index_, remaining);
+}
+
+int64_t LogCache::EvictSomeUnlocked(
     int64_t stop_after_index,
     int64_t bytes_to_evict,
     bool force) {
@@ -767,6 +829,7 @@ void LogCache::EvictSomeUnlocked(
   }
   VLOG_WITH_PREFIX_UNLOCKED(1)
       << "Evicting log cache: after state: " << ToStringUnlocked();
+  return bytes_evicted;
 }
 
 void LogCache::AccountForMessageRemovalUnlocked(
@@ -30,6 +30,7 @@
 #include "kudu/consensus/ref_counted_replicate.h"
 #include "kudu/gutil/macros.h"
 #include "kudu/gutil/ref_counted.h"
+#include "kudu/util/compression/compression_codec.h"
 #include "kudu/util/condition_variable.h"
 #include "kudu/util/faststring.h"
 #include "kudu/util/metrics.h"
@@ -181,12 +182,22 @@ class LogCache {
   // still be en route to the log.
   bool HasOpBeenWritten(int64_t index) const;
 
+  // Return true if reading the operation with the given index would go to the
+  // log on disk: it has been written, but is no longer in the cache.
+  bool NeedsLogReadForOp(int64_t index) const;
+
   // Clear the cache
   Status Clear();
 
   // Evict any operations with op index <= 'index'.
   void EvictThroughOp(int64_t index, bool force = false);
 
+  // Sets the index of the first operation some healthy peer still needs.
+  // With --log_cache_peer_aware_eviction, operations from this index on are
+  // kept past the per-tablet memory limit, as long as the server-wide limit
+  // isn't exceeded.
+  void SetPeerRetentionIndex(int64_t index);
+
   // Return the number of bytes of memory currently in use by the cache.
   int64_t BytesUsed() const;
 
@@ -236,12 +247,14 @@ class LogCache {
   // An entry in the cache.
   struct CacheEntry {
     ReplicateRefPtr msg;
-    // The cached value of msg->SpaceUsedLong(). This method is expensive
-    // to compute, so we compute it only once upon insertion.
+    // The memory used by msg, as returned by ReplicateMsgSpaceUsed() upon
+    // insertion.
     int64_t mem_usage;
-    // The uncompressed size of the msg. If msg is not compressed, then it is
-    // same as mem_usage
+    // The memory used by the uncompressed msg. If msg is not compressed, then
+    // it is same as mem_usage
     int64_t msg_size;
+    // Keeps the dictionary msg was compressed with, if any, registered.
+    CompressionDictRef dict_ref;
   };
 
   // Try to evict the oldest operations from the queue, stopping either when
@@ -250,11 +263,17 @@ class LogCache {
   // Set 'force' to true when msgs that have refs in peers (i.e. in flight)
   // should also be evicted. This will not cause any correctness issues because
   // msgs are ref counted but it can throw off memory accounting.
-  void EvictSomeUnlocked(
+  // Returns the number of bytes evicted.
+  int64_t EvictSomeUnlocked(
       int64_t stop_after_index,
       int64_t bytes_to_evict,
       bool force = false);
 
+  // Try to evict 'bytes_to_evict' bytes to get back under the memory limit,
+  // evicting the operations no healthy peer needs first. See
+  // SetPeerRetentionIndex().
+  void EvictForMemoryUnlocked(int64_t bytes_to_evict);
+
   // Update metrics and MemTracker to account for the removal of the
   // given message.
   void AccountForMessageRemovalUnlocked(const CacheEntry& entry);
@@ -300,6 +319,11 @@ class LogCache {
   // Protected by lock_.
   int64_t min_pinned_op_index_;
 
+  // The index of the first operation some healthy peer still needs, or
+  // int64_t max if unknown. See SetPeerRetentionIndex().
+  // Protected by lock_.
+  int64_t peer_retention_index_;
+
   // Pointer to a parent memtracker for all log caches. This
   // exists to compute server-wide cache size and enforce a
   // server-wide memory limit.  When the first instance of a log
@@ -18,6 +18,7 @@
 #include <cstdint>
 #include <string>
 
+#include <gflags/gflags_declare.h>
 #include <gtest/gtest.h>
 
 #include "kudu/consensus/log_index.h"
@@ -29,6 +30,8 @@
 #include "kudu/util/test_macros.h"
 #include "kudu/util/test_util.h"
 
+DECLARE_int64(log_index_tail_entries);
+
 namespace kudu::log {
 
 using consensus::MakeOpId;
@@ -116,6 +119,39 @@ TEST_F(LogIndexTest, TestMultiSegmentWithGC) {
   VerifyNotFound(2500000);
 }
 
+TEST_F(LogIndexTest, TestTail) {
+  FLAGS_log_index_tail_entries = 16;
+  index_ = new LogIndex(test_dir_);
+  ASSERT_OK(index_->Init());
+
+  // Most entries leave the tail, and are looked up in the chunk files.
+  for (int i = 1; i <= 1000; i++) {
+    ASSERT_OK(AddEntry(MakeOpId(1 + i / 100, i), 1 + i / 10, i * 100));
+  }
+  for (int i = 1; i <= 1000; i++) {
+    VerifyEntry(MakeOpId(1 + i / 100, i), 1 + i / 10, i * 100);
+  }
+
+  // Replace the last entries, as a truncation would.
+  ASSERT_OK(AddEntry(MakeOpId(20, 995), 200, 12345));
+  ASSERT_OK(AddEntry(MakeOpId(20, 996), 200, 23456));
+  VerifyEntry(MakeOpId(10, 994), 100, 99400);
+  VerifyEntry(MakeOpId(20, 995), 200, 12345);
+  VerifyEntry(MakeOpId(20, 996), 200, 23456);
+
+  // An offset too large for the tail goes straight to the chunk files.
+  const int64_t kLargeOffset = 1LL << 33;
+  ASSERT_OK(AddEntry(MakeOpId(20, 997), 200, kLargeOffset));
+  ASSERT_OK(AddEntry(MakeOpId(20, 998), 201, 100));
+  VerifyEntry(MakeOpId(20, 997), 200, kLargeOffset);
+  VerifyEntry(MakeOpId(20, 998), 201, 100);
+
+  // GC drops the tail's entries along with their chunks.
+  index_->GC(9000000);
+  VerifyNotFound(996);
+  VerifyNotFound(998);
+}
+
 TEST(LogIndexEntry, Comparison) {
   LogIndexEntry a;
   LogIndexEntry b;
@@ -25,6 +25,16 @@
 //
 // When the log is GCed, we remove any index chunks which are no longer needed,
 // and unmap them.
+//
+// In front of the chunk files sits the tail index, an in-memory ring of the
+// entries of the latest ops. As ops are appended in order, the entry of op
+// 'i' is at 'i % tail_capacity_', and the ring covers a contiguous range of
+// ops. An entry takes 12 bytes rather than 24: the term and segment are
+// stored relative to the tail's base term and segment, and the offset in
+// 32 bits. Entries which don't fit, or break the contiguity, start the tail
+// over. A flush writes the entries added since the previous one to the chunk
+// files; an entry only leaves the tail once it's flushed, so a lookup misses
+// the tail only for ops whose entries are in the chunk files.
 
 #include "kudu/consensus/log_index.h"
 
@@ -36,12 +46,15 @@
 #include <cinttypes>
 #include <cstdint>
 #include <cstring>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <ostream>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include "kudu/consensus/opid_util.h"
@@ -52,8 +65,11 @@
 #include "kudu/gutil/strings/substitute.h"
 #include "kudu/util/env.h"
 #include "kudu/util/errno.h"
+#include "kudu/util/flag_tags.h"
+#include "kudu/util/threadpool.h"
 
 using std::string;
+using std::unique_ptr;
 using std::vector;
 using strings::Substitute;
 
@@ -61,6 +77,20 @@ DEFINE_bool(
     uncache_unmapped_index,
     false,
     "Whether explicitly uncache log cache index file after the file is closed");
+DEFINE_int64(
+    log_index_tail_entries,
+    4096,
+    "Number of entries of the latest ops that each log index keeps in memory, "
+    "in front of its chunk files, at 12 bytes each. Looking up one of these "
+    "ops doesn't touch the chunk files, which are written in batches. 0 "
+    "disables the in-memory tail.");
+TAG_FLAG(log_index_tail_entries, advanced);
+DEFINE_int32(
+    log_index_flush_threads,
+    2,
+    "Number of threads of the pool, shared by all the log indexes of the "
+    "process, that writes the in-memory tails to the chunk files.");
+TAG_FLAG(log_index_flush_threads, advanced);
 METRIC_DEFINE_counter(
     server,
     log_index_chunk_mmap_for_read,
@@ -71,6 +101,27 @@ METRIC_DEFINE_counter(
 
 namespace kudu::log {
 
+namespace {
+
+// Returns the pool writing the tails of all the log indexes.
+Status GetFlushPool(ThreadPool** pool) {
+  static std::once_flag once;
+  static ThreadPool* flush_pool = nullptr;
+  static Status init_status;
+  std::call_once(once, []() {
+    unique_ptr<ThreadPool> new_pool;
+    init_status = ThreadPoolBuilder("log-index")
+                      .set_min_threads(0)
+                      .set_max_threads(FLAGS_log_index_flush_threads)
+                      .Build(&new_pool);
+    flush_pool = new_pool.release();
+  });
+  *pool = flush_pool;
+  return init_status;
+}
+
+} // anonymous namespace
+
 // The actual physical entry in the file.
 // This mirrors LogIndexEntry but uses simple primitives only so we can
 // read/write it via mmap.
@@ -218,9 +269,39 @@ bool LogIndex::IndexChunk::IsMmapped() const {
 ////////////////////////////////////////////////////////////
 
 LogIndex::LogIndex(std::string base_dir)
-    : base_dir_(std::move(base_dir)), mmap_for_reads_(nullptr) {}
+    : base_dir_(std::move(base_dir)),
+      mmap_for_reads_(nullptr),
+      tail_capacity_(std::max<int64_t>(FLAGS_log_index_tail_entries, 0)),
+      tail_first_index_(0),
+      tail_last_index_(-1),
+      tail_base_term_(0),
+      tail_base_segment_(0),
+      tail_flushed_index_(-1),
+      tail_epoch_(0),
+      flush_scheduled_(false) {
+  if (tail_capacity_ > 0) {
+    tail_.reset(new TailEntry[tail_capacity_]);
+  }
+}
 
-LogIndex::~LogIndex() = default;
+LogIndex::~LogIndex() {
+  if (flush_token_) {
+    flush_token_->Shutdown();
+  }
+  if (tail_) {
+    WARN_NOT_OK(FlushTail(), "Unable to flush the log index tail");
+  }
+}
+
+Status LogIndex::Init() {
+  if (!tail_ || flush_token_) {
+    return Status::OK();
+  }
+  ThreadPool* pool;
+  RETURN_NOT_OK(GetFlushPool(&pool));
+  flush_token_ = pool->NewToken(ThreadPool::ExecutionMode::SERIAL);
+  return Status::OK();
+}
 
 string LogIndex::GetChunkPath(int64_t chunk_idx) {
   return StringPrintf("%s/index.%09" PRId64, base_dir_.c_str(), chunk_idx);
@@ -414,6 +495,82 @@ Status LogIndex::GetChunkForIndex(
 }
 
 Status LogIndex::AddEntry(const LogIndexEntry& entry) {
+  if (!tail_) {
+    return WriteEntryToChunk(entry);
+  }
+
+  const int64_t index = entry.op_id.index();
+  std::unique_lock<simple_spinlock> l(tail_lock_);
+  if (index >= tail_first_index_ && index <= tail_last_index_) {
+    // The entries from 'index' on are replaced, e.g. after a truncation.
+    tail_last_index_ = index - 1;
+    tail_flushed_index_ = std::min(tail_flushed_index_, tail_last_index_);
+    tail_epoch_++;
+  }
+
+  if (index != tail_last_index_ + 1 || !FitsTailUnlocked(entry)) {
+    // Start the tail over from this entry, once the entries it holds are in
+    // the chunk files.
+    l.unlock();
+    RETURN_NOT_OK(FlushTail());
+    l.lock();
+    tail_first_index_ = index;
+    tail_last_index_ = index - 1;
+    tail_flushed_index_ = index - 1;
+    tail_base_term_ = entry.op_id.term();
+    tail_base_segment_ = entry.segment_sequence_number;
+    tail_epoch_++;
+    if (PREDICT_FALSE(!FitsTailUnlocked(entry))) {
+      // The offset doesn't fit in the tail. Leave it empty, expecting the
+      // next op.
+      tail_first_index_ = index + 1;
+      tail_last_index_ = index;
+      tail_flushed_index_ = index;
+      l.unlock();
+      return WriteEntryToChunk(entry);
+    }
+  }
+
+  if (tail_last_index_ - tail_first_index_ + 1 == tail_capacity_) {
+    // The oldest entry makes room, once it's in the chunk files.
+    if (tail_first_index_ > tail_flushed_index_) {
+      l.unlock();
+      RETURN_NOT_OK(FlushTail());
+      l.lock();
+    }
+    tail_first_index_++;
+  }
+
+  TailEntry* tail_entry = &tail_[index % tail_capacity_];
+  tail_entry->term_delta =
+      static_cast<uint32_t>(entry.op_id.term() - tail_base_term_);
+  tail_entry->segment_delta =
+      static_cast<uint32_t>(entry.segment_sequence_number - tail_base_segment_);
+  tail_entry->offset_in_segment =
+      static_cast<uint32_t>(entry.offset_in_segment);
+  tail_last_index_ = index;
+  VLOG(3) << "Added log index entry " << entry.ToString();
+
+  if (!flush_token_) {
+    l.unlock();
+    return FlushTail();
+  }
+  if (flush_scheduled_) {
+    return Status::OK();
+  }
+  flush_scheduled_ = true;
+  l.unlock();
+  Status s = flush_token_->SubmitFunc([this]() { FlushTailTask(); });
+  if (PREDICT_FALSE(!s.ok())) {
+    l.lock();
+    flush_scheduled_ = false;
+    l.unlock();
+    return FlushTail();
+  }
+  return Status::OK();
+}
+
+Status LogIndex::WriteEntryToChunk(const LogIndexEntry& entry) {
   scoped_refptr<IndexChunk> chunk;
   RETURN_NOT_OK(GetChunkForIndex(
       entry.op_id.index(), true /* create if not found */, &chunk));
@@ -441,6 +598,19 @@ Status LogIndex::AddEntry(const LogIndexEntry& entry) {
 }
 
 Status LogIndex::GetEntry(int64_t index, LogIndexEntry* entry) {
+  if (tail_) {
+    std::lock_guard<simple_spinlock> l(tail_lock_);
+    if (index >= tail_first_index_ && index <= tail_last_index_) {
+      const TailEntry& tail_entry = tail_[index % tail_capacity_];
+      entry->op_id =
+          consensus::MakeOpId(tail_base_term_ + tail_entry.term_delta, index);
+      entry->segment_sequence_number =
+          tail_base_segment_ + tail_entry.segment_delta;
+      entry->offset_in_segment = tail_entry.offset_in_segment;
+      return Status::OK();
+    }
+  }
+
   scoped_refptr<IndexChunk> chunk;
   RETURN_NOT_OK(GetChunkForIndex(index, false /* do not create */, &chunk));
   int index_in_chunk = index % kEntriesPerIndexChunk;
@@ -475,9 +645,79 @@ Status LogIndex::GetEntry(int64_t index, LogIndexEntry* entry) {
   return Status::OK();
 }
 
+bool LogIndex::FitsTailUnlocked(const LogIndexEntry& entry) const {
+  DCHECK(tail_lock_.is_locked());
+  const int64_t kMax = std::numeric_limits<uint32_t>::max();
+  const int64_t term_delta = entry.op_id.term() - tail_base_term_;
+  const int64_t segment_delta =
+      entry.segment_sequence_number - tail_base_segment_;
+  return term_delta >= 0 && term_delta <= kMax && segment_delta >= 0 &&
+      segment_delta <= kMax && entry.offset_in_segment >= 0 &&
+      entry.offset_in_segment <= kMax;
+}
+
+Status LogIndex::FlushTail() {
+  std::lock_guard<std::mutex> flush_lock(flush_lock_);
+  vector<LogIndexEntry> entries;
+  uint64_t epoch;
+  int64_t last_index;
+  {
+    std::lock_guard<simple_spinlock> l(tail_lock_);
+    last_index = tail_last_index_;
+    epoch = tail_epoch_;
+    for (int64_t index = std::max(tail_flushed_index_ + 1, tail_first_index_);
+         index <= last_index;
+         index++) {
+      const TailEntry& tail_entry = tail_[index % tail_capacity_];
+      LogIndexEntry entry;
+      entry.op_id =
+          consensus::MakeOpId(tail_base_term_ + tail_entry.term_delta, index);
+      entry.segment_sequence_number =
+          tail_base_segment_ + tail_entry.segment_delta;
+      entry.offset_in_segment = tail_entry.offset_in_segment;
+      entries.emplace_back(std::move(entry));
+    }
+  }
+
+  // Outside of the lock, so that lookups aren't held up by the IO.
+  for (const LogIndexEntry& entry : entries) {
+    RETURN_NOT_OK(WriteEntryToChunk(entry));
+  }
+
+  std::lock_guard<simple_spinlock> l(tail_lock_);
+  if (epoch == tail_epoch_) {
+    tail_flushed_index_ = std::max(tail_flushed_index_, last_index);
+  }
+  return Status::OK();
+}
+
+void LogIndex::FlushTailTask() {
+  while (true) {
+    Status s = FlushTail();
+    WARN_NOT_OK(s, "Unable to flush the log index tail");
+    std::lock_guard<simple_spinlock> l(tail_lock_);
+    // On failure, the entries are flushed again before leaving the tail, by
+    // the thread adding entries.
+    if (!s.ok() || tail_flushed_index_ >= tail_last_index_) {
+      flush_scheduled_ = false;
+      return;
+    }
+  }
+}
+
 void LogIndex::GC(int64_t min_index_to_retain) {
   int min_chunk_to_retain = min_index_to_retain / kEntriesPerIndexChunk;
 
+  if (tail_) {
+    // Flush first, so that no flush recreates a chunk file deleted below.
+    WARN_NOT_OK(FlushTail(), "Unable to flush the log index tail");
+    const int64_t min_index = min_chunk_to_retain * kEntriesPerIndexChunk;
+    std::lock_guard<simple_spinlock> l(tail_lock_);
+    if (tail_first_index_ < min_index) {
+      tail_first_index_ = std::min(min_index, tail_last_index_ + 1);
+    }
+  }
+
   // Enumerate which chunks to delete.
   vector<int64_t> chunks_to_delete;
   {
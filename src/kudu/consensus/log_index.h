@@ -19,6 +19,8 @@
 
 #include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "kudu/consensus/opid.pb.h"
@@ -30,6 +32,7 @@
 
 namespace kudu {
 class Env;
+class ThreadPoolToken;
 namespace log {
 
 // An entry in the index.
@@ -57,6 +60,13 @@ struct LogIndexEntry {
 // out, and never sync it to disk. Its only purpose is to allow random-reading
 // earlier entries from the log to serve to Raft followers.
 //
+// The entries of the latest ops are also kept in memory, in a compact "tail"
+// index (see --log_index_tail_entries), so that looking up a recent op is a
+// few array reads. Entries reach the chunk files in batches, off the thread
+// adding them once Init() is called, and before they leave the tail.
+//
+// Entries are expected to be added by a single thread, in log order.
+//
 // This class is thread-safe, but doesn't provide a memory barrier between
 // writers and readers. In other words, if a reader is expected to see an index
 // entry written by a writer, there should be some other synchronization between
@@ -67,6 +77,10 @@ class LogIndex : public RefCountedThreadSafe<LogIndex> {
  public:
   explicit LogIndex(std::string base_dir);
 
+  // Starts writing the tail's entries to the chunk files in the background.
+  // Until then, they're written as they're added.
+  Status Init();
+
   // Record an index entry in the index.
   Status AddEntry(const LogIndexEntry& entry);
 
@@ -102,6 +116,27 @@ class LogIndex : public RefCountedThreadSafe<LogIndex> {
 
   class IndexChunk;
 
+  // An entry of the tail index. Terms and segments are stored relative to
+  // the tail's base term and segment.
+  struct TailEntry {
+    uint32_t term_delta;
+    uint32_t segment_delta;
+    uint32_t offset_in_segment;
+  };
+
+  // Writes 'entry' to its chunk file.
+  Status WriteEntryToChunk(const LogIndexEntry& entry);
+
+  // Returns true if 'entry' can be encoded relative to the tail's base term
+  // and segment. Requires 'tail_lock_'.
+  bool FitsTailUnlocked(const LogIndexEntry& entry) const;
+
+  // Writes the entries of the tail that aren't in the chunk files yet.
+  Status FlushTail();
+
+  // Runs on 'flush_token_', flushing the tail until it's caught up.
+  void FlushTailTask();
+
   // Opens the file corresponding to 'chunk_idx' and inserts it into
   // 'open_chunks_'
   Status OpenAndInsertChunk(
@@ -190,6 +225,39 @@ class LogIndex : public RefCountedThreadSafe<LogIndex> {
   // dynamically for a read operation
   scoped_refptr<Counter> mmap_for_reads_;
 
+  // Capacity of the tail index, and the tail itself, a ring where the entry
+  // of op 'i' lives at 'i % tail_capacity_'. Null if the tail is disabled.
+  const int64_t tail_capacity_;
+  std::unique_ptr<TailEntry[]> tail_;
+
+  // Protects the members below.
+  mutable simple_spinlock tail_lock_;
+
+  // Range of ops in the tail. It's empty if 'tail_last_index_' is lower than
+  // 'tail_first_index_', and the next op is expected at
+  // 'tail_last_index_ + 1'.
+  int64_t tail_first_index_;
+  int64_t tail_last_index_;
+  int64_t tail_base_term_;
+  int64_t tail_base_segment_;
+
+  // Last op of the tail whose entry is in the chunk files.
+  int64_t tail_flushed_index_;
+
+  // Bumped whenever entries of the tail are replaced, so that a flush
+  // running concurrently doesn't count the replacements as flushed.
+  uint64_t tail_epoch_;
+
+  // Whether a FlushTailTask() is submitted to 'flush_token_'.
+  bool flush_scheduled_;
+
+  // Serializes FlushTail(), so that a chunk entry is never overwritten with
+  // an older one.
+  std::mutex flush_lock_;
+
+  // Token of the process-wide pool writing the tails to the chunk files.
+  std::unique_ptr<ThreadPoolToken> flush_token_;
+
   DISALLOW_COPY_AND_ASSIGN(LogIndex);
 };
 
@@ -49,7 +49,8 @@ METRIC_DEFINE_histogram(
     log_group_commit_latency,
     "Log Group Commit Latency",
     kudu::MetricUnit::kMicroseconds,
-    "Microseconds spent on committing an entire group",
+    "Microseconds spent on committing an entire group, from the start of its "
+    "append until the callbacks of its entries have run",
     60000000LU,
     2);
 
@@ -71,6 +72,45 @@ METRIC_DEFINE_histogram(
     1024,
     2);
 
+METRIC_DEFINE_counter(
+    server,
+    log_segments_deleted,
+    "Log Segments Deleted",
+    kudu::MetricUnit::kUnits,
+    "Number of GC'd log segments deleted since service start");
+
+METRIC_DEFINE_counter(
+    server,
+    log_segments_truncated,
+    "Log Segments Truncated Before Deletion",
+    kudu::MetricUnit::kUnits,
+    "Number of GC'd log segments truncated in steps before being deleted, "
+    "per --log_segment_delete_truncate_step_mb");
+
+METRIC_DEFINE_counter(
+    server,
+    log_segment_bytes_deleted,
+    "Log Segment Bytes Deleted",
+    kudu::MetricUnit::kBytes,
+    "Number of bytes of GC'd log segments deleted since service start");
+
+METRIC_DEFINE_histogram(
+    server,
+    log_segment_delete_latency,
+    "Log Segment Delete Latency",
+    kudu::MetricUnit::kMicroseconds,
+    "Microseconds spent on deleting a GC'd log segment file",
+    60000000LU,
+    2);
+
+METRIC_DEFINE_counter(
+    server,
+    log_segments_dropped_from_cache,
+    "Log Segments Dropped From Page Cache",
+    kudu::MetricUnit::kUnits,
+    "Number of log segments every peer had received that were advised out "
+    "of the page cache");
+
 namespace kudu::log {
 
 #define MINIT(x) x(METRIC_log_##x.Instantiate(metric_entity))
@@ -80,7 +120,12 @@ LogMetrics::LogMetrics(const scoped_refptr<MetricEntity>& metric_entity)
       MINIT(append_latency),
       MINIT(group_commit_latency),
       MINIT(roll_latency),
-      MINIT(entry_batches_per_group) {}
+      MINIT(entry_batches_per_group),
+      MINIT(segments_deleted),
+      MINIT(segments_truncated),
+      MINIT(segment_bytes_deleted),
+      MINIT(segment_delete_latency),
+      MINIT(segments_dropped_from_cache) {}
 #undef MINIT
 
 } // namespace kudu::log
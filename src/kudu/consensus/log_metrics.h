@@ -34,6 +34,13 @@ struct LogMetrics {
   scoped_refptr<Histogram> group_commit_latency;
   scoped_refptr<Histogram> roll_latency;
   scoped_refptr<Histogram> entry_batches_per_group;
+
+  // Housekeeping stats
+  scoped_refptr<Counter> segments_deleted;
+  scoped_refptr<Counter> segments_truncated;
+  scoped_refptr<Counter> segment_bytes_deleted;
+  scoped_refptr<Histogram> segment_delete_latency;
+  scoped_refptr<Counter> segments_dropped_from_cache;
 };
 
 } // namespace kudu::log
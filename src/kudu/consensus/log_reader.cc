@@ -22,12 +22,14 @@
 #include <mutex>
 #include <ostream>
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include "kudu/consensus/consensus.pb.h"
 #include "kudu/consensus/log.pb.h"
 #include "kudu/consensus/log_index.h"
 #include "kudu/consensus/opid.pb.h"
+#include "kudu/consensus/opid_util.h"
 #include "kudu/fs/fs_manager.h"
 #include "kudu/gutil/port.h"
 #include "kudu/gutil/stl_util.h"
@@ -35,10 +37,28 @@
 #include "kudu/gutil/strings/util.h"
 #include "kudu/util/env.h"
 #include "kudu/util/faststring.h"
+#include "kudu/util/flag_tags.h"
 #include "kudu/util/metrics.h"
 #include "kudu/util/path_util.h"
 #include "kudu/util/pb_util.h"
 
+DEFINE_bool(
+    log_prefetch_cold_segments,
+    false,
+    "Whether reading ops from a closed log segment, e.g. to catch up a "
+    "lagging peer, advises the kernel to read the rest of the segment into "
+    "the page cache in the background.");
+TAG_FLAG(log_prefetch_cold_segments, advanced);
+TAG_FLAG(log_prefetch_cold_segments, runtime);
+
+METRIC_DEFINE_counter(
+    server,
+    log_reader_segments_prefetched,
+    "Log Segments Prefetched",
+    kudu::MetricUnit::kUnits,
+    "Number of times a closed log segment was prefetched into the page cache "
+    "for reading ops from it");
+
 METRIC_DEFINE_counter(
     server,
     log_reader_bytes_read,
@@ -64,6 +84,7 @@ METRIC_DEFINE_histogram(
 
 using kudu::consensus::OpId;
 using kudu::consensus::ReplicateMsg;
+using kudu::consensus::ReplicateMsgSpaceUsed;
 using kudu::pb_util::SecureDebugString;
 using kudu::pb_util::SecureShortDebugString;
 using std::shared_ptr;
@@ -127,6 +148,8 @@ LogReader::LogReader(
       tablet_id_(std::move(tablet_id)),
       state_(kLogReaderInitialized) {
   if (metric_entity) {
+    segments_prefetched_ =
+        METRIC_log_reader_segments_prefetched.Instantiate(metric_entity);
     bytes_read_ = METRIC_log_reader_bytes_read.Instantiate(metric_entity);
     entries_read_ = METRIC_log_reader_entries_read.Instantiate(metric_entity);
     read_batch_latency_ =
@@ -271,7 +294,8 @@ scoped_refptr<ReadableLogSegment> LogReader::GetSegmentBySequenceNumber(
 Status LogReader::ReadBatchUsingIndexEntry(
     const LogIndexEntry& index_entry,
     faststring* tmp_buf,
-    unique_ptr<LogEntryBatchPB>* batch) const {
+    unique_ptr<LogEntryBatchPB>* batch,
+    bool read_ahead) const {
   const int64_t index = index_entry.op_id.index();
 
   scoped_refptr<ReadableLogSegment> segment =
@@ -285,6 +309,20 @@ Status LogReader::ReadBatchUsingIndexEntry(
 
   CHECK_GT(index_entry.offset_in_segment, 0);
   int64_t offset = index_entry.offset_in_segment;
+
+  // A closed segment is likely cold, and the reader likely to go on reading
+  // it, so prefetch it once rather than faulting it in a batch at a time.
+  if ((FLAGS_log_prefetch_cold_segments || read_ahead) &&
+      segment->HasFooter()) {
+    bool prefetched;
+    WARN_NOT_OK(
+        segment->PrefetchIntoPageCache(offset, &prefetched),
+        "Unable to prefetch log segment");
+    if (prefetched && segments_prefetched_) {
+      segments_prefetched_->Increment();
+    }
+  }
+
   ScopedLatencyMetric scoped(read_batch_latency_.get());
   EntryHeaderStatus unused_status_detail;
   RETURN_NOT_OK_PREPEND(
@@ -309,7 +347,8 @@ Status LogReader::ReadReplicatesInRange(
     int64_t starting_at,
     int64_t up_to,
     int64_t max_bytes_to_read,
-    vector<ReplicateMsg*>* replicates) const {
+    vector<ReplicateMsg*>* replicates,
+    bool read_ahead) const {
   DCHECK_GT(starting_at, 0);
   DCHECK_GE(up_to, starting_at);
   DCHECK(log_index_) << "Require an index to random-read logs";
@@ -337,7 +376,8 @@ Status LogReader::ReadReplicatesInRange(
         index_entry.segment_sequence_number !=
             prev_index_entry.segment_sequence_number ||
         index_entry.offset_in_segment != prev_index_entry.offset_in_segment) {
-      RETURN_NOT_OK(ReadBatchUsingIndexEntry(index_entry, &tmp_buf, &batch));
+      RETURN_NOT_OK(ReadBatchUsingIndexEntry(
+          index_entry, &tmp_buf, &batch, read_ahead));
 
       // Sanity-check the property that a batch should only have increasing
       // indexes.
@@ -367,7 +407,7 @@ Status LogReader::ReadReplicatesInRange(
         continue;
       }
 
-      int64_t space_required = entry->replicate().SpaceUsed();
+      int64_t space_required = ReplicateMsgSpaceUsed(entry->replicate());
       if (replicates_tmp.empty() || max_bytes_to_read <= 0 ||
           total_size + space_required < max_bytes_to_read) {
         total_size += space_required;
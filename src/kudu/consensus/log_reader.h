@@ -99,12 +99,16 @@ class LogReader : public enable_make_shared<LogReader> {
   // LogReader::kNoSizeLimit. If the size limit would prevent reading any
   // operations at all, then will read exactly one operation.
   //
+  // If 'read_ahead' is true, closed segments read from are prefetched into
+  // the page cache as with --log_prefetch_cold_segments.
+  //
   // Requires that a LogIndex was passed into LogReader::Open().
   Status ReadReplicatesInRange(
       int64_t starting_at,
       int64_t up_to,
       int64_t max_bytes_to_read,
-      std::vector<consensus::ReplicateMsg*>* replicates) const;
+      std::vector<consensus::ReplicateMsg*>* replicates,
+      bool read_ahead = false) const;
   static const int64_t kNoSizeLimit;
 
   // Look up the OpId for the given operation index.
@@ -171,10 +175,12 @@ class LogReader : public enable_make_shared<LogReader> {
 
   // Read the LogEntryBatchPB pointed to by the provided index entry.
   // 'tmp_buf' is used as scratch space to avoid extra allocation.
+  // See ReadReplicatesInRange() for 'read_ahead'.
   Status ReadBatchUsingIndexEntry(
       const LogIndexEntry& index_entry,
       faststring* tmp_buf,
-      std::unique_ptr<LogEntryBatchPB>* batch) const;
+      std::unique_ptr<LogEntryBatchPB>* batch,
+      bool read_ahead) const;
 
   // Reads the headers of all segments in 'tablet_wal_path'.
   Status Init(const std::string& tablet_wal_path);
@@ -188,6 +194,7 @@ class LogReader : public enable_make_shared<LogReader> {
   const std::string tablet_id_;
 
   // Metrics
+  scoped_refptr<Counter> segments_prefetched_;
   scoped_refptr<Counter> bytes_read_;
   scoped_refptr<Counter> entries_read_;
   scoped_refptr<Histogram> read_batch_latency_;
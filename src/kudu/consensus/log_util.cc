@@ -17,7 +17,12 @@
 
 #include "kudu/consensus/log_util.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <memory>
@@ -29,6 +34,7 @@
 #include "kudu/consensus/opid_util.h"
 #include "kudu/consensus/ref_counted_replicate.h"
 #include "kudu/fs/fs_manager.h"
+#include "kudu/gutil/macros.h"
 #include "kudu/gutil/port.h"
 #include "kudu/gutil/strings/split.h"
 #include "kudu/gutil/strings/substitute.h"
@@ -38,13 +44,16 @@
 #include "kudu/util/coding.h"
 #include "kudu/util/compression/compression.pb.h"
 #include "kudu/util/compression/compression_codec.h"
+#include "kudu/util/condition_variable.h"
 #include "kudu/util/crc.h"
 #include "kudu/util/debug/trace_event.h"
 #include "kudu/util/env_util.h"
+#include "kudu/util/errno.h"
 #include "kudu/util/fault_injection.h"
 #include "kudu/util/flag_tags.h"
 #include "kudu/util/logging.h"
 #include "kudu/util/pb_util.h"
+#include "kudu/util/random.h"
 
 DEFINE_int32(
     log_segment_size_mb,
@@ -113,7 +122,10 @@ LogOptions::LogOptions()
     : segment_size_mb(FLAGS_log_segment_size_mb),
       force_fsync_all(FLAGS_log_force_fsync_all),
       preallocate_segments(FLAGS_log_preallocate_segments),
-      async_preallocate_segments(FLAGS_log_async_preallocate_segments) {}
+      async_preallocate_segments(FLAGS_log_async_preallocate_segments),
+      append_pool(nullptr),
+      sync_pool(nullptr),
+      sync_coalescer(nullptr) {}
 
 ////////////////////////////////////////////////////////////
 // LogEntryReader
@@ -307,7 +319,8 @@ ReadableLogSegment::ReadableLogSegment(
       readable_file_(std::move(readable_file)),
       codec_(nullptr),
       is_initialized_(false),
-      footer_was_rebuilt_(false) {}
+      footer_was_rebuilt_(false),
+      prefetched_(false) {}
 
 Status ReadableLogSegment::Init(
     const LogSegmentHeaderPB& header,
@@ -433,6 +446,45 @@ Status ReadableLogSegment::RebuildFooterByScanning() {
   return Status::OK();
 }
 
+namespace {
+// Applies posix_fadvise() 'advice' to the file at 'path', from 'offset' to
+// the end of the file. The page cache is per file rather than per
+// descriptor, so a descriptor of our own will do.
+Status AdviseFile(const string& path, int64_t offset, int advice) {
+  int fd;
+  RETRY_ON_EINTR(fd, open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd < 0) {
+    int err = errno;
+    return Status::IOError(
+        Substitute("Unable to open $0", path), ErrnoToString(err), err);
+  }
+  int rc = posix_fadvise(fd, offset, 0, advice);
+  int ret;
+  RETRY_ON_EINTR(ret, close(fd));
+  if (rc != 0) {
+    return Status::IOError(
+        Substitute("Unable to fadvise $0", path), ErrnoToString(rc), rc);
+  }
+  return Status::OK();
+}
+} // anonymous namespace
+
+Status ReadableLogSegment::DropFromPageCache() const {
+  RETURN_NOT_OK(AdviseFile(path_, 0, POSIX_FADV_DONTNEED));
+  prefetched_.Store(false);
+  return Status::OK();
+}
+
+Status ReadableLogSegment::PrefetchIntoPageCache(
+    int64_t offset,
+    bool* prefetched) const {
+  *prefetched = prefetched_.CompareAndSet(false, true);
+  if (!*prefetched) {
+    return Status::OK();
+  }
+  return AdviseFile(path_, offset, POSIX_FADV_WILLNEED);
+}
+
 Status ReadableLogSegment::ReadFileSize() {
   // Check the size of the file.
   // Env uses uint here, even though we generally prefer signed ints to avoid
@@ -839,6 +891,111 @@ WritableLogSegment::WritableLogSegment(
       is_footer_written_(false),
       written_offset_(0) {}
 
+namespace {
+// Filler batches carry their padding in this field, which LogEntryBatchPB
+// doesn't define, so that readers parse them as batches without entries.
+const uint32_t kFillerFieldNumber = 15;
+
+// Maximum number of attempts at finding a filler batch of a given size.
+const int kMaxFillerAttempts = 32;
+
+// Encodes the header of an entry batch whose data is 'data', and which takes
+// 'uncompressed_len' bytes once uncompressed.
+void EncodeEntryHeader(
+    const Slice& data,
+    uint32_t uncompressed_len,
+    uint8_t* header_buf) {
+  InlineEncodeFixed32(&header_buf[0], data.size());
+  InlineEncodeFixed32(&header_buf[4], uncompressed_len);
+  InlineEncodeFixed32(&header_buf[8], crc::Crc32c(data.data(), data.size()));
+  InlineEncodeFixed32(
+      &header_buf[12], crc::Crc32c(&header_buf[0], kEntryHeaderSizeV2 - 4));
+}
+
+// Serializes to 'buf' a batch without entries, with 'padding_len' bytes of
+// padding. The padding doesn't compress, so that the size of the compressed
+// batch follows 'padding_len'.
+void SerializeFillerBatch(size_t padding_len, faststring* buf) {
+  buf->clear();
+  PutVarint32(buf, (kFillerFieldNumber << 3) | 2);
+  PutVarint32(buf, padding_len);
+  Random rng(padding_len);
+  for (size_t i = 0; i < padding_len; i++) {
+    buf->push_back(static_cast<uint8_t>(rng.Next()));
+  }
+}
+
+// Writes to 'buf' an entry batch without entries whose header and data take
+// exactly 'len' bytes, compressed with 'codec' if it isn't null. Returns false
+// if there is no such batch, e.g. because 'len' is too small, or if none was
+// found.
+bool BuildFillerBatch(
+    size_t len,
+    CompressionCodec* codec,
+    faststring* buf,
+    faststring* scratch) {
+  if (len < kEntryHeaderSizeV2 + 2) {
+    return false;
+  }
+  const int64_t target = len - kEntryHeaderSizeV2;
+  // Start from the padding that would fill an uncompressed batch, and adjust
+  // it by how far the compressed batch is from the target.
+  int64_t padding = target - 2;
+  for (int i = 0; i < kMaxFillerAttempts && padding >= 0; i++) {
+    SerializeFillerBatch(padding, scratch);
+    Slice data(*scratch);
+    const uint32_t uncompressed_len = scratch->size();
+    if (codec) {
+      buf->resize(kEntryHeaderSizeV2 + codec->MaxCompressedLength(data.size()));
+      size_t compressed_len;
+      Status s = codec->Compress(
+          data, buf->data() + kEntryHeaderSizeV2, &compressed_len);
+      if (!s.ok()) {
+        return false;
+      }
+      buf->resize(kEntryHeaderSizeV2 + compressed_len);
+      data = Slice(buf->data() + kEntryHeaderSizeV2, compressed_len);
+    } else {
+      buf->resize(kEntryHeaderSizeV2);
+      buf->append(data.data(), data.size());
+      data = Slice(buf->data() + kEntryHeaderSizeV2, data.size());
+    }
+    const int64_t diff = target - static_cast<int64_t>(data.size());
+    if (diff == 0) {
+      EncodeEntryHeader(data, uncompressed_len, buf->data());
+      return true;
+    }
+    // Varint lengths and compression framing don't always grow by one byte
+    // with the padding, so step by one once close to the target.
+    padding += std::abs(diff) > 1 ? diff : (diff > 0 ? 1 : -1);
+  }
+  return false;
+}
+} // anonymous namespace
+
+void WritableLogSegment::BuildFiller(
+    int64_t offset,
+    CompressionCodec* codec) {
+  filler_buf_.clear();
+  const size_t alignment = writable_file_->direct_io_alignment();
+  if (alignment == 0 || offset % alignment == 0) {
+    return;
+  }
+  // A filler can't be arbitrarily small, so it may have to take up the next
+  // block too.
+  size_t len = alignment - offset % alignment;
+  for (int i = 0; i < 3; i++, len += alignment) {
+    if (BuildFillerBatch(len, codec, &filler_buf_, &filler_scratch_)) {
+      return;
+    }
+  }
+  filler_buf_.clear();
+  KLOG_EVERY_N_SECS(WARNING, 60)
+      << "Could not pad log segment " << path_ << " at offset " << offset
+      << " to a block boundary; the next append will rewrite its last block"
+      << THROTTLE_MSG;
+}
+
 Status WritableLogSegment::WriteHeaderAndOpen(
     const LogSegmentHeaderPB& new_header) {
   MAYBE_FAULT(FLAGS_fault_crash_before_write_log_segment_header);
@@ -854,11 +1011,21 @@ Status WritableLogSegment::WriteHeaderAndOpen(
   PutFixed32(&buf, new_header.ByteSize());
   // Then Serialize the PB.
   pb_util::AppendToString(new_header, &buf);
-  RETURN_NOT_OK(writable_file()->Append(Slice(buf)));
+
+  // With direct I/O, pad the header to a block boundary, so that appending
+  // the first entries doesn't rewrite it.
+  shared_ptr<CompressionCodec> codec;
+  if (new_header.compression_codec() != NO_COMPRESSION) {
+    RETURN_NOT_OK(CompressionCodecManager::GetCodec(
+        new_header.compression_codec(), &codec));
+  }
+  BuildFiller(buf.size(), codec.get());
+  Slice slices[2] = {Slice(buf), Slice(filler_buf_)};
+  RETURN_NOT_OK(writable_file()->AppendV(slices));
 
   header_.CopyFrom(new_header);
   first_entry_offset_ = buf.size();
-  written_offset_ = first_entry_offset_;
+  written_offset_ = first_entry_offset_ + filler_buf_.size();
   is_header_written_ = true;
 
   return Status::OK();
@@ -912,17 +1079,22 @@ Status WritableLogSegment::WriteEntryBatch(
   }
 
   // Fill in the header.
-  InlineEncodeFixed32(&header_buf[0], data_to_write.size());
-  InlineEncodeFixed32(&header_buf[4], uncompressed_len);
-  InlineEncodeFixed32(
-      &header_buf[8], crc::Crc32c(data_to_write.data(), data_to_write.size()));
-  InlineEncodeFixed32(
-      &header_buf[12], crc::Crc32c(&header_buf[0], kEntryHeaderSizeV2 - 4));
+  EncodeEntryHeader(data_to_write, uncompressed_len, header_buf);
+
+  // With direct I/O, a filler batch pads the batch to a block boundary, so
+  // that the next append doesn't rewrite a block that may already be synced:
+  // a torn write of that block could damage acknowledged entries.
+  const int64_t end =
+      written_offset_ + arraysize(header_buf) + data_to_write.size();
+  BuildFiller(end, codec.get());
 
   // Write the header to the file, followed by the batch data itself.
-  Slice slices[2] = {Slice(header_buf, arraysize(header_buf)), data_to_write};
+  Slice slices[3] = {
+      Slice(header_buf, arraysize(header_buf)),
+      data_to_write,
+      Slice(filler_buf_)};
   RETURN_NOT_OK(writable_file_->AppendV(slices));
-  written_offset_ += arraysize(header_buf) + data_to_write.size();
+  written_offset_ = end + filler_buf_.size();
   return Status::OK();
 }
 
@@ -933,11 +1105,90 @@ unique_ptr<LogEntryBatchPB> CreateBatchFromAllocatedOperations(
   for (const auto& msg : msgs) {
     LogEntryPB* entry_pb = entry_batch->add_entry();
     entry_pb->set_type(log::REPLICATE);
-    entry_pb->set_allocated_replicate(msg->get());
+    entry_pb->unsafe_arena_set_allocated_replicate(msg->get());
   }
   return entry_batch;
 }
 
+Status WritableLogSegment::SyncWith(
+    LogSyncCoalescer* coalescer,
+    uint64_t fs_id) {
+  return coalescer->Sync(fs_id, writable_file_.get());
+}
+
+// A call to LogSyncCoalescer::Sync() waiting for its file to be synced.
+struct LogSyncCoalescer::Waiter {
+  explicit Waiter(WritableFile* file) : file(file), done(false) {}
+
+  WritableFile* const file;
+  Status status;
+  bool done;
+};
+
+// The rounds of syncs of the files on one filesystem.
+struct LogSyncCoalescer::FileSystem {
+  explicit FileSystem(Mutex* lock) : cond(lock), round_in_flight(false) {}
+
+  ConditionVariable cond;
+
+  // Whether a round is in flight, and the calls waiting for the next one.
+  bool round_in_flight;
+  std::vector<Waiter*> next_round;
+};
+
+LogSyncCoalescer::LogSyncCoalescer() : num_syncs_(0), num_rounds_(0) {}
+
+LogSyncCoalescer::~LogSyncCoalescer() = default;
+
+Status LogSyncCoalescer::Sync(uint64_t fs_id, WritableFile* file) {
+  MutexLock l(lock_);
+  num_syncs_++;
+  auto& fs = file_systems_[fs_id];
+  if (!fs) {
+    fs.reset(new FileSystem(&lock_));
+  }
+  Waiter waiter(file);
+  fs->next_round.push_back(&waiter);
+  // Wait for the round in flight, if any, to finish: the first caller to get
+  // to run after that leads the next round, and the others of that round
+  // wait for it to finish too.
+  while (!waiter.done && fs->round_in_flight) {
+    fs->cond.Wait();
+  }
+  if (waiter.done) {
+    return waiter.status;
+  }
+
+  fs->round_in_flight = true;
+  vector<Waiter*> round;
+  round.swap(fs->next_round);
+  l.Unlock();
+  // A file syncing again before its earlier sync returned appears more than
+  // once, but syncing it again is cheap: there's nothing left to sync unless
+  // the earlier sync failed.
+  for (Waiter* w : round) {
+    w->status = w->file->Sync();
+  }
+  l.Lock();
+  for (Waiter* w : round) {
+    w->done = true;
+  }
+  fs->round_in_flight = false;
+  num_rounds_++;
+  fs->cond.Broadcast();
+  return waiter.status;
+}
+
+int64_t LogSyncCoalescer::num_syncs() const {
+  MutexLock l(lock_);
+  return num_syncs_;
+}
+
+int64_t LogSyncCoalescer::num_rounds() const {
+  MutexLock l(lock_);
+  return num_rounds_;
+}
+
 bool IsLogFileName(const string& fname) {
   if (HasPrefixString(fname, ".")) {
     // Hidden file or ./..
@@ -967,6 +1218,24 @@ void UpdateFooterForReplicateEntry(
       index > footer->max_replicate_index()) {
     footer->set_max_replicate_index(index);
   }
+  const unsigned int dict_id = GetPayloadDictionaryID(entry_pb.replicate());
+  if (dict_id != 0 &&
+      std::find(
+          footer->compression_dict_ids().begin(),
+          footer->compression_dict_ids().end(),
+          dict_id) == footer->compression_dict_ids().end()) {
+    footer->add_compression_dict_ids(dict_id);
+  }
+}
+
+unsigned int GetPayloadDictionaryID(const consensus::ReplicateMsg& msg) {
+  if (!msg.has_write_payload() ||
+      msg.write_payload().compression_codec() == NO_COMPRESSION) {
+    return 0;
+  }
+  return CompressionCodecManager::GetFrameDictionaryID(
+      msg.write_payload().compression_codec(),
+      Slice(msg.write_payload().payload()));
 }
 
 } // namespace kudu::log
@@ -22,6 +22,7 @@
 #include <deque>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <gflags/gflags_declare.h>
@@ -36,6 +37,7 @@
 #include "kudu/util/atomic.h"
 #include "kudu/util/env.h"
 #include "kudu/util/faststring.h"
+#include "kudu/util/mutex.h"
 #include "kudu/util/slice.h"
 #include "kudu/util/status.h"
 
@@ -45,10 +47,12 @@ DECLARE_bool(log_force_fsync_all);
 namespace kudu {
 
 class CompressionCodec;
+class ThreadPool;
 
 namespace log {
 
 class LogFactory;
+class LogSyncCoalescer;
 
 // Each log entry is prefixed by a header. See DecodeEntryHeader()
 // implementation for details.
@@ -75,6 +79,16 @@ struct LogOptions {
 
   std::shared_ptr<LogFactory> log_factory;
 
+  // Pools to run the log's append and sync tasks on, through a serial token
+  // each. If null, the log gets a thread of its own for each. Sharing them
+  // lets a server hosting many raft groups run their logs on a few threads.
+  ThreadPool* append_pool;
+  ThreadPool* sync_pool;
+
+  // If set, the log syncs together with the other logs sharing it, rather
+  // than on its own. See LogSyncCoalescer.
+  LogSyncCoalescer* sync_coalescer;
+
   LogOptions();
 };
 
@@ -219,6 +233,16 @@ class ReadableLogSegment : public RefCountedThreadSafe<ReadableLogSegment> {
   // missing because we didn't have the time to write it out.
   Status RebuildFooterByScanning();
 
+  // Advises the kernel that the segment's pages won't be needed soon, so that
+  // they may leave the page cache. Pages that aren't written back yet stay.
+  // The segment may be prefetched again afterwards.
+  Status DropFromPageCache() const;
+
+  // Advises the kernel to read the segment from 'offset' on into the page
+  // cache, in the background, unless it was already prefetched since it was
+  // last dropped from the cache. Sets 'prefetched' to whether it was.
+  Status PrefetchIntoPageCache(int64_t offset, bool* prefetched) const;
+
   bool IsInitialized() const {
     return is_initialized_;
   }
@@ -409,6 +433,10 @@ class ReadableLogSegment : public RefCountedThreadSafe<ReadableLogSegment> {
   // True if the footer was rebuilt, rather than actually found on disk.
   bool footer_was_rebuilt_;
 
+  // Whether the segment was prefetched into the page cache. Shared by all the
+  // readers of the segment, so that it's only prefetched once.
+  mutable AtomicBool prefetched_;
+
   // the offset of the first entry in the log
   int64_t first_entry_offset_;
 
@@ -437,6 +465,11 @@ class WritableLogSegment {
     return writable_file_->Size();
   }
 
+  // See WritableFile::direct_io_alignment().
+  size_t direct_io_alignment() const {
+    return writable_file_->direct_io_alignment();
+  }
+
   // Appends the provided batch of data, including a header
   // and checksum. If 'codec' is not NULL, compresses the batch.
   // Makes sure that the log segment has not been closed.
@@ -450,6 +483,17 @@ class WritableLogSegment {
     return writable_file_->Sync();
   }
 
+  // Like Sync(), but syncs together with the other logs syncing through
+  // 'coalescer'. 'fs_id' identifies the filesystem the segment resides on. See
+  // LogSyncCoalescer::Sync().
+  Status SyncWith(LogSyncCoalescer* coalescer, uint64_t fs_id);
+
+  // Like Sync(), but 'cb' is invoked once the sync completes, possibly on
+  // another thread. See WritableFile::SyncAsync().
+  void SyncAsync(const StdStatusCallback& cb) {
+    writable_file_->SyncAsync(cb);
+  }
+
   // Returns true if the segment header has already been written to disk.
   bool IsHeaderWritten() const {
     return is_header_written_;
@@ -487,6 +531,12 @@ class WritableLogSegment {
     return writable_file_;
   }
 
+  // If the file is written with direct I/O and 'offset' isn't on a block
+  // boundary, builds in 'filler_buf_' an entry batch without entries which
+  // pads the segment from 'offset' to a block boundary. Leaves 'filler_buf_'
+  // empty otherwise. 'codec' is the codec of the segment's batches, if any.
+  void BuildFiller(int64_t offset, CompressionCodec* codec);
+
   // The path to the log file.
   const std::string path_;
 
@@ -510,9 +560,51 @@ class WritableLogSegment {
   // Buffer used for output when compressing.
   faststring compress_buf_;
 
+  // Filler batch appended after the header or an entry batch when the file
+  // is written with direct I/O, and scratch space used to build it.
+  faststring filler_buf_;
+  faststring filler_scratch_;
+
   DISALLOW_COPY_AND_ASSIGN(WritableLogSegment);
 };
 
+// Syncs the logs of many raft rings together, e.g. those of all the rings
+// hosted by a server. Syncs through the coalescer go in rounds, one round at
+// a time per filesystem: the logs on a filesystem that sync while a round is
+// in flight there all join the next one. One of them then syncs the segment
+// of every log in the round, back to back, while the others wait for it.
+// Rather than one thread per ring waking up to issue a sync, the filesystem
+// sees a burst of syncs from a single thread, which its journal can commit
+// together.
+class LogSyncCoalescer {
+ public:
+  LogSyncCoalescer();
+  ~LogSyncCoalescer();
+
+  // Syncs 'file', which resides on the filesystem identified by 'fs_id' (see
+  // Env::GetFileSystemId()), together with the other files of its round.
+  // Returns the status of the sync of 'file'.
+  Status Sync(uint64_t fs_id, WritableFile* file);
+
+  // The number of calls to Sync() and of rounds so far.
+  int64_t num_syncs() const;
+  int64_t num_rounds() const;
+
+ private:
+  struct Waiter;
+  struct FileSystem;
+
+  mutable Mutex lock_;
+
+  // Keyed by filesystem id. Never shrinks: there are few filesystems.
+  std::unordered_map<uint64_t, std::unique_ptr<FileSystem>> file_systems_;
+
+  int64_t num_syncs_;
+  int64_t num_rounds_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogSyncCoalescer);
+};
+
 // Return a newly created batch that contains the pre-allocated
 // ReplicateMsgs in 'msgs'.
 std::unique_ptr<LogEntryBatchPB> CreateBatchFromAllocatedOperations(
@@ -522,10 +614,15 @@ std::unique_ptr<LogEntryBatchPB> CreateBatchFromAllocatedOperations(
 bool IsLogFileName(const std::string& fname);
 
 // Update 'footer' to reflect the given REPLICATE message 'entry_pb'.
-// In particular, updates the min/max seen replicate OpID.
+// In particular, updates the min/max seen replicate OpID and the ids of the
+// compression dictionaries the payloads were compressed with.
 void UpdateFooterForReplicateEntry(
     const LogEntryPB& entry_pb,
     LogSegmentFooterPB* footer);
 
+// Returns the id of the compression dictionary the payload of 'msg' was
+// compressed with, or 0 if it wasn't compressed with a dictionary.
+unsigned int GetPayloadDictionaryID(const consensus::ReplicateMsg& msg);
+
 } // namespace log
 } // namespace kudu
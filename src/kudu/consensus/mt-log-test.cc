@@ -28,6 +28,7 @@
 #include <memory>
 #include <mutex>
 #include <ostream>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -54,7 +55,9 @@
 #include "kudu/gutil/strings/substitute.h"
 // #include "kudu/tserver/tserver.pb.h"
 #include "kudu/util/countdown_latch.h"
+#include "kudu/util/env.h"
 #include "kudu/util/fault_injection.h"
+#include "kudu/util/hdr_histogram.h"
 #include "kudu/util/locks.h"
 #include "kudu/util/metrics.h"
 #include "kudu/util/random.h"
@@ -82,6 +85,16 @@ DEFINE_bool(
 
 DECLARE_int32(log_thread_idle_threshold_ms);
 DECLARE_int32(log_inject_thread_lifecycle_latency_ms);
+DECLARE_bool(log_use_io_uring);
+DECLARE_bool(log_use_direct_io);
+
+DEFINE_int32(
+    page_cache_pressure_mb,
+    0,
+    "Size of the file that TestDirectIOCommitLatency keeps rewriting through "
+    "the page cache while appending, to put pressure on the page cache");
+
+METRIC_DECLARE_histogram(log_sync_latency);
 
 namespace kudu {
 namespace log {
@@ -92,6 +105,8 @@ using consensus::ReplicateMsg;
 using consensus::ReplicateRefPtr;
 using consensus::WRITE_OP;
 using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
 using std::vector;
 
 namespace {
@@ -242,7 +257,7 @@ class MultiThreadedLogTest : public LogTestBase {
     ASSERT_TRUE(std::is_sorted(ids.begin(), ids.end()));
   }
 
- private:
+ protected:
   ThreadSafeRandom random_;
   simple_spinlock lock_;
   vector<scoped_refptr<kudu::Thread>> threads_;
@@ -271,6 +286,82 @@ TEST_F(MultiThreadedLogTest, TestAppends) {
   }
 }
 
+// Compares fsync-bound append throughput with and without io_uring syncs, which
+// let the appender write the next group while the previous one is being synced.
+TEST_F(MultiThreadedLogTest, TestFsyncThroughput) {
+  SKIP_IF_SLOW_NOT_ALLOWED();
+  options_.force_fsync_all = true;
+  for (bool use_io_uring : {false, true}) {
+    for (int num_writers : {1, 4, 16}) {
+      FLAGS_log_use_io_uring = use_io_uring;
+      FLAGS_num_writer_threads = num_writers;
+      ASSERT_OK(BuildLog());
+      Stopwatch sw;
+      sw.start();
+      ASSERT_NO_FATAL_FAILURE(Run());
+      sw.stop();
+      ASSERT_OK(log_->Close());
+      int64_t num_batches = num_writers * FLAGS_num_batches_per_thread;
+      LOG(INFO) << strings::Substitute(
+          "io_uring=$0 writers=$1: $2 batches/sec",
+          use_io_uring,
+          num_writers,
+          num_batches / sw.elapsed().wall_seconds());
+      threads_.clear();
+      current_index_ = kStartIndex;
+      ASSERT_OK(
+          env_->DeleteRecursively(fs_manager_->GetTabletWalDir(kTestTablet)));
+    }
+  }
+}
+
+// Reports the p99 latency of fsync-bound appends with and without direct I/O,
+// optionally while another thread dirties the page cache.
+TEST_F(MultiThreadedLogTest, TestDirectIOCommitLatency) {
+  SKIP_IF_SLOW_NOT_ALLOWED();
+  options_.force_fsync_all = true;
+  std::atomic<bool> stop_dirtier(false);
+  std::thread dirtier;
+  if (FLAGS_page_cache_pressure_mb > 0) {
+    dirtier = std::thread([&]() {
+      const string path = GetTestPath("page_cache_pressure");
+      const string chunk(1024 * 1024, 'x');
+      while (!stop_dirtier) {
+        unique_ptr<WritableFile> file;
+        CHECK_OK(env_->NewWritableFile(path, &file));
+        for (int i = 0; i < FLAGS_page_cache_pressure_mb && !stop_dirtier;
+             i++) {
+          CHECK_OK(file->Append(chunk));
+        }
+        CHECK_OK(file->Close());
+      }
+    });
+  }
+  for (bool use_direct_io : {false, true}) {
+    FLAGS_log_use_direct_io = use_direct_io;
+    ASSERT_OK(BuildLog());
+    ASSERT_NO_FATAL_FAILURE(Run());
+    ASSERT_OK(log_->Close());
+    scoped_refptr<Histogram> latency = METRIC_log_sync_latency.Instantiate(
+        metric_entity_);
+    LOG(INFO) << strings::Substitute(
+        "direct_io=$0: p99 sync latency $1us",
+        use_direct_io,
+        latency->histogram()->ValueAtPercentile(99));
+    threads_.clear();
+    current_index_ = kStartIndex;
+    ASSERT_OK(
+        env_->DeleteRecursively(fs_manager_->GetTabletWalDir(kTestTablet)));
+    metric_registry_.reset(new MetricRegistry());
+    metric_entity_ = METRIC_ENTITY_server.Instantiate(
+        metric_registry_.get(), "mt-log-test");
+  }
+  stop_dirtier = true;
+  if (dirtier.joinable()) {
+    dirtier.join();
+  }
+}
+
 // The lifecycle of the appender task starting and stopping is a bit complicated
 // (see Log::AppendThread::GoIdle for details). This injects some latency in key
 // points of that lifecycle to ensure that the different potential interleavings
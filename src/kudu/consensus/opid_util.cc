@@ -18,6 +18,7 @@
 #include "kudu/consensus/opid_util.h"
 
 #include <limits>
+#include <string>
 #include <utility>
 
 #include <glog/logging.h>
@@ -187,4 +188,43 @@ OpId MakeOpId(int64_t term, int64_t index) {
   return ret;
 }
 
+namespace {
+// The memory used by a set string field, as protobuf accounts for it: the
+// string object, plus its buffer unless it's stored inline.
+int64_t StringSpaceUsed(const std::string& str) {
+  const char* start = reinterpret_cast<const char*>(&str);
+  const char* end = start + sizeof(str);
+  int64_t size = sizeof(str);
+  if (str.data() < start || str.data() >= end) {
+    size += str.capacity();
+  }
+  return size;
+}
+} // anonymous namespace
+
+int64_t ReplicateMsgSpaceUsed(const ReplicateMsg& msg) {
+  if (PREDICT_FALSE(
+          msg.has_change_config_record() || msg.has_proxy_record() ||
+          msg.has_request_id() || !msg.unknown_fields().empty())) {
+    return static_cast<int64_t>(msg.SpaceUsedLong());
+  }
+  int64_t size = sizeof(ReplicateMsg);
+  if (msg.has_id()) {
+    size += sizeof(OpId);
+  }
+  if (msg.has_write_payload()) {
+    size += sizeof(WritePayloadPB);
+    if (msg.write_payload().has_payload()) {
+      size += StringSpaceUsed(msg.write_payload().payload());
+    }
+  }
+  if (msg.has_noop_request()) {
+    size += sizeof(NoOpRequestPB);
+    if (msg.noop_request().has_payload_for_tests()) {
+      size += StringSpaceUsed(msg.noop_request().payload_for_tests());
+    }
+  }
+  return size;
+}
+
 } // namespace kudu::consensus
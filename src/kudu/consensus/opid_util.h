@@ -26,6 +26,7 @@ namespace kudu::consensus {
 
 class ConsensusRequestPB;
 class OpId;
+class ReplicateMsg;
 
 // Minimum possible term.
 extern const int64_t kMinimumTerm;
@@ -108,4 +109,10 @@ std::string OpsRangeString(const ConsensusRequestPB& req);
 
 OpId MakeOpId(int64_t term, int64_t index);
 
+// Returns the memory used by 'msg', as ReplicateMsg::SpaceUsedLong() would,
+// but derived from the fields replicated ops normally carry (op id, write
+// payload, no-op request) rather than by walking every field through
+// reflection. Messages with other fields set fall back to SpaceUsedLong().
+int64_t ReplicateMsgSpaceUsed(const ReplicateMsg& msg);
+
 } // namespace kudu::consensus
@@ -22,19 +22,37 @@
 #include <ostream>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include "kudu/consensus/consensus_peers.h"
+#include "kudu/consensus/consensus_queue.h"
 #include "kudu/consensus/log.h"
 #include "kudu/consensus/metadata.pb.h"
 #include "kudu/gutil/map-util.h"
 #include "kudu/gutil/port.h"
 #include "kudu/gutil/strings/substitute.h"
+#include "kudu/util/flag_tags.h"
 #include "kudu/util/pb_util.h"
+#include "kudu/util/threadpool.h"
+
+DEFINE_bool(
+    raft_fan_out_requests_in_one_task,
+    false,
+    "Whether the leader builds the requests signaled to all of its peers in a "
+    "single raft pool task, rather than in one task per peer. Each request is "
+    "handed to the reactor of its peer's connection as soon as it's built. "
+    "This saves thread wakeups, and contention on the queue's lock between "
+    "raft pool threads, when there are many peers.");
+TAG_FLAG(raft_fan_out_requests_in_one_task, experimental);
+TAG_FLAG(raft_fan_out_requests_in_one_task, runtime);
 
 using kudu::pb_util::SecureShortDebugString;
 using std::shared_ptr;
+using std::vector;
+using std::weak_ptr;
 using strings::Substitute;
 
 namespace kudu::consensus {
@@ -98,12 +116,19 @@ void PeerManager::SignalRequest(
     bool is_leader_lease_revoke,
     ReplicateRefPtr latest_appended_replicate) {
   std::lock_guard<simple_spinlock> lock(lock_);
+  if (FLAGS_raft_fan_out_requests_in_one_task) {
+    FanOutRequestUnlocked(
+        force_if_queue_empty,
+        is_leader_lease_revoke,
+        std::move(latest_appended_replicate));
+    return;
+  }
   for (auto iter = peers_.begin(); iter != peers_.end();) {
     Status s = (*iter).second->SignalRequest(
         force_if_queue_empty,
         false,
         is_leader_lease_revoke,
-        std::move(latest_appended_replicate));
+        latest_appended_replicate);
     if (PREDICT_FALSE(!s.ok())) {
       LOG(WARNING) << GetLogPrefix()
                    << "Peer was closed, removing from peers. Peer: "
@@ -115,6 +140,88 @@ void PeerManager::SignalRequest(
   }
 }
 
+void PeerManager::FanOutRequestUnlocked(
+    bool force_if_queue_empty,
+    bool is_leader_lease_revoke,
+    ReplicateRefPtr latest_appended_replicate) {
+  DCHECK(lock_.is_locked());
+  vector<weak_ptr<Peer>> peers;
+  peers.reserve(peers_.size());
+  for (auto iter = peers_.begin(); iter != peers_.end();) {
+    bool send_now;
+    Status s = iter->second->PrepareRequest(
+        force_if_queue_empty,
+        /*from_heartbeater=*/false,
+        is_leader_lease_revoke,
+        latest_appended_replicate,
+        &send_now);
+    if (PREDICT_FALSE(!s.ok())) {
+      LOG(WARNING) << GetLogPrefix()
+                   << "Peer was closed, removing from peers. Peer: "
+                   << SecureShortDebugString(iter->second->peer_pb());
+      peers_.erase(iter++);
+      continue;
+    }
+    if (send_now) {
+      peers.emplace_back(iter->second);
+    }
+    ++iter;
+  }
+  if (peers.empty()) {
+    return;
+  }
+
+  // The requests of the peers whose next ops are in the log cache are built
+  // one after the other, each under its own peer lock, and sent
+  // asynchronously. A lagging peer would read its ops from disk and hold the
+  // others up, so its request is built in a task of its own, submitted first
+  // so that it runs alongside.
+  Status s = raft_pool_token_->SubmitFunc(
+      [queue = queue_,
+       token = raft_pool_token_,
+       force_if_queue_empty,
+       is_leader_lease_revoke,
+       latest_rep = std::move(latest_appended_replicate),
+       peers = std::move(peers)]() {
+        vector<shared_ptr<Peer>> cached_peers;
+        cached_peers.reserve(peers.size());
+        for (const auto& w : peers) {
+          auto p = w.lock();
+          if (!p) {
+            continue;
+          }
+          if (!queue->PeerNeedsLogRead(p->peer_pb().permanent_uuid())) {
+            cached_peers.emplace_back(std::move(p));
+            continue;
+          }
+          Status s = token->SubmitFunc(
+              [force_if_queue_empty, is_leader_lease_revoke, latest_rep, w]() {
+                if (auto peer = w.lock()) {
+                  peer->SendNextRequest(
+                      force_if_queue_empty,
+                      /*from_heartbeater=*/false,
+                      is_leader_lease_revoke,
+                      latest_rep);
+                }
+              });
+          if (PREDICT_FALSE(!s.ok())) {
+            cached_peers.emplace_back(std::move(p));
+          }
+        }
+        for (const auto& p : cached_peers) {
+          p->SendNextRequest(
+              force_if_queue_empty,
+              /*from_heartbeater=*/false,
+              is_leader_lease_revoke,
+              latest_rep);
+        }
+      });
+  if (PREDICT_FALSE(!s.ok())) {
+    LOG(WARNING) << GetLogPrefix()
+                 << "Could not signal peers: " << s.ToString();
+  }
+}
+
 Status PeerManager::StartElection(
     const std::string& uuid,
     RunLeaderElectionResponsePB* resp,
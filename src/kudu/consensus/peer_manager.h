@@ -55,7 +55,8 @@ class PeerManager {
   Status UpdateRaftConfig(const RaftConfigPB& config);
 
   // Signals all peers of the current configuration that there is a new request
-  // pending.
+  // pending. With --raft_fan_out_requests_in_one_task, the requests to all
+  // peers are built and sent from a single raft pool task.
   void SignalRequest(
       bool force_if_queue_empty = false,
       bool is_leader_lease_revoke = false,
@@ -73,6 +74,14 @@ class PeerManager {
  private:
   std::string GetLogPrefix() const;
 
+  // Submits a single task to 'raft_pool_token_' sending the next request to
+  // each peer that needs one, except that a peer whose next ops must be read
+  // from the log gets a task of its own. Removes the closed peers.
+  void FanOutRequestUnlocked(
+      bool force_if_queue_empty,
+      bool is_leader_lease_revoke,
+      ReplicateRefPtr latest_appended_replicate);
+
   const std::string tablet_id_;
   const std::string local_uuid_;
   PeerProxyFactory* peer_proxy_factory_;
@@ -19,6 +19,7 @@
 
 #include <ostream>
 #include <utility>
+#include <vector>
 
 #include <glog/logging.h>
 
@@ -37,6 +38,7 @@
 
 using kudu::pb_util::SecureShortDebugString;
 using std::string;
+using std::vector;
 using strings::Substitute;
 
 namespace kudu::consensus {
@@ -145,7 +147,9 @@ OpId PendingRounds::GetLastPendingTransactionOpId() const {
                                : (--pending_txns_.end())->second->id();
 }
 
-Status PendingRounds::AdvanceCommittedIndex(int64_t committed_index) {
+Status PendingRounds::AdvanceCommittedIndex(
+    int64_t committed_index,
+    vector<scoped_refptr<ConsensusRound>>* committed_rounds) {
   // If we already committed up to (or past) 'id' return.
   // This can happen in the case that multiple UpdateConsensus() calls end
   // up in the RPC queue at the same time, and then might get interleaved out
@@ -188,7 +192,11 @@ Status PendingRounds::AdvanceCommittedIndex(int64_t committed_index) {
     pending_txns_.erase(iter++);
     last_committed_op_id_ = round->id();
     time_manager_->AdvanceSafeTimeWithMessage(*round->replicate_msg());
-    round->NotifyReplicationFinished(Status::OK());
+    if (committed_rounds) {
+      committed_rounds->emplace_back(std::move(round));
+    } else {
+      round->NotifyReplicationFinished(Status::OK());
+    }
   }
 
   return Status::OK();
@@ -20,6 +20,7 @@
 #include <cstdint>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "kudu/consensus/opid.pb.h"
 #include "kudu/gutil/macros.h"
@@ -60,7 +61,14 @@ class PendingRounds {
 
   // Advances the committed index.
   // This is a no-op if the committed index has not changed.
-  Status AdvanceCommittedIndex(int64_t committed_index);
+  //
+  // If 'committed_rounds' is null, the replication callback of every newly
+  // committed round is run inline. Otherwise the rounds are appended to
+  // 'committed_rounds', in index order, and the caller becomes responsible
+  // for calling NotifyReplicationFinished() on each of them.
+  Status AdvanceCommittedIndex(
+      int64_t committed_index,
+      std::vector<scoped_refptr<ConsensusRound>>* committed_rounds = nullptr);
 
   // Aborts pending operations after, but not including 'index'. The OpId with
   // 'index' will become our new last received id. If there are pending
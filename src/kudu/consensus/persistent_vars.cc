@@ -18,7 +18,9 @@
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <algorithm>
 #include <atomic>
+#include <vector>
 
 #include "kudu/consensus/persistent_vars.pb.h"
 #include "kudu/fs/fs_manager.h"
@@ -75,9 +77,30 @@ const std::string& PersistentVars::compression_dictionary() const {
 
 void PersistentVars::set_compression_dictionary(const std::string& dict) {
   DFAKE_SCOPED_RECURSIVE_LOCK(fake_lock_);
+  if (!pb_.compression_dictionary().empty() &&
+      pb_.compression_dictionary() != dict) {
+    pb_.add_compression_dictionary_history(pb_.compression_dictionary());
+  }
   pb_.set_compression_dictionary(dict);
 }
 
+std::vector<std::string> PersistentVars::compression_dictionary_history()
+    const {
+  DFAKE_SCOPED_RECURSIVE_LOCK(fake_lock_);
+  return {
+      pb_.compression_dictionary_history().begin(),
+      pb_.compression_dictionary_history().end()};
+}
+
+void PersistentVars::set_compression_dictionary_history(
+    const std::vector<std::string>& history) {
+  DFAKE_SCOPED_RECURSIVE_LOCK(fake_lock_);
+  pb_.clear_compression_dictionary_history();
+  for (const std::string& dict : history) {
+    pb_.add_compression_dictionary_history(dict);
+  }
+}
+
 Status PersistentVars::Flush(FlushMode flush_mode) {
   DFAKE_SCOPED_RECURSIVE_LOCK(fake_lock_);
   SCOPED_LOG_SLOW_EXECUTION_PREFIX(
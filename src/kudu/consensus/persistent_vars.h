@@ -20,6 +20,7 @@
 #include <cstdint>
 #include <deque>
 #include <string>
+#include <vector>
 
 #include <optional>
 
@@ -65,9 +66,17 @@ class PersistentVars : public RefCountedThreadSafe<PersistentVars> {
   // Fetches compression dict from PB
   const std::string& compression_dictionary() const;
 
-  // Sets compression dict in PB
+  // Sets compression dict in PB. The previous dict, if any, is moved to the
+  // dictionary history.
   void set_compression_dictionary(const std::string& dict);
 
+  // Fetches the dicts that were in use before the current one, oldest first
+  std::vector<std::string> compression_dictionary_history() const;
+
+  // Replaces the dictionary history, e.g. to drop the dicts no longer needed
+  void set_compression_dictionary_history(
+      const std::vector<std::string>& history);
+
   // Persist current state of the protobuf to disk.
   Status Flush(FlushMode flush_mode = OVERWRITE);
 
@@ -43,11 +43,13 @@
 #include <gflags/gflags.h>
 #include <gflags/gflags_declare.h>
 #include <google/protobuf/util/message_differencer.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <optional>
 
 #include "kudu/common/timestamp.h"
 #include "kudu/common/wire_protocol.h"
+#include "kudu/consensus/compression_policy.h"
 #include "kudu/consensus/consensus.pb.h"
 #include "kudu/consensus/consensus_meta.h"
 #include "kudu/consensus/consensus_meta_manager.h"
@@ -79,12 +81,16 @@
 #include "kudu/util/async_util.h"
 #include "kudu/util/compression/compression.pb.h"
 #include "kudu/util/compression/compression_codec.h"
+#include "kudu/util/compression/compression_dict_trainer.h"
 #include "kudu/util/crc.h"
 #include "kudu/util/debug/trace_event.h"
+#include "kudu/util/errno.h"
 #include "kudu/util/flag_tags.h"
+#include "kudu/util/jsonwriter.h"
 #include "kudu/util/logging.h"
 #include "kudu/util/metrics.h"
 #include "kudu/util/pb_util.h"
+#include "kudu/util/phi_accrual_failure_detector.h"
 #include "kudu/util/process_memory.h"
 #include "kudu/util/random.h"
 #include "kudu/util/random_util.h"
@@ -112,6 +118,55 @@ DEFINE_double(
     ". This will prevent this instance from initiating an election");
 TAG_FLAG(snooze_for_leader_ban_ratio, advanced);
 
+DEFINE_bool(
+    raft_phi_accrual_failure_detection,
+    false,
+    "Whether followers suspect the leader once a phi accrual failure detector, "
+    "which estimates the distribution of the intervals between the leader's "
+    "heartbeats, reaches --raft_phi_accrual_threshold, rather than after a "
+    "fixed number of missed heartbeat periods. The resulting timeout is never "
+    "longer than the fixed one.");
+TAG_FLAG(raft_phi_accrual_failure_detection, experimental);
+TAG_FLAG(raft_phi_accrual_failure_detection, runtime);
+
+DEFINE_double(
+    raft_phi_accrual_threshold,
+    8.0,
+    "Suspicion level at which followers start an election when "
+    "--raft_phi_accrual_failure_detection is set. A level of N means a 10^-N "
+    "chance that the leader is wrongly suspected.");
+TAG_FLAG(raft_phi_accrual_threshold, experimental);
+TAG_FLAG(raft_phi_accrual_threshold, runtime);
+
+DEFINE_int32(
+    raft_phi_accrual_window_size,
+    1000,
+    "Number of recent heartbeat intervals the phi accrual failure detector "
+    "estimates their distribution from");
+TAG_FLAG(raft_phi_accrual_window_size, experimental);
+
+DEFINE_int32(
+    raft_phi_accrual_min_samples,
+    20,
+    "Number of heartbeat intervals from a leader needed before the phi accrual "
+    "failure detector is used. The fixed timeout is used until then.");
+TAG_FLAG(raft_phi_accrual_min_samples, experimental);
+
+DEFINE_int32(
+    raft_phi_accrual_min_std_dev_ms,
+    50,
+    "Lower bound of the standard deviation of the heartbeat intervals assumed "
+    "by the phi accrual failure detector");
+TAG_FLAG(raft_phi_accrual_min_std_dev_ms, experimental);
+
+DEFINE_int32(
+    raft_phi_accrual_acceptable_pause_ms,
+    0,
+    "Pause of the leader tolerated by the phi accrual failure detector on top "
+    "of the heartbeat intervals it has seen. The leader is never suspected "
+    "before two heartbeat periods plus this pause.");
+TAG_FLAG(raft_phi_accrual_acceptable_pause_ms, experimental);
+
 DEFINE_int32(
     leader_failure_exp_backoff_max_delta_ms,
     20 * 1000,
@@ -214,6 +269,59 @@ DEFINE_bool(
     true,
     "Should we notify peers of commit index after every response?");
 
+DEFINE_bool(
+    raft_deliver_commits_async,
+    false,
+    "Whether to run the replication callbacks of committed operations on a "
+    "dedicated executor, in index order, instead of inline while holding the "
+    "consensus lock. Slow callbacks then no longer hold up updates, "
+    "replication and vote requests.");
+TAG_FLAG(raft_deliver_commits_async, experimental);
+
+DEFINE_bool(
+    compression_dict_training_enabled,
+    false,
+    "Whether the leader should periodically train a new compression "
+    "dictionary from a sample of the payloads it replicates, and roll it out "
+    "to the followers. Only used with dictionary compression codecs.");
+TAG_FLAG(compression_dict_training_enabled, experimental);
+TAG_FLAG(compression_dict_training_enabled, runtime);
+
+DEFINE_int32(
+    compression_dict_training_interval_secs,
+    3600,
+    "Minimum number of seconds between two compression dictionary trainings");
+TAG_FLAG(compression_dict_training_interval_secs, experimental);
+
+DEFINE_int32(
+    compression_dict_training_sample_every_n,
+    16,
+    "Sample one out of this many payloads for compression dictionary "
+    "training");
+TAG_FLAG(compression_dict_training_sample_every_n, experimental);
+
+DEFINE_int32(
+    compression_dict_training_max_samples,
+    4096,
+    "Maximum number of recent payloads kept for compression dictionary "
+    "training");
+TAG_FLAG(compression_dict_training_max_samples, experimental);
+
+DEFINE_int32(
+    compression_dict_training_nice,
+    10,
+    "Nice value of the thread that trains compression dictionaries, which "
+    "is shared by all the rings of the process");
+TAG_FLAG(compression_dict_training_nice, experimental);
+
+DEFINE_int32(
+    compression_dict_size_bytes,
+    64 * 1024,
+    "Size of the compression dictionaries trained by the leader");
+TAG_FLAG(compression_dict_size_bytes, experimental);
+
+DECLARE_int32(raft_quiescent_heartbeat_interval_ms);
+
 DEFINE_int32(
     mock_elections_timeout_ms,
     5000,
@@ -282,6 +390,35 @@ METRIC_DEFINE_gauge_int64(
     "Number of failed elections on this node since there was a stable "
     "leader. This number increments on each failed election and resets on "
     "each successful one.");
+METRIC_DEFINE_gauge_int64(
+    server,
+    leader_heartbeat_interval_mean,
+    "Leader Heartbeat Interval Mean",
+    kudu::MetricUnit::kMilliseconds,
+    "Mean of the recent intervals between the requests received from the "
+    "leader, as estimated by the phi accrual failure detector.");
+METRIC_DEFINE_gauge_int64(
+    server,
+    leader_heartbeat_interval_stddev,
+    "Leader Heartbeat Interval Standard Deviation",
+    kudu::MetricUnit::kMilliseconds,
+    "Standard deviation of the recent intervals between the requests received "
+    "from the leader, as estimated by the phi accrual failure detector.");
+METRIC_DEFINE_gauge_int64(
+    server,
+    leader_failure_timeout,
+    "Leader Failure Timeout",
+    kudu::MetricUnit::kMilliseconds,
+    "Time without hearing from the leader after which this follower starts an "
+    "election, before randomization.");
+METRIC_DEFINE_histogram(
+    server,
+    leader_heartbeat_interval,
+    "Leader Heartbeat Interval",
+    kudu::MetricUnit::kMicroseconds,
+    "Microseconds between the requests received from the leader",
+    60000000LU,
+    2);
 METRIC_DEFINE_gauge_int64(
     server,
     time_since_last_leader_heartbeat,
@@ -494,6 +631,38 @@ Status RaftConsensus::Start(
               Unretained(this)))
       ->AutoDetach(&metric_detacher_);
 
+  PhiAccrualFailureDetector::Options detector_opts;
+  detector_opts.max_samples = std::max(FLAGS_raft_phi_accrual_window_size, 1);
+  detector_opts.min_samples = std::max(FLAGS_raft_phi_accrual_min_samples, 1);
+  detector_opts.min_std_dev =
+      MonoDelta::FromMilliseconds(FLAGS_raft_phi_accrual_min_std_dev_ms);
+  detector_opts.acceptable_pause =
+      MonoDelta::FromMilliseconds(FLAGS_raft_phi_accrual_acceptable_pause_ms);
+  leader_heartbeats_.reset(new PhiAccrualFailureDetector(detector_opts));
+  leader_heartbeat_interval_histogram_ =
+      METRIC_leader_heartbeat_interval.Instantiate(metric_entity);
+  METRIC_leader_heartbeat_interval_mean
+      .InstantiateFunctionGauge(
+          metric_entity,
+          Bind(
+              &RaftConsensus::GetLeaderHeartbeatIntervalMeanMillis,
+              Unretained(this)))
+      ->AutoDetach(&metric_detacher_);
+  METRIC_leader_heartbeat_interval_stddev
+      .InstantiateFunctionGauge(
+          metric_entity,
+          Bind(
+              &RaftConsensus::GetLeaderHeartbeatIntervalStdDevMillis,
+              Unretained(this)))
+      ->AutoDetach(&metric_detacher_);
+  METRIC_leader_failure_timeout
+      .InstantiateFunctionGauge(
+          metric_entity,
+          Bind(
+              &RaftConsensus::GetLeaderFailureTimeoutMillis,
+              Unretained(this)))
+      ->AutoDetach(&metric_detacher_);
+
   raft_proxy_num_requests_received_ = metric_entity->FindOrCreateCounter(
       &METRIC_raft_proxy_num_requests_received);
   raft_proxy_num_requests_success_ = metric_entity->FindOrCreateCounter(
@@ -523,6 +692,22 @@ Status RaftConsensus::Start(
   //
   // TODO(adar): the token is SERIAL to match the previous single-thread
   // observer pool behavior, but CONCURRENT may be safe here.
+  // Replication callbacks are delivered serially so that they run in index
+  // order, which state machines rely on.
+  commit_delivery_token_ =
+      raft_pool_->NewToken(ThreadPool::ExecutionMode::SERIAL);
+
+  CompressionDictTrainer::Options trainer_opts;
+  trainer_opts.sample_every_n =
+      std::max(FLAGS_compression_dict_training_sample_every_n, 1);
+  trainer_opts.max_samples =
+      std::max(FLAGS_compression_dict_training_max_samples, 1);
+  trainer_opts.dict_size = FLAGS_compression_dict_size_bytes;
+  trainer_opts.min_interval =
+      MonoDelta::FromSeconds(FLAGS_compression_dict_training_interval_secs);
+  dict_trainer_.reset(new CompressionDictTrainer(trainer_opts));
+  compression_policy_.reset(new CompressionPolicy());
+
   unique_ptr<PeerMessageQueue> queue(new PeerMessageQueue(
       metric_entity,
       log_,
@@ -587,6 +772,12 @@ Status RaftConsensus::Start(
     peer_manager_ = std::move(peer_manager);
     pending_ = std::move(pending);
 
+    // Earlier dictionaries may still be needed to decompress payloads
+    // in the log.
+    for (const std::string& dict :
+         persistent_vars_->compression_dictionary_history()) {
+      CompressionCodecManager::RegisterDictionary(dict);
+    }
     const std::string& compression_dict =
         persistent_vars_->compression_dictionary();
     if (!compression_dict.empty()) {
@@ -1269,20 +1460,27 @@ Status RaftConsensus::BecomeReplicaUnlocked(std::optional<MonoDelta> fd_delta) {
 }
 
 Status RaftConsensus::Replicate(const scoped_refptr<ConsensusRound>& round) {
-  std::lock_guard<simple_mutexlock> lock(update_lock_);
   {
-    ThreadRestrictions::AssertWaitAllowed();
-    LockGuard l(lock_);
-    RETURN_NOT_OK(CheckSafeToReplicateUnlocked(*round->replicate_msg()));
-    RETURN_NOT_OK(round->CheckBoundTerm(CurrentTermUnlocked()));
-    RETURN_NOT_OK(AppendNewRoundToQueueUnlocked(round));
+    std::lock_guard<simple_mutexlock> lock(update_lock_);
+    {
+      ThreadRestrictions::AssertWaitAllowed();
+      LockGuard l(lock_);
+      RETURN_NOT_OK(CheckSafeToReplicateUnlocked(*round->replicate_msg()));
+      RETURN_NOT_OK(round->CheckBoundTerm(CurrentTermUnlocked()));
+      RETURN_NOT_OK(AppendNewRoundToQueueUnlocked(round));
+    }
+
+    peer_manager_->SignalRequest(
+        false,
+        false,
+        FLAGS_buffer_messages_between_rpcs ? round->replicate_scoped_refptr()
+                                           : nullptr);
   }
 
-  peer_manager_->SignalRequest(
-      false,
-      false,
-      FLAGS_buffer_messages_between_rpcs ? round->replicate_scoped_refptr()
-                                         : nullptr);
+  // Sampling copies the payload, which is better done without the locks.
+  if (FLAGS_compression_dict_training_enabled) {
+    MaybeSampleForDictTraining(*round->replicate_msg());
+  }
   return Status::OK();
 }
 
@@ -1337,7 +1535,10 @@ Status RaftConsensus::AppendNewRoundToQueueUnlocked(
   }
   RETURN_NOT_OK(AddPendingOperationUnlocked(round));
 
-  ReplicateMsgWrapper msg_wrapper(round->replicate_scoped_refptr());
+  ReplicateMsgWrapper msg_wrapper(
+      round->replicate_scoped_refptr(),
+      /*should_compress=*/true,
+      compression_policy_.get());
   RETURN_NOT_OK(msg_wrapper.Init(&compression_buffer_));
 
   // The only reasons for a bad status would be if the log itself were shut
@@ -1428,7 +1629,7 @@ void RaftConsensus::NotifyCommitIndex(int64_t commit_index, bool need_lock) {
         << "Unable to update committed index: "
         << "Replica not in running state: " << State_Name(state_);
   } else {
-    pending_->AdvanceCommittedIndex(commit_index);
+    CHECK_OK(AdvanceCommittedIndexUnlocked(commit_index));
 
     if (FLAGS_notify_commit_index_after_response &&
         cmeta_->active_role() == RaftPeerPB::LEADER) {
@@ -1692,7 +1893,8 @@ void RaftConsensus::TryStartElectionOnPeerTask(
 
 Status RaftConsensus::Update(
     const ConsensusRequestPB* request,
-    ConsensusResponsePB* response) {
+    ConsensusResponsePB* response,
+    std::shared_ptr<google::protobuf::Arena> request_arena) {
   update_calls_for_tests_.Increment();
 
   if (PREDICT_FALSE(
@@ -1705,12 +1907,17 @@ Status RaftConsensus::Update(
 
   response->set_responder_uuid(peer_uuid());
 
+  if (PREDICT_FALSE(request->has_compressed_ops())) {
+    // The RPC layer decodes them before handing the request over.
+    return Status::InvalidArgument("request ops are still compressed");
+  }
+
   VLOG_WITH_PREFIX(2) << "Replica received request: "
                       << SecureShortDebugString(*request);
 
   // see var declaration
   std::lock_guard<simple_mutexlock> lock(update_lock_);
-  Status s = UpdateReplica(request, response);
+  Status s = UpdateReplica(request, response, std::move(request_arena));
   if (PREDICT_FALSE(VLOG_IS_ON(1))) {
     if (request->ops().empty()) {
       VLOG_WITH_PREFIX(1) << "Replica replied to status only request. Replica: "
@@ -1850,7 +2057,7 @@ void RaftConsensus::DeduplicateLeaderRequestUnlocked(
       deduplicated_req->first_message_idx = i;
     }
     deduplicated_req->messages.push_back(
-        make_scoped_refptr_replicate(leader_msg));
+        make_scoped_refptr_replicate(leader_msg, deduplicated_req->arena));
   }
 
   if (deduplicated_req->messages.size() != rpc_req->ops_size()) {
@@ -1932,6 +2139,9 @@ Status RaftConsensus::EnforceLogMatchingPropertyMatchesUnlocked(
 void RaftConsensus::TruncateAndAbortOpsAfterUnlocked(
     int64_t truncate_after_index) {
   DCHECK(lock_.is_locked());
+  // The rounds being aborted come after those still being delivered, so their
+  // callbacks must run after those of the latter.
+  WaitForCommitDeliveriesUnlocked();
   pending_->AbortOpsAfter(truncate_after_index);
   queue_->TruncateOpsAfter(truncate_after_index);
 }
@@ -2032,7 +2242,8 @@ Status RaftConsensus::CheckLeaderRequestUnlocked(
 
 Status RaftConsensus::UpdateReplica(
     const ConsensusRequestPB* request,
-    ConsensusResponsePB* response) {
+    ConsensusResponsePB* response,
+    std::shared_ptr<google::protobuf::Arena> request_arena) {
   TRACE_EVENT2(
       "consensus",
       "RaftConsensus::UpdateReplica",
@@ -2147,8 +2358,13 @@ Status RaftConsensus::UpdateReplica(
   // then we snooze for longer to give other instances an opportunity to win
   // the election
   // We only activate this after the proper snooze point below
-  auto snooze_guard = folly::makeDismissedGuard(
-      [this]() { SnoozeFailureDetector({}, MinimumElectionTimeoutWithBan()); });
+  auto snooze_guard =
+      folly::makeDismissedGuard([this, quiescent = request->quiescent()]() {
+        SnoozeFailureDetector(
+            {},
+            quiescent ? QuiescentLeaderFailureTimeout()
+                      : LeaderFailureTimeout());
+      });
 
   {
     ThreadRestrictions::AssertWaitAllowed();
@@ -2160,6 +2376,7 @@ Status RaftConsensus::UpdateReplica(
     }
 
     deduped_req.leader_uuid = request->caller_uuid();
+    deduped_req.arena = std::move(request_arena);
 
     RETURN_NOT_OK(CheckLeaderRequestUnlocked(request, response, &deduped_req));
     if (response->status().has_error()) {
@@ -2177,6 +2394,11 @@ Status RaftConsensus::UpdateReplica(
     SnoozeFailureDetector({}, UpdateReplicaSnoozeTimeout());
 
     last_leader_communication_time_micros_ = GetMonoTimeMicros();
+    RecordLeaderHeartbeat(
+        request->caller_uuid(),
+        request->caller_term(),
+        request->ops_size() == 0,
+        request->quiescent());
 
     // Reset the 'failed_elections_since_stable_leader' metric now that we've
     // accepted an update from the established leader. This is done in addition
@@ -2245,7 +2467,7 @@ Status RaftConsensus::UpdateReplica(
         << ", preceding opid index: " << deduped_req.preceding_opid->index()
         << ", requested index: " << request->committed_index();
     TRACE("Early marking committed up to index $0", early_apply_up_to);
-    CHECK_OK(pending_->AdvanceCommittedIndex(early_apply_up_to));
+    CHECK_OK(AdvanceCommittedIndexUnlocked(early_apply_up_to));
 
     // 2 - Enqueue the prepares
 
@@ -2285,8 +2507,7 @@ Status RaftConsensus::UpdateReplica(
           << "[EVERY 3 mins] Received compression dictionary from leader";
       const std::string& compression_dict = request->compression_dictionary();
       RETURN_NOT_OK(CompressionCodecManager::SetDictionary(compression_dict));
-      persistent_vars_->set_compression_dictionary(compression_dict);
-      RETURN_NOT_OK(persistent_vars_->Flush());
+      RETURN_NOT_OK(PersistCompressionDictUnlocked(compression_dict));
     }
     while (iter != messages.end()) {
       // Create a ReplicateMsgWrapper which handles compression, here we'll be
@@ -2412,7 +2633,7 @@ Status RaftConsensus::UpdateReplica(
 
     VLOG_WITH_PREFIX_UNLOCKED(1) << "Marking committed up to " << apply_up_to;
     TRACE("Marking committed up to $0", apply_up_to);
-    CHECK_OK(pending_->AdvanceCommittedIndex(apply_up_to));
+    CHECK_OK(AdvanceCommittedIndexUnlocked(apply_up_to));
     queue_->UpdateFollowerWatermarks(
         apply_up_to,
         request->all_replicated_index(),
@@ -3351,8 +3572,12 @@ void RaftConsensus::Stop() {
   {
     ThreadRestrictions::AssertWaitAllowed();
     LockGuard l(lock_);
-    if (pending_)
+    if (pending_) {
+      // Committed rounds get their callbacks before the pending ones are
+      // cancelled.
+      WaitForCommitDeliveriesUnlocked();
       CHECK_OK(pending_->CancelPendingTransactions());
+    }
     SetStateUnlocked(kStopped);
 
     // Clear leader status on Stop(), in case this replica was the leader. If
@@ -3370,6 +3595,13 @@ void RaftConsensus::Stop() {
     LOG_WITH_PREFIX_UNLOCKED(INFO) << "Raft consensus is shut down!";
   }
 
+  // Rounds that committed before the replica stopped still get their
+  // callbacks, so let any delivery in progress finish.
+  if (commit_delivery_token_) {
+    commit_delivery_token_->Wait();
+    commit_delivery_token_->Shutdown();
+  }
+
   // Shut down things that might acquire locks during destruction.
   if (raft_pool_token_) {
     raft_pool_token_->Shutdown();
@@ -3396,6 +3628,58 @@ void RaftConsensus::Shutdown() {
   shutdown_.Store(true, kMemOrderRelease);
 }
 
+Status RaftConsensus::AdvanceCommittedIndexUnlocked(int64_t commit_index) {
+  if (!FLAGS_raft_deliver_commits_async || !commit_delivery_token_) {
+    return pending_->AdvanceCommittedIndex(commit_index);
+  }
+
+  auto committed = std::make_shared<vector<scoped_refptr<ConsensusRound>>>();
+  RETURN_NOT_OK(pending_->AdvanceCommittedIndex(commit_index, committed.get()));
+  if (committed->empty()) {
+    return Status::OK();
+  }
+  TRACE("Delivering $0 committed rounds", committed->size());
+
+  auto deliver = [committed]() {
+    for (const auto& round : *committed) {
+      round->NotifyReplicationFinished(Status::OK());
+    }
+  };
+  // Consensus-only rounds (e.g. NO_OP or CHANGE_CONFIG_OP) update the
+  // consensus state when they finish, which the next request may depend on.
+  // Such batches are delivered inline, once the earlier deliveries are done.
+  // Tasks on the token thus never take 'lock_', so it can be waited on while
+  // holding it.
+  bool consensus_only = std::any_of(
+      committed->begin(), committed->end(), [](const auto& round) {
+        return IsConsensusOnlyOperation(round->replicate_msg()->op_type());
+      });
+  if (consensus_only) {
+    WaitForCommitDeliveriesUnlocked();
+    deliver();
+    return Status::OK();
+  }
+  // Deliveries are submitted while holding 'lock_' and the token is serial,
+  // so callbacks run in index order even though they run without the lock.
+  Status s = commit_delivery_token_->SubmitFunc(deliver);
+  if (PREDICT_FALSE(!s.ok())) {
+    // The token only rejects tasks once the replica has stopped.
+    LOG_WITH_PREFIX_UNLOCKED(WARNING)
+        << "Unable to deliver committed rounds asynchronously: "
+        << s.ToString() << ". Delivering them inline.";
+    deliver();
+  }
+  return Status::OK();
+}
+
+void RaftConsensus::WaitForCommitDeliveriesUnlocked() {
+  DCHECK(lock_.is_locked());
+  if (commit_delivery_token_) {
+    ThreadRestrictions::AssertWaitAllowed();
+    commit_delivery_token_->Wait();
+  }
+}
+
 Status RaftConsensus::StartConsensusOnlyRoundUnlocked(
     const ReplicateRefPtr& msg) {
   DCHECK(lock_.is_locked());
@@ -3849,6 +4133,21 @@ Status RaftConsensus::RefreshConsensusQueueAndPeersUnlocked() {
   queue_->SetLeaderMode(
       pending_->GetCommittedIndex(), CurrentTermUnlocked(), active_config);
   RETURN_NOT_OK(peer_manager_->UpdateRaftConfig(active_config));
+
+  // Peers without a region are assumed to be remote.
+  const std::string region = peer_region();
+  bool has_remote_peers = false;
+  for (const RaftPeerPB& peer : active_config.peers()) {
+    if (peer.permanent_uuid() == peer_uuid()) {
+      continue;
+    }
+    if (region.empty() || !peer.has_attrs() || !peer.attrs().has_region() ||
+        peer.attrs().region() != region) {
+      has_remote_peers = true;
+      break;
+    }
+  }
+  compression_policy_->SetHasRemotePeers(has_remote_peers);
   return Status::OK();
 }
 
@@ -4478,6 +4777,82 @@ MonoDelta RaftConsensus::MinimumElectionTimeoutWithBan() {
   return MonoDelta::FromMilliseconds(failure_timeout);
 }
 
+std::optional<MonoDelta> RaftConsensus::PhiAccrualTimeout() const {
+  if (!FLAGS_raft_phi_accrual_failure_detection ||
+      fabs(FLAGS_snooze_for_leader_ban_ratio - 1.0) >= 0.001 ||
+      !leader_heartbeats_->HasEnoughSamples()) {
+    return std::nullopt;
+  }
+  // Never suspect the leader before two heartbeat periods and the acceptable
+  // pause went by, nor later than with the fixed timeout: on a jittery link
+  // the detector falls back to the fixed timeout rather than making failover
+  // slower.
+  const MonoDelta timeout =
+      leader_heartbeats_->TimeToPhi(FLAGS_raft_phi_accrual_threshold);
+  const MonoDelta min_timeout = MonoDelta::FromMilliseconds(
+      2 * static_cast<int64_t>(FLAGS_raft_heartbeat_interval_ms) +
+      FLAGS_raft_phi_accrual_acceptable_pause_ms);
+  return std::min(std::max(timeout, min_timeout), MinimumElectionTimeout());
+}
+
+MonoDelta RaftConsensus::LeaderFailureTimeout() {
+  std::optional<MonoDelta> phi_timeout = PhiAccrualTimeout();
+  if (!phi_timeout) {
+    return MinimumElectionTimeoutWithBan();
+  }
+  // Randomized like the fixed timeout, so that followers which heard from the
+  // leader at the same time don't all start an election at the same time.
+  return MonoDelta::FromMicroseconds(static_cast<int64_t>(
+      phi_timeout->ToMicroseconds() * (1.0 + 0.5 * rng_.NextDoubleFraction())));
+}
+
+MonoDelta RaftConsensus::QuiescentLeaderFailureTimeout() const {
+  return MonoDelta::FromMilliseconds(static_cast<int64_t>(
+      FLAGS_leader_failure_max_missed_heartbeat_periods *
+      FLAGS_raft_quiescent_heartbeat_interval_ms));
+}
+
+void RaftConsensus::RecordLeaderHeartbeat(
+    const std::string& leader_uuid,
+    int64_t leader_term,
+    bool status_only,
+    bool quiescent) {
+  if (leader_uuid != heartbeats_leader_uuid_ ||
+      leader_term != heartbeats_leader_term_) {
+    // How often a previous leader was heard from says little about this one.
+    leader_heartbeats_->Reset();
+    heartbeats_leader_uuid_ = leader_uuid;
+    heartbeats_leader_term_ = leader_term;
+  }
+  // Requests carrying ops are sent as soon as there are ops to replicate, so
+  // only the status-only ones follow the leader's heartbeat period.
+  if (!status_only) {
+    return;
+  }
+  const MonoDelta interval =
+      leader_heartbeats_->HeartbeatArrived(MonoTime::Now());
+  if (interval.Initialized()) {
+    leader_heartbeat_interval_histogram_->Increment(interval.ToMicroseconds());
+  }
+  if (quiescent) {
+    leader_heartbeats_->ForgetLastHeartbeat();
+  }
+}
+
+int64_t RaftConsensus::GetLeaderHeartbeatIntervalMeanMillis() const {
+  return leader_heartbeats_->mean().ToMilliseconds();
+}
+
+int64_t RaftConsensus::GetLeaderHeartbeatIntervalStdDevMillis() const {
+  return leader_heartbeats_->std_dev().ToMilliseconds();
+}
+
+int64_t RaftConsensus::GetLeaderFailureTimeoutMillis() const {
+  return PhiAccrualTimeout()
+      .value_or(MinimumElectionTimeout())
+      .ToMilliseconds();
+}
+
 MonoDelta RaftConsensus::LeaderElectionExpBackoffNotInConfig() {
   DCHECK(lock_.is_locked());
   // Compute a backoff factor based on how many leader elections have
@@ -5382,7 +5757,8 @@ void RaftConsensus::HandleProxyRequest(
         LOG_WITH_PREFIX(ERROR) << s.ToString();
         RET_RESPOND_ERROR_NOT_OK(s);
       }
-      downstream_request.mutable_ops()->AddAllocated(messages[i]->get());
+      downstream_request.mutable_ops()->UnsafeArenaAddAllocated(
+          messages[i]->get());
     }
   }
 
@@ -5496,15 +5872,123 @@ Status RaftConsensus::LoadCompressionDict(const std::string& filename) {
 
   LockGuard l(lock_);
   RETURN_NOT_OK(queue_->SetCompressionDictionary(dict_buffer));
-  persistent_vars_->set_compression_dictionary(dict_buffer);
-  RETURN_NOT_OK(persistent_vars_->Flush());
-  return Status::OK();
+  return PersistCompressionDictUnlocked(dict_buffer);
+}
+
+Status RaftConsensus::PersistCompressionDictUnlocked(const std::string& dict) {
+  // Dictionaries are only dropped from the registry once no log segment or
+  // cached payload refers to them anymore, so those are the ones to keep.
+  vector<string> history = persistent_vars_->compression_dictionary_history();
+  history.erase(
+      std::remove_if(
+          history.begin(),
+          history.end(),
+          [](const string& prev) {
+            return !CompressionCodecManager::IsDictionaryRegistered(prev);
+          }),
+      history.end());
+  persistent_vars_->set_compression_dictionary_history(history);
+  persistent_vars_->set_compression_dictionary(dict);
+  return persistent_vars_->Flush();
+}
+
+namespace {
+
+// The trainings of all the rings of the process share a single thread, so
+// that they neither compete with each other nor hold up the raft pool.
+Status GetDictTrainingPool(ThreadPool** pool) {
+  static std::once_flag once;
+  static ThreadPool* training_pool = nullptr;
+  static Status init_status;
+  std::call_once(once, []() {
+    unique_ptr<ThreadPool> new_pool;
+    init_status = ThreadPoolBuilder("dict-training")
+                      .set_max_threads(1)
+                      .Build(&new_pool);
+    training_pool = new_pool.release();
+  });
+  *pool = training_pool;
+  return init_status;
+}
+
+} // anonymous namespace
+
+void RaftConsensus::MaybeSampleForDictTraining(const ReplicateMsg& msg) {
+  if (msg.op_type() != WRITE_OP_EXT || !msg.has_write_payload() ||
+      msg.write_payload().compression_codec() != NO_COMPRESSION) {
+    return;
+  }
+  const auto codec = CompressionCodecManager::GetCurrentCodec();
+  if (!codec || (codec->type() != ZSTD_DICT && codec->type() != LZ4_DICT)) {
+    return;
+  }
+  dict_trainer_->AddSample(Slice(msg.write_payload().payload()));
+  if (!dict_trainer_->StartTrainingIfDue()) {
+    return;
+  }
+  ThreadPool* pool = nullptr;
+  Status s = GetDictTrainingPool(&pool);
+  if (s.ok()) {
+    s = pool->SubmitFunc(std::bind(
+        &RaftConsensus::TrainCompressionDictTask, shared_from_this()));
+  }
+  if (!s.ok()) {
+    dict_trainer_->CancelTraining();
+    WARN_NOT_OK(
+        s,
+        LogPrefixThreadSafe() + "Unable to start TrainCompressionDictTask");
+  }
+}
+
+void RaftConsensus::TrainCompressionDictTask() {
+  // Training is CPU heavy and never urgent, so it yields to the threads that
+  // serve requests. Raising our own nice value needs no privileges.
+  if (setpriority(PRIO_PROCESS, 0, FLAGS_compression_dict_training_nice) !=
+      0) {
+    KLOG_FIRST_N(WARNING, 1) << "Unable to lower the priority of the "
+                             << "compression dictionary training thread: "
+                             << ErrnoToString(errno);
+  }
+  std::string dict;
+  Status s = dict_trainer_->Train(&dict);
+  if (!s.ok()) {
+    LOG_WITH_PREFIX_UNLOCKED(WARNING) << s.ToString();
+    return;
+  }
+
+  LockGuard l(lock_);
+  if (state_ != kRunning || cmeta_->active_role() != RaftPeerPB::LEADER) {
+    return;
+  }
+  // The queue sends the new dictionary to every follower ahead of the first
+  // payload compressed with it, and the previous dictionaries stay available
+  // to decompress the payloads that were compressed before.
+  s = queue_->SetCompressionDictionary(dict);
+  if (s.ok()) {
+    s = PersistCompressionDictUnlocked(dict);
+  }
+  if (!s.ok()) {
+    LOG_WITH_PREFIX_UNLOCKED(WARNING)
+        << "Unable to roll out the trained compression dictionary: "
+        << s.ToString();
+    return;
+  }
+  LOG_WITH_PREFIX_UNLOCKED(INFO)
+      << "Rolled out compression dictionary "
+      << CompressionCodecManager::GetCurrentDictionaryID() << " ("
+      << dict.size() << " bytes, training #"
+      << dict_trainer_->num_trainings() << " took "
+      << dict_trainer_->last_training_duration().ToString() << ")";
 }
 
 std::string RaftConsensus::GetCompressionStats() const {
   LockGuard l(lock_);
   auto codec = CompressionCodecManager::GetCurrentCodec();
-  return codec ? codec->Stats() : "";
+  if (!codec) {
+    return "";
+  }
+  return codec->Stats(
+      [this](JsonWriter* jw) { compression_policy_->AppendStats(jw); });
 }
 
 Status RaftConsensus::SetProxyPolicy(const ProxyPolicy& proxy_policy) {
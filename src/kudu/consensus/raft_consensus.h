@@ -75,6 +75,9 @@ namespace kudu {
 using Lock = std::lock_guard<simple_mutexlock>;
 using ScopedLock = std::unique_ptr<Lock>;
 
+class CompressionDictTrainer;
+class Histogram;
+class PhiAccrualFailureDetector;
 class Status;
 class ThreadPool;
 class ThreadPoolToken;
@@ -94,6 +97,7 @@ class RaftConsensusInstance;
 
 namespace consensus {
 
+class CompressionPolicy;
 class ConsensusMetadataManager;
 class ConsensusRound;
 class ConsensusRoundHandler;
@@ -479,9 +483,13 @@ class RaftConsensus : public std::enable_shared_from_this<RaftConsensus>,
   // error response could not be formed, which will result in the service
   // returning an UNKNOWN_ERROR RPC error code to the caller and including the
   // stringified Status message.
+  //
+  // If 'request' is allocated on 'request_arena', the operations appended
+  // to the log are kept on it rather than copied, and keep it alive.
   Status Update(
       const ConsensusRequestPB* request,
-      ConsensusResponsePB* response);
+      ConsensusResponsePB* response,
+      std::shared_ptr<google::protobuf::Arena> request_arena = nullptr);
 
   // Messages sent from CANDIDATEs to voting peers to request their vote
   // in leader election.
@@ -630,6 +638,15 @@ class RaftConsensus : public std::enable_shared_from_this<RaftConsensus>,
   // Return the minimum election timeout considering ban-factor
   MonoDelta MinimumElectionTimeoutWithBan();
 
+  // Returns how long to wait for the leader before starting an election,
+  // after hearing from it. This is MinimumElectionTimeoutWithBan() unless
+  // --raft_phi_accrual_failure_detection is set.
+  MonoDelta LeaderFailureTimeout();
+
+  // Returns how long to wait for the leader after a quiescent heartbeat. See
+  // --raft_quiescence_idle_ms.
+  MonoDelta QuiescentLeaderFailureTimeout() const;
+
   // Returns a copy of the state of the consensus system.
   // If 'report_health' is set to 'INCLUDE_HEALTH_REPORT', and if the
   // local replica believes it is the leader of the config, it will include a
@@ -704,6 +721,12 @@ class RaftConsensus : public std::enable_shared_from_this<RaftConsensus>,
 
   int64_t GetMillisSinceLastLeaderHeartbeat() const;
 
+  // The phi accrual failure detector's estimate of the leader's heartbeat
+  // intervals, and the resulting timeout.
+  int64_t GetLeaderHeartbeatIntervalMeanMillis() const;
+  int64_t GetLeaderHeartbeatIntervalStdDevMillis() const;
+  int64_t GetLeaderFailureTimeoutMillis() const;
+
   // Returns true if the request is intended to be proxied.
   bool IsProxyRequest(const ConsensusRequestPB* request) const;
 
@@ -878,6 +901,9 @@ class RaftConsensus : public std::enable_shared_from_this<RaftConsensus>,
     // The positional index of the first message selected to be appended, in the
     // original leader's request message sequence.
     int64_t first_message_idx;
+    // The arena the leader's request, and thus 'messages', is allocated on,
+    // if any.
+    std::shared_ptr<google::protobuf::Arena> arena;
 
     std::string OpsRangeString() const;
   };
@@ -948,7 +974,8 @@ class RaftConsensus : public std::enable_shared_from_this<RaftConsensus>,
   // until this is done.
   Status UpdateReplica(
       const ConsensusRequestPB* request,
-      ConsensusResponsePB* response);
+      ConsensusResponsePB* response,
+      std::shared_ptr<google::protobuf::Arena> request_arena);
 
   // Deduplicates an RPC request making sure that we get only messages that we
   // haven't appended to our log yet.
@@ -1150,6 +1177,22 @@ class RaftConsensus : public std::enable_shared_from_this<RaftConsensus>,
 
   MonoDelta TimeoutBackoffHelper(double backoff_factor);
 
+  // Returns the timeout derived from the phi accrual failure detector, before
+  // randomization, or nullopt if it's disabled or doesn't know enough about
+  // the leader yet.
+  std::optional<MonoDelta> PhiAccrualTimeout() const;
+
+  // Records that a request from 'leader_uuid' in 'leader_term' was accepted.
+  // Only the intervals between 'status_only' requests, i.e. heartbeats, are
+  // recorded. After a 'quiescent' request, the leader deliberately waits
+  // longer before the next one, so that interval isn't recorded either.
+  // Must be called with 'update_lock_' held.
+  void RecordLeaderHeartbeat(
+      const std::string& leader_uuid,
+      int64_t leader_term,
+      bool status_only,
+      bool quiescent);
+
   // Handle when the term has advanced beyond the current term.
   //
   // 'flush' may be used to control whether the term change is flushed to disk.
@@ -1224,6 +1267,32 @@ class RaftConsensus : public std::enable_shared_from_this<RaftConsensus>,
   Status AddPendingOperationUnlocked(
       const scoped_refptr<ConsensusRound>& round);
 
+  // Advances the committed index to 'commit_index' and arranges for the
+  // replication callbacks of the newly committed rounds to run. With
+  // --raft_deliver_commits_async they are handed off to
+  // 'commit_delivery_token_' and run without 'lock_', unless one of them is a
+  // consensus-only round; otherwise they run inline.
+  Status AdvanceCommittedIndexUnlocked(int64_t commit_index);
+
+  // Waits for the replication callbacks handed off to
+  // 'commit_delivery_token_' to have run, so that callbacks run inline after
+  // this run in index order. Must be called with 'lock_' held.
+  void WaitForCommitDeliveriesUnlocked();
+
+  // Offers the payload of 'msg' as a sample for compression dictionary
+  // training and, once a new dictionary is due, schedules its training on the
+  // process-wide training thread. Called without 'lock_'.
+  void MaybeSampleForDictTraining(const ReplicateMsg& msg);
+
+  // Trains a new compression dictionary from the sampled payloads and, if
+  // this replica is still the leader, rolls it out to the followers.
+  void TrainCompressionDictTask();
+
+  // Persists 'dict' as the current compression dictionary. The previous one
+  // is kept in the dictionary history, from which the dictionaries that are
+  // no longer registered are dropped.
+  Status PersistCompressionDictUnlocked(const std::string& dict);
+
   // Checks that the replica is in the appropriate state and role to replicate
   // the provided operation and that the replicate message does not yet have an
   // OpId assigned.
@@ -1371,6 +1440,10 @@ class RaftConsensus : public std::enable_shared_from_this<RaftConsensus>,
   // callbacks, etc.
   std::unique_ptr<ThreadPoolToken> raft_pool_token_;
 
+  // Serial threadpool token on which the replication callbacks of committed
+  // rounds run when --raft_deliver_commits_async is set.
+  std::unique_ptr<ThreadPoolToken> commit_delivery_token_;
+
   scoped_refptr<log::Log> log_;
   scoped_refptr<ITimeManager> time_manager_;
   std::unique_ptr<PeerProxyFactory> peer_proxy_factory_;
@@ -1394,6 +1467,14 @@ class RaftConsensus : public std::enable_shared_from_this<RaftConsensus>,
 
   std::shared_ptr<rpc::PeriodicTimer> failure_detector_;
   std::chrono::system_clock::time_point failure_detector_last_snoozed_;
+
+  // The intervals between the requests from the current leader, and the
+  // leader and term they came from. Only accessed under 'update_lock_',
+  // except for the detector which is thread-safe.
+  std::unique_ptr<PhiAccrualFailureDetector> leader_heartbeats_;
+  std::string heartbeats_leader_uuid_;
+  int64_t heartbeats_leader_term_ = -1;
+  scoped_refptr<Histogram> leader_heartbeat_interval_histogram_;
   folly::Synchronized<std::optional<MonoDelta>> failure_detector_time_left_ =
       {};
 
@@ -1499,6 +1580,14 @@ class RaftConsensus : public std::enable_shared_from_this<RaftConsensus>,
 
   faststring compression_buffer_;
 
+  // Samples leader payloads and trains compression dictionaries from them
+  // when --compression_dict_training_enabled is set.
+  std::unique_ptr<CompressionDictTrainer> dict_trainer_;
+
+  // Decides which leader payloads are worth compressing when
+  // --compression_adaptive is set.
+  std::unique_ptr<CompressionPolicy> compression_policy_;
+
   CheckQuorumFailureCallback check_quorum_failure_callback_;
   int32_t check_quorum_interval_heartbeats_;
   std::mutex check_quorum_running_;
@@ -86,6 +86,7 @@
 
 DECLARE_int32(raft_heartbeat_interval_ms);
 DECLARE_bool(enable_leader_failure_detection);
+DECLARE_bool(raft_deliver_commits_async);
 
 // METRIC_DECLARE_entity(tablet);
 
@@ -726,6 +727,79 @@ TEST_F(RaftConsensusQuorumTest, TestFollowersReplicateAndCommitSequence) {
   VerifyLogs(2, 0, 1);
 }
 
+// Same as above, but with the replication callbacks delivered outside of the
+// consensus lock.
+TEST_F(RaftConsensusQuorumTest, TestReplicateAndCommitWithAsyncCommitDelivery) {
+  FLAGS_raft_deliver_commits_async = true;
+  const int kFollower0Idx = 0;
+  const int kFollower1Idx = 1;
+  const int kLeaderIdx = 2;
+
+  ASSERT_OK(BuildAndStartConfig(3));
+
+  OpId last_op_id;
+  vector<scoped_refptr<ConsensusRound>> rounds;
+  shared_ptr<Synchronizer> commit_sync;
+
+  NO_FATALS(ReplicateSequenceOfMessages(
+      100,
+      kLeaderIdx,
+      WAIT_FOR_ALL_REPLICAS,
+      DONT_COMMIT,
+      &last_op_id,
+      &rounds,
+      &commit_sync));
+
+  for (const scoped_refptr<ConsensusRound>& round : rounds) {
+    ASSERT_OK(CommitDummyMessage(kLeaderIdx, round.get(), &commit_sync));
+  }
+
+  ASSERT_OK(commit_sync->Wait());
+  WaitForCommitIfNotAlreadyPresent(
+      last_op_id.index(), kFollower0Idx, kLeaderIdx);
+  WaitForCommitIfNotAlreadyPresent(
+      last_op_id.index(), kFollower1Idx, kLeaderIdx);
+  VerifyLogs(2, 0, 1);
+}
+
+// Tests that with the replication callbacks delivered outside of the consensus
+// lock, config changes, whose callbacks need the lock, still commit.
+TEST_F(RaftConsensusQuorumTest, TestChangeConfigWithAsyncCommitDelivery) {
+  FLAGS_raft_deliver_commits_async = true;
+  const int kFollower0Idx = 0;
+  const int kLeaderIdx = 2;
+
+  ASSERT_OK(BuildAndStartConfig(3));
+  shared_ptr<RaftConsensus> leader;
+  ASSERT_OK(peers_->GetPeerByIdx(kLeaderIdx, &leader));
+
+  OpId last_op_id;
+  vector<scoped_refptr<ConsensusRound>> rounds;
+  NO_FATALS(ReplicateSequenceOfMessages(
+      10,
+      kLeaderIdx,
+      WAIT_FOR_MAJORITY,
+      COMMIT_ONE_BY_ONE,
+      &last_op_id,
+      &rounds));
+
+  ChangeConfigRequestPB req;
+  req.set_tablet_id(kTestTablet);
+  req.set_type(REMOVE_PEER);
+  req.mutable_server()->set_permanent_uuid(
+      config_.peers(kFollower0Idx).permanent_uuid());
+  Synchronizer sync;
+  std::optional<ServerErrorPB::Code> error_code;
+  ASSERT_OK(
+      leader->ChangeConfig(req, sync.AsStdStatusCallback(), &error_code));
+  ASSERT_OK(sync.Wait());
+
+  RaftConfigPB committed_config = leader->CommittedConfig();
+  ASSERT_EQ(2, committed_config.peers_size());
+  ASSERT_FALSE(IsRaftConfigMember(
+      config_.peers(kFollower0Idx).permanent_uuid(), committed_config));
+}
+
 TEST_F(RaftConsensusQuorumTest, TestConsensusContinuesIfAMinorityFallsBehind) {
   // Constants with the indexes of peers with certain roles,
   // since peers don't change roles in this test.
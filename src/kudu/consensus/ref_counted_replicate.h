@@ -17,22 +17,54 @@
 
 #pragma once
 
+#include <memory>
+#include <tuple>
+#include <utility>
+
+#include <glog/logging.h>
+
 #include "kudu/consensus/consensus.pb.h"
 #include "kudu/gutil/ref_counted.h"
 
+namespace google {
+namespace protobuf {
+class Arena;
+} // namespace protobuf
+} // namespace google
+
 namespace kudu::consensus {
 
 // A simple ref-counted wrapper around ReplicateMsg.
+//
+// The message is either owned by the wrapper, or allocated on 'arena' (e.g.
+// the arena of the request it was received in), in which case the wrapper
+// keeps the arena alive instead.
 class RefCountedReplicate : public RefCountedThreadSafe<RefCountedReplicate> {
  public:
   explicit RefCountedReplicate(ReplicateMsg* msg) : msg_(msg) {}
 
+  RefCountedReplicate(
+      ReplicateMsg* msg,
+      std::shared_ptr<google::protobuf::Arena> arena)
+      : msg_(msg), arena_(std::move(arena)) {
+    if (arena_) {
+      DCHECK_EQ(msg->GetArena(), arena_.get());
+    }
+  }
+
+  ~RefCountedReplicate() {
+    if (arena_) {
+      std::ignore = msg_.release();
+    }
+  }
+
   ReplicateMsg* get() {
     return msg_.get();
   }
 
  private:
   std::unique_ptr<ReplicateMsg> msg_;
+  const std::shared_ptr<google::protobuf::Arena> arena_;
 };
 
 using ReplicateRefPtr = scoped_refptr<RefCountedReplicate>;
@@ -41,4 +73,12 @@ inline ReplicateRefPtr make_scoped_refptr_replicate(ReplicateMsg* replicate) {
   return ReplicateRefPtr(new RefCountedReplicate(replicate));
 }
 
+// Like the above, for a message allocated on 'arena', or on the heap if
+// 'arena' is null.
+inline ReplicateRefPtr make_scoped_refptr_replicate(
+    ReplicateMsg* replicate,
+    std::shared_ptr<google::protobuf::Arena> arena) {
+  return ReplicateRefPtr(new RefCountedReplicate(replicate, std::move(arena)));
+}
+
 } // namespace kudu::consensus
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "kudu/consensus/compression_policy.h"
 #include "kudu/consensus/ref_counted_replicate.h"
 #include "kudu/gutil/strings/substitute.h"
 #include "kudu/util/compression/compression.pb.h"
@@ -13,14 +14,19 @@ namespace kudu::consensus {
  * Thin wrapper to handle compression/decompression of replicate msg
  *
  * Pass any msg (compressed or uncompressed) to the constructor and then call
- * Init() to populate both the compressed and uncompressed msgs.
+ * Init() to populate both the compressed and uncompressed msgs. If a
+ * CompressionPolicy is passed as well, it may decide that an uncompressed msg
+ * isn't worth compressing, in which case only the uncompressed msg is
+ * populated.
  */
 class ReplicateMsgWrapper {
  public:
   explicit ReplicateMsgWrapper(
       const ReplicateRefPtr& msg,
-      const bool should_compress = true) {
+      const bool should_compress = true,
+      CompressionPolicy* policy = nullptr) {
     orig_msg_ = msg;
+    policy_ = policy;
     auto codec_hint = CompressionCodecManager::GetCurrentCodec();
     const CompressionType msg_codec_type =
         orig_msg_->get()->write_payload().compression_codec();
@@ -29,6 +35,10 @@ class ReplicateMsgWrapper {
       codec_ = codec_hint;
       should_compress_ = should_compress &&
           msg_->get()->op_type() == WRITE_OP_EXT && codec_ != nullptr;
+      if (should_compress_ && policy_) {
+        should_compress_ = policy_->ShouldCompress(
+            codec_->type(), msg_->get()->write_payload().payload().size());
+      }
     } else {
       compressed_msg_ = orig_msg_;
       CHECK_OK(CompressionCodecManager::SetCurrentCodec(msg_codec_type));
@@ -179,6 +189,13 @@ class ReplicateMsgWrapper {
       return status;
     }
 
+    if (policy_ &&
+        !policy_->RecordCompression(
+            codec_->type(), uncompressed_slice.size(), compressed_len)) {
+      // Not worth it: replicate the payload uncompressed.
+      return Status::OK();
+    }
+
     // Resize buffer to the actual compressed length
     buffer->resize(compressed_len);
     VLOG(2) << "Compressed OpId: " << msg_->get()->id().ShortDebugString()
@@ -211,6 +228,8 @@ class ReplicateMsgWrapper {
   bool should_compress_ = false;
   // The compression codec to use
   std::shared_ptr<CompressionCodec> codec_ = nullptr;
+  // Decides whether compressing is worth it, if set
+  CompressionPolicy* policy_ = nullptr;
   // Buffer used for compression if user hasn't provided one
   std::shared_ptr<faststring> compression_buffer_;
 };
@@ -0,0 +1,191 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "kudu/consensus/serialized_ops_cache.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "kudu/consensus/consensus.pb.h"
+#include "kudu/consensus/opid_util.h"
+#include "kudu/consensus/ref_counted_replicate.h"
+#include "kudu/util/compression/compression_codec.h"
+#include "kudu/util/test_macros.h"
+
+DECLARE_int32(consensus_max_uncompressed_ops_bytes);
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace kudu {
+namespace consensus {
+
+namespace {
+
+vector<ReplicateRefPtr> MakeOps(int64_t term, int64_t first, int64_t last) {
+  vector<ReplicateRefPtr> ops;
+  for (int64_t index = first; index <= last; index++) {
+    ReplicateRefPtr op = make_scoped_refptr_replicate(new ReplicateMsg);
+    *op->get()->mutable_id() = MakeOpId(term, index);
+    op->get()->set_timestamp(index);
+    op->get()->set_op_type(NO_OP);
+    op->get()->mutable_noop_request()->set_payload_for_tests(
+        string(100, 'a' + index % 4));
+    ops.emplace_back(std::move(op));
+  }
+  return ops;
+}
+
+} // anonymous namespace
+
+// Tests that the encoding, appended to a request serialized without ops,
+// parses back into the request with the ops.
+TEST(SerializedOpsCacheTest, TestEncodingMatchesRequest) {
+  SerializedOpsCache cache(4);
+  vector<ReplicateRefPtr> ops = MakeOps(1, 1, 10);
+
+  ConsensusRequestPB request;
+  request.set_tablet_id("tablet");
+  request.set_caller_uuid("leader");
+  request.set_caller_term(1);
+  *request.mutable_preceding_id() = MinimumOpId();
+  string wire = request.SerializeAsString();
+  wire += *cache.Get(ops);
+
+  for (const ReplicateRefPtr& op : ops) {
+    *request.add_ops() = *op->get();
+  }
+  ConsensusRequestPB parsed;
+  ASSERT_TRUE(parsed.ParseFromString(wire));
+  ASSERT_EQ(request.SerializeAsString(), parsed.SerializeAsString());
+}
+
+TEST(SerializedOpsCacheTest, TestRunsAreEncodedOnce) {
+  SerializedOpsCache cache(2);
+  shared_ptr<const string> a = cache.Get(MakeOps(1, 1, 5));
+  ASSERT_EQ(a, cache.Get(MakeOps(1, 1, 5)));
+
+  // Runs are identified by their first and last op ids.
+  shared_ptr<const string> b = cache.Get(MakeOps(1, 3, 5));
+  ASSERT_NE(a, b);
+  ASSERT_NE(a, cache.Get(MakeOps(2, 1, 5)));
+
+  // Adding a third run evicted the least recently requested one.
+  ASSERT_EQ(b, cache.Get(MakeOps(1, 3, 5)));
+  ASSERT_NE(a, cache.Get(MakeOps(1, 1, 5)));
+
+  cache.Clear();
+  ASSERT_NE(b, cache.Get(MakeOps(1, 3, 5)));
+}
+
+// Tests that peers asking for the same run at the same time, while it's
+// encoded outside of the cache's lock, all get the same encoding.
+TEST(SerializedOpsCacheTest, TestConcurrentGets) {
+  SerializedOpsCache cache(4);
+  const int kNumThreads = 8;
+  vector<shared_ptr<const string>> encoded(kNumThreads);
+  vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back(
+        [&, i]() { encoded[i] = cache.Get(MakeOps(1, 1, 100)); });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  shared_ptr<const string> cached = cache.Get(MakeOps(1, 1, 100));
+  for (const auto& e : encoded) {
+    ASSERT_EQ(*cached, *e);
+  }
+}
+
+// Tests that ops compressed as a whole uncompress into the same request as
+// the plain encoding.
+TEST(SerializedOpsCacheTest, TestCompressedOps) {
+  SerializedOpsCache cache(4);
+  vector<ReplicateRefPtr> ops = MakeOps(1, 1, 50);
+  std::shared_ptr<CompressionCodec> codec;
+  ASSERT_OK(CompressionCodecManager::GetCodec(ZSTD, &codec));
+
+  ConsensusRequestPB request;
+  request.set_tablet_id("tablet");
+  request.set_caller_uuid("leader");
+  request.set_caller_term(1);
+  *request.mutable_preceding_id() = MinimumOpId();
+  const string header = request.SerializeAsString();
+
+  shared_ptr<const string> compressed = cache.GetCompressed(ops, codec.get());
+  ASSERT_LT(compressed->size(), cache.Get(ops)->size() / 4);
+  // Compressed once for all peers.
+  ASSERT_EQ(compressed, cache.GetCompressed(ops, codec.get()));
+
+  ConsensusRequestPB parsed;
+  ASSERT_TRUE(parsed.ParseFromString(header + *compressed));
+  ASSERT_EQ(0, parsed.ops_size());
+  ASSERT_TRUE(parsed.has_compressed_ops());
+  ASSERT_EQ(ZSTD, parsed.compressed_ops_codec());
+  ASSERT_OK(UncompressOps(&parsed));
+  ASSERT_FALSE(parsed.has_compressed_ops());
+
+  ConsensusRequestPB expected;
+  ASSERT_TRUE(expected.ParseFromString(header + *cache.Get(ops)));
+  ASSERT_EQ(expected.SerializeAsString(), parsed.SerializeAsString());
+
+  // Requests with plain ops are left alone.
+  ASSERT_OK(UncompressOps(&expected));
+  ASSERT_EQ(50, expected.ops_size());
+}
+
+TEST(SerializedOpsCacheTest, TestCorruptCompressedOps) {
+  gflags::FlagSaver saver;
+  SerializedOpsCache cache(4);
+  vector<ReplicateRefPtr> ops = MakeOps(1, 1, 50);
+  std::shared_ptr<CompressionCodec> codec;
+  ASSERT_OK(CompressionCodecManager::GetCodec(ZSTD, &codec));
+
+  ConsensusRequestPB request;
+  ASSERT_TRUE(request.ParsePartialFromString(
+      *cache.GetCompressed(ops, codec.get())));
+  request.set_compressed_ops_uncompressed_size(
+      request.compressed_ops_uncompressed_size() - 1);
+  ASSERT_FALSE(UncompressOps(&request).ok());
+
+  ASSERT_TRUE(request.ParsePartialFromString(
+      *cache.GetCompressed(ops, codec.get())));
+  request.mutable_compressed_ops()->resize(
+      request.compressed_ops().size() / 2);
+  ASSERT_FALSE(UncompressOps(&request).ok());
+
+  // Sizes protobuf couldn't parse are rejected even if the limit allows them.
+  FLAGS_consensus_max_uncompressed_ops_bytes = -1;
+  ASSERT_TRUE(request.ParsePartialFromString(
+      *cache.GetCompressed(ops, codec.get())));
+  request.set_compressed_ops_uncompressed_size(
+      static_cast<uint64_t>(std::numeric_limits<int>::max()) + 1);
+  Status s = UncompressOps(&request);
+  ASSERT_TRUE(s.IsInvalidArgument()) << s.ToString();
+}
+
+} // namespace consensus
+} // namespace kudu
@@ -0,0 +1,271 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "kudu/consensus/serialized_ops_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "kudu/consensus/consensus.pb.h"
+#include "kudu/consensus/opid_util.h"
+#include "kudu/gutil/strings/substitute.h"
+#include "kudu/util/compression/compression_codec.h"
+#include "kudu/util/faststring.h"
+#include "kudu/util/flag_tags.h"
+#include "kudu/util/logging.h"
+
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+DEFINE_int32(
+    consensus_max_uncompressed_ops_bytes,
+    512 * 1024 * 1024,
+    "Requests whose compressed ops claim to uncompress to more than this many "
+    "bytes are rejected");
+TAG_FLAG(consensus_max_uncompressed_ops_bytes, advanced);
+
+namespace kudu {
+namespace consensus {
+
+SerializedOpsCache::SerializedOpsCache(size_t capacity)
+    : capacity_(capacity) {
+  DCHECK_GT(capacity_, 0);
+}
+
+shared_ptr<const string> SerializedOpsCache::Get(
+    const vector<ReplicateRefPtr>& ops) {
+  {
+    MutexLock l(lock_);
+    if (const Entry* entry = FindUnlocked(ops)) {
+      return entry->encoded;
+    }
+  }
+  shared_ptr<const string> encoded = Encode(ops);
+  MutexLock l(lock_);
+  return AddUnlocked(ops, std::move(encoded))->encoded;
+}
+
+shared_ptr<const string> SerializedOpsCache::GetCompressed(
+    const vector<ReplicateRefPtr>& ops,
+    CompressionCodec* codec) {
+  DCHECK(codec);
+  const unsigned int dict_id =
+      CompressionCodecManager::GetCurrentDictionaryID();
+  auto compressed_matches = [&](const Entry& entry) {
+    return entry.compressed && entry.compressed_codec == codec->type() &&
+        entry.compressed_dict_id == dict_id;
+  };
+
+  shared_ptr<const string> encoded;
+  {
+    MutexLock l(lock_);
+    if (const Entry* entry = FindUnlocked(ops)) {
+      if (compressed_matches(*entry)) {
+        return entry->compressed;
+      }
+      encoded = entry->encoded;
+    }
+  }
+  if (!encoded) {
+    encoded = Encode(ops);
+  }
+  shared_ptr<const string> compressed = Compress(encoded, codec);
+
+  MutexLock l(lock_);
+  Entry* entry = AddUnlocked(ops, std::move(encoded));
+  if (compressed_matches(*entry)) {
+    // Another peer compressed the run in the meantime.
+    return entry->compressed;
+  }
+  entry->compressed = std::move(compressed);
+  entry->compressed_codec = codec->type();
+  entry->compressed_dict_id = dict_id;
+  return entry->compressed;
+}
+
+SerializedOpsCache::Entry* SerializedOpsCache::FindUnlocked(
+    const vector<ReplicateRefPtr>& ops) {
+  lock_.AssertAcquired();
+  DCHECK(!ops.empty());
+  const OpId& first = ops.front()->get()->id();
+  const OpId& last = ops.back()->get()->id();
+
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (OpIdEquals(it->first, first) && OpIdEquals(it->last, last)) {
+      Entry entry = std::move(*it);
+      entries_.erase(it);
+      entries_.emplace_back(std::move(entry));
+      return &entries_.back();
+    }
+  }
+  return nullptr;
+}
+
+SerializedOpsCache::Entry* SerializedOpsCache::AddUnlocked(
+    const vector<ReplicateRefPtr>& ops,
+    shared_ptr<const string> encoded) {
+  if (Entry* entry = FindUnlocked(ops)) {
+    // Another peer added the run in the meantime.
+    return entry;
+  }
+  if (entries_.size() >= capacity_) {
+    entries_.pop_front();
+  }
+  Entry entry;
+  entry.first = ops.front()->get()->id();
+  entry.last = ops.back()->get()->id();
+  entry.encoded = std::move(encoded);
+  entries_.emplace_back(std::move(entry));
+  return &entries_.back();
+}
+
+void SerializedOpsCache::Clear() {
+  MutexLock l(lock_);
+  entries_.clear();
+}
+
+shared_ptr<const string> SerializedOpsCache::Encode(
+    const vector<ReplicateRefPtr>& ops) {
+  auto encoded = std::make_shared<string>();
+  {
+    StringOutputStream stream(encoded.get());
+    CodedOutputStream out(&stream);
+    const uint32_t tag = WireFormatLite::MakeTag(
+        ConsensusRequestPB::kOpsFieldNumber,
+        WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+    for (const ReplicateRefPtr& op : ops) {
+      const ReplicateMsg* msg = op->get();
+      out.WriteTag(tag);
+      out.WriteVarint32(msg->ByteSizeLong());
+      msg->SerializeWithCachedSizes(&out);
+    }
+  }
+  return encoded;
+}
+
+shared_ptr<const string> SerializedOpsCache::Compress(
+    const shared_ptr<const string>& encoded,
+    CompressionCodec* codec) {
+  faststring buffer;
+  buffer.resize(codec->MaxCompressedLength(encoded->size()));
+  size_t compressed_size;
+  Status s = codec->CompressWithStats(
+      Slice(*encoded), buffer.data(), &compressed_size);
+  if (PREDICT_FALSE(!s.ok())) {
+    KLOG_EVERY_N_SECS(WARNING, 60)
+        << "Unable to compress ops, sending them uncompressed: "
+        << s.ToString() << THROTTLE_MSG;
+    return encoded;
+  }
+  if (compressed_size >= encoded->size() ||
+      compressed_size > std::numeric_limits<int>::max()) {
+    return encoded;
+  }
+
+  auto compressed = std::make_shared<string>();
+  {
+    StringOutputStream stream(compressed.get());
+    CodedOutputStream out(&stream);
+    out.WriteTag(WireFormatLite::MakeTag(
+        ConsensusRequestPB::kCompressedOpsFieldNumber,
+        WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    out.WriteVarint32(compressed_size);
+    out.WriteRaw(buffer.data(), compressed_size);
+    out.WriteTag(WireFormatLite::MakeTag(
+        ConsensusRequestPB::kCompressedOpsCodecFieldNumber,
+        WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint32SignExtended(codec->type());
+    out.WriteTag(WireFormatLite::MakeTag(
+        ConsensusRequestPB::kCompressedOpsUncompressedSizeFieldNumber,
+        WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint64(encoded->size());
+  }
+  return compressed;
+}
+
+Status UncompressOps(ConsensusRequestPB* request) {
+  if (!request->has_compressed_ops()) {
+    return Status::OK();
+  }
+  if (request->ops_size() > 0) {
+    return Status::InvalidArgument("Request has both ops and compressed ops");
+  }
+  const uint64_t size = request->compressed_ops_uncompressed_size();
+  // Protobuf can't parse more than INT_MAX bytes, whatever the flag says.
+  if (size >
+      std::min<uint64_t>(
+          std::max(FLAGS_consensus_max_uncompressed_ops_bytes, 0),
+          std::numeric_limits<int>::max())) {
+    return Status::InvalidArgument(strings::Substitute(
+        "Compressed ops uncompress to $0 bytes, more than the maximum of $1",
+        size,
+        FLAGS_consensus_max_uncompressed_ops_bytes));
+  }
+
+  // The dictionary may be new to this follower, in which case it comes with
+  // the request. It must stay registered until the ops are uncompressed.
+  const CompressionDictRef dict_ref(
+      CompressionCodecManager::GetFrameDictionaryID(
+          request->compressed_ops_codec(), Slice(request->compressed_ops())));
+  if (request->has_compression_dictionary()) {
+    CompressionCodecManager::RegisterDictionary(
+        request->compression_dictionary());
+  }
+  std::shared_ptr<CompressionCodec> codec =
+      CompressionCodecManager::GetCurrentCodec();
+  if (!codec || codec->type() != request->compressed_ops_codec()) {
+    // The leader switched codecs, and the ops of this request are the first
+    // to say so.
+    RETURN_NOT_OK(CompressionCodecManager::GetCodec(
+        request->compressed_ops_codec(), &codec));
+    if (!codec) {
+      return Status::InvalidArgument("Compressed ops have no codec");
+    }
+    RETURN_NOT_OK(
+        codec->SetDictionary(CompressionCodecManager::GetDictionary()));
+  }
+
+  faststring encoded;
+  encoded.resize(size);
+  RETURN_NOT_OK(codec->UncompressWithStats(
+      Slice(request->compressed_ops()), encoded.data(), size));
+  request->clear_compressed_ops();
+  request->clear_compressed_ops_codec();
+  request->clear_compressed_ops_uncompressed_size();
+  CodedInputStream in(encoded.data(), static_cast<int>(size));
+  in.SetTotalBytesLimit(static_cast<int>(size));
+  if (!request->MergeFromCodedStream(&in)) {
+    return Status::Corruption("Unable to parse uncompressed ops");
+  }
+  return Status::OK();
+}
+
+} // namespace consensus
+} // namespace kudu
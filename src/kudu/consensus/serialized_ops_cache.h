@@ -0,0 +1,122 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "kudu/consensus/opid.pb.h"
+#include "kudu/consensus/ref_counted_replicate.h"
+#include "kudu/gutil/macros.h"
+#include "kudu/util/compression/compression.pb.h"
+#include "kudu/util/mutex.h"
+#include "kudu/util/status.h"
+
+namespace kudu {
+
+class CompressionCodec;
+
+namespace consensus {
+
+class ConsensusRequestPB;
+
+// Caches the wire encoding of the runs of ops that the leader sends to its
+// peers, so that a run sent to several peers is serialized once rather than
+// once per peer. The encoding is that of the 'ops' field of a
+// ConsensusRequestPB, ready to be appended to the rest of the request with
+// rpc::RpcController::SetSerializedRequestFields().
+//
+// A run is identified by the ids of its first and last ops: by Raft's Log
+// Matching Property, two runs with the same first and last op ids hold the
+// same ops.
+//
+// This class is thread-safe.
+class SerializedOpsCache {
+ public:
+  // Creates a cache which keeps the encoding of the 'capacity' most recently
+  // requested runs.
+  explicit SerializedOpsCache(size_t capacity);
+
+  // Returns the encoding of 'ops', which must not be empty, encoding it if it
+  // isn't cached yet.
+  std::shared_ptr<const std::string> Get(
+      const std::vector<ReplicateRefPtr>& ops);
+
+  // Same as above, but the encoding of 'ops' is compressed as a whole with
+  // 'codec' and returned as the 'compressed_ops' fields of a
+  // ConsensusRequestPB, to be decoded with UncompressOps(). Falls back to the
+  // plain encoding if compressing fails or doesn't make it any smaller.
+  std::shared_ptr<const std::string> GetCompressed(
+      const std::vector<ReplicateRefPtr>& ops,
+      CompressionCodec* codec);
+
+  // Drops all the cached runs.
+  void Clear();
+
+ private:
+  struct Entry {
+    OpId first;
+    OpId last;
+    std::shared_ptr<const std::string> encoded;
+
+    // The compressed encoding, and the codec and dictionary it was compressed
+    // with, if it was asked for.
+    std::shared_ptr<const std::string> compressed;
+    CompressionType compressed_codec = NO_COMPRESSION;
+    unsigned int compressed_dict_id = 0;
+  };
+
+  // Returns the entry of 'ops', or nullptr if they aren't cached.
+  Entry* FindUnlocked(const std::vector<ReplicateRefPtr>& ops);
+
+  // Returns the entry of 'ops', adding one with 'encoded' if they aren't
+  // cached.
+  Entry* AddUnlocked(
+      const std::vector<ReplicateRefPtr>& ops,
+      std::shared_ptr<const std::string> encoded);
+
+  static std::shared_ptr<const std::string> Encode(
+      const std::vector<ReplicateRefPtr>& ops);
+
+  static std::shared_ptr<const std::string> Compress(
+      const std::shared_ptr<const std::string>& encoded,
+      CompressionCodec* codec);
+
+  const size_t capacity_;
+
+  // Protects 'entries_'. Runs are encoded and compressed without holding it,
+  // so that peers asking for different runs don't wait for each other. Peers
+  // asking for the same uncached run at the same time may each encode it;
+  // the first to add it wins.
+  Mutex lock_;
+
+  // The cached runs, the most recently requested last.
+  std::deque<Entry> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(SerializedOpsCache);
+};
+
+// Replaces the 'compressed_ops' of 'request', if any, with the ops they
+// encode.
+Status UncompressOps(ConsensusRequestPB* request);
+
+} // namespace consensus
+} // namespace kudu
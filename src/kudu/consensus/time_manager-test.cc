@@ -15,6 +15,7 @@
 // specific language governing permissions and limitations
 // under the License.
 
+#include <atomic>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -213,5 +214,62 @@ TEST_F(TimeManagerTest, TestTimeManagerLeaderMode) {
   after_latch->Wait();
 }
 
+// Tests that asynchronous waiters are released in timestamp order, only once
+// safe time moves past them, and that they time out without blocking anyone.
+TEST_F(TimeManagerTest, TestWaitUntilSafeAsync) {
+  Timestamp init = clock_->Now();
+  InitTimeManager(init);
+
+  const int kNumWaiters = 10;
+  std::vector<Timestamp> timestamps;
+  for (int i = 0; i < kNumWaiters; i++) {
+    timestamps.emplace_back(init.value() + 1 + i);
+  }
+  std::atomic<int> num_done(0);
+  std::vector<Status> statuses(kNumWaiters);
+  // Register the waiters out of order.
+  for (int i = kNumWaiters - 1; i >= 0; i--) {
+    time_manager_->WaitUntilSafeAsync(
+        timestamps[i], MonoTime::Max(), [&, i](const Status& s) {
+          statuses[i] = s;
+          num_done++;
+        });
+  }
+  ASSERT_EQ(0, num_done);
+  // Asynchronous waiters are only released once the local clock is past them.
+  ASSERT_OK(clock_->WaitUntilAfterLocally(timestamps.back(), MonoTime::Max()));
+
+  // Advancing safe time halfway should release exactly the first half.
+  time_manager_->AdvanceSafeTime(timestamps[kNumWaiters / 2 - 1]);
+  ASSERT_EQ(kNumWaiters / 2, num_done);
+  for (int i = 0; i < kNumWaiters / 2; i++) {
+    ASSERT_OK(statuses[i]);
+  }
+
+  // ... and advancing it past the rest should release the rest.
+  time_manager_->AdvanceSafeTime(timestamps.back());
+  ASSERT_EQ(kNumWaiters, num_done);
+  for (const auto& s : statuses) {
+    ASSERT_OK(s);
+  }
+
+  // A timestamp that is already safe is notified inline.
+  Status inline_status = Status::Incomplete("");
+  time_manager_->WaitUntilSafeAsync(
+      init, MonoTime::Max(), [&](const Status& s) { inline_status = s; });
+  ASSERT_OK(inline_status);
+
+  // A waiter whose deadline elapses is failed with TimedOut once expired.
+  Status timed_out_status = Status::Incomplete("");
+  time_manager_->WaitUntilSafeAsync(
+      Timestamp(timestamps.back().value() + 1),
+      MonoTime::Now() + MonoDelta::FromMilliseconds(10),
+      [&](const Status& s) { timed_out_status = s; });
+  ASSERT_TRUE(timed_out_status.IsIncomplete());
+  SleepFor(MonoDelta::FromMilliseconds(20));
+  time_manager_->ExpireTimedOutWaiters();
+  ASSERT_TRUE(timed_out_status.IsTimedOut()) << timed_out_status.ToString();
+}
+
 } // namespace consensus
 } // namespace kudu
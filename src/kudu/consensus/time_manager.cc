@@ -23,8 +23,11 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <memory>
 #include <mutex>
 #include <ostream>
+#include <utility>
+#include <vector>
 
 #include <gflags/gflags.h>
 #include <gflags/gflags_declare.h>
@@ -93,14 +96,19 @@ TimeManager::TimeManager(
     Timestamp initial_safe_time)
     : last_serial_ts_assigned_(initial_safe_time),
       last_safe_ts_(initial_safe_time),
+      num_pending_waiters_(0),
       last_advanced_safe_time_(MonoTime::Now()),
       mode_(NON_LEADER),
       clock_(std::move(clock)) {}
 
 void TimeManager::SetLeaderMode() {
-  Lock l(lock_);
-  mode_ = LEADER;
-  AdvanceSafeTimeAndWakeUpWaitersUnlocked(clock_->Now());
+  WaiterNotifications notifications;
+  {
+    Lock l(lock_);
+    mode_ = LEADER;
+    AdvanceSafeTimeAndWakeUpWaitersUnlocked(clock_->Now(), &notifications);
+  }
+  RunNotifications(&notifications);
 }
 
 void TimeManager::SetNonLeaderMode() {
@@ -168,18 +176,26 @@ Status TimeManager::MessageReceivedFromLeader(const ReplicateMsg& message) {
 }
 
 void TimeManager::AdvanceSafeTimeWithMessage(const ReplicateMsg& message) {
-  Lock l(lock_);
-  if (GetMessageConsistencyMode(message) == CLIENT_PROPAGATED) {
-    AdvanceSafeTimeAndWakeUpWaitersUnlocked(Timestamp(message.timestamp()));
+  WaiterNotifications notifications;
+  {
+    Lock l(lock_);
+    if (GetMessageConsistencyMode(message) == CLIENT_PROPAGATED) {
+      AdvanceSafeTimeAndWakeUpWaitersUnlocked(
+          Timestamp(message.timestamp()), &notifications);
+    }
   }
+  RunNotifications(&notifications);
 }
 
 void TimeManager::AdvanceSafeTime(Timestamp safe_time) {
-  Lock l(lock_);
-  CHECK_EQ(mode_, NON_LEADER)
-      << "Cannot advance safe time by timestamp in leader mode.";
-  ;
-  AdvanceSafeTimeAndWakeUpWaitersUnlocked(safe_time);
+  WaiterNotifications notifications;
+  {
+    Lock l(lock_);
+    CHECK_EQ(mode_, NON_LEADER)
+        << "Cannot advance safe time by timestamp in leader mode.";
+    AdvanceSafeTimeAndWakeUpWaitersUnlocked(safe_time, &notifications);
+  }
+  RunNotifications(&notifications);
 }
 
 bool TimeManager::HasAdvancedSafeTimeRecentlyUnlocked(string* error_message) {
@@ -246,29 +262,37 @@ void TimeManager::MakeWaiterTimeoutMessageUnlocked(
       clock_diff);
 }
 
-Status TimeManager::WaitUntilSafe(
-    Timestamp timestamp,
-    const MonoTime& deadline) {
-  string error_message;
+bool TimeManager::PreflightWaitUnlocked(Timestamp timestamp, Status* status) {
+  DCHECK(lock_.is_locked());
 
-  // Pre-flight checks:
   // - If this timestamp is before the last safe time return.
   // - If we're not the leader make sure we've heard from the leader recently.
   // - If we're not the leader make sure safe time isn't lagging too much.
-  {
-    Lock l(lock_);
-    if (timestamp < GetSafeTimeUnlocked()) {
-      return Status::OK();
-    }
+  if (timestamp < GetSafeTimeUnlocked()) {
+    *status = Status::OK();
+    return true;
+  }
 
-    if (mode_ == NON_LEADER) {
-      if (IsSafeTimeLaggingUnlocked(timestamp, &error_message)) {
-        return Status::TimedOut(error_message);
-      }
+  if (mode_ == NON_LEADER) {
+    string error_message;
+    if (IsSafeTimeLaggingUnlocked(timestamp, &error_message) ||
+        !HasAdvancedSafeTimeRecentlyUnlocked(&error_message)) {
+      *status = Status::TimedOut(error_message);
+      return true;
+    }
+  }
+  return false;
+}
 
-      if (!HasAdvancedSafeTimeRecentlyUnlocked(&error_message)) {
-        return Status::TimedOut(error_message);
-      }
+Status TimeManager::WaitUntilSafe(
+    Timestamp timestamp,
+    const MonoTime& deadline) {
+  // Pre-flight checks.
+  {
+    Lock l(lock_);
+    Status s;
+    if (PreflightWaitUnlocked(timestamp, &s)) {
+      return s;
     }
   }
 
@@ -280,9 +304,12 @@ Status TimeManager::WaitUntilSafe(
   }
 
   CountDownLatch latch(1);
-  WaitingState waiter;
-  waiter.timestamp = timestamp;
-  waiter.latch = &latch;
+  auto waiter = std::make_shared<WaitingState>();
+  waiter->timestamp = timestamp;
+  waiter->deadline = deadline;
+  waiter->callback = [&latch](const Status& /* s */) { latch.CountDown(); };
+  waiter->needs_clock_check = false;
+  waiter->done = false;
 
   // Register a waiter in waiters_
   {
@@ -290,30 +317,190 @@ Status TimeManager::WaitUntilSafe(
     if (IsTimestampSafeUnlocked(timestamp)) {
       return Status::OK();
     }
-    waiters_.push_back(&waiter);
+    AddWaiterUnlocked(waiter);
   }
 
   // Wait until we get notified or 'deadline' elapses.
-  if (waiter.latch->WaitUntil(deadline)) {
+  if (latch.WaitUntil(deadline)) {
     return Status::OK();
   }
 
   // Timed out, clean up.
   {
     Lock l(lock_);
-    // Address the case where we were notified after the timeout.
-    if (waiter.latch->count() == 0) {
-      return Status::OK();
+    if (!waiter->done) {
+      // The entry itself is lazily dropped from 'waiters_'.
+      waiter->done = true;
+      waiter->callback = nullptr;
+      num_pending_waiters_--;
+      MaybeCompactWaitersUnlocked();
+
+      string error_message;
+      MakeWaiterTimeoutMessageUnlocked(waiter->timestamp, &error_message);
+      return Status::TimedOut(error_message);
     }
+  }
 
-    waiters_.erase(std::find(waiters_.begin(), waiters_.end(), &waiter));
+  // We were notified after the timeout. The notification runs outside of
+  // 'lock_', so wait for it to land before 'latch' goes out of scope.
+  latch.Wait();
+  return Status::OK();
+}
 
-    MakeWaiterTimeoutMessageUnlocked(waiter.timestamp, &error_message);
-    return Status::TimedOut(error_message);
+void TimeManager::WaitUntilSafeAsync(
+    Timestamp timestamp,
+    const MonoTime& deadline,
+    StdStatusCallback callback) {
+  WaiterNotifications notifications;
+  {
+    Lock l(lock_);
+    Status s;
+    if (PreflightWaitUnlocked(timestamp, &s)) {
+      notifications.emplace_back(std::move(callback), std::move(s));
+    } else if (PREDICT_FALSE(MonoTime::Now() > deadline)) {
+      string error_message;
+      MakeWaiterTimeoutMessageUnlocked(timestamp, &error_message);
+      notifications.emplace_back(
+          std::move(callback), Status::TimedOut(error_message));
+    } else {
+      auto waiter = std::make_shared<WaitingState>();
+      waiter->timestamp = timestamp;
+      waiter->deadline = deadline;
+      waiter->callback = std::move(callback);
+      waiter->needs_clock_check = true;
+      waiter->done = false;
+      AddWaiterUnlocked(std::move(waiter));
+      // Piggyback on the registration to expire any stale waiters.
+      CollectExpiredWaitersUnlocked(&notifications);
+    }
   }
+  RunNotifications(&notifications);
 }
 
-void TimeManager::AdvanceSafeTimeAndWakeUpWaitersUnlocked(Timestamp safe_time) {
+void TimeManager::ExpireTimedOutWaiters() {
+  WaiterNotifications notifications;
+  {
+    Lock l(lock_);
+    CollectExpiredWaitersUnlocked(&notifications);
+  }
+  RunNotifications(&notifications);
+}
+
+void TimeManager::AddWaiterUnlocked(WaiterPtr waiter) {
+  DCHECK(lock_.is_locked());
+
+  if (waiter->needs_clock_check && waiter->deadline != MonoTime::Max()) {
+    waiter_deadlines_.push_back(waiter);
+    std::push_heap(
+        waiter_deadlines_.begin(),
+        waiter_deadlines_.end(),
+        WaiterDeadlineGreater());
+  }
+  waiters_.push_back(std::move(waiter));
+  std::push_heap(waiters_.begin(), waiters_.end(), WaiterTimestampGreater());
+  num_pending_waiters_++;
+}
+
+void TimeManager::FinishWaiterUnlocked(
+    const WaiterPtr& waiter,
+    Status status,
+    WaiterNotifications* notifications) {
+  DCHECK(lock_.is_locked());
+  DCHECK(!waiter->done);
+
+  waiter->done = true;
+  num_pending_waiters_--;
+  notifications->emplace_back(std::move(waiter->callback), std::move(status));
+  waiter->callback = nullptr;
+}
+
+void TimeManager::CollectReadyWaitersUnlocked(
+    Timestamp safe_time,
+    WaiterNotifications* notifications) {
+  DCHECK(lock_.is_locked());
+
+  while (!waiters_.empty()) {
+    const WaiterPtr& top = waiters_.front();
+    if (!top->done) {
+      if (top->timestamp > safe_time) {
+        break;
+      }
+      // Asynchronous waiters didn't wait for the local clock. Since the heap
+      // is ordered by timestamp, if the clock isn't past this waiter it isn't
+      // past any of the remaining ones either.
+      if (top->needs_clock_check && !clock_->IsAfter(top->timestamp)) {
+        break;
+      }
+      FinishWaiterUnlocked(top, Status::OK(), notifications);
+    }
+    std::pop_heap(waiters_.begin(), waiters_.end(), WaiterTimestampGreater());
+    waiters_.pop_back();
+  }
+  CollectExpiredWaitersUnlocked(notifications);
+}
+
+void TimeManager::CollectExpiredWaitersUnlocked(
+    WaiterNotifications* notifications) {
+  DCHECK(lock_.is_locked());
+
+  if (waiter_deadlines_.empty()) {
+    return;
+  }
+  MonoTime now = MonoTime::Now();
+  while (!waiter_deadlines_.empty()) {
+    const WaiterPtr& top = waiter_deadlines_.front();
+    if (!top->done) {
+      if (top->deadline > now) {
+        break;
+      }
+      string error_message;
+      MakeWaiterTimeoutMessageUnlocked(top->timestamp, &error_message);
+      FinishWaiterUnlocked(
+          top, Status::TimedOut(error_message), notifications);
+    }
+    std::pop_heap(
+        waiter_deadlines_.begin(),
+        waiter_deadlines_.end(),
+        WaiterDeadlineGreater());
+    waiter_deadlines_.pop_back();
+  }
+  MaybeCompactWaitersUnlocked();
+}
+
+void TimeManager::MaybeCompactWaitersUnlocked() {
+  DCHECK(lock_.is_locked());
+
+  // Entries of waiters that were finished out of order (timed out, or released
+  // before their deadline) linger in the heaps until they reach the top. Only
+  // pay for a rebuild once they make up most of a heap.
+  static constexpr size_t kMinCompactionSize = 64;
+  auto compact = [this](std::vector<WaiterPtr>* heap, auto cmp) {
+    if (heap->size() < kMinCompactionSize ||
+        heap->size() <= 2 * num_pending_waiters_) {
+      return;
+    }
+    heap->erase(
+        std::remove_if(
+            heap->begin(),
+            heap->end(),
+            [](const WaiterPtr& w) { return w->done; }),
+        heap->end());
+    std::make_heap(heap->begin(), heap->end(), cmp);
+  };
+  compact(&waiters_, WaiterTimestampGreater());
+  compact(&waiter_deadlines_, WaiterDeadlineGreater());
+}
+
+void TimeManager::RunNotifications(WaiterNotifications* notifications) {
+  for (auto& notification : *notifications) {
+    notification.first(notification.second);
+  }
+  notifications->clear();
+}
+
+void TimeManager::AdvanceSafeTimeAndWakeUpWaitersUnlocked(
+    Timestamp safe_time,
+    WaiterNotifications* notifications) {
   DCHECK(lock_.is_locked());
 
   if (safe_time <= last_safe_ts_) {
@@ -323,16 +510,7 @@ void TimeManager::AdvanceSafeTimeAndWakeUpWaitersUnlocked(Timestamp safe_time) {
   last_advanced_safe_time_ = MonoTime::Now();
 
   if (PREDICT_FALSE(!waiters_.empty())) {
-    auto iter = waiters_.begin();
-    while (iter != waiters_.end()) {
-      WaitingState* waiter = *iter;
-      if (IsTimestampSafeUnlocked(waiter->timestamp)) {
-        iter = waiters_.erase(iter);
-        waiter->latch->CountDown();
-        continue;
-      }
-      iter++;
-    }
+    CollectReadyWaitersUnlocked(GetSafeTimeUnlocked(), notifications);
   }
 }
 
@@ -346,8 +524,19 @@ bool TimeManager::IsTimestampSafeUnlocked(Timestamp timestamp) {
 }
 
 Timestamp TimeManager::GetSafeTime() {
-  Lock l(lock_);
-  return GetSafeTimeUnlocked();
+  WaiterNotifications notifications;
+  Timestamp safe_time;
+  {
+    Lock l(lock_);
+    safe_time = GetSafeTimeUnlocked();
+    // In leader mode safe time moves with the clock, so this may have made
+    // some waiters safe.
+    if (mode_ == LEADER && PREDICT_FALSE(!waiters_.empty())) {
+      CollectReadyWaitersUnlocked(safe_time, &notifications);
+    }
+  }
+  RunNotifications(&notifications);
+  return safe_time;
 }
 
 Timestamp TimeManager::GetSafeTimeUnlocked() {
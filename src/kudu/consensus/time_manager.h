@@ -16,7 +16,9 @@
 // under the License.
 #pragma once
 
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <gtest/gtest_prod.h>
@@ -28,13 +30,11 @@
 #include "kudu/util/locks.h"
 #include "kudu/util/monotime.h"
 #include "kudu/util/status.h"
+#include "kudu/util/status_callback.h"
 
 DECLARE_int32(raft_heartbeat_interval_ms);
 
 namespace kudu {
-
-class CountDownLatch;
-
 namespace consensus {
 class ReplicateMsg;
 
@@ -53,6 +53,10 @@ class ITimeManager : public RefCountedThreadSafe<ITimeManager> {
   virtual Status WaitUntilSafe(
       Timestamp timestamp,
       const MonoTime& deadline) = 0;
+  virtual void WaitUntilSafeAsync(
+      Timestamp timestamp,
+      const MonoTime& deadline,
+      StdStatusCallback callback) = 0;
   virtual Timestamp GetSafeTime() = 0;
   virtual Timestamp GetSerialTimestamp() = 0;
 };
@@ -80,6 +84,13 @@ class TimeManagerDummy : public ITimeManager {
     return Status::OK();
   }
 
+  void WaitUntilSafeAsync(
+      Timestamp timestamp,
+      const MonoTime& deadline,
+      StdStatusCallback callback) override {
+    callback(Status::OK());
+  }
+
   Timestamp GetSafeTime() override {
     return Timestamp::kInitialTimestamp;
   }
@@ -99,7 +110,8 @@ class TimeManagerDummy : public ITimeManager {
 // After this method returns an OK status, all the transactions whose timestamps
 // fall before the scan's timestamp will be either committed or in-flight. If
 // the scanner additionally uses the MvccManager to wait until the given
-// timestamp is clean, then the read will be repeatable.
+// timestamp is clean, then the read will be repeatable. Callers that must not
+// pin a thread while waiting can use WaitUntilSafeAsync() instead.
 //
 // In leader mode the TimeManager is responsible for assigning timestamps to
 // transactions and for moving the leader's safe time, which in turn may be sent
@@ -190,9 +202,33 @@ class TimeManager : public ITimeManager {
   // back in the past or hasn't moved in a long time.
   Status WaitUntilSafe(Timestamp timestamp, const MonoTime& deadline) override;
 
+  // Asynchronous version of WaitUntilSafe(). Instead of blocking the calling
+  // thread, 'callback' is invoked with the status WaitUntilSafe() would have
+  // returned.
+  //
+  // 'callback' may run on the calling thread (if the outcome is known right
+  // away) or on whichever thread advances safe time past 'timestamp'. It is
+  // never invoked while holding the TimeManager's lock, but it should be cheap
+  // and must not block, since it may delay other waiters.
+  //
+  // Unlike WaitUntilSafe() this does not wait for the local clock to move past
+  // 'timestamp'; the waiter is simply not released until it has. Deadlines are
+  // enforced lazily: whenever safe time advances, a new waiter registers, or
+  // ExpireTimedOutWaiters() is called.
+  void WaitUntilSafeAsync(
+      Timestamp timestamp,
+      const MonoTime& deadline,
+      StdStatusCallback callback) override;
+
+  // Fails any asynchronous waiters whose deadline has elapsed with
+  // Status::TimedOut(). Useful for callers that need timely expiry while safe
+  // time is not moving (e.g. while there's no leader).
+  void ExpireTimedOutWaiters();
+
   // Returns the current safe time.
   //
-  // In leader mode returns clock_->Now() or some value close to it.
+  // In leader mode returns clock_->Now() or some value close to it, releasing
+  // any waiters that became safe as a result.
   //
   // In non-leader mode returns the last safe time received from a leader.
   Timestamp GetSafeTime() override;
@@ -235,11 +271,73 @@ class TimeManager : public ITimeManager {
   struct WaitingState {
     // The timestamp the waiter requires be safe.
     Timestamp timestamp;
-    // Latch that will be count down once 'timestamp' if safe, unblocking the
-    // waiter.
-    CountDownLatch* latch;
+    // When the waiter gives up. Only tracked by TimeManager for asynchronous
+    // waiters, synchronous ones time themselves out.
+    MonoTime deadline;
+    // Invoked once 'timestamp' is safe or the wait fails. Reset once the
+    // waiter is done so that captured state is released promptly.
+    StdStatusCallback callback;
+    // Whether the waiter registered without first waiting for the local clock
+    // to move past 'timestamp'.
+    bool needs_clock_check;
+    // Set once the waiter has been notified or has timed out. Entries that are
+    // done are lazily dropped from the heaps below. Protected by 'lock_'.
+    bool done;
+  };
+  typedef std::shared_ptr<WaitingState> WaiterPtr;
+
+  // Orders a heap so that the waiter with the lowest timestamp is on top.
+  struct WaiterTimestampGreater {
+    bool operator()(const WaiterPtr& a, const WaiterPtr& b) const {
+      return a->timestamp > b->timestamp;
+    }
   };
 
+  // Orders a heap so that the waiter with the earliest deadline is on top.
+  struct WaiterDeadlineGreater {
+    bool operator()(const WaiterPtr& a, const WaiterPtr& b) const {
+      return a->deadline > b->deadline;
+    }
+  };
+
+  // Callbacks (and the statuses to invoke them with) of waiters that were
+  // released while holding 'lock_'. They must be run after releasing it.
+  typedef std::vector<std::pair<StdStatusCallback, Status>> WaiterNotifications;
+
+  // Runs the pre-flight checks shared by WaitUntilSafe() and
+  // WaitUntilSafeAsync(). Returns true if the outcome of the wait is already
+  // known, in which case it's stored in 'status'.
+  bool PreflightWaitUnlocked(Timestamp timestamp, Status* status);
+
+  // Adds 'waiter' to the waiter heaps.
+  void AddWaiterUnlocked(WaiterPtr waiter);
+
+  // Marks 'waiter' as done, queueing its callback in 'notifications' with
+  // 'status'.
+  void FinishWaiterUnlocked(
+      const WaiterPtr& waiter,
+      Status status,
+      WaiterNotifications* notifications);
+
+  // Releases the waiters whose timestamp is at or below 'safe_time' and times
+  // out the asynchronous waiters whose deadline has elapsed. Only the released
+  // prefix of each heap is touched, so this is O(k log n) for k released
+  // waiters out of n.
+  void CollectReadyWaitersUnlocked(
+      Timestamp safe_time,
+      WaiterNotifications* notifications);
+
+  // Times out the asynchronous waiters whose deadline has elapsed.
+  void CollectExpiredWaitersUnlocked(WaiterNotifications* notifications);
+
+  // Rebuilds the heaps without the entries that are done, once those make up
+  // most of the heaps.
+  void MaybeCompactWaitersUnlocked();
+
+  // Runs the callbacks in 'notifications'. Must not be called with 'lock_'
+  // held.
+  static void RunNotifications(WaiterNotifications* notifications);
+
   // Returns whether 'timestamp' is safe.
   // Requires that we've waited for the local clock to move past 'timestamp'.
   bool IsTimestampSafe(Timestamp timestamp);
@@ -247,8 +345,11 @@ class TimeManager : public ITimeManager {
   // Internal, unlocked implementation of IsTimestampSafe().
   bool IsTimestampSafeUnlocked(Timestamp timestamp);
 
-  // Advances safe time and wakes up any waiters.
-  void AdvanceSafeTimeAndWakeUpWaitersUnlocked(Timestamp safe_time);
+  // Advances safe time and collects the waiters that can be woken up in
+  // 'notifications'.
+  void AdvanceSafeTimeAndWakeUpWaitersUnlocked(
+      Timestamp safe_time,
+      WaiterNotifications* notifications);
 
   // Internal, unlocked implementation of GetSerialTimestamp().
   Timestamp GetSerialTimestampUnlocked();
@@ -264,8 +365,15 @@ class TimeManager : public ITimeManager {
   // Lock to protect the non-const fields below.
   mutable simple_spinlock lock_;
 
-  // Vector of waiters to be notified when the safe time advances.
-  mutable std::vector<WaitingState*> waiters_;
+  // Min-heap of waiters, ordered by timestamp, to be notified when the safe
+  // time advances.
+  std::vector<WaiterPtr> waiters_;
+
+  // Min-heap of the asynchronous waiters, ordered by deadline.
+  std::vector<WaiterPtr> waiter_deadlines_;
+
+  // The number of waiters in 'waiters_' that are not done yet.
+  size_t num_pending_waiters_;
 
   // The last serial timestamp that was assigned.
   Timestamp last_serial_ts_assigned_;
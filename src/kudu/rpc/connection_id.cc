@@ -47,6 +47,11 @@ void ConnectionId::set_user_credentials(UserCredentials user_credentials) {
   user_credentials_ = std::move(user_credentials);
 }
 
+void ConnectionId::set_stripe(int stripe) {
+  DCHECK_GE(stripe, 0);
+  stripe_ = stripe;
+}
+
 string ConnectionId::ToString() const {
   string remote;
   if (hostname_ != remote_.host()) {
@@ -55,6 +60,14 @@ string ConnectionId::ToString() const {
     remote = remote_.ToString();
   }
 
+  if (stripe_ != 0 || control_) {
+    return strings::Substitute(
+        "{remote=$0, user_credentials=$1, stripe=$2$3}",
+        remote,
+        user_credentials_.ToString(),
+        stripe_,
+        control_ ? ", control" : "");
+  }
   return strings::Substitute(
       "{remote=$0, user_credentials=$1}", remote, user_credentials_.ToString());
 }
@@ -64,12 +77,15 @@ size_t ConnectionId::HashCode() const {
   boost::hash_combine(seed, remote_.HashCode());
   boost::hash_combine(seed, hostname_);
   boost::hash_combine(seed, user_credentials_.HashCode());
+  boost::hash_combine(seed, stripe_);
+  boost::hash_combine(seed, control_);
   return seed;
 }
 
 bool ConnectionId::Equals(const ConnectionId& other) const {
   return remote() == other.remote() && hostname_ == other.hostname_ &&
-      user_credentials().Equals(other.user_credentials());
+      user_credentials().Equals(other.user_credentials()) &&
+      stripe_ == other.stripe_ && control_ == other.control_;
 }
 
 size_t ConnectionIdHash::operator()(const ConnectionId& conn_id) const {
@@ -58,6 +58,24 @@ class ConnectionId {
     return user_credentials_;
   }
 
+  // Calls to the same remote with different stripes go through different
+  // connections. See Proxy::set_num_connections().
+  void set_stripe(int stripe);
+
+  int stripe() const {
+    return stripe_;
+  }
+
+  // Control calls go through their own connections, which are never shared
+  // with bulk calls, whatever the stripe. See ConnectionClass::CONTROL.
+  void set_control(bool control) {
+    control_ = control;
+  }
+
+  bool control() const {
+    return control_;
+  }
+
   // Copy state from another object to this one.
   void CopyFrom(const ConnectionId& other);
 
@@ -78,6 +96,10 @@ class ConnectionId {
   std::string hostname_;
 
   UserCredentials user_credentials_;
+
+  int stripe_ = 0;
+
+  bool control_ = false;
 };
 
 class ConnectionIdHash {
@@ -369,7 +369,8 @@ Status Messenger::UnregisterService(const string& service_name) {
 }
 
 void Messenger::QueueOutboundCall(const shared_ptr<OutboundCall>& call) {
-  Reactor* reactor = RemoteToReactor(call->conn_id().remote());
+  Reactor* reactor =
+      RemoteToReactor(call->conn_id().remote(), call->conn_id().stripe());
   reactor->QueueOutboundCall(call);
 }
 
@@ -396,7 +397,8 @@ void Messenger::QueueInboundCall(unique_ptr<InboundCall> call) {
 }
 
 void Messenger::QueueCancellation(const shared_ptr<OutboundCall>& call) {
-  Reactor* reactor = RemoteToReactor(call->conn_id().remote());
+  Reactor* reactor =
+      RemoteToReactor(call->conn_id().remote(), call->conn_id().stripe());
   reactor->QueueCancellation(call);
 }
 
@@ -461,9 +463,10 @@ Messenger::~Messenger() {
   STLDeleteElements(&reactors_);
 }
 
-Reactor* Messenger::RemoteToReactor(const Sockaddr& remote) {
+Reactor* Messenger::RemoteToReactor(const Sockaddr& remote, int stripe) {
   uint32_t hashCode = remote.HashCode();
-  int reactor_idx = hashCode % reactors_.size();
+  // Successive stripes go to successive reactors.
+  int reactor_idx = (hashCode + stripe) % reactors_.size();
   // This is just a static partitioning; we could get a lot
   // fancier with assigning Sockaddrs to Reactors.
   return reactors_[reactor_idx];
@@ -374,7 +374,9 @@ class Messenger {
 
   explicit Messenger(const MessengerBuilder& bld);
 
-  Reactor* RemoteToReactor(const Sockaddr& remote);
+  // Returns the reactor handling the connections to 'remote' with the given
+  // stripe (see ConnectionId::set_stripe()).
+  Reactor* RemoteToReactor(const Sockaddr& remote, int stripe = 0);
   Status Init();
   void RunTimeoutThread();
   void UpdateCurTime();
@@ -64,6 +64,7 @@ DEFINE_int32(
     "will be injected. Should use values in OutboundCall::State only");
 TAG_FLAG(rpc_inject_cancellation_state, unsafe);
 
+using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
 using std::vector;
@@ -132,14 +133,21 @@ size_t OutboundCall::SerializeTo(TransferPayload* slices) {
   }
 
   DCHECK_LE(0, sidecar_byte_size_);
+  size_t serialized_fields_size =
+      serialized_fields_ ? serialized_fields_->size() : 0;
   serialization::SerializeHeader(
-      header_, sidecar_byte_size_ + request_buf_.size(), &header_buf_);
+      header_,
+      sidecar_byte_size_ + request_buf_.size() + serialized_fields_size,
+      &header_buf_);
 
-  size_t n_slices = 2 + sidecars_.size();
+  size_t n_slices = 2 + (serialized_fields_ ? 1 : 0) + sidecars_.size();
   DCHECK_LE(n_slices, slices->size());
   auto slice_iter = slices->begin();
   *slice_iter++ = Slice(header_buf_);
   *slice_iter++ = Slice(request_buf_);
+  if (serialized_fields_) {
+    *slice_iter++ = Slice(*serialized_fields_);
+  }
   for (auto& sidecar : sidecars_) {
     *slice_iter++ = sidecar->AsSlice();
   }
@@ -149,15 +157,20 @@ size_t OutboundCall::SerializeTo(TransferPayload* slices) {
 
 void OutboundCall::SetRequestPayload(
     const Message& req,
-    vector<unique_ptr<RpcSidecar>>&& sidecars) {
+    vector<unique_ptr<RpcSidecar>>&& sidecars,
+    shared_ptr<const string> serialized_fields) {
   DCHECK_EQ(-1, sidecar_byte_size_);
 
   sidecars_ = std::move(sidecars);
   DCHECK_LE(sidecars_.size(), TransferLimits::kMaxSidecars);
+  serialized_fields_ = std::move(serialized_fields);
+  uint32_t serialized_fields_size =
+      serialized_fields_ ? serialized_fields_->size() : 0;
 
   // Compute total size of sidecar payload so that extra space can be reserved
-  // as part of the request body.
-  uint32_t message_size = req.ByteSize();
+  // as part of the request body. The pre-serialized fields belong to the
+  // message itself, so sidecars start after them.
+  uint32_t message_size = req.ByteSize() + serialized_fields_size;
   sidecar_byte_size_ = 0;
   for (const unique_ptr<RpcSidecar>& car : sidecars_) {
     header_.add_sidecar_offsets(sidecar_byte_size_ + message_size);
@@ -168,7 +181,11 @@ void OutboundCall::SetRequestPayload(
     sidecar_byte_size_ += sidecar_bytes;
   }
 
-  serialization::SerializeMessage(req, &request_buf_, sidecar_byte_size_, true);
+  serialization::SerializeMessage(
+      req,
+      &request_buf_,
+      sidecar_byte_size_ + serialized_fields_size,
+      true);
 }
 
 Status OutboundCall::status() const {
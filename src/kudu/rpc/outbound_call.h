@@ -95,9 +95,13 @@ class OutboundCall {
   //
   // Because the request data is fully serialized by this call, 'req' may be
   // subsequently mutated with no ill effects.
+  //
+  // If non-null, 'serialized_fields' is sent right after 'req', as part of the
+  // same message. See RpcController::SetSerializedRequestFields().
   void SetRequestPayload(
       const google::protobuf::Message& req,
-      std::vector<std::unique_ptr<RpcSidecar>>&& sidecars);
+      std::vector<std::unique_ptr<RpcSidecar>>&& sidecars,
+      std::shared_ptr<const std::string> serialized_fields = nullptr);
 
   // Assign the call ID for this call. This is called from the reactor
   // thread once a connection has been assigned. Must only be called once.
@@ -280,6 +284,9 @@ class OutboundCall {
   faststring header_buf_;
   faststring request_buf_;
 
+  // Pre-serialized fields of the request message, sent after 'request_buf_'.
+  std::shared_ptr<const std::string> serialized_fields_;
+
   // Once a response has been received for this call, contains that response.
   // Otherwise NULL.
   std::unique_ptr<CallResponse> call_response_;
@@ -225,6 +225,9 @@ class MethodSubstitutions : public Substituter {
     bool track_result =
         static_cast<bool>(method_->options().GetExtension(track_rpc_result));
     (*map)["track_result"] = track_result ? " true" : "false";
+    bool use_arena =
+        static_cast<bool>(method_->options().GetExtension(arena_allocate));
+    (*map)["arena_allocate"] = use_arena ? " true" : "false";
     (*map)["authz_method"] =
         GetAuthzMethod(*method_).value_or("AuthorizeAllowAll");
     (*map)["long_call_loading_hook"] =
@@ -578,6 +581,7 @@ class CodeGenerator : public ::google::protobuf::compiler::CodeGenerator {
             "                           ctx);\n"
             "    };\n"
             "    mi->track_result = $track_result$;\n"
+            "    mi->arena_allocate = $arena_allocate$;\n"
             "    mi->handler_latency_histogram =\n"
             "        METRIC_handler_latency_$rpc_full_name_plainchars$.Instantiate(entity);\n"
             "    mi->func = [this](const Message* req, Message* resp, RpcContext* ctx) {\n"
@@ -49,7 +49,8 @@ Proxy::Proxy(
     string service_name)
     : service_name_(std::move(service_name)),
       messenger_(std::move(messenger)),
-      is_started_(false) {
+      is_started_(false),
+      next_stripe_(0) {
   CHECK(messenger_ != nullptr);
   DCHECK(!service_name_.empty()) << "Proxy service name must not be blank";
 
@@ -66,6 +67,8 @@ Proxy::Proxy(
   UserCredentials creds;
   creds.set_real_user(std::move(real_user));
   conn_id_ = ConnectionId(remote, std::move(hostname), std::move(creds));
+  stripe_conn_ids_.emplace_back(conn_id_);
+  UpdateConnectionIds();
 }
 
 Proxy::~Proxy() {}
@@ -80,7 +83,11 @@ void Proxy::AsyncRequest(
   base::subtle::NoBarrier_Store(&is_started_, true);
   RemoteMethod remote_method(service_name_, method);
   controller->call_.reset(new OutboundCall(
-      conn_id_, remote_method, response, controller, callback));
+      ConnectionIdForCall(*controller),
+      remote_method,
+      response,
+      controller,
+      callback));
   controller->SetRequestParam(req);
   controller->SetMessenger(messenger_.get());
 
@@ -110,6 +117,41 @@ void Proxy::set_user_credentials(const UserCredentials& user_credentials) {
   CHECK(base::subtle::NoBarrier_Load(&is_started_) == false)
       << "It is illegal to call set_user_credentials() after request processing has started";
   conn_id_.set_user_credentials(user_credentials);
+  UpdateConnectionIds();
+}
+
+void Proxy::set_num_connections(int num_connections) {
+  CHECK(base::subtle::NoBarrier_Load(&is_started_) == false)
+      << "It is illegal to call set_num_connections() after request processing "
+         "has started";
+  CHECK_GT(num_connections, 0);
+  stripe_conn_ids_.resize(num_connections, conn_id_);
+  UpdateConnectionIds();
+}
+
+const ConnectionId& Proxy::ConnectionIdForCall(
+    const RpcController& controller) const {
+  if (controller.connection_class() == ConnectionClass::CONTROL) {
+    return control_conn_id_;
+  }
+  if (stripe_conn_ids_.size() == 1) {
+    return stripe_conn_ids_[0];
+  }
+  const uint32_t stripe = next_stripe_.fetch_add(1, std::memory_order_relaxed);
+  return stripe_conn_ids_[stripe % stripe_conn_ids_.size()];
+}
+
+void Proxy::UpdateConnectionIds() {
+  for (size_t i = 0; i < stripe_conn_ids_.size(); i++) {
+    stripe_conn_ids_[i] = conn_id_;
+    stripe_conn_ids_[i].set_stripe(static_cast<int>(i));
+  }
+  // The control connection is keyed apart from every bulk connection, this
+  // proxy's or another's. Its stripe only picks the reactor thread, one past
+  // the bulk stripes.
+  control_conn_id_ = conn_id_;
+  control_conn_id_.set_stripe(static_cast<int>(stripe_conn_ids_.size()));
+  control_conn_id_.set_control(true);
 }
 
 std::string Proxy::ToString() const {
@@ -18,8 +18,10 @@
 #ifndef KUDU_RPC_PROXY_H
 #define KUDU_RPC_PROXY_H
 
+#include <atomic>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "kudu/gutil/atomicops.h"
 #include "kudu/gutil/macros.h"
@@ -48,7 +50,9 @@ class UserCredentials;
 // Proxy objects do not map one-to-one with TCP connections.  The underlying TCP
 // connection is not established until the first call, and may be torn down and
 // re-established as necessary by the messenger. Additionally, the messenger is
-// likely to multiplex many Proxy objects on the same connection.
+// likely to multiplex many Proxy objects on the same connection. A proxy may
+// also spread its calls over several connections to the remote, see
+// set_num_connections().
 //
 // Proxy objects are thread-safe after initialization only.
 // Setters on the Proxy are not thread-safe, and calling a setter after any RPC
@@ -115,14 +119,36 @@ class Proxy {
     return conn_id_.user_credentials();
   }
 
+  // Spreads the calls of the BULK connection class round-robin over
+  // 'num_connections' connections to the remote, rather than one, so that a
+  // large call doesn't hold up the calls queued behind it and several calls
+  // can be in flight over different TCP flows. The connections are handled by
+  // different reactor threads where possible. Calls of the CONTROL class go
+  // through a connection of their own regardless. Proxies to the same remote
+  // share the stripes they have in common, but never a control connection.
+  void set_num_connections(int num_connections);
+
   std::string ToString() const;
 
  private:
   const std::string service_name_;
   std::shared_ptr<Messenger> messenger_;
+  // Returns the connection id of a call made with 'controller'.
+  const ConnectionId& ConnectionIdForCall(
+      const RpcController& controller) const;
+
+  // Rebuilds 'stripe_conn_ids_' and 'control_conn_id_' from 'conn_id_'.
+  void UpdateConnectionIds();
+
   ConnectionId conn_id_;
   mutable Atomic32 is_started_;
 
+  // The connection ids of the BULK calls, and of the CONTROL calls. The first
+  // stripe is 'conn_id_' itself.
+  std::vector<ConnectionId> stripe_conn_ids_;
+  ConnectionId control_conn_id_;
+  mutable std::atomic<uint32_t> next_stripe_;
+
   DISALLOW_COPY_AND_ASSIGN(Proxy);
 };
 
@@ -323,6 +323,19 @@ class CalculatorService : public CalculatorServiceIf {
 
   void Echo(const EchoRequestPB* req, EchoResponsePB* resp, RpcContext* context)
       override {
+    CHECK(!context->request_arena());
+    resp->set_data(req->data());
+    context->RespondSuccess();
+  }
+
+  void EchoOnArena(
+      const EchoRequestPB* req,
+      EchoResponsePB* resp,
+      RpcContext* context) override {
+    const auto& arena = context->request_arena();
+    CHECK(arena);
+    CHECK_EQ(arena.get(), req->GetArena());
+    CHECK_EQ(arena.get(), resp->GetArena());
     resp->set_data(req->data());
     context->RespondSuccess();
   }
@@ -606,6 +606,71 @@ TEST_P(TestRpc, TestConnectionAlwaysKeepalive) {
       << "Client should have 1 client connections";
 }
 
+// Test that a proxy spreads its calls over the number of connections it's
+// asked to, handled by different reactors, and that control calls get a
+// connection of their own.
+TEST_P(TestRpc, TestStripedConnections) {
+  n_server_reactor_threads_ = 1;
+  keepalive_time_ms_ = -1;
+
+  // Set up server.
+  Sockaddr server_addr;
+  bool enable_ssl = GetParam();
+  ASSERT_OK(StartTestServer(&server_addr, enable_ssl));
+
+  // Set up client.
+  const int kNumReactors = 4;
+  const int kNumStripes = 3;
+  shared_ptr<Messenger> client_messenger;
+  ASSERT_OK(CreateMessenger(
+      "Client", &client_messenger, kNumReactors, enable_ssl));
+  Proxy p(
+      client_messenger,
+      server_addr,
+      server_addr.host(),
+      GenericCalculatorService::static_service_name());
+  p.set_num_connections(kNumStripes);
+
+  // Go around the stripes twice.
+  for (int i = 0; i < 2 * kNumStripes; i++) {
+    ASSERT_OK(DoTestSyncCall(p, GenericCalculatorService::kAddMethodName));
+  }
+  AddRequestPB req;
+  req.set_x(1);
+  req.set_y(2);
+  AddResponsePB resp;
+  RpcController controller;
+  controller.set_timeout(MonoDelta::FromMilliseconds(10000));
+  controller.set_connection_class(ConnectionClass::CONTROL);
+  ASSERT_OK(p.SyncRequest(
+      GenericCalculatorService::kAddMethodName, req, &resp, &controller));
+  ASSERT_EQ(3, resp.result());
+
+  ReactorMetrics metrics;
+  ASSERT_OK(server_messenger_->reactors_[0]->GetMetrics(&metrics));
+  ASSERT_EQ(kNumStripes + 1, metrics.num_server_connections_);
+
+  // Each connection is handled by a reactor of its own.
+  for (int i = 0; i < kNumReactors; i++) {
+    ASSERT_OK(client_messenger->reactors_[i]->GetMetrics(&metrics));
+    ASSERT_EQ(1, metrics.num_client_connections_) << "reactor " << i;
+  }
+
+  // A proxy with one more stripe shares the first stripes, but its last one
+  // is not the other proxy's control connection, though their stripes match.
+  Proxy p2(
+      client_messenger,
+      server_addr,
+      server_addr.host(),
+      GenericCalculatorService::static_service_name());
+  p2.set_num_connections(kNumStripes + 1);
+  for (int i = 0; i < kNumStripes + 1; i++) {
+    ASSERT_OK(DoTestSyncCall(p2, GenericCalculatorService::kAddMethodName));
+  }
+  ASSERT_OK(server_messenger_->reactors_[0]->GetMetrics(&metrics));
+  ASSERT_EQ(kNumStripes + 2, metrics.num_server_connections_);
+}
+
 // Test that the metrics on a per connection level work accurately.
 TEST_P(TestRpc, TestClientConnectionMetrics) {
   // Only run one reactor per messenger, so we can grab the metrics from that
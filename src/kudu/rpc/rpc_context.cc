@@ -19,6 +19,7 @@
 
 #include <memory>
 #include <ostream>
+#include <tuple>
 #include <utility>
 
 #include <glog/logging.h>
@@ -48,11 +49,19 @@ namespace rpc {
 
 RpcContext::RpcContext(
     InboundCall* call,
-    const google::protobuf::Message* request_pb,
+    google::protobuf::Message* request_pb,
     google::protobuf::Message* response_pb)
+    : RpcContext(call, request_pb, response_pb, nullptr) {}
+
+RpcContext::RpcContext(
+    InboundCall* call,
+    google::protobuf::Message* request_pb,
+    google::protobuf::Message* response_pb,
+    std::shared_ptr<google::protobuf::Arena> arena)
     : call_(CHECK_NOTNULL(call)),
       request_pb_(request_pb),
-      response_pb_(response_pb) {
+      response_pb_(response_pb),
+      arena_(std::move(arena)) {
   VLOG(4) << call_->remote_method().service_name()
           << ": Received RPC request for " << call_->ToString() << ":"
           << std::endl
@@ -67,7 +76,12 @@ RpcContext::RpcContext(
       pb_util::PbTracer::TracePb(*request_pb_));
 }
 
-RpcContext::~RpcContext() {}
+RpcContext::~RpcContext() {
+  if (arena_) {
+    std::ignore = request_pb_.release();
+    std::ignore = response_pb_.release();
+  }
+}
 
 void RpcContext::SetResultTracker(scoped_refptr<ResultTracker> result_tracker) {
   DCHECK(!result_tracker_);
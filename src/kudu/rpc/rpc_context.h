@@ -30,6 +30,7 @@
 
 namespace google {
 namespace protobuf {
+class Arena;
 class Message;
 } // namespace protobuf
 } // namespace google
@@ -68,9 +69,17 @@ class RpcContext {
   // and is not a public API.
   RpcContext(
       InboundCall* call,
-      const google::protobuf::Message* request_pb,
+      google::protobuf::Message* request_pb,
       google::protobuf::Message* response_pb);
 
+  // Like the above, but 'request_pb' and 'response_pb' are allocated on
+  // 'arena', which frees them.
+  RpcContext(
+      InboundCall* call,
+      google::protobuf::Message* request_pb,
+      google::protobuf::Message* response_pb,
+      std::shared_ptr<google::protobuf::Arena> arena);
+
   ~RpcContext();
 
   // Initialize a result tracker for the RPC.
@@ -208,10 +217,22 @@ class RpcContext {
   const google::protobuf::Message* request_pb() const {
     return request_pb_.get();
   }
+  // The request is owned by this context, so a handler may rewrite it in
+  // place (e.g. to decode a field) before passing it on.
+  google::protobuf::Message* mutable_request_pb() const {
+    return request_pb_.get();
+  }
   google::protobuf::Message* response_pb() const {
     return response_pb_.get();
   }
 
+  // Returns the arena the request and response protobufs are allocated on, or
+  // null if they're allocated on the heap. Holding a reference keeps parts of
+  // the request valid after the call was responded to.
+  const std::shared_ptr<google::protobuf::Arena>& request_arena() const {
+    return arena_;
+  }
+
   // Return an upper bound on the client timeout deadline. This does not
   // account for transmission delays between the client and the server.
   // If the client did not specify a deadline, returns MonoTime::Max().
@@ -251,8 +272,10 @@ class RpcContext {
  private:
   friend class ResultTracker;
   InboundCall* const call_;
-  const std::unique_ptr<const google::protobuf::Message> request_pb_;
-  const std::unique_ptr<google::protobuf::Message> response_pb_;
+  // Released rather than deleted if 'arena_' is set.
+  std::unique_ptr<google::protobuf::Message> request_pb_;
+  std::unique_ptr<google::protobuf::Message> response_pb_;
+  const std::shared_ptr<google::protobuf::Arena> arena_;
   scoped_refptr<ResultTracker> result_tracker_;
 };
 
@@ -40,6 +40,7 @@ namespace rpc {
 
 RpcController::RpcController()
     : credentials_policy_(CredentialsPolicy::ANY_CREDENTIALS),
+      connection_class_(ConnectionClass::BULK),
       messenger_(nullptr) {
   DVLOG(4) << "RpcController " << this << " constructed";
 }
@@ -60,8 +61,10 @@ void RpcController::Swap(RpcController* other) {
   std::swap(outbound_sidecars_, other->outbound_sidecars_);
   std::swap(
       outbound_sidecars_total_bytes_, other->outbound_sidecars_total_bytes_);
+  std::swap(serialized_request_fields_, other->serialized_request_fields_);
   std::swap(timeout_, other->timeout_);
   std::swap(credentials_policy_, other->credentials_policy_);
+  std::swap(connection_class_, other->connection_class_);
   std::swap(call_, other->call_);
 }
 
@@ -73,8 +76,10 @@ void RpcController::Reset() {
   call_.reset();
   required_server_features_.clear();
   credentials_policy_ = CredentialsPolicy::ANY_CREDENTIALS;
+  connection_class_ = ConnectionClass::BULK;
   messenger_ = nullptr;
   outbound_sidecars_total_bytes_ = 0;
+  serialized_request_fields_.reset();
 }
 
 bool RpcController::finished() const {
@@ -165,7 +170,10 @@ Status RpcController::AddOutboundSidecar(unique_ptr<RpcSidecar> car, int* idx) {
 
 void RpcController::SetRequestParam(const google::protobuf::Message& req) {
   DCHECK(call_ != nullptr);
-  call_->SetRequestPayload(req, std::move(outbound_sidecars_));
+  call_->SetRequestPayload(
+      req,
+      std::move(outbound_sidecars_),
+      std::move(serialized_request_fields_));
 }
 
 void RpcController::Cancel() {
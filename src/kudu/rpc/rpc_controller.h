@@ -19,7 +19,9 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "kudu/gutil/macros.h"
@@ -63,6 +65,17 @@ enum class CredentialsPolicy {
   PRIMARY_CREDENTIALS,
 };
 
+// The kind of connection an outbound call goes through. See
+// Proxy::set_num_connections().
+enum class ConnectionClass {
+  // Bulk calls are spread over the connections of the proxy.
+  BULK,
+
+  // Control calls are small, latency-sensitive calls, and go through a
+  // connection of their own so they don't queue behind bulk calls.
+  CONTROL,
+};
+
 // Controller for managing properties of a single RPC call, on the client side.
 //
 // An RpcController maps to exactly one call and is not thread-safe. The client
@@ -212,6 +225,15 @@ class RpcController {
     credentials_policy_ = policy;
   }
 
+  ConnectionClass connection_class() const {
+    return connection_class_;
+  }
+
+  // Must be called before the call is sent.
+  void set_connection_class(ConnectionClass connection_class) {
+    connection_class_ = connection_class;
+  }
+
   // Fills the 'sidecar' parameter with the slice pointing to the i-th
   // sidecar upon success.
   //
@@ -227,6 +249,18 @@ class RpcController {
   // sidecars would exceed TransferLimits::kMaxTotalSidecarBytes.
   Status AddOutboundSidecar(std::unique_ptr<RpcSidecar> car, int* idx);
 
+  // Sets pre-serialized fields to append to the serialized request message, as
+  // if they had been set in the request itself. Protobuf parsers accept fields
+  // in any order and append to repeated fields, so callers that send the same
+  // large fields to many servers can serialize them once and leave them out of
+  // each request message.
+  //
+  // 'fields' must be valid wire format for fields of the request message. It
+  // is kept alive until the call is done, and may be shared by several calls.
+  void SetSerializedRequestFields(std::shared_ptr<const std::string> fields) {
+    serialized_request_fields_ = std::move(fields);
+  }
+
   // Cancel the call associated with the RpcController. This function should
   // only be called when there is an outstanding outbound call. It's always safe
   // to call Cancel() after you've sent a call, so long as you haven't called
@@ -261,6 +295,8 @@ class RpcController {
   // RPC authentication policy for outbound calls.
   CredentialsPolicy credentials_policy_;
 
+  ConnectionClass connection_class_;
+
   mutable simple_spinlock lock_;
 
   // The id of this request.
@@ -280,6 +316,9 @@ class RpcController {
   // of TransferLimits::kMaxTotalSidecarBytes.
   int32_t outbound_sidecars_total_bytes_ = 0;
 
+  // See SetSerializedRequestFields().
+  std::shared_ptr<const std::string> serialized_request_fields_;
+
   DISALLOW_COPY_AND_ASSIGN(RpcController);
 };
 
@@ -298,6 +298,22 @@ TEST_F(RpcStubTest, TestRemoteAddress) {
 // Tests for error cases
 ////////////////////////////////////////////////////////////
 
+// Test a call whose request and response are allocated on an arena, sized
+// both smaller and larger than the arena's first block.
+TEST_F(RpcStubTest, TestArenaAllocatedCall) {
+  CalculatorServiceProxy p(
+      client_messenger_, server_addr_, server_addr_.host());
+
+  for (size_t size : {10, 1024 * 1024}) {
+    EchoRequestPB req;
+    req.set_data(string(size, 'x'));
+    EchoResponsePB resp;
+    RpcController controller;
+    ASSERT_OK(p.EchoOnArena(req, &resp, &controller));
+    ASSERT_EQ(req.data(), resp.data());
+  }
+}
+
 // Test sending a PB parameter with a missing field, where the client
 // thinks it has sent a full PB. (eg due to version mismatch)
 TEST_F(RpcStubTest, TestCallWithInvalidParam) {
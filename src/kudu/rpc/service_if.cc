@@ -17,6 +17,8 @@
 
 #include "kudu/rpc/service_if.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <memory>
 #include <ostream>
 #include <string>
@@ -24,6 +26,8 @@
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/message.h>
 
 #include "kudu/gutil/macros.h"
 #include "kudu/gutil/port.h"
@@ -49,7 +53,9 @@ DEFINE_bool(
     "Whether to enable exactly once semantics.");
 TAG_FLAG(enable_exactly_once, hidden);
 
+using google::protobuf::Arena;
 using google::protobuf::Message;
+using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
 using strings::Substitute;
@@ -57,6 +63,27 @@ using strings::Substitute;
 namespace kudu {
 namespace rpc {
 
+namespace {
+
+// Bounds of the blocks of the arenas of arena-allocated calls.
+constexpr size_t kMinArenaBlockBytes = 1024;
+constexpr size_t kMaxArenaBlockBytes = 8 * 1024 * 1024;
+
+shared_ptr<Arena> NewRequestArena(InboundCall* call) {
+  // The parsed request is usually somewhat larger than its serialized form,
+  // so start with a block that fits both it and a small response; the arena
+  // grows geometrically from there if needed.
+  const size_t serialized_size = call->serialized_request().size();
+  google::protobuf::ArenaOptions options;
+  options.start_block_size = std::max<size_t>(
+      kMinArenaBlockBytes, serialized_size + serialized_size / 2);
+  options.max_block_size =
+      std::max<size_t>(options.start_block_size, kMaxArenaBlockBytes);
+  return std::make_shared<Arena>(options);
+}
+
+} // anonymous namespace
+
 ServiceIf::~ServiceIf() {}
 
 void ServiceIf::Shutdown() {}
@@ -107,13 +134,24 @@ void GeneratedServiceIf::Handle(InboundCall* call) {
     RespondBadMethod(call);
     return;
   }
-  unique_ptr<Message> req(method_info->req_prototype->New());
-  if (PREDICT_FALSE(!ParseParam(call, req.get()))) {
-    return;
+  RpcContext* ctx;
+  Message* resp;
+  if (method_info->arena_allocate && !method_info->track_result) {
+    shared_ptr<Arena> arena = NewRequestArena(call);
+    Message* req = method_info->req_prototype->New(arena.get());
+    if (PREDICT_FALSE(!ParseParam(call, req))) {
+      return;
+    }
+    resp = method_info->resp_prototype->New(arena.get());
+    ctx = new RpcContext(call, req, resp, std::move(arena));
+  } else {
+    unique_ptr<Message> req(method_info->req_prototype->New());
+    if (PREDICT_FALSE(!ParseParam(call, req.get()))) {
+      return;
+    }
+    resp = method_info->resp_prototype->New();
+    ctx = new RpcContext(call, req.release(), resp);
   }
-  Message* resp = method_info->resp_prototype->New();
-
-  RpcContext* ctx = new RpcContext(call, req.release(), resp);
   if (!method_info->authz_method(ctx->request_pb(), resp, ctx)) {
     // The authz_method itself should have responded to the RPC.
     return;
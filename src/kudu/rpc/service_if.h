@@ -52,6 +52,10 @@ struct RpcMethodInfo : public RefCountedThreadSafe<RpcMethodInfo> {
   // Whether we should track this method's result, using ResultTracker.
   bool track_result;
 
+  // Whether the request and response protobufs of each call are allocated on
+  // an arena. See the 'arena_allocate' method option.
+  bool arena_allocate = false;
+
   // The authorization function for this RPC. If this function
   // returns false, the RPC has already been handled (i.e. rejected)
   // by the authorization function.
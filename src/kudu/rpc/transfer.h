@@ -50,7 +50,7 @@ class TransferLimits {
  public:
   enum {
     kMaxSidecars = 10,
-    kMaxPayloadSlices = kMaxSidecars + 2, // (header + msg)
+    kMaxPayloadSlices = kMaxSidecars + 3, // (header + msg + serialized fields)
     kMaxTotalSidecarBytes = INT_MAX
   };
 
@@ -646,6 +646,7 @@ TEST_F(ToolTest, TestModeHelp) {
   {
     const vector<string> kWalModeRegexes = {
         "dump.*Dump a WAL",
+        "stats.*Summarize and verify WAL",
     };
     NO_FATALS(RunTestHelp("wal", kWalModeRegexes));
   }
@@ -1211,6 +1212,74 @@ TEST_F(ToolTest, TestWalDump) {
   }
 }
 
+TEST_F(ToolTest, TestWalStats) {
+  const string kTestDir = GetTestPath("test");
+  const string kTestTablet = "ffffffffffffffffffffffffffffffff";
+  const int kNumOps = 10;
+
+  FsManager fs(env_, kTestDir);
+  ASSERT_OK(fs.CreateInitialFileSystemLayout());
+  ASSERT_OK(fs.Open());
+
+  {
+    scoped_refptr<Log> log;
+    ASSERT_OK(Log::Open(LogOptions(), &fs, kTestTablet, nullptr, &log));
+    for (int i = 1; i <= kNumOps; i++) {
+      ReplicateRefPtr replicate =
+          consensus::make_scoped_refptr_replicate(new ReplicateMsg());
+      replicate->get()->set_op_type(consensus::WRITE_OP_EXT);
+      *replicate->get()->mutable_id() = consensus::MakeOpId(i <= 4 ? 1 : 2, i);
+      replicate->get()->set_timestamp(i);
+      replicate->get()->mutable_write_payload()->set_payload(
+          string(100, 'x'));
+      Synchronizer s;
+      ASSERT_OK(log->AsyncAppendReplicates({replicate}, s.AsStatusCallback()));
+      ASSERT_OK(s.Wait());
+    }
+  }
+
+  // Both a segment and the directory of segments can be scanned.
+  const string wal_dir = fs.GetTabletWalDir(kTestTablet);
+  string stdout;
+  for (const auto& path :
+       {fs.GetWalSegmentFileName(kTestTablet, 1), wal_dir}) {
+    SCOPED_TRACE(path);
+    NO_FATALS(RunActionStdoutString(
+        Substitute("wal stats --format=csv $0", path), &stdout));
+    SCOPED_TRACE(stdout);
+    // One segment of kNumOps single-op batches, with no checksum mismatch.
+    ASSERT_STR_MATCHES(stdout, Substitute("^1,0,$0,$0,[0-9]+,0\n", kNumOps));
+    ASSERT_STR_MATCHES(stdout, Substitute("entries per batch,$0,1,", kNumOps));
+    ASSERT_STR_MATCHES(stdout, "REPLICATE,10");
+    ASSERT_STR_MATCHES(stdout, "payloads,NO_COMPRESSION,10,1000,1000,1");
+    ASSERT_STR_MATCHES(stdout, "\n1,4,[0-9]+\n");
+    ASSERT_STR_MATCHES(stdout, "\n2,6,[0-9]+\n");
+  }
+
+  // Corrupting a payload is detected.
+  {
+    scoped_refptr<Log> log;
+    ASSERT_OK(Log::Open(LogOptions(), &fs, kTestTablet, nullptr, &log));
+    ReplicateRefPtr replicate =
+        consensus::make_scoped_refptr_replicate(new ReplicateMsg());
+    replicate->get()->set_op_type(consensus::WRITE_OP_EXT);
+    *replicate->get()->mutable_id() = consensus::MakeOpId(2, kNumOps + 1);
+    replicate->get()->set_timestamp(kNumOps + 1);
+    replicate->get()->mutable_write_payload()->set_payload(string(100, 'x'));
+    replicate->get()->mutable_write_payload()->set_crc32(1234);
+    Synchronizer s;
+    ASSERT_OK(log->AsyncAppendReplicates({replicate}, s.AsStatusCallback()));
+    ASSERT_OK(s.Wait());
+  }
+  NO_FATALS(RunActionStdoutString(
+      Substitute("wal stats --format=csv $0", wal_dir), &stdout));
+  ASSERT_STR_MATCHES(stdout, "Payload checksum mismatch for op 2.11");
+  NO_FATALS(RunActionStdoutString(
+      Substitute("wal stats --verify_payload_crc=false $0", wal_dir),
+      &stdout));
+  ASSERT_STR_NOT_MATCHES(stdout, "Payload checksum mismatch");
+}
+
 TEST_F(ToolTest, TestLocalReplicaDumpMeta) {
   const string kTestDir = GetTestPath("test");
   const string kTestTablet = "ffffffffffffffffffffffffffffffff";
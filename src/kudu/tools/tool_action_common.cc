@@ -46,6 +46,7 @@
 #include "kudu/gutil/endian.h"
 #include "kudu/gutil/map-util.h"
 #include "kudu/gutil/ref_counted.h"
+#include "kudu/gutil/strings/escaping.h"
 #include "kudu/gutil/strings/join.h"
 #include "kudu/gutil/strings/numbers.h"
 #include "kudu/gutil/strings/split.h"
@@ -60,6 +61,7 @@
 #include "kudu/tools/tool.pb.h" // IWYU pragma: keep
 #include "kudu/tools/tool_action.h"
 #include "kudu/tserver/tserver_admin.proxy.h" // IWYU pragma: keep
+#include "kudu/util/compression/compression.pb.h"
 #include "kudu/util/faststring.h"
 #include "kudu/util/jsonwriter.h"
 #include "kudu/util/memory/arena.h"
@@ -293,6 +295,114 @@ Status SetServerFlag(const string& address, uint16_t default_port,
 }
 */
 
+namespace {
+
+enum class PrintEntryType { DONT_PRINT, DECODED, PB, ID };
+
+Status ParsePrintType(PrintEntryType* type) {
+  if (ParseLeadingBoolValue(FLAGS_print_entries.c_str(), true) == false) {
+    *type = PrintEntryType::DONT_PRINT;
+  } else if (
+      ParseLeadingBoolValue(FLAGS_print_entries.c_str(), false) == true ||
+      FLAGS_print_entries == "decoded") {
+    *type = PrintEntryType::DECODED;
+  } else if (FLAGS_print_entries == "pb") {
+    *type = PrintEntryType::PB;
+  } else if (FLAGS_print_entries == "id") {
+    *type = PrintEntryType::ID;
+  } else {
+    return Status::InvalidArgument(
+        "unknown value for --print_entries", FLAGS_print_entries);
+  }
+  return Status::OK();
+}
+
+void PrintIdOnly(const LogEntryPB& entry) {
+  switch (entry.type()) {
+    case log::REPLICATE: {
+      cout << entry.replicate().id().term() << "."
+           << entry.replicate().id().index() << "@"
+           << entry.replicate().timestamp() << "\t";
+      cout << "REPLICATE "
+           << consensus::OperationType_Name(entry.replicate().op_type());
+      break;
+    }
+    case log::COMMIT: {
+      cout << "COMMIT " << entry.commit().commited_op_id().term() << "."
+           << entry.commit().commited_op_id().index();
+      break;
+    }
+    default:
+      cout << "UNKNOWN: " << SecureShortDebugString(entry);
+  }
+
+  cout << endl;
+}
+
+// The payloads of write ops are opaque to the log, so they are printed as
+// escaped strings, unless compressed.
+void PrintDecoded(const LogEntryPB& entry) {
+  PrintIdOnly(entry);
+  if (entry.type() != log::REPLICATE ||
+      !entry.replicate().has_write_payload()) {
+    return;
+  }
+  const auto& write_payload = entry.replicate().write_payload();
+  const string& payload = write_payload.payload();
+  if (write_payload.compression_codec() != NO_COMPRESSION) {
+    cout << "\tpayload: " << payload.size() << " bytes compressed with "
+         << CompressionType_Name(write_payload.compression_codec()) << endl;
+    return;
+  }
+  cout << "\tpayload: ";
+  if (FLAGS_truncate_data > 0 && payload.size() > FLAGS_truncate_data) {
+    cout << strings::CEscape(StringPiece(payload.data(), FLAGS_truncate_data))
+         << "<truncated>";
+  } else {
+    cout << strings::CEscape(payload);
+  }
+  cout << endl;
+}
+
+} // anonymous namespace
+
+Status PrintSegment(const scoped_refptr<ReadableLogSegment>& segment) {
+  PrintEntryType print_type;
+  RETURN_NOT_OK(ParsePrintType(&print_type));
+  if (FLAGS_print_meta) {
+    cout << "Header:\n" << SecureDebugString(segment->header());
+  }
+  if (print_type != PrintEntryType::DONT_PRINT) {
+    // Entries are read and printed one batch at a time, so that arbitrarily
+    // large segments can be dumped.
+    LogEntryReader reader(segment.get());
+    while (true) {
+      unique_ptr<LogEntryPB> entry;
+      Status s = reader.ReadNextEntry(&entry);
+      if (s.IsEndOfFile()) {
+        break;
+      }
+      RETURN_NOT_OK(s);
+
+      if (print_type == PrintEntryType::PB) {
+        if (FLAGS_truncate_data > 0) {
+          pb_util::TruncateFields(entry.get(), FLAGS_truncate_data);
+        }
+        cout << "Entry:\n" << SecureDebugString(*entry);
+      } else if (print_type == PrintEntryType::DECODED) {
+        PrintDecoded(*entry);
+      } else if (print_type == PrintEntryType::ID) {
+        PrintIdOnly(*entry);
+      }
+    }
+  }
+  if (FLAGS_print_meta && segment->HasFooter()) {
+    cout << "Footer:\n" << SecureDebugString(segment->footer());
+  }
+
+  return Status::OK();
+}
+
 bool MatchesAnyPattern(const vector<string>& patterns, const string& str) {
   // Consider no filter a wildcard.
   if (patterns.empty())
@@ -73,6 +73,14 @@ Status BuildProxy(
     uint16_t default_port,
     std::unique_ptr<ProxyClass>* proxy);
 
+// Prints the contents of a WAL segment to stdout, one entry batch at a time.
+//
+// The following gflags affect the output:
+// - print_entries: in what style entries should be printed.
+// - print_meta: whether or not headers/footers are printed.
+// - truncate_data: how many bytes to print for each data field.
+Status PrintSegment(const scoped_refptr<log::ReadableLogSegment>& segment);
+
 /*
 // Get the current status of the Kudu server running at 'address', storing it
 // in 'status'.
@@ -81,14 +89,6 @@ Status BuildProxy(
 Status GetServerStatus(const std::string& address, uint16_t default_port,
                        server::ServerStatusPB* status);
 
-// Prints the contents of a WAL segment to stdout.
-//
-// The following gflags affect the output:
-// - print_entries: in what style entries should be printed.
-// - print_meta: whether or not headers/footers are printed.
-// - truncate_data: how many bytes to print for each data field.
-Status PrintSegment(const scoped_refptr<log::ReadableLogSegment>& segment);
-
 // Print the current status of the Kudu server running at 'address'.
 //
 // If 'address' does not contain a port, 'default_port' is used instead.
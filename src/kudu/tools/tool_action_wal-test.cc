@@ -0,0 +1,154 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags_declare.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "kudu/consensus/consensus.pb.h"
+#include "kudu/consensus/log.h"
+#include "kudu/consensus/opid_util.h"
+#include "kudu/consensus/ref_counted_replicate.h"
+#include "kudu/fs/fs_manager.h"
+#include "kudu/gutil/ref_counted.h"
+#include "kudu/gutil/strings/substitute.h"
+#include "kudu/tools/tool_action.h"
+#include "kudu/util/async_util.h"
+#include "kudu/util/scoped_cleanup.h"
+#include "kudu/util/status.h"
+#include "kudu/util/test_macros.h"
+#include "kudu/util/test_util.h"
+
+DECLARE_bool(verify_payload_crc);
+DECLARE_string(format);
+
+namespace kudu {
+namespace tools {
+
+using consensus::ReplicateMsg;
+using consensus::ReplicateRefPtr;
+using log::Log;
+using log::LogOptions;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using strings::Substitute;
+
+class ToolActionWalTest : public KuduTest {
+ protected:
+  void SetUp() override {
+    KuduTest::SetUp();
+    fs_.reset(new FsManager(env_, GetTestPath("test")));
+    ASSERT_OK(fs_->CreateInitialFileSystemLayout());
+    ASSERT_OK(fs_->Open());
+  }
+
+  // Appends single-op batches for ops 'first' to 'last', of term 1 up to
+  // op 4 and of term 2 after that. The payload checksum is set to 'crc32' if
+  // it's positive.
+  void AppendOps(int first, int last, int crc32 = 0) {
+    scoped_refptr<Log> log;
+    ASSERT_OK(Log::Open(LogOptions(), fs_.get(), kTabletId, nullptr, &log));
+    for (int i = first; i <= last; i++) {
+      ReplicateRefPtr replicate =
+          consensus::make_scoped_refptr_replicate(new ReplicateMsg());
+      replicate->get()->set_op_type(consensus::WRITE_OP_EXT);
+      *replicate->get()->mutable_id() = consensus::MakeOpId(i <= 4 ? 1 : 2, i);
+      replicate->get()->set_timestamp(i);
+      replicate->get()->mutable_write_payload()->set_payload(string(100, 'x'));
+      if (crc32 > 0) {
+        replicate->get()->mutable_write_payload()->set_crc32(crc32);
+      }
+      Synchronizer s;
+      ASSERT_OK(log->AsyncAppendReplicates({replicate}, s.AsStatusCallback()));
+      ASSERT_OK(s.Wait());
+    }
+  }
+
+  // Runs 'wal stats' on 'paths' in-process, capturing its output in 'out'.
+  Status RunStats(const vector<string>& paths, string* out) {
+    unique_ptr<Mode> mode = BuildWalMode();
+    const Action* stats = nullptr;
+    for (const auto& action : mode->actions()) {
+      if (action->name() == "stats") {
+        stats = action.get();
+      }
+    }
+    CHECK(stats);
+    std::ostringstream captured;
+    std::streambuf* cout_buf = std::cout.rdbuf(captured.rdbuf());
+    SCOPED_CLEANUP({ std::cout.rdbuf(cout_buf); });
+    Status s = stats->Run({mode.get()}, {}, paths);
+    *out = captured.str();
+    return s;
+  }
+
+  const string kTabletId = "ffffffffffffffffffffffffffffffff";
+  unique_ptr<FsManager> fs_;
+};
+
+TEST_F(ToolActionWalTest, TestStats) {
+  const int kNumOps = 10;
+  NO_FATALS(AppendOps(1, kNumOps));
+  FLAGS_format = "csv";
+
+  // Both a segment and the directory of segments can be scanned.
+  const string wal_dir = fs_->GetTabletWalDir(kTabletId);
+  string out;
+  for (const auto& path :
+       {fs_->GetWalSegmentFileName(kTabletId, 1), wal_dir}) {
+    SCOPED_TRACE(path);
+    ASSERT_OK(RunStats({path}, &out));
+    SCOPED_TRACE(out);
+    // One segment of kNumOps single-op batches, with no checksum mismatch.
+    ASSERT_STR_MATCHES(out, Substitute("^1,0,$0,$0,[0-9]+,0\n", kNumOps));
+    ASSERT_STR_MATCHES(out, Substitute("entries per batch,$0,1,", kNumOps));
+    ASSERT_STR_MATCHES(out, "REPLICATE,10");
+    ASSERT_STR_MATCHES(out, "payloads,NO_COMPRESSION,10,1000,1000,1");
+    ASSERT_STR_MATCHES(out, "\n1,4,[0-9]+\n");
+    ASSERT_STR_MATCHES(out, "\n2,6,[0-9]+\n");
+  }
+
+  // Nothing to scan.
+  Status s = RunStats({GetTestPath("no-such-dir")}, &out);
+  ASSERT_FALSE(s.ok());
+}
+
+TEST_F(ToolActionWalTest, TestStatsDetectsPayloadCorruption) {
+  const int kNumOps = 10;
+  NO_FATALS(AppendOps(1, kNumOps));
+  NO_FATALS(AppendOps(kNumOps + 1, kNumOps + 1, /*crc32=*/1234));
+  FLAGS_format = "csv";
+
+  const string wal_dir = fs_->GetTabletWalDir(kTabletId);
+  string out;
+  ASSERT_OK(RunStats({wal_dir}, &out));
+  ASSERT_STR_MATCHES(out, "Payload checksum mismatch for op 2.11");
+
+  FLAGS_verify_payload_crc = false;
+  ASSERT_OK(RunStats({wal_dir}, &out));
+  ASSERT_STR_NOT_MATCHES(out, "Payload checksum mismatch");
+}
+
+} // namespace tools
+} // namespace kudu
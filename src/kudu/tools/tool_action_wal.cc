@@ -17,29 +17,80 @@
 
 #include "kudu/tools/tool_action.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "kudu/consensus/consensus.pb.h"
+#include "kudu/consensus/log.pb.h"
 #include "kudu/consensus/log_util.h"
+#include "kudu/consensus/opid.pb.h"
 #include "kudu/gutil/map-util.h"
 #include "kudu/gutil/ref_counted.h"
+#include "kudu/gutil/strings/substitute.h"
 #include "kudu/tools/tool_action_common.h"
+#include "kudu/util/compression/compression.pb.h"
+#include "kudu/util/crc.h"
 #include "kudu/util/env.h"
+#include "kudu/util/flag_tags.h"
+#include "kudu/util/hdr_histogram.h"
+#include "kudu/util/locks.h"
+#include "kudu/util/monotime.h"
+#include "kudu/util/path_util.h"
 #include "kudu/util/status.h"
+#include "kudu/util/threadpool.h"
+
+DEFINE_int32(
+    wal_scan_threads,
+    4,
+    "Number of WAL segments scanned in parallel. Each scan holds one entry "
+    "batch in memory at a time.");
+TAG_FLAG(wal_scan_threads, stable);
+
+DEFINE_bool(
+    verify_payload_crc,
+    true,
+    "Whether to also verify the checksums of write payloads. The checksums of "
+    "entry batches are always verified.");
+TAG_FLAG(verify_payload_crc, stable);
 
 namespace kudu {
 namespace tools {
 
+using google::protobuf::internal::WireFormatLite;
+using log::LogEntryPB;
+using log::LogEntryReader;
 using log::ReadableLogSegment;
+using std::cout;
+using std::endl;
+using std::map;
 using std::string;
 using std::unique_ptr;
+using std::vector;
+using strings::Substitute;
 
 namespace {
 
 const char* const kPathArg = "path";
 
+// Values larger than these are recorded as these.
+const int64_t kMaxBatchBytes = 1LL << 32;
+const int64_t kMaxOpsPerBatch = 1LL << 20;
+
+// The number of payload checksum mismatches reported individually.
+const int kMaxReportedCrcMismatches = 10;
+
 Status Dump(const RunnerContext& context) {
   const string& segment_path = FindOrDie(context.required_args, kPathArg);
 
@@ -50,6 +101,396 @@ Status Dump(const RunnerContext& context) {
   return Status::OK();
 }
 
+// Statistics gathered from scanning WAL segments.
+//
+// Segments are scanned one entry batch at a time, so scanning needs memory
+// for one batch per segment being scanned, regardless of the size of the WAL.
+//
+// This class is thread-safe.
+class WalStats {
+ public:
+  WalStats()
+      : batch_disk_bytes_(kMaxBatchBytes, 2),
+        batch_bytes_(kMaxBatchBytes, 2),
+        ops_per_batch_(kMaxOpsPerBatch, 2) {}
+
+  // Scans the segment at 'path', accounting for its entries. If the segment
+  // turns out to be corrupt, the entries read up to the corruption are still
+  // accounted for.
+  Status ScanSegment(const string& path);
+
+  // Prints the statistics to stdout, honoring --format.
+  Status Print() const;
+
+  // Returns the number of segments that failed to be scanned.
+  int64_t num_failed_segments() const {
+    std::lock_guard<simple_spinlock> l(lock_);
+    return failed_segments_.size();
+  }
+
+ private:
+  struct CodecStats {
+    int64_t count = 0;
+    int64_t compressed_bytes = 0;
+    int64_t uncompressed_bytes = 0;
+  };
+
+  struct TermStats {
+    int64_t ops = 0;
+    int64_t bytes = 0;
+  };
+
+  // What a single segment contributed. Merged into the totals once the
+  // segment has been scanned.
+  struct SegmentStats {
+    int64_t batches = 0;
+    int64_t entries = 0;
+    int64_t disk_bytes = 0;
+    int64_t batch_bytes = 0;
+    int64_t payload_crc_mismatches = 0;
+    vector<string> reported_crc_mismatches;
+    map<string, int64_t> entries_by_type;
+    map<int64_t, TermStats> terms;
+    map<CompressionType, CodecStats> payload_codecs;
+  };
+
+  // Accounts for 'entry', of the batch currently being scanned.
+  void AccountForEntry(const LogEntryPB& entry, SegmentStats* stats) const;
+
+  void RecordBatch(int64_t disk_bytes, int64_t bytes, int64_t ops);
+
+  void Merge(
+      const scoped_refptr<ReadableLogSegment>& segment,
+      const SegmentStats& stats);
+
+  static string Ratio(int64_t compressed_bytes, int64_t uncompressed_bytes);
+
+  // Adds a row for 'histogram' to 'table'.
+  static void AddHistogramRow(
+      const string& name,
+      const HdrHistogram& histogram,
+      DataTable* table);
+
+  // Sizes of entry batches, on disk and uncompressed, and their number of
+  // entries.
+  HdrHistogram batch_disk_bytes_;
+  HdrHistogram batch_bytes_;
+  HdrHistogram ops_per_batch_;
+
+  mutable simple_spinlock lock_;
+  int64_t num_segments_ = 0;
+  SegmentStats totals_;
+  // Batch compression, by the codec of the segments.
+  map<CompressionType, CodecStats> batch_codecs_;
+  vector<std::pair<string, Status>> failed_segments_;
+};
+
+Status WalStats::ScanSegment(const string& path) {
+  scoped_refptr<ReadableLogSegment> segment;
+  Status s = ReadableLogSegment::Open(Env::Default(), path, &segment);
+  if (s.IsUninitialized()) {
+    // The segment was preallocated but never written to.
+    return Status::OK();
+  }
+  if (!s.ok()) {
+    std::lock_guard<simple_spinlock> l(lock_);
+    failed_segments_.emplace_back(path, s);
+    return s;
+  }
+
+  SegmentStats stats;
+  LogEntryReader reader(segment.get());
+  // The reader reads a whole batch before returning its first entry, so a
+  // new batch was read whenever its offset moves.
+  int64_t batch_end = reader.offset();
+  int64_t batch_disk_bytes = 0;
+  int64_t batch_bytes = 0;
+  int64_t batch_ops = 0;
+  while (true) {
+    unique_ptr<LogEntryPB> entry;
+    s = reader.ReadNextEntry(&entry);
+    if (!s.ok()) {
+      break;
+    }
+    if (reader.offset() != batch_end) {
+      if (batch_ops > 0) {
+        RecordBatch(batch_disk_bytes, batch_bytes, batch_ops);
+      }
+      batch_disk_bytes = reader.offset() - batch_end;
+      batch_bytes = 0;
+      batch_ops = 0;
+      batch_end = reader.offset();
+      stats.batches++;
+      stats.disk_bytes += batch_disk_bytes;
+    }
+    // Batches are made of a single repeated field, so their serialized size
+    // is the sum of that of the entries.
+    const int64_t entry_bytes =
+        1 + WireFormatLite::LengthDelimitedSize(entry->ByteSizeLong());
+    batch_bytes += entry_bytes;
+    stats.batch_bytes += entry_bytes;
+    batch_ops++;
+    AccountForEntry(*entry, &stats);
+  }
+  if (batch_ops > 0) {
+    RecordBatch(batch_disk_bytes, batch_bytes, batch_ops);
+  }
+
+  Merge(segment, stats);
+  if (s.IsEndOfFile()) {
+    return Status::OK();
+  }
+  std::lock_guard<simple_spinlock> l(lock_);
+  failed_segments_.emplace_back(path, s);
+  return s;
+}
+
+void WalStats::AccountForEntry(const LogEntryPB& entry, SegmentStats* stats)
+    const {
+  stats->entries++;
+  stats->entries_by_type[log::LogEntryTypePB_Name(entry.type())]++;
+  if (entry.type() != log::REPLICATE || !entry.has_replicate()) {
+    return;
+  }
+
+  const consensus::ReplicateMsg& replicate = entry.replicate();
+  TermStats& term = stats->terms[replicate.id().term()];
+  term.ops++;
+  term.bytes += replicate.ByteSizeLong();
+
+  if (!replicate.has_write_payload()) {
+    return;
+  }
+  const consensus::WritePayloadPB& write_payload = replicate.write_payload();
+  const string& payload = write_payload.payload();
+  CodecStats& codec = stats->payload_codecs[write_payload.compression_codec()];
+  codec.count++;
+  codec.compressed_bytes += payload.size();
+  codec.uncompressed_bytes +=
+      write_payload.compression_codec() == NO_COMPRESSION
+      ? payload.size()
+      : write_payload.uncompressed_size();
+
+  // A checksum of 0 means none was computed.
+  if (FLAGS_verify_payload_crc && write_payload.crc32() != 0 &&
+      crc::Crc32c(payload.data(), payload.size()) != write_payload.crc32()) {
+    stats->payload_crc_mismatches++;
+    if (stats->reported_crc_mismatches.size() < kMaxReportedCrcMismatches) {
+      stats->reported_crc_mismatches.emplace_back(
+          Substitute("$0.$1", replicate.id().term(), replicate.id().index()));
+    }
+  }
+}
+
+void WalStats::RecordBatch(int64_t disk_bytes, int64_t bytes, int64_t ops) {
+  batch_disk_bytes_.Increment(std::min(disk_bytes, kMaxBatchBytes));
+  batch_bytes_.Increment(std::min(bytes, kMaxBatchBytes));
+  ops_per_batch_.Increment(std::min(ops, kMaxOpsPerBatch));
+}
+
+void WalStats::Merge(
+    const scoped_refptr<ReadableLogSegment>& segment,
+    const SegmentStats& stats) {
+  std::lock_guard<simple_spinlock> l(lock_);
+  num_segments_++;
+  totals_.batches += stats.batches;
+  totals_.entries += stats.entries;
+  totals_.disk_bytes += stats.disk_bytes;
+  totals_.batch_bytes += stats.batch_bytes;
+  totals_.payload_crc_mismatches += stats.payload_crc_mismatches;
+  for (const auto& op : stats.reported_crc_mismatches) {
+    if (totals_.reported_crc_mismatches.size() < kMaxReportedCrcMismatches) {
+      totals_.reported_crc_mismatches.emplace_back(
+          Substitute("$0 in $1", op, segment->path()));
+    }
+  }
+  for (const auto& entry : stats.entries_by_type) {
+    totals_.entries_by_type[entry.first] += entry.second;
+  }
+  for (const auto& entry : stats.terms) {
+    TermStats& term = totals_.terms[entry.first];
+    term.ops += entry.second.ops;
+    term.bytes += entry.second.bytes;
+  }
+  for (const auto& entry : stats.payload_codecs) {
+    CodecStats& codec = totals_.payload_codecs[entry.first];
+    codec.count += entry.second.count;
+    codec.compressed_bytes += entry.second.compressed_bytes;
+    codec.uncompressed_bytes += entry.second.uncompressed_bytes;
+  }
+  CodecStats& codec = batch_codecs_[segment->header().compression_codec()];
+  codec.count += stats.batches;
+  codec.compressed_bytes += stats.disk_bytes;
+  codec.uncompressed_bytes += stats.batch_bytes;
+}
+
+string WalStats::Ratio(int64_t compressed_bytes, int64_t uncompressed_bytes) {
+  if (uncompressed_bytes == 0) {
+    return "-";
+  }
+  return Substitute(
+      "$0", static_cast<double>(compressed_bytes) / uncompressed_bytes);
+}
+
+void WalStats::AddHistogramRow(
+    const string& name,
+    const HdrHistogram& histogram,
+    DataTable* table) {
+  if (histogram.TotalCount() == 0) {
+    table->AddRow({name, "0", "-", "-", "-", "-", "-", "-"});
+    return;
+  }
+  table->AddRow({name,
+                 std::to_string(histogram.TotalCount()),
+                 std::to_string(histogram.MinValue()),
+                 Substitute("$0", histogram.MeanValue()),
+                 std::to_string(histogram.ValueAtPercentile(50)),
+                 std::to_string(histogram.ValueAtPercentile(95)),
+                 std::to_string(histogram.ValueAtPercentile(99)),
+                 std::to_string(histogram.MaxValue())});
+}
+
+Status WalStats::Print() const {
+  std::lock_guard<simple_spinlock> l(lock_);
+
+  DataTable summary({"segments",
+                     "failed segments",
+                     "batches",
+                     "entries",
+                     "bytes on disk",
+                     "payload crc mismatches"});
+  summary.AddRow({std::to_string(num_segments_),
+                  std::to_string(failed_segments_.size()),
+                  std::to_string(totals_.batches),
+                  std::to_string(totals_.entries),
+                  std::to_string(totals_.disk_bytes),
+                  std::to_string(totals_.payload_crc_mismatches)});
+  RETURN_NOT_OK(summary.PrintTo(cout));
+  cout << endl;
+
+  DataTable histograms(
+      {"histogram", "count", "min", "mean", "p50", "p95", "p99", "max"});
+  AddHistogramRow("batch bytes on disk", batch_disk_bytes_, &histograms);
+  AddHistogramRow("batch bytes", batch_bytes_, &histograms);
+  AddHistogramRow("entries per batch", ops_per_batch_, &histograms);
+  RETURN_NOT_OK(histograms.PrintTo(cout));
+  cout << endl;
+
+  DataTable entry_types({"entry type", "entries"});
+  for (const auto& entry : totals_.entries_by_type) {
+    entry_types.AddRow({entry.first, std::to_string(entry.second)});
+  }
+  RETURN_NOT_OK(entry_types.PrintTo(cout));
+  cout << endl;
+
+  DataTable codecs({"compressed",
+                    "codec",
+                    "count",
+                    "compressed bytes",
+                    "uncompressed bytes",
+                    "ratio"});
+  for (const auto& entry : batch_codecs_) {
+    codecs.AddRow({"batches",
+                   CompressionType_Name(entry.first),
+                   std::to_string(entry.second.count),
+                   std::to_string(entry.second.compressed_bytes),
+                   std::to_string(entry.second.uncompressed_bytes),
+                   Ratio(
+                       entry.second.compressed_bytes,
+                       entry.second.uncompressed_bytes)});
+  }
+  for (const auto& entry : totals_.payload_codecs) {
+    codecs.AddRow({"payloads",
+                   CompressionType_Name(entry.first),
+                   std::to_string(entry.second.count),
+                   std::to_string(entry.second.compressed_bytes),
+                   std::to_string(entry.second.uncompressed_bytes),
+                   Ratio(
+                       entry.second.compressed_bytes,
+                       entry.second.uncompressed_bytes)});
+  }
+  RETURN_NOT_OK(codecs.PrintTo(cout));
+  cout << endl;
+
+  DataTable terms({"term", "ops", "bytes"});
+  for (const auto& entry : totals_.terms) {
+    terms.AddRow({std::to_string(entry.first),
+                  std::to_string(entry.second.ops),
+                  std::to_string(entry.second.bytes)});
+  }
+  RETURN_NOT_OK(terms.PrintTo(cout));
+
+  for (const auto& op : totals_.reported_crc_mismatches) {
+    cout << "Payload checksum mismatch for op " << op << endl;
+  }
+  for (const auto& failure : failed_segments_) {
+    cout << "Failed to scan " << failure.first << ": "
+         << failure.second.ToString() << endl;
+  }
+  return Status::OK();
+}
+
+// Appends the WAL segments at 'path' to 'segment_paths', 'path' being either
+// a segment or a directory of segments.
+Status ListSegments(const string& path, vector<string>* segment_paths) {
+  Env* env = Env::Default();
+  bool is_dir;
+  RETURN_NOT_OK_PREPEND(
+      env->IsDirectory(path, &is_dir), Substitute("Unable to stat $0", path));
+  if (!is_dir) {
+    segment_paths->push_back(path);
+    return Status::OK();
+  }
+  vector<string> children;
+  RETURN_NOT_OK_PREPEND(
+      env->GetChildren(path, &children),
+      Substitute("Unable to list $0", path));
+  std::sort(children.begin(), children.end());
+  for (const auto& child : children) {
+    if (log::IsLogFileName(child)) {
+      segment_paths->push_back(JoinPathSegments(path, child));
+    }
+  }
+  return Status::OK();
+}
+
+Status Stats(const RunnerContext& context) {
+  vector<string> segment_paths;
+  for (const auto& path : context.variadic_args) {
+    RETURN_NOT_OK(ListSegments(path, &segment_paths));
+  }
+  if (segment_paths.empty()) {
+    return Status::NotFound("No WAL segments found");
+  }
+
+  unique_ptr<ThreadPool> pool;
+  RETURN_NOT_OK(ThreadPoolBuilder("wal-scan")
+                    .set_min_threads(0)
+                    .set_max_threads(std::max(FLAGS_wal_scan_threads, 1))
+                    .Build(&pool));
+  WalStats stats;
+  const MonoTime start = MonoTime::Now();
+  for (const auto& path : segment_paths) {
+    RETURN_NOT_OK(pool->SubmitFunc([&stats, path]() {
+      WARN_NOT_OK(
+          stats.ScanSegment(path), Substitute("Unable to scan $0", path));
+    }));
+  }
+  pool->Wait();
+  pool->Shutdown();
+  const MonoDelta elapsed = MonoTime::Now() - start;
+
+  RETURN_NOT_OK(stats.Print());
+  cout << endl
+       << "Scanned " << segment_paths.size() << " segments in "
+       << elapsed.ToString() << endl;
+  if (stats.num_failed_segments() > 0) {
+    return Status::Corruption(
+        Substitute("$0 segments failed to scan", stats.num_failed_segments()));
+  }
+  return Status::OK();
+}
+
 } // anonymous namespace
 
 unique_ptr<Mode> BuildWalMode() {
@@ -62,9 +503,22 @@ unique_ptr<Mode> BuildWalMode() {
           .AddOptionalParameter("truncate_data")
           .Build();
 
+  unique_ptr<Action> stats =
+      ActionBuilder("stats", &Stats)
+          .Description(
+              "Summarize and verify WAL (write-ahead log) files: batch sizes, "
+              "compression ratios and bytes per term")
+          .AddRequiredVariadicParameter(
+              {kPathArg, "path to WAL files or to directories of WAL files"})
+          .AddOptionalParameter("format")
+          .AddOptionalParameter("verify_payload_crc")
+          .AddOptionalParameter("wal_scan_threads")
+          .Build();
+
   return ModeBuilder("wal")
       .Description("Operate on WAL (write-ahead log) files")
       .AddAction(std::move(dump))
+      .AddAction(std::move(stats))
       .Build();
 }
 
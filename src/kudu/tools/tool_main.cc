@@ -75,7 +75,7 @@ unique_ptr<Mode> RootMode(const string& name) {
       //.AddMode(BuildTabletMode())
       //.AddMode(BuildTestMode())
       //.AddMode(BuildTServerMode())
-      //.AddMode(BuildWalMode())
+      .AddMode(BuildWalMode())
       .Build();
 }
 
@@ -85,6 +85,26 @@
 #include "kudu/util/trace.h"
 
 DECLARE_bool(enable_flexi_raft);
+DECLARE_int32(raft_heartbeat_coalesce_window_ms);
+
+DEFINE_int32(
+    log_shared_pool_max_threads,
+    0,
+    "If positive, the logs of all raft rings hosted by the server append and "
+    "sync on two pools of at most this many threads each, rather than each "
+    "log using two threads of its own. Useful when hosting many rings.");
+TAG_FLAG(log_shared_pool_max_threads, advanced);
+TAG_FLAG(log_shared_pool_max_threads, experimental);
+
+DEFINE_bool(
+    log_coalesce_syncs,
+    false,
+    "Whether the logs of all raft rings hosted by the server sync together: "
+    "the rings on a filesystem that sync while another ring's sync is in "
+    "flight there wait for it, then one thread syncs all their segments back "
+    "to back, rather than each ring syncing its own segment.");
+TAG_FLAG(log_coalesce_syncs, advanced);
+TAG_FLAG(log_coalesce_syncs, experimental);
 
 using kudu::rpc::ServiceIf;
 using std::set;
@@ -147,8 +167,28 @@ Status RaftConsensusServer::Init() {
   RETURN_NOT_OK(
       ThreadPoolBuilder("init").set_max_threads(1).Build(&init_pool_));
 
+  if (FLAGS_log_shared_pool_max_threads > 0) {
+    RETURN_NOT_OK(ThreadPoolBuilder("wal-append")
+                      .set_min_threads(0)
+                      .set_max_threads(FLAGS_log_shared_pool_max_threads)
+                      .Build(&log_append_pool_));
+    RETURN_NOT_OK(ThreadPoolBuilder("wal-sync")
+                      .set_min_threads(0)
+                      .set_max_threads(FLAGS_log_shared_pool_max_threads)
+                      .Build(&log_sync_pool_));
+  }
+  if (FLAGS_log_coalesce_syncs) {
+    log_sync_coalescer_.reset(new log::LogSyncCoalescer());
+  }
+
   RETURN_NOT_OK(KuduServer::Init());
 
+  if (FLAGS_raft_heartbeat_coalesce_window_ms > 0) {
+    heartbeat_coalescer_ = std::make_shared<consensus::HeartbeatCoalescer>(
+        messenger(),
+        MonoDelta::FromMilliseconds(FLAGS_raft_heartbeat_coalesce_window_ms));
+  }
+
   std::unique_ptr<ServiceIf> consensus_service(
       new ConsensusServiceImpl(this, *consensus_manager_));
   RETURN_NOT_OK(RegisterService(std::move(consensus_service)));
@@ -201,8 +241,12 @@ void RaftConsensusServer::Shutdown() {
   // 1. Stop accepting new RPCs.
   UnregisterAllServices();
 
-  // 2. Stop consensus
+  // 2. Stop consensus, along with the logs running on the shared pools.
   consensus_manager_->Shutdown();
+  if (log_append_pool_) {
+    log_append_pool_->Shutdown();
+    log_sync_pool_->Shutdown();
+  }
 
   // 3. Shut down generic subsystems.
   KuduServer::Shutdown();
@@ -276,8 +320,10 @@ Status RaftConsensusInstance::Start(bool /*is_first_run*/) {
   std::unique_ptr<PeerProxyFactory> peer_proxy_factory;
   scoped_refptr<ITimeManager> time_manager;
 
-  peer_proxy_factory.reset(
-      new RpcPeerProxyFactory(server_->messenger(), server_->metric_entity()));
+  peer_proxy_factory.reset(new RpcPeerProxyFactory(
+      server_->messenger(),
+      server_->metric_entity(),
+      server_->heartbeat_coalescer_));
 
   if (server_->opts(id_).enable_time_manager) {
     // THIS IS OBVIOUSLY NOT CORRECT.
@@ -587,6 +633,9 @@ Status RaftConsensusInstance::SetupRaft() {
   // Factory could be empty.
   LogOptions log_options;
   log_options.log_factory = opts.log_factory;
+  log_options.append_pool = server_->log_append_pool_.get();
+  log_options.sync_pool = server_->log_sync_pool_.get();
+  log_options.sync_coalescer = server_->log_sync_coalescer_.get();
   RETURN_NOT_OK(Log::Open(
       log_options, fs_manager_, id_, server_->metric_entity(), &log_));
 
@@ -36,6 +36,14 @@ namespace kudu {
 
 class ThreadPool;
 
+namespace consensus {
+class HeartbeatCoalescer;
+} // namespace consensus
+
+namespace log {
+class LogSyncCoalescer;
+} // namespace log
+
 namespace tserver {
 
 class TabletManagerIf;
@@ -118,6 +126,19 @@ class RaftConsensusServer : public RaftConsensusServerIf {
   // For initializing the catalog manager.
   std::unique_ptr<ThreadPool> init_pool_;
 
+  // Pools the logs of every ring append and sync on, if
+  // --log_shared_pool_max_threads is set. Each log goes through a serial
+  // token, so that its appends stay in order.
+  std::unique_ptr<ThreadPool> log_append_pool_;
+  std::unique_ptr<ThreadPool> log_sync_pool_;
+
+  // Syncs the logs of all rings together, if --log_coalesce_syncs is set.
+  std::unique_ptr<log::LogSyncCoalescer> log_sync_coalescer_;
+
+  // Sends the heartbeats of all rings to the same server together, if
+  // --raft_heartbeat_coalesce_window_ms is set.
+  std::shared_ptr<consensus::HeartbeatCoalescer> heartbeat_coalescer_;
+
   // The options passed at construction time.
   const ConsensusServerOptions opts_;
 
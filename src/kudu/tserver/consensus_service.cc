@@ -18,6 +18,7 @@
 #include "kudu/tserver/consensus_service.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <functional>
@@ -44,6 +45,7 @@
 #include "kudu/consensus/opid.pb.h"
 #include "kudu/consensus/raft_consensus.h"
 #include "kudu/consensus/replica_management.pb.h"
+#include "kudu/consensus/serialized_ops_cache.h"
 #include "kudu/consensus/time_manager.h"
 #include "kudu/gutil/casts.h"
 #include "kudu/gutil/macros.h"
@@ -70,6 +72,7 @@
 #include "kudu/util/slice.h"
 #include "kudu/util/status.h"
 #include "kudu/util/status_callback.h"
+#include "kudu/util/threadpool.h"
 #include "kudu/util/trace.h"
 #include "kudu/util/trace_metrics.h"
 
@@ -85,11 +88,14 @@ using kudu::consensus::GetNodeInstanceResponsePB;
 using kudu::consensus::LeaderElectionContextPB;
 using kudu::consensus::LeaderStepDownRequestPB;
 using kudu::consensus::LeaderStepDownResponsePB;
+using kudu::consensus::MultiConsensusRequestPB;
+using kudu::consensus::MultiConsensusResponsePB;
 using kudu::consensus::OpId;
 using kudu::consensus::RaftConsensus;
 using kudu::consensus::RunLeaderElectionRequestPB;
 using kudu::consensus::RunLeaderElectionResponsePB;
 using kudu::consensus::ServerErrorPB;
+using kudu::consensus::UncompressOps;
 using kudu::consensus::UnsafeChangeConfigRequestPB;
 using kudu::consensus::UnsafeChangeConfigResponsePB;
 using kudu::consensus::VoteRequestPB;
@@ -102,6 +108,14 @@ using std::shared_ptr;
 using std::string;
 using strings::Substitute;
 
+DEFINE_int32(
+    multi_update_consensus_threads,
+    8,
+    "Maximum number of threads that apply the per-group updates of coalesced "
+    "MultiUpdateConsensus requests, so that a group whose update is held up "
+    "doesn't delay the others");
+TAG_FLAG(multi_update_consensus_threads, advanced);
+
 METRIC_DEFINE_counter(
     server,
     raft_rpc_token_num_request_mismatches,
@@ -233,14 +247,15 @@ bool GetConsensusOrRespond(
   return true;
 }
 
-template <class ReqType, class RespType>
-bool CheckRaftRpcTokenOrRespond(
+// Returns false, and sets 'error', if the request's token doesn't match the
+// one of 'consensus' and tokens are enforced.
+template <class ReqType>
+bool CheckRaftRpcToken(
     const std::string& method_name,
     const ReqType* req,
-    RespType resp,
-    rpc::RpcContext* context,
     const consensus::RaftConsensus& consensus,
-    const scoped_refptr<Counter>& mismatch_counter) {
+    const scoped_refptr<Counter>& mismatch_counter,
+    Status* error) {
   const auto& ownToken = consensus.GetRaftRpcToken();
   if (!ownToken && !req->has_raft_rpc_token()) {
     // Empty on both, nothing to enforce
@@ -270,14 +285,27 @@ bool CheckRaftRpcTokenOrRespond(
 
   KLOG_EVERY_N_SECS(ERROR, 60)
       << method_name << ": Rejecting incoming RPC: " << error_message;
-  SetupErrorAndRespond(
-      resp->mutable_error(),
-      Status::NotAuthorized(std::move(error_message)),
-      ServerErrorPB::RING_TOKEN_MISMATCH,
-      context);
+  *error = Status::NotAuthorized(std::move(error_message));
   return false;
 }
 
+template <class ReqType, class RespType>
+bool CheckRaftRpcTokenOrRespond(
+    const std::string& method_name,
+    const ReqType* req,
+    RespType resp,
+    rpc::RpcContext* context,
+    const consensus::RaftConsensus& consensus,
+    const scoped_refptr<Counter>& mismatch_counter) {
+  Status s;
+  if (!CheckRaftRpcToken(method_name, req, consensus, mismatch_counter, &s)) {
+    SetupErrorAndRespond(
+        resp->mutable_error(), s, ServerErrorPB::RING_TOKEN_MISMATCH, context);
+    return false;
+  }
+  return true;
+}
+
 template <class RespType>
 void HandleUnknownError(const Status& s, RespType* resp, RpcContext* context) {
   resp->Clear();
@@ -334,9 +362,15 @@ ConsensusServiceImpl::ConsensusServiceImpl(
       tablet_manager_(tablet_manager),
       request_rpc_token_mismatches_(
           server->metric_entity()->FindOrCreateCounter(
-              &METRIC_raft_rpc_token_num_request_mismatches)) {}
+              &METRIC_raft_rpc_token_num_request_mismatches)) {
+  CHECK_OK(ThreadPoolBuilder("multi-update")
+               .set_max_threads(FLAGS_multi_update_consensus_threads)
+               .Build(&multi_update_pool_));
+}
 
-ConsensusServiceImpl::~ConsensusServiceImpl() {}
+ConsensusServiceImpl::~ConsensusServiceImpl() {
+  multi_update_pool_->Shutdown();
+}
 
 bool ConsensusServiceImpl::AuthorizeServiceUser(
     const google::protobuf::Message* /*req*/,
@@ -398,7 +432,16 @@ void ConsensusServiceImpl::UpdateConsensus(
     return;
   }
 
-  Status s = consensus->Update(req, resp);
+  // Ops sent in compressed form are decoded in place, on the request owned by
+  // this RPC, before consensus takes ownership of them.
+  Status s;
+  if (req->has_compressed_ops()) {
+    s = UncompressOps(
+        static_cast<ConsensusRequestPB*>(context->mutable_request_pb()));
+  }
+  if (PREDICT_TRUE(s.ok())) {
+    s = consensus->Update(req, resp, context->request_arena());
+  }
   if (PREDICT_FALSE(!s.ok())) {
     // Clear the response first, since a partially-filled response could
     // result in confusing a caller, or in having missing required fields
@@ -416,6 +459,120 @@ void ConsensusServiceImpl::UpdateConsensus(
   context->RespondSuccess();
 }
 
+void ConsensusServiceImpl::MultiUpdateConsensus(
+    const MultiConsensusRequestPB* req,
+    MultiConsensusResponsePB* resp,
+    rpc::RpcContext* context) {
+  DVLOG(3) << "Received Consensus MultiUpdate RPC: " << SecureDebugString(*req);
+  const string& local_uuid = tablet_manager_.NodeInstance().permanent_uuid();
+  // The requests are for different groups, so each one gets its own response
+  // and an error in one doesn't fail the others.
+  for (int i = 0; i < req->requests_size(); i++) {
+    resp->add_responses();
+  }
+
+  // The updates that passed the checks below. Each one takes its group's
+  // update lock, which may be held across a log append or sync, so they run
+  // independently of each other.
+  std::vector<std::function<void()>> updates;
+  for (int i = 0; i < req->requests_size(); i++) {
+    const ConsensusRequestPB& sub_req = req->requests(i);
+    ConsensusResponsePB* sub_resp = resp->mutable_responses(i);
+    auto set_error = [sub_resp](const Status& s, ServerErrorPB::Code code) {
+      StatusToPB(s, sub_resp->mutable_error()->mutable_status());
+      sub_resp->mutable_error()->set_code(code);
+    };
+
+    if (PREDICT_FALSE(sub_req.dest_uuid() != local_uuid)) {
+      set_error(
+          Status::InvalidArgument(Substitute(
+              "MultiUpdateConsensus: Wrong destination UUID requested. "
+              "Local UUID: $0. Requested UUID: $1",
+              local_uuid,
+              sub_req.dest_uuid())),
+          ServerErrorPB::WRONG_SERVER_UUID);
+      continue;
+    }
+
+    shared_ptr<RaftConsensus> consensus =
+        tablet_manager_.shared_consensus(sub_req.tablet_id());
+    if (!consensus) {
+      set_error(
+          Status::ServiceUnavailable(
+              "Raft Consensus unavailable", "Tablet replica not initialized"),
+          ServerErrorPB::CONSENSUS_NOT_RUNNING);
+      continue;
+    }
+
+    auto ownToken = consensus->GetRaftRpcToken();
+    if (ownToken) {
+      sub_resp->set_raft_rpc_token(*ownToken);
+    }
+    Status s;
+    if (!CheckRaftRpcToken(
+            "MultiUpdateConsensus",
+            &sub_req,
+            *consensus,
+            request_rpc_token_mismatches_,
+            &s)) {
+      set_error(s, ServerErrorPB::RING_TOKEN_MISMATCH);
+      continue;
+    }
+
+    // Only status-only requests are coalesced, and never proxied ones.
+    if (PREDICT_FALSE(
+            sub_req.ops_size() > 0 || consensus->IsProxyRequest(&sub_req))) {
+      set_error(
+          Status::InvalidArgument(
+              "MultiUpdateConsensus: only direct status-only requests can be "
+              "coalesced"),
+          ServerErrorPB::UNKNOWN_ERROR);
+      continue;
+    }
+
+    updates.emplace_back([consensus = std::move(consensus),
+                          ownToken = std::move(ownToken),
+                          &sub_req,
+                          sub_resp,
+                          set_error]() {
+      Status s = consensus->Update(&sub_req, sub_resp);
+      if (PREDICT_FALSE(!s.ok())) {
+        sub_resp->Clear();
+        if (ownToken) {
+          sub_resp->set_raft_rpc_token(*ownToken);
+        }
+        set_error(s, ServerErrorPB::UNKNOWN_ERROR);
+      }
+    });
+  }
+
+  if (updates.empty()) {
+    context->RespondSuccess();
+    return;
+  }
+
+  // Whichever update finishes last responds. All but one are handed to the
+  // pool; the last one runs on this thread, as do those the pool refuses.
+  auto remaining =
+      std::make_shared<std::atomic<int>>(static_cast<int>(updates.size()));
+  auto run = [remaining, context](const std::function<void()>& update) {
+    update();
+    if (remaining->fetch_sub(1) == 1) {
+      context->RespondSuccess();
+    }
+  };
+  for (size_t i = 0; i + 1 < updates.size(); i++) {
+    Status s = multi_update_pool_->SubmitFunc(
+        [run, update = updates[i]]() { run(update); });
+    if (PREDICT_FALSE(!s.ok())) {
+      KLOG_EVERY_N_SECS(WARNING, 10)
+          << "Running a coalesced update inline: " << s.ToString();
+      run(updates[i]);
+    }
+  }
+  run(updates.back());
+}
+
 void ConsensusServiceImpl::RequestConsensusVote(
     const VoteRequestPB* req,
     VoteResponsePB* resp,
@@ -18,6 +18,7 @@
 #define KUDU_TSERVER_TABLET_SERVICE_H
 
 #include <cstdint>
+#include <memory>
 #include <string>
 
 #include "kudu/consensus/consensus.service.h"
@@ -33,6 +34,7 @@ class Message;
 namespace kudu {
 
 class Status;
+class ThreadPool;
 
 namespace server {
 class ServerBase;
@@ -92,6 +94,11 @@ class ConsensusServiceImpl : public consensus::ConsensusServiceIf {
       consensus::ConsensusResponsePB* resp,
       rpc::RpcContext* context) override;
 
+  virtual void MultiUpdateConsensus(
+      const consensus::MultiConsensusRequestPB* req,
+      consensus::MultiConsensusResponsePB* resp,
+      rpc::RpcContext* context) override;
+
   virtual void LongUpdateConsensusLoading() override;
   virtual void LongUpdateConsensusLoaded() override;
 
@@ -150,6 +157,9 @@ class ConsensusServiceImpl : public consensus::ConsensusServiceIf {
   TabletManagerIf& tablet_manager_;
 
   scoped_refptr<Counter> request_rpc_token_mismatches_;
+
+  // Applies the per-group updates of MultiUpdateConsensus requests.
+  std::unique_ptr<ThreadPool> multi_update_pool_;
 };
 
 } // namespace tserver
@@ -0,0 +1,141 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "kudu/util/buffer_pool.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "kudu/util/mem_tracker.h"
+#include "kudu/util/test_util.h"
+
+using std::shared_ptr;
+using std::vector;
+
+namespace kudu {
+
+class BufferPoolTest : public KuduTest {};
+
+TEST_F(BufferPoolTest, TestSizeClasses) {
+  BufferPool pool(4096, 1 << 20, 8 << 20);
+  // Small requests get the smallest class.
+  auto buf = pool.Acquire(10);
+  ASSERT_EQ(0, buf->size());
+  ASSERT_EQ(4096, buf->capacity());
+  buf = pool.Acquire(4097);
+  ASSERT_EQ(8192, buf->capacity());
+  buf = pool.Acquire(1 << 20);
+  ASSERT_EQ(1 << 20, buf->capacity());
+  buf.reset();
+  ASSERT_EQ((1 << 20) + 8192 + 4096, pool.cached_bytes());
+
+  // Larger requests aren't pooled.
+  buf = pool.Acquire((1 << 20) + 1);
+  ASSERT_GE(buf->capacity(), (1 << 20) + 1);
+  buf.reset();
+  ASSERT_EQ((1 << 20) + 8192 + 4096, pool.cached_bytes());
+}
+
+TEST_F(BufferPoolTest, TestReuse) {
+  BufferPool pool(4096, 1 << 20, 8 << 20);
+  auto buf = pool.Acquire(5000);
+  buf->append("abc", 3);
+  const uint8_t* data = buf->data();
+  buf.reset();
+  ASSERT_EQ(8192, pool.cached_bytes());
+
+  // The buffer comes back empty, and other size classes don't take it.
+  buf = pool.Acquire(8000);
+  ASSERT_EQ(data, buf->data());
+  ASSERT_EQ(0, buf->size());
+  ASSERT_EQ(0, pool.cached_bytes());
+  auto other = pool.Acquire(100);
+  ASSERT_NE(data, other->data());
+
+  // A buffer is returned once its last reference is dropped.
+  shared_ptr<faststring> ref = buf;
+  buf.reset();
+  ASSERT_EQ(0, pool.cached_bytes());
+  ref.reset();
+  ASSERT_EQ(8192, pool.cached_bytes());
+}
+
+TEST_F(BufferPoolTest, TestGrownBuffer) {
+  BufferPool pool(4096, 1 << 20, 8 << 20);
+  auto buf = pool.Acquire(4096);
+  buf->resize(20000);
+  buf.reset();
+  // The buffer serves the largest class that fits in its capacity.
+  ASSERT_GE(pool.cached_bytes(), 20000);
+  buf = pool.Acquire(16384);
+  ASSERT_GE(buf->capacity(), 20000);
+  ASSERT_EQ(0, pool.cached_bytes());
+}
+
+TEST_F(BufferPoolTest, TestMaxCachedBytes) {
+  BufferPool pool(4096, 1 << 20, 3 * 4096);
+  vector<shared_ptr<faststring>> bufs;
+  for (int i = 0; i < 10; i++) {
+    bufs.emplace_back(pool.Acquire(4096));
+  }
+  bufs.clear();
+  ASSERT_EQ(3 * 4096, pool.cached_bytes());
+}
+
+TEST_F(BufferPoolTest, TestMemTracker) {
+  shared_ptr<MemTracker> tracker =
+      MemTracker::CreateTracker(-1, "buffer-pool-test");
+  {
+    BufferPool pool(4096, 1 << 20, 8 << 20, tracker);
+    auto buf = pool.Acquire(5000);
+    auto other = pool.Acquire(100);
+    // Buffers in use aren't charged, free ones are.
+    ASSERT_EQ(0, tracker->consumption());
+    buf.reset();
+    other.reset();
+    ASSERT_EQ(8192 + 4096, tracker->consumption());
+    buf = pool.Acquire(8000);
+    ASSERT_EQ(4096, tracker->consumption());
+    ASSERT_EQ(pool.cached_bytes(), tracker->consumption());
+    buf.reset();
+  }
+  // The pool's free buffers are released along with it.
+  ASSERT_EQ(0, tracker->consumption());
+}
+
+TEST_F(BufferPoolTest, TestConcurrentUse) {
+  BufferPool pool(4096, 1 << 20, 1 << 20);
+  vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&pool, t]() {
+      for (int i = 0; i < 1000; i++) {
+        auto buf = pool.Acquire(4096 << ((t + i) % 4));
+        buf->resize(100);
+        buf->data()[99] = static_cast<uint8_t>(i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_LE(pool.cached_bytes(), 1 << 20);
+}
+
+} // namespace kudu
@@ -0,0 +1,107 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "kudu/util/buffer_pool.h"
+
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include "kudu/gutil/bits.h"
+#include "kudu/util/mem_tracker.h"
+
+namespace kudu {
+
+BufferPool::BufferPool(
+    size_t min_buffer_size,
+    size_t max_buffer_size,
+    int64_t max_cached_bytes,
+    std::shared_ptr<MemTracker> mem_tracker)
+    : min_size_class_(
+          Bits::Log2Ceiling64(std::max<size_t>(min_buffer_size, 1))),
+      max_size_class_(Bits::Log2Floor64(max_buffer_size)),
+      max_cached_bytes_(max_cached_bytes),
+      mem_tracker_(std::move(mem_tracker)),
+      cached_bytes_(0) {
+  CHECK_LE(min_size_class_, max_size_class_);
+  free_lists_.resize(max_size_class_ - min_size_class_ + 1);
+}
+
+BufferPool::~BufferPool() {
+  if (mem_tracker_) {
+    mem_tracker_->Release(cached_bytes_);
+  }
+}
+
+std::shared_ptr<faststring> BufferPool::Acquire(size_t size) {
+  const int size_class =
+      std::max(Bits::Log2Ceiling64(std::max<size_t>(size, 1)), min_size_class_);
+  if (size_class > max_size_class_) {
+    return std::make_shared<faststring>(size);
+  }
+
+  std::unique_ptr<faststring> buffer;
+  {
+    std::lock_guard<simple_spinlock> l(lock_);
+    auto& free_list = free_lists_[size_class - min_size_class_];
+    if (!free_list.empty()) {
+      buffer = std::move(free_list.back());
+      free_list.pop_back();
+      cached_bytes_ -= buffer->capacity();
+      // Charged under the lock so that the tracker never goes below zero.
+      if (mem_tracker_) {
+        mem_tracker_->Release(buffer->capacity());
+      }
+    }
+  }
+  if (!buffer) {
+    buffer.reset(new faststring(size_t{1} << size_class));
+  }
+  return std::shared_ptr<faststring>(
+      buffer.release(), [this](faststring* b) { Release(b); });
+}
+
+int64_t BufferPool::cached_bytes() const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  return cached_bytes_;
+}
+
+void BufferPool::Release(faststring* buffer) {
+  std::unique_ptr<faststring> owned(buffer);
+  // The buffer may have grown past its size class, in which case it's filed
+  // under the largest class it can serve.
+  const int size_class = Bits::Log2Floor64(owned->capacity());
+  if (size_class < min_size_class_ || size_class > max_size_class_) {
+    return;
+  }
+  const int64_t capacity = owned->capacity();
+  owned->clear();
+
+  std::lock_guard<simple_spinlock> l(lock_);
+  if (cached_bytes_ + capacity > max_cached_bytes_) {
+    return;
+  }
+  free_lists_[size_class - min_size_class_].emplace_back(std::move(owned));
+  cached_bytes_ += capacity;
+  if (mem_tracker_) {
+    mem_tracker_->Consume(capacity);
+  }
+}
+
+} // namespace kudu
@@ -0,0 +1,80 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "kudu/gutil/macros.h"
+#include "kudu/util/faststring.h"
+#include "kudu/util/locks.h"
+
+namespace kudu {
+
+class MemTracker;
+
+// A pool of reusable byte buffers, for callers that repeatedly need large,
+// short-lived buffers (e.g. to serialize a batch of WAL entries) and would
+// otherwise allocate and free one each time.
+//
+// Buffers are grouped in power-of-two size classes between 'min_buffer_size'
+// and 'max_buffer_size'. A buffer is handed out as a refcounted faststring
+// with the capacity of its size class, and goes back to the free list of that
+// class when the last reference to it is dropped, unless the pool already
+// caches 'max_cached_bytes' of free buffers. Requests larger than
+// 'max_buffer_size' are served with buffers that aren't pooled. The free
+// buffers are charged to 'mem_tracker', if any.
+//
+// The pool must outlive the buffers it hands out.
+//
+// This class is thread-safe.
+class BufferPool {
+ public:
+  BufferPool(
+      size_t min_buffer_size,
+      size_t max_buffer_size,
+      int64_t max_cached_bytes,
+      std::shared_ptr<MemTracker> mem_tracker = nullptr);
+  ~BufferPool();
+
+  // Returns an empty buffer with a capacity of at least 'size' bytes.
+  std::shared_ptr<faststring> Acquire(size_t size);
+
+  // The total capacity of the free buffers in the pool.
+  int64_t cached_bytes() const;
+
+ private:
+  // Returns 'buffer' to the free list of its size class, or frees it.
+  void Release(faststring* buffer);
+
+  const int min_size_class_;
+  const int max_size_class_;
+  const int64_t max_cached_bytes_;
+  const std::shared_ptr<MemTracker> mem_tracker_;
+
+  mutable simple_spinlock lock_;
+
+  // Free buffers, indexed by size class minus 'min_size_class_'.
+  std::vector<std::vector<std::unique_ptr<faststring>>> free_lists_;
+  int64_t cached_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(BufferPool);
+};
+
+} // namespace kudu
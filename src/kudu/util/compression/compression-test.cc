@@ -15,21 +15,37 @@
 // specific language governing permissions and limitations
 // under the License.
 
+#include <atomic>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include <gflags/gflags.h>
+#include <glog/logging.h>
 #include <gtest/gtest.h>
 
 #include "kudu/util/compression/compression.pb.h"
 #include "kudu/util/compression/compression_codec.h"
+#include "kudu/util/compression/compression_dict_trainer.h"
+#include "kudu/util/monotime.h"
+#include "kudu/util/random.h"
 #include "kudu/util/slice.h"
 #include "kudu/util/test_macros.h"
 #include "kudu/util/test_util.h"
 
+DEFINE_int32(
+    compression_bench_ops_per_thread,
+    2000,
+    "Number of compress/uncompress round trips each thread runs in the "
+    "concurrent compression benchmark");
+
 namespace kudu {
 
+using std::string;
 using std::vector;
 
 class TestCompression : public KuduTest {};
@@ -90,4 +106,291 @@ TEST_F(TestCompression, TestZlibCompressionCodec) {
   TestCompressionCodec(ZLIB);
 }
 
+// Returns a row-image-like payload: mostly repeated structure with some
+// random bytes, so that it compresses reasonably but not trivially.
+static string MakePayload(Random* rng, int size) {
+  string payload;
+  payload.reserve(size);
+  while (payload.size() < size) {
+    payload.append("{\"id\":");
+    payload.append(std::to_string(rng->Next32()));
+    payload.append(",\"state\":\"ACTIVE\",\"region\":\"");
+    payload.push_back('a' + rng->Uniform(26));
+    payload.append("\"}");
+  }
+  payload.resize(size);
+  return payload;
+}
+
+// Runs round trips through a single shared codec from 1 up to 32 threads at
+// once, verifying each of them and logging the aggregate throughput.
+static void BenchmarkConcurrentCompression(
+    CompressionType type,
+    const string& dict) {
+  const int kPayloadSize = 4096;
+  const int kOpsPerThread = FLAGS_compression_bench_ops_per_thread;
+
+  std::shared_ptr<CompressionCodec> codec;
+  ASSERT_OK(CompressionCodecManager::GetCodec(type, &codec));
+  if (!dict.empty()) {
+    ASSERT_OK(codec->SetDictionary(dict));
+  }
+
+  for (int num_threads = 1; num_threads <= 32; num_threads *= 2) {
+    std::atomic<int> num_failures(0);
+    vector<std::thread> threads;
+    MonoTime start = MonoTime::Now();
+    for (int t = 0; t < num_threads; t++) {
+      threads.emplace_back([&, t]() {
+        Random rng(SeedRandom() + t);
+        std::unique_ptr<uint8_t[]> cbuffer(
+            new uint8_t[codec->MaxCompressedLength(kPayloadSize)]);
+        string ubuffer(kPayloadSize, '\0');
+        for (int i = 0; i < kOpsPerThread; i++) {
+          const string payload = MakePayload(&rng, kPayloadSize);
+          size_t compressed;
+          Status s = codec->CompressWithStats(
+              Slice(payload), cbuffer.get(), &compressed);
+          if (s.ok()) {
+            s = codec->UncompressWithStats(
+                Slice(cbuffer.get(), compressed),
+                reinterpret_cast<uint8_t*>(&ubuffer[0]),
+                kPayloadSize);
+          }
+          if (!s.ok() || ubuffer != payload) {
+            num_failures++;
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    MonoDelta elapsed = MonoTime::Now() - start;
+    ASSERT_EQ(0, num_failures.load());
+
+    const int64_t total_ops = static_cast<int64_t>(num_threads) * kOpsPerThread;
+    const double mb_per_sec =
+        total_ops * kPayloadSize / 1024.0 / 1024.0 / elapsed.ToSeconds();
+    LOG(INFO) << CompressionType_Name(type) << " with " << num_threads
+              << " threads: " << total_ops << " round trips in "
+              << elapsed.ToString() << " (" << mb_per_sec << " MB/s)";
+  }
+  LOG(INFO) << codec->Stats();
+}
+
+TEST_F(TestCompression, TestConcurrentZstdCompression) {
+  NO_FATALS(BenchmarkConcurrentCompression(ZSTD, ""));
+}
+
+TEST_F(TestCompression, TestConcurrentZstdDictCompression) {
+  Random rng(SeedRandom());
+  NO_FATALS(
+      BenchmarkConcurrentCompression(ZSTD_DICT, MakePayload(&rng, 16 * 1024)));
+}
+
+TEST_F(TestCompression, TestConcurrentLz4DictCompression) {
+  Random rng(SeedRandom());
+  NO_FATALS(
+      BenchmarkConcurrentCompression(LZ4_DICT, MakePayload(&rng, 16 * 1024)));
+}
+
+// Compresses 'payload' with 'codec' and returns the compressed bytes.
+static string CompressOrDie(CompressionCodec* codec, const string& payload) {
+  string compressed(codec->MaxCompressedLength(payload.size()), '\0');
+  size_t compressed_size;
+  CHECK_OK(codec->Compress(
+      Slice(payload),
+      reinterpret_cast<uint8_t*>(&compressed[0]),
+      &compressed_size));
+  compressed.resize(compressed_size);
+  return compressed;
+}
+
+TEST_F(TestCompression, TestDictTrainer) {
+  CompressionDictTrainer::Options opts;
+  opts.sample_every_n = 2;
+  opts.max_samples = 512;
+  opts.min_samples = 128;
+  opts.dict_size = 4 * 1024;
+  opts.min_interval = MonoDelta::FromSeconds(3600);
+  CompressionDictTrainer trainer(opts);
+
+  Random rng(SeedRandom());
+  vector<string> payloads;
+  for (int i = 0; i < 2 * opts.min_samples; i++) {
+    payloads.emplace_back(MakePayload(&rng, 512));
+    // Nothing is due until there are enough samples.
+    ASSERT_FALSE(trainer.StartTrainingIfDue());
+    trainer.AddSample(Slice(payloads.back()));
+  }
+  ASSERT_TRUE(trainer.StartTrainingIfDue());
+  // Only one training at a time.
+  ASSERT_FALSE(trainer.StartTrainingIfDue());
+
+  string dict;
+  ASSERT_OK(trainer.Train(&dict));
+  ASSERT_FALSE(dict.empty());
+  ASSERT_LE(dict.size(), opts.dict_size);
+  ASSERT_EQ(1, trainer.num_trainings());
+  // The next training waits for the interval to elapse.
+  ASSERT_FALSE(trainer.StartTrainingIfDue());
+
+  // The trained dictionary does better than no dictionary on small payloads.
+  std::shared_ptr<CompressionCodec> plain;
+  std::shared_ptr<CompressionCodec> with_dict;
+  ASSERT_OK(CompressionCodecManager::GetCodec(ZSTD, &plain));
+  ASSERT_OK(CompressionCodecManager::GetCodec(ZSTD_DICT, &with_dict));
+  ASSERT_OK(with_dict->SetDictionary(dict));
+  const string payload = MakePayload(&rng, 512);
+  ASSERT_LT(
+      CompressOrDie(with_dict.get(), payload).size(),
+      CompressOrDie(plain.get(), payload).size());
+}
+
+// Trains two distinct dictionaries.
+static void TrainTwoDictionaries(Random* rng, vector<string>* dicts) {
+  CompressionDictTrainer::Options opts;
+  opts.sample_every_n = 1;
+  opts.min_samples = 128;
+  opts.dict_size = 4 * 1024;
+  opts.min_interval = MonoDelta::FromSeconds(0);
+  CompressionDictTrainer trainer(opts);
+
+  for (int d = 0; d < 2; d++) {
+    for (int i = 0; i < opts.min_samples; i++) {
+      trainer.AddSample(Slice(MakePayload(rng, 512)));
+    }
+    ASSERT_TRUE(trainer.StartTrainingIfDue());
+    string dict;
+    ASSERT_OK(trainer.Train(&dict));
+    dicts->emplace_back(std::move(dict));
+  }
+  ASSERT_NE(
+      CompressionCodecManager::GetDictionaryID((*dicts)[0]),
+      CompressionCodecManager::GetDictionaryID((*dicts)[1]));
+}
+
+// Payloads compressed with an earlier dictionary can still be decompressed
+// after the dictionary is replaced, by the same codec or by another one.
+static void TestDictionaryHistory(CompressionType type) {
+  Random rng(SeedRandom());
+  vector<string> dicts;
+  NO_FATALS(TrainTwoDictionaries(&rng, &dicts));
+
+  std::shared_ptr<CompressionCodec> codec;
+  ASSERT_OK(CompressionCodecManager::GetCodec(type, &codec));
+  ASSERT_OK(codec->SetDictionary(dicts[0]));
+  const string payload = MakePayload(&rng, 1024);
+  const string compressed = CompressOrDie(codec.get(), payload);
+
+  ASSERT_OK(codec->SetDictionary(dicts[1]));
+  string uncompressed(payload.size(), '\0');
+  ASSERT_OK(codec->Uncompress(
+      Slice(compressed),
+      reinterpret_cast<uint8_t*>(&uncompressed[0]),
+      payload.size()));
+  ASSERT_EQ(payload, uncompressed);
+
+  // A codec that never used the first dictionary finds it in the registry.
+  std::shared_ptr<CompressionCodec> other;
+  ASSERT_OK(CompressionCodecManager::GetCodec(type, &other));
+  ASSERT_OK(other->SetDictionary(dicts[1]));
+  uncompressed.assign(payload.size(), '\0');
+  ASSERT_OK(other->Uncompress(
+      Slice(compressed),
+      reinterpret_cast<uint8_t*>(&uncompressed[0]),
+      payload.size()));
+  ASSERT_EQ(payload, uncompressed);
+  LOG(INFO) << codec->Stats();
+}
+
+TEST_F(TestCompression, TestZstdDictionaryHistory) {
+  NO_FATALS(TestDictionaryHistory(ZSTD_DICT));
+}
+
+TEST_F(TestCompression, TestLz4DictionaryHistory) {
+  NO_FATALS(TestDictionaryHistory(LZ4_DICT));
+}
+
+// A registered dictionary is pruned once it's neither referenced nor the
+// current one.
+static void TestDictionaryPruning(CompressionType type) {
+  Random rng(SeedRandom());
+  vector<string> dicts;
+  NO_FATALS(TrainTwoDictionaries(&rng, &dicts));
+
+  std::shared_ptr<CompressionCodec> codec;
+  ASSERT_OK(CompressionCodecManager::GetCodec(type, &codec));
+  ASSERT_OK(codec->SetDictionary(dicts[0]));
+  const string payload = MakePayload(&rng, 1024);
+  const string compressed = CompressOrDie(codec.get(), payload);
+  const unsigned int old_id =
+      CompressionCodecManager::GetFrameDictionaryID(type, Slice(compressed));
+  ASSERT_EQ(CompressionCodecManager::GetDictionaryID(dicts[0]), old_id);
+
+  ASSERT_OK(CompressionCodecManager::SetDictionary(dicts[1]));
+  ASSERT_OK(codec->SetDictionary(dicts[1]));
+  {
+    // Referenced, e.g. by a log segment holding 'compressed'.
+    CompressionDictRef ref(old_id);
+    CompressionDictRef copy = ref;
+    CompressionCodecManager::PruneDictionaries();
+    ASSERT_TRUE(CompressionCodecManager::IsDictionaryRegistered(dicts[0]));
+    ASSERT_TRUE(CompressionCodecManager::IsDictionaryRegistered(dicts[1]));
+  }
+  CompressionCodecManager::PruneDictionaries();
+  ASSERT_FALSE(CompressionCodecManager::IsDictionaryRegistered(dicts[0]));
+  // The current dictionary is never pruned.
+  ASSERT_TRUE(CompressionCodecManager::IsDictionaryRegistered(dicts[1]));
+
+  // A codec that never used the pruned dictionary can't find it anymore.
+  std::shared_ptr<CompressionCodec> other;
+  ASSERT_OK(CompressionCodecManager::GetCodec(type, &other));
+  ASSERT_OK(other->SetDictionary(dicts[1]));
+  string uncompressed(payload.size(), '\0');
+  ASSERT_TRUE(other
+                  ->Uncompress(
+                      Slice(compressed),
+                      reinterpret_cast<uint8_t*>(&uncompressed[0]),
+                      payload.size())
+                  .IsCompressionDictMismatch());
+
+  ASSERT_OK(CompressionCodecManager::SetDictionary(""));
+}
+
+TEST_F(TestCompression, TestZstdDictionaryPruning) {
+  NO_FATALS(TestDictionaryPruning(ZSTD_DICT));
+}
+
+TEST_F(TestCompression, TestLz4DictionaryPruning) {
+  NO_FATALS(TestDictionaryPruning(LZ4_DICT));
+}
+
+// A dictionary that can't be loaded is rejected, and the codec keeps
+// compressing with the previous one.
+TEST_F(TestCompression, TestZstdSetBadDictionary) {
+  Random rng(SeedRandom());
+  std::shared_ptr<CompressionCodec> codec;
+  ASSERT_OK(CompressionCodecManager::GetCodec(ZSTD_DICT, &codec));
+  const string dict = MakePayload(&rng, 1024);
+  ASSERT_OK(codec->SetDictionary(dict));
+
+  // The ZSTD dictionary magic number, followed by garbage instead of entropy
+  // tables.
+  string bad_dict("\x37\xa4\x30\xec\x01\x00\x00\x00", 8);
+  bad_dict.append(256, '\xff');
+  ASSERT_FALSE(codec->SetDictionary(bad_dict).ok());
+  ASSERT_EQ(dict, codec->GetDictionary());
+
+  const string payload = MakePayload(&rng, 1024);
+  const string compressed = CompressOrDie(codec.get(), payload);
+  string uncompressed(payload.size(), '\0');
+  ASSERT_OK(codec->Uncompress(
+      Slice(compressed),
+      reinterpret_cast<uint8_t*>(&uncompressed[0]),
+      payload.size()));
+  ASSERT_EQ(payload, uncompressed);
+}
+
 } // namespace kudu
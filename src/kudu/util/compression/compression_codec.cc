@@ -21,9 +21,14 @@
 
 #include "kudu/util/compression/compression_codec.h"
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <folly/compression/CompressionContextPoolSingletons.h>
@@ -35,15 +40,27 @@
 #include <zlib.h>
 #include <zstd.h>
 
+#include "kudu/gutil/endian.h"
+#include "kudu/gutil/map-util.h"
 #include "kudu/gutil/port.h"
 #include "kudu/gutil/stringprintf.h"
 #include "kudu/util/faststring.h"
 #include "kudu/util/jsonwriter.h"
+#include "kudu/util/locks.h"
 #include "kudu/util/logging.h"
+#include "kudu/util/monotime.h"
 #include "kudu/util/scoped_cleanup.h"
 
 DEFINE_string(compression_dict_filename, "", "Compression dictionary filename");
 
+DEFINE_int32(
+    compression_dict_history_size,
+    8,
+    "Number of digested compression dictionaries, including the current one, "
+    "that each dictionary codec caches. Earlier dictionaries stay registered "
+    "for as long as the log cache or a retained WAL segment refers to them, "
+    "and are digested again when needed");
+
 namespace kudu {
 
 using std::vector;
@@ -53,6 +70,11 @@ CompressionCodec::CompressionCodec() {}
 CompressionCodec::~CompressionCodec() {}
 
 std::string CompressionCodec::Stats() const {
+  return Stats(nullptr);
+}
+
+std::string CompressionCodec::Stats(
+    const std::function<void(JsonWriter*)>& append_stats) const {
   try {
     std::ostringstream s;
     JsonWriter jw(&s, JsonWriter::COMPACT);
@@ -91,6 +113,11 @@ std::string CompressionCodec::Stats() const {
     jw.String("total_decompression_errors");
     jw.Int64(total_decompression_errors_);
 
+    AppendStats(&jw);
+    if (append_stats) {
+      append_stats(&jw);
+    }
+
     jw.EndObject();
     return s.str();
   } catch (...) {
@@ -162,6 +189,59 @@ class SlicesSource : public snappy::Source {
   const vector<Slice>& slices_;
 };
 
+// A pool of codec contexts, so that concurrent calls into a codec each get a
+// context of their own instead of serializing on a single one. Contexts are
+// created on demand and returned to the pool once the call is done with them,
+// so the pool grows to the peak number of concurrent callers.
+template <typename T, T* (*Create)(), void (*Free)(T*)>
+class ContextPool {
+ public:
+  struct Releaser {
+    void operator()(T* ctx) const {
+      pool->Release(ctx);
+    }
+    ContextPool* pool;
+  };
+  typedef std::unique_ptr<T, Releaser> Ref;
+
+  ContextPool() {}
+
+  ~ContextPool() {
+    for (T* ctx : free_) {
+      Free(ctx);
+    }
+  }
+
+  // Returns a context for the exclusive use of the caller until the reference
+  // goes out of scope, or a null reference if a new context couldn't be
+  // created.
+  Ref Get() {
+    T* ctx = nullptr;
+    {
+      std::lock_guard<simple_spinlock> l(lock_);
+      if (!free_.empty()) {
+        ctx = free_.back();
+        free_.pop_back();
+      }
+    }
+    if (!ctx) {
+      ctx = Create();
+    }
+    return Ref(ctx, Releaser{this});
+  }
+
+ private:
+  void Release(T* ctx) {
+    std::lock_guard<simple_spinlock> l(lock_);
+    free_.push_back(ctx);
+  }
+
+  simple_spinlock lock_;
+  vector<T*> free_;
+
+  DISALLOW_COPY_AND_ASSIGN(ContextPool);
+};
+
 class SnappyCodec : public CompressionCodec {
  public:
   Status Compress(
@@ -276,41 +356,230 @@ class Lz4Codec : public CompressionCodec {
   }
 };
 
+// Compression stats of a single dictionary.
+struct DictionaryStats {
+  void RecordCompression(size_t before, size_t after, MonoDelta elapsed) {
+    compressions.fetch_add(1, std::memory_order_relaxed);
+    bytes_before_compression.fetch_add(before, std::memory_order_relaxed);
+    bytes_after_compression.fetch_add(after, std::memory_order_relaxed);
+    compression_micros.fetch_add(
+        elapsed.ToMicroseconds(), std::memory_order_relaxed);
+  }
+
+  void RecordDecompression(MonoDelta elapsed) {
+    decompressions.fetch_add(1, std::memory_order_relaxed);
+    decompression_micros.fetch_add(
+        elapsed.ToMicroseconds(), std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> compressions{0};
+  std::atomic<uint64_t> bytes_before_compression{0};
+  std::atomic<uint64_t> bytes_after_compression{0};
+  std::atomic<uint64_t> compression_micros{0};
+  std::atomic<uint64_t> decompressions{0};
+  std::atomic<uint64_t> decompression_micros{0};
+};
+
+// The fields common to the digested dictionaries of all dictionary codecs.
+// Digested dictionaries are immutable once built and are shared read-only by
+// every call into the codec.
+struct DictionaryBase {
+  void WriteStats(JsonWriter* jw) const {
+    jw->StartObject();
+    jw->String("dict_id");
+    jw->Uint(id);
+    jw->String("version");
+    jw->Int64(version);
+    jw->String("size");
+    jw->Uint64(dict.size());
+    jw->String("compressions");
+    jw->Uint64(stats.compressions);
+    jw->String("bytes_before_compression");
+    jw->Uint64(stats.bytes_before_compression);
+    jw->String("bytes_after_compression");
+    jw->Uint64(stats.bytes_after_compression);
+    jw->String("compression_micros");
+    jw->Uint64(stats.compression_micros);
+    jw->String("decompressions");
+    jw->Uint64(stats.decompressions);
+    jw->String("decompression_micros");
+    jw->Uint64(stats.decompression_micros);
+    jw->EndObject();
+  }
+
+  std::string dict;
+  unsigned id = 0;
+  int64_t version = 0;
+  mutable DictionaryStats stats;
+};
+
+// The dictionaries known to a dictionary codec: the current one, used to
+// compress, and the previous ones, still needed to decompress payloads that
+// were compressed before the dictionary was last replaced.
+//
+// 'D' is the codec's digested dictionary type. It derives from DictionaryBase
+// and provides:
+//
+//   static Status Create(
+//       const std::string& dict,
+//       int level,
+//       int64_t version,
+//       std::shared_ptr<D>* digested);
+//
+// where 'version' is the dictionary's version in CompressionCodecManager's
+// registry.
+template <typename D>
+class DictionarySet {
+ public:
+  std::shared_ptr<const D> current() const {
+    return std::atomic_load(&current_);
+  }
+
+  // Makes 'dict' the current dictionary. Calls already using the previous one
+  // are unaffected.
+  void SetCurrent(std::shared_ptr<const D> dict) {
+    std::lock_guard<simple_spinlock> l(lock_);
+    std::shared_ptr<const D> prev = std::atomic_load(&current_);
+    if (prev && (!dict || prev->id != dict->id)) {
+      previous_.push_back(std::move(prev));
+    }
+    if (dict) {
+      EraseUnlocked(dict->id);
+    }
+    std::atomic_store(&current_, std::move(dict));
+    TrimUnlocked();
+  }
+
+  // Returns the dictionary with id 'id', or null if it is unknown. A
+  // dictionary this codec hasn't used yet is digested from the ones
+  // registered with CompressionCodecManager.
+  std::shared_ptr<const D> Find(unsigned id, int level) {
+    std::shared_ptr<const D> dict = current();
+    if (dict && dict->id == id) {
+      return dict;
+    }
+    {
+      std::lock_guard<simple_spinlock> l(lock_);
+      for (const auto& prev : previous_) {
+        if (prev->id == id) {
+          return prev;
+        }
+      }
+    }
+
+    std::string raw;
+    int64_t version;
+    if (!CompressionCodecManager::FindDictionary(id, &raw, &version)) {
+      return nullptr;
+    }
+    std::shared_ptr<D> digested;
+    if (!D::Create(raw, level, version, &digested).ok()) {
+      return nullptr;
+    }
+    std::lock_guard<simple_spinlock> l(lock_);
+    // Someone may have digested it concurrently, in which case either copy
+    // will do.
+    EraseUnlocked(id);
+    previous_.push_back(digested);
+    TrimUnlocked();
+    return digested;
+  }
+
+  void AppendStats(JsonWriter* jw) const {
+    jw->String("dictionaries");
+    jw->StartArray();
+    std::lock_guard<simple_spinlock> l(lock_);
+    for (const auto& prev : previous_) {
+      prev->WriteStats(jw);
+    }
+    std::shared_ptr<const D> dict = current();
+    if (dict) {
+      dict->WriteStats(jw);
+    }
+    jw->EndArray();
+  }
+
+ private:
+  void EraseUnlocked(unsigned id) {
+    for (auto it = previous_.begin(); it != previous_.end();) {
+      it = (*it)->id == id ? previous_.erase(it) : it + 1;
+    }
+  }
+
+  void TrimUnlocked() {
+    const size_t max_previous =
+        std::max(FLAGS_compression_dict_history_size - 1, 0);
+    while (previous_.size() > max_previous) {
+      previous_.pop_front();
+    }
+  }
+
+  mutable simple_spinlock lock_;
+  std::shared_ptr<const D> current_;
+  // Oldest first.
+  std::deque<std::shared_ptr<const D>> previous_;
+};
+
+namespace {
+
+LZ4F_cctx* CreateLz4CompressionContext() {
+  LZ4F_cctx* ctx = nullptr;
+  if (LZ4F_isError(LZ4F_createCompressionContext(&ctx, LZ4F_VERSION))) {
+    return nullptr;
+  }
+  return ctx;
+}
+
+void FreeLz4CompressionContext(LZ4F_cctx* ctx) {
+  LZ4F_freeCompressionContext(ctx);
+}
+
+LZ4F_dctx* CreateLz4DecompressionContext() {
+  LZ4F_dctx* ctx = nullptr;
+  if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION))) {
+    return nullptr;
+  }
+  return ctx;
+}
+
+void FreeLz4DecompressionContext(LZ4F_dctx* ctx) {
+  LZ4F_freeDecompressionContext(ctx);
+}
+
+} // anonymous namespace
+
 class Lz4DictCodec : public CompressionCodec {
  public:
   Lz4DictCodec() {
     compression_level_ = 1;
-  }
-
-  ~Lz4DictCodec() {
-    LZ4F_freeCompressionContext(compression_ctx_);
-    LZ4F_freeDecompressionContext(decompression_ctx_);
-    LZ4F_freeCDict(dict_ctx_);
+    CHECK_OK(SetDictionary(""));
   }
 
   Status Compress(
       const Slice& input,
       uint8_t* compressed,
       size_t* compressed_length) override {
-    if (!compression_ctx_ &&
-        LZ4F_createCompressionContext(&compression_ctx_, LZ4F_VERSION)) {
+    auto ctx = compression_ctxs_.Get();
+    if (!ctx) {
       return Status::RuntimeError("Could not create LZ4 compression context");
     }
+    const std::shared_ptr<const Dictionary> dict = dicts_.current();
+    const MonoTime start = MonoTime::Now();
 
     const size_t max_comp_size = MaxCompressedLength(input.size());
 
     LZ4F_preferences_t prefs{};
     prefs.compressionLevel = compression_level_;
-    prefs.frameInfo.dictID = CompressionCodecManager::GetDictionaryID(dict_);
+    prefs.frameInfo.dictID = dict->id;
     prefs.frameInfo.contentSize = input.size();
 
     size_t ret = LZ4F_compressFrame_usingCDict(
-        compression_ctx_,
+        ctx.get(),
         compressed,
         max_comp_size,
         input.data(),
         input.size(),
-        dict_ctx_,
+        dict->cdict,
         &prefs);
 
     if (LZ4F_isError(ret)) {
@@ -319,6 +588,8 @@ class Lz4DictCodec : public CompressionCodec {
     }
 
     *compressed_length = ret;
+    dict->stats.RecordCompression(
+        input.size(), ret, MonoTime::Now() - start);
     return Status::OK();
   }
 
@@ -341,27 +612,29 @@ class Lz4DictCodec : public CompressionCodec {
       const Slice& compressed,
       uint8_t* uncompressed,
       size_t uncompressed_length) override {
-    if (!decompression_ctx_ &&
-        LZ4F_createDecompressionContext(&decompression_ctx_, LZ4F_VERSION)) {
+    auto ctx = decompression_ctxs_.Get();
+    if (!ctx) {
       return Status::RuntimeError("Could not create LZ4 decompression context");
     }
+    // The context goes back to the pool once we're done, so it must not be
+    // left in the middle of a frame.
+    auto reset_ctx = MakeScopedCleanup(
+        [&]() { LZ4F_resetDecompressionContext(ctx.get()); });
+    const MonoTime start = MonoTime::Now();
 
     size_t frame_info_size = compressed.size();
 
     LZ4F_frameInfo_t frame_info;
     size_t ret = LZ4F_getFrameInfo(
-        decompression_ctx_, &frame_info, compressed.data(), &frame_info_size);
+        ctx.get(), &frame_info, compressed.data(), &frame_info_size);
     if (LZ4F_isError(ret)) {
-      LZ4F_resetDecompressionContext(decompression_ctx_);
       return Status::Corruption(strings::Substitute(
           "Could not extract LZ4 frame info: $0", LZ4F_getErrorName(ret)));
     }
 
-    const unsigned actual_dict_id = frame_info.dictID;
-    const unsigned expected_dict_id =
-        CompressionCodecManager::GetDictionaryID(dict_);
-
-    if (expected_dict_id != actual_dict_id) {
+    const std::shared_ptr<const Dictionary> dict =
+        dicts_.Find(frame_info.dictID, compression_level_);
+    if (!dict) {
       return Status::CompressionDictMismatch("Dictionary ID mismatch");
     }
 
@@ -373,20 +646,24 @@ class Lz4DictCodec : public CompressionCodec {
     const uint8_t* compressed_buf = compressed.data() + frame_info_size;
 
     ret = LZ4F_decompress_usingDict(
-        decompression_ctx_,
+        ctx.get(),
         uncompressed,
         &uncompressed_length,
         compressed_buf,
         &compressed_size,
-        dict_.data(),
-        dict_.size(),
+        dict->dict.data(),
+        dict->dict.size(),
         &opts);
     if (LZ4F_isError(ret)) {
-      LZ4F_resetDecompressionContext(decompression_ctx_);
       return Status::Corruption(strings::Substitute(
           "Unable to decompress the buffer: $0", LZ4F_getErrorName(ret)));
     }
+    if (ret == 0) {
+      // The frame was fully decoded, which leaves the context ready for reuse.
+      reset_ctx.cancel();
+    }
 
+    dict->stats.RecordDecompression(MonoTime::Now() - start);
     return Status::OK();
   }
 
@@ -395,13 +672,18 @@ class Lz4DictCodec : public CompressionCodec {
   }
 
   Status SetDictionary(const std::string& dict) override {
-    dict_ = dict;
-    dict_ctx_ = LZ4F_createCDict(dict_.data(), dict_.size());
+    std::shared_ptr<Dictionary> digested;
+    RETURN_NOT_OK(Dictionary::Create(
+        dict,
+        compression_level_,
+        CompressionCodecManager::RegisterDictionary(dict),
+        &digested));
+    dicts_.SetCurrent(std::move(digested));
     return Status::OK();
   }
 
   std::string GetDictionary() const override {
-    return dict_;
+    return dicts_.current()->dict;
   }
 
   Status SetCompressionLevel(int level) override {
@@ -419,12 +701,54 @@ class Lz4DictCodec : public CompressionCodec {
     return LZ4_DICT;
   }
 
+ protected:
+  void AppendStats(JsonWriter* jw) const override {
+    dicts_.AppendStats(jw);
+  }
+
  private:
-  LZ4F_cctx* compression_ctx_ = nullptr;
-  LZ4F_dctx* decompression_ctx_ = nullptr;
+  struct Dictionary : public DictionaryBase {
+    ~Dictionary() {
+      LZ4F_freeCDict(cdict);
+    }
+
+    static Status Create(
+        const std::string& dict,
+        int /* level */,
+        int64_t version,
+        std::shared_ptr<Dictionary>* digested) {
+      auto new_dict = std::make_shared<Dictionary>();
+      new_dict->dict = dict;
+      new_dict->id = CompressionCodecManager::GetDictionaryID(dict);
+      new_dict->version = version;
+      // Without a dictionary, frames are compressed on their own.
+      if (!dict.empty()) {
+        new_dict->cdict =
+            LZ4F_createCDict(new_dict->dict.data(), new_dict->dict.size());
+        if (!new_dict->cdict) {
+          return Status::RuntimeError(
+              "Could not create compression dict objects");
+        }
+      }
+      *digested = std::move(new_dict);
+      return Status::OK();
+    }
 
-  LZ4F_CDict* dict_ctx_ = nullptr;
-  std::string dict_;
+    LZ4F_CDict* cdict = nullptr;
+  };
+
+  ContextPool<
+      LZ4F_cctx,
+      CreateLz4CompressionContext,
+      FreeLz4CompressionContext>
+      compression_ctxs_;
+  ContextPool<
+      LZ4F_dctx,
+      CreateLz4DecompressionContext,
+      FreeLz4DecompressionContext>
+      decompression_ctxs_;
+
+  DictionarySet<Dictionary> dicts_;
 };
 
 /**
@@ -575,18 +899,15 @@ class ZstdDictCodec : public CompressionCodec {
     SetDictionary("");
   }
 
-  ~ZstdDictCodec() {
-    ZSTD_freeCDict(compression_dict_);
-    ZSTD_freeDDict(decompression_dict_);
-  }
-
   Status Compress(
       const Slice& input,
       uint8_t* compressed,
       size_t* compressed_length) override {
-    if (!compression_dict_) {
+    const std::shared_ptr<const Dictionary> dict = dicts_.current();
+    if (!dict) {
       return Status::CompressionDictMismatch("Compression dictionary is empty");
     }
+    const MonoTime start = MonoTime::Now();
 
     auto ctx_ref = folly::compression::contexts::getZSTD_CCtx();
     auto ctx = ctx_ref.get();
@@ -598,7 +919,7 @@ class ZstdDictCodec : public CompressionCodec {
         max_comp_size,
         input.data(),
         input.size(),
-        compression_dict_);
+        dict->cdict);
 
     if (ZSTD_isError(ret)) {
       return Status::Corruption(strings::Substitute(
@@ -606,6 +927,8 @@ class ZstdDictCodec : public CompressionCodec {
     }
 
     *compressed_length = ret;
+    dict->stats.RecordCompression(
+        input.size(), ret, MonoTime::Now() - start);
     return Status::OK();
   }
 
@@ -628,16 +951,12 @@ class ZstdDictCodec : public CompressionCodec {
       const Slice& compressed,
       uint8_t* uncompressed,
       size_t uncompressed_length) override {
-    if (!decompression_dict_) {
-      return Status::CompressionDictMismatch("Compression dictionary is empty");
-    }
-
-    const unsigned expected_dict_id =
-        CompressionCodecManager::GetDictionaryID(dict_);
-    const unsigned actual_dict_id =
+    const MonoTime start = MonoTime::Now();
+    const unsigned dict_id =
         ZSTD_getDictID_fromFrame(compressed.data(), compressed.size());
-
-    if (expected_dict_id != actual_dict_id) {
+    const std::shared_ptr<const Dictionary> dict =
+        dicts_.Find(dict_id, compression_level_);
+    if (!dict) {
       return Status::CompressionDictMismatch("Dictionary ID mismatch");
     }
 
@@ -650,12 +969,13 @@ class ZstdDictCodec : public CompressionCodec {
         uncompressed_length,
         compressed.data(),
         compressed.size(),
-        decompression_dict_);
+        dict->ddict);
     if (ZSTD_isError(ret)) {
       return Status::Corruption(strings::Substitute(
           "unable to uncompress the buffer: $0", ZSTD_getErrorName(ret)));
     }
 
+    dict->stats.RecordDecompression(MonoTime::Now() - start);
     return Status::OK();
   }
 
@@ -664,27 +984,19 @@ class ZstdDictCodec : public CompressionCodec {
   }
 
   Status SetDictionary(const std::string& dict) override {
-    ZSTD_freeCDict(compression_dict_);
-    ZSTD_freeDDict(decompression_dict_);
-
-    dict_.clear();
-    compression_dict_ = nullptr;
-    decompression_dict_ = nullptr;
-
-    compression_dict_ =
-        ZSTD_createCDict(dict.c_str(), dict.size(), compression_level_);
-    decompression_dict_ = ZSTD_createDDict(dict.c_str(), dict.size());
-
-    if (!compression_dict_ || !decompression_dict_) {
-      return Status::RuntimeError("Could not create compression dict objects");
-    }
-
-    dict_ = dict;
+    std::shared_ptr<Dictionary> digested;
+    RETURN_NOT_OK(Dictionary::Create(
+        dict,
+        compression_level_,
+        CompressionCodecManager::RegisterDictionary(dict),
+        &digested));
+    dicts_.SetCurrent(std::move(digested));
     return Status::OK();
   }
 
   std::string GetDictionary() const override {
-    return dict_;
+    const std::shared_ptr<const Dictionary> dict = dicts_.current();
+    return dict ? dict->dict : std::string();
   }
 
   Status SetCompressionLevel(int level) override {
@@ -695,21 +1007,84 @@ class ZstdDictCodec : public CompressionCodec {
       return Status::NotSupported(msg);
     }
     compression_level_ = level;
-    std::string dict = dict_;
-    return SetDictionary(dict);
+    // The level is baked into the digested dictionary.
+    return SetDictionary(GetDictionary());
   }
 
   CompressionType type() const override {
     return ZSTD_DICT;
   }
 
+ protected:
+  void AppendStats(JsonWriter* jw) const override {
+    dicts_.AppendStats(jw);
+  }
+
  private:
-  std::string dict_;
+  // Shared read-only by all the contexts of the process-wide ZSTD context
+  // pools.
+  struct Dictionary : public DictionaryBase {
+    ~Dictionary() {
+      ZSTD_freeCDict(cdict);
+      ZSTD_freeDDict(ddict);
+    }
+
+    static Status Create(
+        const std::string& dict,
+        int level,
+        int64_t version,
+        std::shared_ptr<Dictionary>* digested) {
+      auto new_dict = std::make_shared<Dictionary>();
+      new_dict->cdict = ZSTD_createCDict(dict.c_str(), dict.size(), level);
+      new_dict->ddict = ZSTD_createDDict(dict.c_str(), dict.size());
+      if (!new_dict->cdict || !new_dict->ddict) {
+        digested->reset();
+        return Status::RuntimeError(
+            "Could not create compression dict objects");
+      }
+      new_dict->dict = dict;
+      new_dict->id = CompressionCodecManager::GetDictionaryID(dict);
+      new_dict->version = version;
+      *digested = std::move(new_dict);
+      return Status::OK();
+    }
+
+    ZSTD_CDict* cdict = nullptr;
+    ZSTD_DDict* ddict = nullptr;
+  };
 
-  ZSTD_CDict* compression_dict_ = nullptr;
-  ZSTD_DDict* decompression_dict_ = nullptr;
+  DictionarySet<Dictionary> dicts_;
 };
 
+namespace {
+
+// The dictionaries registered with CompressionCodecManager, oldest first.
+struct RegisteredDictionary {
+  unsigned int id;
+  int64_t version;
+  std::string dict;
+};
+
+simple_spinlock registry_lock;
+std::deque<RegisteredDictionary> registry;
+int64_t last_registered_version = 0;
+// Number of CompressionDictRefs per dictionary id. Ids without references
+// have no entry.
+std::unordered_map<unsigned int, int64_t> dict_refs;
+// The id of CompressionCodecManager::dictionary_, which is never pruned.
+std::atomic<unsigned int> current_dict_id{0};
+
+// The LZ4 frame header: magic number, FLG and BD bytes, then the optional
+// content size and dictionary id.
+constexpr uint32_t kLz4FrameMagic = 0x184D2204;
+constexpr uint8_t kLz4FlagContentSize = 0x08;
+constexpr uint8_t kLz4FlagDictID = 0x01;
+constexpr size_t kLz4FrameFlagsOffset = 4;
+constexpr size_t kLz4FrameOptionalFieldsOffset = 6;
+constexpr size_t kLz4ContentSizeLength = 8;
+
+} // anonymous namespace
+
 std::string CompressionCodecManager::dictionary_;
 std::shared_ptr<CompressionCodec> CompressionCodecManager::codec_;
 int CompressionCodecManager::level_;
@@ -762,23 +1137,102 @@ Status CompressionCodecManager::SetCurrentCodec(CompressionType type) {
       level_ = codec_level;
     }
   }
-  codec_ = codec;
+  std::atomic_store(&codec_, codec);
   LOG(INFO) << "Set compression codec to: "
-            << GetCodecName(codec_ ? codec_->type() : NO_COMPRESSION);
+            << GetCodecName(codec ? codec->type() : NO_COMPRESSION);
   return Status::OK();
 }
 
 Status CompressionCodecManager::SetDictionary(const std::string& dict) {
   if (!codec_) {
     dictionary_ = dict;
+    current_dict_id = GetDictionaryID(dict);
     return Status::OK();
   }
   RETURN_NOT_OK(codec_->SetDictionary(dict));
   dictionary_ = dict;
+  current_dict_id = GetDictionaryID(dict);
   LOG(INFO) << "Updating compression dict to id " << GetCurrentDictionaryID();
   return Status::OK();
 }
 
+int64_t CompressionCodecManager::RegisterDictionary(const std::string& dict) {
+  if (dict.empty()) {
+    return 0;
+  }
+  const unsigned int id = GetDictionaryID(dict);
+  std::lock_guard<simple_spinlock> l(registry_lock);
+  for (const auto& registered : registry) {
+    if (registered.id == id && registered.dict == dict) {
+      return registered.version;
+    }
+  }
+  registry.push_back({id, ++last_registered_version, dict});
+  return last_registered_version;
+}
+
+int CompressionCodecManager::PruneDictionaries() {
+  const unsigned int current_id = current_dict_id;
+  std::deque<RegisteredDictionary> pruned;
+  {
+    std::lock_guard<simple_spinlock> l(registry_lock);
+    for (auto it = registry.begin(); it != registry.end();) {
+      if (it->id == current_id || ContainsKey(dict_refs, it->id)) {
+        ++it;
+        continue;
+      }
+      pruned.push_back(std::move(*it));
+      it = registry.erase(it);
+    }
+  }
+  for (const auto& dict : pruned) {
+    LOG(INFO) << "Dropping compression dict id " << dict.id << " (version "
+              << dict.version << "), which is no longer referenced";
+  }
+  return static_cast<int>(pruned.size());
+}
+
+bool CompressionCodecManager::IsDictionaryRegistered(const std::string& dict) {
+  const unsigned int id = GetDictionaryID(dict);
+  std::lock_guard<simple_spinlock> l(registry_lock);
+  for (const auto& registered : registry) {
+    if (registered.id == id && registered.dict == dict) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void CompressionCodecManager::RetainDictionary(unsigned int id) {
+  std::lock_guard<simple_spinlock> l(registry_lock);
+  dict_refs[id]++;
+}
+
+void CompressionCodecManager::ReleaseDictionary(unsigned int id) {
+  std::lock_guard<simple_spinlock> l(registry_lock);
+  auto it = dict_refs.find(id);
+  DCHECK(it != dict_refs.end());
+  if (it != dict_refs.end() && --it->second == 0) {
+    dict_refs.erase(it);
+  }
+}
+
+bool CompressionCodecManager::FindDictionary(
+    unsigned int id,
+    std::string* dict,
+    int64_t* version) {
+  std::lock_guard<simple_spinlock> l(registry_lock);
+  // Prefer the most recent registration should two dictionaries share an id.
+  for (auto it = registry.rbegin(); it != registry.rend(); ++it) {
+    if (it->id == id) {
+      *dict = it->dict;
+      *version = it->version;
+      return true;
+    }
+  }
+  return false;
+}
+
 unsigned int CompressionCodecManager::GetCurrentDictionaryID() {
   return GetDictionaryID(dictionary_);
 }
@@ -788,6 +1242,35 @@ unsigned int CompressionCodecManager::GetDictionaryID(const std::string& dict) {
   return ZSTD_getDictID_fromDict(dict.data(), dict.size());
 }
 
+unsigned int CompressionCodecManager::GetFrameDictionaryID(
+    CompressionType type,
+    const Slice& frame) {
+  switch (type) {
+    case ZSTD_DICT:
+      return ZSTD_getDictID_fromFrame(frame.data(), frame.size());
+    case LZ4_DICT: {
+      if (frame.size() < kLz4FrameOptionalFieldsOffset ||
+          LittleEndian::Load32(frame.data()) != kLz4FrameMagic) {
+        return 0;
+      }
+      const uint8_t flags = frame[kLz4FrameFlagsOffset];
+      if (!(flags & kLz4FlagDictID)) {
+        return 0;
+      }
+      size_t offset = kLz4FrameOptionalFieldsOffset;
+      if (flags & kLz4FlagContentSize) {
+        offset += kLz4ContentSizeLength;
+      }
+      if (frame.size() < offset + sizeof(uint32_t)) {
+        return 0;
+      }
+      return LittleEndian::Load32(frame.data() + offset);
+    }
+    default:
+      return 0;
+  }
+}
+
 Status CompressionCodecManager::SetCurrentCompressionLevel(int level) {
   if (!codec_) {
     level_ = level;
@@ -17,10 +17,14 @@
 #ifndef KUDU_CFILE_COMPRESSION_CODEC_H
 #define KUDU_CFILE_COMPRESSION_CODEC_H
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <glog/logging.h>
@@ -33,6 +37,16 @@
 
 namespace kudu {
 
+class JsonWriter;
+
+// Compresses and decompresses buffers with a given algorithm.
+//
+// Compress() and Uncompress() may be called concurrently from any number of
+// threads: codecs that need a context check one out of a pool of contexts for
+// the duration of the call, and dictionaries are loaded once and shared
+// read-only by all of them. SetDictionary() and SetCompressionLevel() may also
+// be called concurrently with compression; calls already in progress finish
+// with the previous dictionary.
 class CompressionCodec {
  public:
   CompressionCodec();
@@ -43,12 +57,14 @@ class CompressionCodec {
       uint8_t* compressed,
       size_t* compressed_length) {
     Status ret = Compress(input, compressed, compressed_length);
-    ++total_compressions_;
+    total_compressions_.fetch_add(1, std::memory_order_relaxed);
     if (ret.ok()) {
-      total_bytes_before_compression_ += input.size();
-      total_bytes_after_compression_ += *compressed_length;
+      total_bytes_before_compression_.fetch_add(
+          input.size(), std::memory_order_relaxed);
+      total_bytes_after_compression_.fetch_add(
+          *compressed_length, std::memory_order_relaxed);
     } else {
-      ++total_compression_errors_;
+      total_compression_errors_.fetch_add(1, std::memory_order_relaxed);
     }
     return ret;
   }
@@ -75,12 +91,14 @@ class CompressionCodec {
       uint8_t* uncompressed,
       size_t uncompressed_length) {
     Status ret = Uncompress(compressed, uncompressed, uncompressed_length);
-    ++total_decompressions_;
+    total_decompressions_.fetch_add(1, std::memory_order_relaxed);
     if (ret.ok()) {
-      total_bytes_before_decompression_ += compressed.size();
-      total_bytes_after_decompression_ += uncompressed_length;
+      total_bytes_before_decompression_.fetch_add(
+          compressed.size(), std::memory_order_relaxed);
+      total_bytes_after_decompression_.fetch_add(
+          uncompressed_length, std::memory_order_relaxed);
     } else {
-      ++total_decompression_errors_;
+      total_decompression_errors_.fetch_add(1, std::memory_order_relaxed);
     }
     return ret;
   }
@@ -101,6 +119,11 @@ class CompressionCodec {
   // Returns a JSON which contains stats
   virtual std::string Stats() const;
 
+  // Same as above, with the fields written by 'append_stats' added at the
+  // end of the JSON object.
+  std::string Stats(
+      const std::function<void(JsonWriter*)>& append_stats) const;
+
   // Sets a compression dictionary
   virtual Status SetDictionary(const std::string& /*dict*/) {
     LOG(WARNING) << "Dictionary compression is not supported by "
@@ -127,18 +150,21 @@ class CompressionCodec {
   virtual CompressionType type() const = 0;
 
  protected:
-  int compression_level_ = 0;
+  // Appends codec-specific fields to the JSON returned by Stats().
+  virtual void AppendStats(JsonWriter* /* jw */) const {}
+
+  std::atomic<int> compression_level_{0};
 
  private:
   // Stats
-  uint64_t total_bytes_before_compression_ = 0;
-  uint64_t total_bytes_after_compression_ = 0;
-  uint64_t total_compressions_ = 0;
-  uint64_t total_bytes_before_decompression_ = 0;
-  uint64_t total_bytes_after_decompression_ = 0;
-  uint64_t total_decompressions_ = 0;
-  uint64_t total_compression_errors_ = 0;
-  uint64_t total_decompression_errors_ = 0;
+  std::atomic<uint64_t> total_bytes_before_compression_{0};
+  std::atomic<uint64_t> total_bytes_after_compression_{0};
+  std::atomic<uint64_t> total_compressions_{0};
+  std::atomic<uint64_t> total_bytes_before_decompression_{0};
+  std::atomic<uint64_t> total_bytes_after_decompression_{0};
+  std::atomic<uint64_t> total_decompressions_{0};
+  std::atomic<uint64_t> total_compression_errors_{0};
+  std::atomic<uint64_t> total_decompression_errors_{0};
 
   DISALLOW_COPY_AND_ASSIGN(CompressionCodec);
 };
@@ -146,10 +172,11 @@ class CompressionCodec {
 /**
  * Manages global compression codec, dictionary and compression level
  *
- * This class is NOT thread safe. In the commit path we rely on taking
- * RaftConsensus::lock_ and PeerConsensusQueue::queue_lock_ while updating
- * codec, dict, level etc. and also compression and decompression using the
- * codec
+ * The current codec is shared by every compression and decompression site of
+ * the server, which may use it concurrently (see CompressionCodec). Updating
+ * the codec, dict, level etc. is NOT thread safe: in the commit path we rely
+ * on taking RaftConsensus::lock_ and PeerConsensusQueue::queue_lock_ while
+ * doing so.
  */
 class CompressionCodecManager {
  public:
@@ -164,7 +191,7 @@ class CompressionCodecManager {
   }
 
   static std::shared_ptr<CompressionCodec> GetCurrentCodec() {
-    return codec_;
+    return std::atomic_load(&codec_);
   }
 
   static Status SetCurrentCodec(CompressionType type);
@@ -179,10 +206,39 @@ class CompressionCodecManager {
 
   static Status SetDictionary(const std::string& dict);
 
+  // Registers 'dict', so that payloads compressed with it can still be
+  // decompressed once it's no longer the current dictionary. Returns the
+  // dictionary's version: dictionaries are numbered in registration order.
+  //
+  // A registered dictionary is kept until PruneDictionaries() finds it
+  // unreferenced. Unlike the setters above, this method is thread-safe.
+  static int64_t RegisterDictionary(const std::string& dict);
+
+  // Drops the registered dictionaries that are neither the current one nor
+  // held by a CompressionDictRef. Returns the number of dictionaries dropped.
+  // Thread-safe.
+  static int PruneDictionaries();
+
+  // Returns true if 'dict' is registered. Thread-safe.
+  static bool IsDictionaryRegistered(const std::string& dict);
+
+  // Looks up a registered dictionary by id. Returns false if there is none.
+  // Thread-safe.
+  static bool FindDictionary(
+      unsigned int id,
+      std::string* dict,
+      int64_t* version);
+
   static unsigned int GetCurrentDictionaryID();
 
   static unsigned int GetDictionaryID(const std::string& dict);
 
+  // Returns the id of the dictionary 'frame' was compressed with by a codec
+  // of type 'type', or 0 if it wasn't compressed with a dictionary.
+  static unsigned int GetFrameDictionaryID(
+      CompressionType type,
+      const Slice& frame);
+
   static Status SetCurrentCompressionLevel(int level);
 
   static CompressionType GetCodecType(const std::string& name) {
@@ -200,8 +256,14 @@ class CompressionCodecManager {
   }
 
  private:
+  friend class CompressionDictRef;
+
   CompressionCodecManager() {}
 
+  // Adds or removes a reference to the dictionary with id 'id'. Thread-safe.
+  static void RetainDictionary(unsigned int id);
+  static void ReleaseDictionary(unsigned int id);
+
   static std::shared_ptr<CompressionCodec> codec_;
   static std::string dictionary_;
   static int level_;
@@ -209,5 +271,46 @@ class CompressionCodecManager {
   DISALLOW_COPY_AND_ASSIGN(CompressionCodecManager);
 };
 
+/**
+ * Keeps the registered dictionary with a given id from being pruned for as
+ * long as the reference lives, e.g. while payloads compressed with it are
+ * cached or stored in a retained WAL segment. Id 0 holds nothing.
+ */
+class CompressionDictRef {
+ public:
+  CompressionDictRef() = default;
+
+  explicit CompressionDictRef(unsigned int id) : id_(id) {
+    if (id_ != 0) {
+      CompressionCodecManager::RetainDictionary(id_);
+    }
+  }
+
+  CompressionDictRef(const CompressionDictRef& other)
+      : CompressionDictRef(other.id_) {}
+
+  CompressionDictRef(CompressionDictRef&& other) noexcept : id_(other.id_) {
+    other.id_ = 0;
+  }
+
+  CompressionDictRef& operator=(CompressionDictRef other) noexcept {
+    std::swap(id_, other.id_);
+    return *this;
+  }
+
+  ~CompressionDictRef() {
+    if (id_ != 0) {
+      CompressionCodecManager::ReleaseDictionary(id_);
+    }
+  }
+
+  unsigned int id() const {
+    return id_;
+  }
+
+ private:
+  unsigned int id_ = 0;
+};
+
 } // namespace kudu
 #endif
@@ -0,0 +1,149 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "kudu/util/compression/compression_dict_trainer.h"
+
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
+#include <glog/logging.h>
+#include <zdict.h>
+
+#include "kudu/gutil/strings/substitute.h"
+#include "kudu/util/scoped_cleanup.h"
+
+using std::string;
+using std::vector;
+
+namespace kudu {
+
+CompressionDictTrainer::CompressionDictTrainer(Options options)
+    : options_(std::move(options)),
+      next_sample_(0),
+      skipped_(0),
+      training_(false),
+      num_trainings_(0) {
+  CHECK_GT(options_.sample_every_n, 0);
+  CHECK_GT(options_.max_samples, 0);
+}
+
+void CompressionDictTrainer::AddSample(const Slice& payload) {
+  if (payload.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<simple_spinlock> l(lock_);
+    if (++skipped_ < options_.sample_every_n) {
+      return;
+    }
+    skipped_ = 0;
+  }
+
+  // The copy is made, and the sample it replaces freed, outside the lock.
+  string sample(
+      reinterpret_cast<const char*>(payload.data()),
+      std::min(payload.size(), options_.max_sample_size));
+  std::lock_guard<simple_spinlock> l(lock_);
+  if (samples_.size() < static_cast<size_t>(options_.max_samples)) {
+    samples_.push_back(std::move(sample));
+    return;
+  }
+  samples_[next_sample_].swap(sample);
+  next_sample_ = (next_sample_ + 1) % samples_.size();
+}
+
+bool CompressionDictTrainer::StartTrainingIfDue() {
+  std::lock_guard<simple_spinlock> l(lock_);
+  if (training_ ||
+      samples_.size() < static_cast<size_t>(options_.min_samples)) {
+    return false;
+  }
+  // The first dictionary is trained as soon as there are enough samples.
+  if (last_training_time_.Initialized() &&
+      MonoTime::Now() - last_training_time_ < options_.min_interval) {
+    return false;
+  }
+  training_ = true;
+  return true;
+}
+
+Status CompressionDictTrainer::Train(string* dict) {
+  string samples;
+  vector<size_t> sample_sizes;
+  {
+    std::lock_guard<simple_spinlock> l(lock_);
+    DCHECK(training_);
+    sample_sizes.reserve(samples_.size());
+    for (const string& sample : samples_) {
+      samples.append(sample);
+      sample_sizes.push_back(sample.size());
+    }
+  }
+  auto finish = MakeScopedCleanup([&]() {
+    std::lock_guard<simple_spinlock> l(lock_);
+    training_ = false;
+    last_training_time_ = MonoTime::Now();
+  });
+
+  const MonoTime start = MonoTime::Now();
+  string new_dict(options_.dict_size, '\0');
+  const size_t ret = ZDICT_trainFromBuffer(
+      &new_dict[0],
+      new_dict.size(),
+      samples.data(),
+      sample_sizes.data(),
+      sample_sizes.size());
+  if (ZDICT_isError(ret)) {
+    return Status::RuntimeError(strings::Substitute(
+        "Unable to train a compression dictionary from $0 samples: $1",
+        sample_sizes.size(),
+        ZDICT_getErrorName(ret)));
+  }
+  new_dict.resize(ret);
+  const MonoDelta duration = MonoTime::Now() - start;
+
+  LOG(INFO) << "Trained a " << new_dict.size()
+            << " byte compression dictionary from " << sample_sizes.size()
+            << " samples (" << samples.size() << " bytes) in "
+            << duration.ToString();
+  {
+    std::lock_guard<simple_spinlock> l(lock_);
+    num_trainings_++;
+    last_training_duration_ = duration;
+  }
+  *dict = std::move(new_dict);
+  return Status::OK();
+}
+
+void CompressionDictTrainer::CancelTraining() {
+  std::lock_guard<simple_spinlock> l(lock_);
+  DCHECK(training_);
+  training_ = false;
+}
+
+int64_t CompressionDictTrainer::num_trainings() const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  return num_trainings_;
+}
+
+MonoDelta CompressionDictTrainer::last_training_duration() const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  return last_training_duration_;
+}
+
+} // namespace kudu
@@ -0,0 +1,103 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kudu/gutil/macros.h"
+#include "kudu/util/locks.h"
+#include "kudu/util/monotime.h"
+#include "kudu/util/slice.h"
+#include "kudu/util/status.h"
+
+namespace kudu {
+
+// Trains compression dictionaries from a sample of the payloads that are
+// being compressed, so that the dictionary can follow the shape of the
+// payloads as it drifts over time.
+//
+// Payloads are offered with AddSample(), which keeps every n-th one in a
+// bounded ring of recent samples. Once enough samples were collected, and
+// then each time the training interval elapses, StartTrainingIfDue() returns
+// true and the caller is expected to call Train(), typically in the
+// background.
+//
+// This class is thread-safe.
+class CompressionDictTrainer {
+ public:
+  struct Options {
+    // Keep one payload out of this many.
+    int sample_every_n = 16;
+    // Maximum number of samples kept. Older samples are replaced first.
+    int max_samples = 4096;
+    // Samples larger than this are truncated.
+    size_t max_sample_size = 16 * 1024;
+    // Minimum number of samples to train from.
+    int min_samples = 256;
+    // Size of the dictionaries to train.
+    size_t dict_size = 64 * 1024;
+    // Minimum time between two trainings.
+    MonoDelta min_interval = MonoDelta::FromSeconds(3600);
+  };
+
+  explicit CompressionDictTrainer(Options options);
+
+  // Offers 'payload' as a potential training sample.
+  void AddSample(const Slice& payload);
+
+  // Returns true if a training is due, in which case the caller must call
+  // Train(). Returns false while a training is in progress.
+  bool StartTrainingIfDue();
+
+  // Trains a dictionary from the current samples. The samples are copied up
+  // front, so AddSample() isn't held up while training.
+  Status Train(std::string* dict);
+
+  // Called instead of Train() if the training can't run after all.
+  void CancelTraining();
+
+  // Returns the number of dictionaries trained so far.
+  int64_t num_trainings() const;
+
+  // Returns how long the last successful training took.
+  MonoDelta last_training_duration() const;
+
+ private:
+  const Options options_;
+
+  mutable simple_spinlock lock_;
+
+  // Ring of the most recent samples, and the position of the next one.
+  std::vector<std::string> samples_;
+  size_t next_sample_;
+
+  // Number of payloads offered since the last one that was sampled.
+  int skipped_;
+
+  bool training_;
+  // Uninitialized until the first training attempt.
+  MonoTime last_training_time_;
+  MonoDelta last_training_duration_;
+  int64_t num_trainings_;
+
+  DISALLOW_COPY_AND_ASSIGN(CompressionDictTrainer);
+};
+
+} // namespace kudu
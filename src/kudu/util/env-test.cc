@@ -33,11 +33,13 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <string>
 #include <unordered_set>
@@ -57,8 +59,11 @@
 #include "kudu/gutil/strings/substitute.h"
 #include "kudu/gutil/strings/util.h"
 #include "kudu/util/array_view.h" // IWYU pragma: keep
+#include "kudu/util/countdown_latch.h"
 #include "kudu/util/env_util.h"
 #include "kudu/util/faststring.h"
+#include "kudu/util/io_uring.h"
+#include "kudu/util/locks.h"
 #include "kudu/util/monotime.h"
 #include "kudu/util/path_util.h"
 #include "kudu/util/random.h"
@@ -664,6 +669,92 @@ TEST_F(TestEnv, TestReopen) {
   ASSERT_EQ(first + second, s.ToString());
 }
 
+// Tests that direct I/O appends of arbitrary sizes, which rewrite the partial
+// block at the end of the file, produce the same contents as buffered ones,
+// including after reopening the file. Where direct I/O isn't supported, this
+// exercises the fallback to buffered writes.
+TEST_F(TestEnv, TestDirectIOAppends) {
+  string test_path = GetTestPath("test_env_direct_io");
+  WritableFileOptions opts;
+  opts.use_direct_io = true;
+  shared_ptr<WritableFile> writer;
+  ASSERT_OK(env_util::OpenFileForWrite(opts, env_, test_path, &writer));
+  ASSERT_OK(writer->PreAllocate(1024 * 1024));
+
+  Random rng(SeedRandom());
+  string expected;
+  for (int i = 0; i < 100; i++) {
+    string data(rng.Uniform(10000), static_cast<char>('a' + i % 26));
+    vector<Slice> slices = {Slice(data), Slice("|")};
+    ASSERT_OK(writer->AppendV(slices));
+    expected += data + "|";
+    ASSERT_EQ(expected.size(), writer->Size());
+    if (i == 50) {
+      ASSERT_OK(writer->Close());
+      opts.mode = Env::OPEN_EXISTING;
+      ASSERT_OK(env_util::OpenFileForWrite(opts, env_, test_path, &writer));
+      ASSERT_EQ(expected.size(), writer->Size());
+    }
+  }
+  ASSERT_OK(writer->Close());
+
+  faststring contents;
+  ASSERT_OK(ReadFileToString(env_, test_path, &contents));
+  ASSERT_EQ(expected, contents.ToString());
+}
+
+// Tests that asynchronous syncs complete in order, for files sharing an
+// io_uring instance if io_uring is available.
+TEST_F(TestEnv, TestSyncAsync) {
+  FLAGS_never_fsync = false;
+  WritableFileOptions opts;
+  unique_ptr<IoUring> ring;
+  Status ring_status = IoUring::Create(64, &ring);
+  if (ring_status.ok()) {
+    opts.io_uring = std::move(ring);
+  } else {
+    LOG(INFO) << "Testing without io_uring: " << ring_status.ToString();
+  }
+  const int kNumFiles = 2;
+  vector<shared_ptr<WritableFile>> writers(kNumFiles);
+  for (int f = 0; f < kNumFiles; f++) {
+    ASSERT_OK(env_util::OpenFileForWrite(
+        opts,
+        env_,
+        GetTestPath(Substitute("test_env_sync_async_$0", f)),
+        &writers[f]));
+  }
+
+  const int kNumSyncs = 100;
+  simple_spinlock lock;
+  vector<vector<int>> completed(kNumFiles);
+  CountDownLatch latch(kNumFiles * kNumSyncs);
+  for (int i = 0; i < kNumSyncs; i++) {
+    for (int f = 0; f < kNumFiles; f++) {
+      ASSERT_OK(writers[f]->Append(Substitute("entry $0\n", i)));
+      writers[f]->SyncAsync([&, f, i](const Status& s) {
+        CHECK_OK(s);
+        std::lock_guard<simple_spinlock> l(lock);
+        completed[f].push_back(i);
+        latch.CountDown();
+      });
+    }
+  }
+  latch.Wait();
+  for (int f = 0; f < kNumFiles; f++) {
+    ASSERT_EQ(kNumSyncs, completed[f].size());
+    ASSERT_TRUE(std::is_sorted(completed[f].begin(), completed[f].end()));
+  }
+
+  // A sync with nothing to sync completes right away.
+  Status s = Status::Incomplete("");
+  writers[0]->SyncAsync([&](const Status& status) { s = status; });
+  ASSERT_OK(s);
+  for (const auto& writer : writers) {
+    ASSERT_OK(writer->Close());
+  }
+}
+
 TEST_F(TestEnv, TestIsDirectory) {
   string dir = GetTestPath("a_directory");
   ASSERT_OK(env_->CreateDir(dir));
@@ -876,6 +967,20 @@ TEST_F(TestEnv, TestGetBlockSize) {
   ASSERT_GT(block_size, 0);
 }
 
+TEST_F(TestEnv, TestGetFileSystemId) {
+  uint64_t id;
+  ASSERT_TRUE(env_->GetFileSystemId("does_not_exist", &id).IsNotFound());
+
+  // A file and the directory it's in are on the same filesystem.
+  string path = GetTestPath("foo");
+  unique_ptr<WritableFile> writer;
+  ASSERT_OK(env_->NewWritableFile(path, &writer));
+  uint64_t dir_id;
+  ASSERT_OK(env_->GetFileSystemId(GetTestDataDirectory(), &dir_id));
+  ASSERT_OK(env_->GetFileSystemId(path, &id));
+  ASSERT_EQ(dir_id, id);
+}
+
 TEST_F(TestEnv, TestGetFileModifiedTime) {
   string path = GetTestPath("mtime");
   unique_ptr<WritableFile> writer;
@@ -23,11 +23,13 @@
 #include "kudu/gutil/callback_forward.h"
 #include "kudu/gutil/macros.h"
 #include "kudu/util/status.h"
+#include "kudu/util/status_callback.h"
 
 namespace kudu {
 
 class faststring;
 class FileLock;
+class IoUring;
 class RandomAccessFile;
 class RWFile;
 class SequentialFile;
@@ -366,6 +368,12 @@ class Env {
   // On success, 'result' contains the answer. On failure, 'result' is unset.
   virtual Status IsOnXfsFilesystem(const std::string& path, bool* result) = 0;
 
+  // Gets an identifier of the filesystem that 'path' resides on, the same for
+  // every path on that filesystem.
+  //
+  // On success, 'id' contains the answer. On failure, 'id' is unset.
+  virtual Status GetFileSystemId(const std::string& path, uint64_t* id) = 0;
+
   // Gets the kernel release string for this machine.
   virtual std::string GetKernelRelease() = 0;
 
@@ -478,8 +486,19 @@ struct WritableFileOptions {
   // See CreateMode for details.
   Env::CreateMode mode;
 
+  // If set, syncs are issued through this io_uring(7) instance, so that
+  // SyncAsync() doesn't block the caller. A ring, and the thread reaping its
+  // completions, may be shared by any number of files.
+  std::shared_ptr<IoUring> io_uring;
+
+  // Whether to write with O_DIRECT, bypassing the page cache. Falls back to
+  // buffered writes if the filesystem doesn't support direct I/O.
+  bool use_direct_io;
+
   WritableFileOptions()
-      : sync_on_close(false), mode(Env::CREATE_IF_NON_EXISTING_TRUNCATE) {}
+      : sync_on_close(false),
+        mode(Env::CREATE_IF_NON_EXISTING_TRUNCATE),
+        use_direct_io(false) {}
 };
 
 // Options specified when a file is opened for random access.
@@ -528,6 +547,25 @@ class WritableFile {
 
   virtual Status Sync() = 0;
 
+  // Like Sync(), but doesn't necessarily wait for the sync to finish. Instead,
+  // 'cb' is invoked once all the data appended before this call is durable,
+  // possibly on another thread. Callbacks are invoked in the order in which
+  // the syncs were requested.
+  //
+  // The default implementation syncs inline and invokes 'cb' before returning.
+  virtual void SyncAsync(const StdStatusCallback& cb) {
+    cb(Sync());
+  }
+
+  // If appends bypass the page cache (see WritableFileOptions::use_direct_io),
+  // the block size they are padded to, and 0 otherwise. An append that doesn't
+  // end on a block boundary rewrites that last block on the next append; a
+  // caller that must never rewrite data it already synced pads its appends to
+  // whole blocks.
+  virtual size_t direct_io_alignment() const {
+    return 0;
+  }
+
   virtual uint64_t Size() const = 0;
 
   // Returns the filename provided when the WritableFile was constructed.
@@ -17,6 +17,7 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <cstdint>
 #include <cstdio>
@@ -46,16 +47,21 @@
 #include "kudu/gutil/strings/split.h"
 #include "kudu/gutil/strings/substitute.h"
 #include "kudu/gutil/strings/util.h"
+#include "kudu/util/alignment.h"
 #include "kudu/util/array_view.h"
+#include "kudu/util/async_util.h"
+#include "kudu/util/condition_variable.h"
 #include "kudu/util/debug/trace_event.h"
 #include "kudu/util/env.h"
 #include "kudu/util/errno.h"
 #include "kudu/util/fault_injection.h"
 #include "kudu/util/flag_tags.h"
 #include "kudu/util/flags.h"
+#include "kudu/util/io_uring.h"
 #include "kudu/util/logging.h"
 #include "kudu/util/malloc.h"
 #include "kudu/util/monotime.h"
+#include "kudu/util/mutex.h"
 #include "kudu/util/path_util.h"
 #include "kudu/util/scoped_cleanup.h"
 #include "kudu/util/slice.h"
@@ -83,6 +89,7 @@
 using base::subtle::Atomic64;
 using base::subtle::Barrier_AtomicIncrement;
 using std::accumulate;
+using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
 using std::vector;
@@ -231,6 +238,10 @@ struct FreeDeleter {
   }
 };
 
+// Alignment of the buffers, offsets and lengths of O_DIRECT writes. This is
+// the largest logical block size in common use, so it works on any device.
+const size_t kDirectIOAlignment = 4096;
+
 #if defined(__APPLE__)
 // Simulates Linux's fallocate file preallocation API on OS X.
 int fallocate(int fd, int mode, off_t offset, off_t len) {
@@ -701,18 +712,75 @@ class PosixWritableFile : public WritableFile {
         filesize_(file_size),
         pre_allocated_size_(0),
         pending_sync_(false),
-        closed_(false) {}
+        closed_(false),
+        direct_io_(false),
+        staging_capacity_(0) {}
 
   ~PosixWritableFile() {
     WARN_NOT_OK(Close(), "Failed to close " + filename_);
   }
 
+  // Switches the file to O_DIRECT writes, which bypass the page cache.
+  //
+  // Appends are then staged in an aligned buffer, reused from one append to
+  // the next, and padded to a whole number of blocks. The partial block at the
+  // end of the file is kept in the buffer and rewritten by the next append.
+  // Callers that can't have that block rewritten once it is synced pad their
+  // appends to direct_io_alignment() themselves.
+  //
+  // Returns Status::NotSupported() if the filesystem doesn't support direct
+  // I/O, in which case the file keeps writing through the page cache.
+  Status EnableDirectIO() {
+#if defined(__linux__)
+    DCHECK(!direct_io_);
+    ThreadRestrictions::AssertIOAllowed();
+    RETURN_NOT_OK(ReserveStaging(kDirectIOAlignment));
+    size_t tail_len = filesize_ % kDirectIOAlignment;
+    if (tail_len > 0) {
+      // Read the partial block while the file still goes through the page
+      // cache, so that the read needn't be aligned.
+      ssize_t r;
+      RETRY_ON_EINTR(
+          r, pread(fd_, staging_.get(), tail_len, filesize_ - tail_len));
+      if (r < 0) {
+        return IOError(filename_, errno);
+      }
+      if (static_cast<size_t>(r) != tail_len) {
+        return Status::IOError(
+            Substitute("$0: short read of the last block", filename_));
+      }
+    }
+    int flags;
+    RETRY_ON_EINTR(flags, fcntl(fd_, F_GETFL));
+    if (flags < 0) {
+      return IOError(filename_, errno);
+    }
+    int ret;
+    RETRY_ON_EINTR(ret, fcntl(fd_, F_SETFL, flags | O_DIRECT));
+    if (ret < 0) {
+      int err = errno;
+      if (err == EINVAL) {
+        return Status::NotSupported(
+            "filesystem does not support direct I/O", filename_, err);
+      }
+      return IOError(filename_, err);
+    }
+    direct_io_ = true;
+    return Status::OK();
+#else
+    return Status::NotSupported("direct I/O is not supported on this platform");
+#endif
+  }
+
   virtual Status Append(const Slice& data) override {
     return AppendV(ArrayView<const Slice>(&data, 1));
   }
 
   virtual Status AppendV(ArrayView<const Slice> data) override {
     ThreadRestrictions::AssertIOAllowed();
+    if (direct_io_) {
+      return AppendVDirect(data);
+    }
     RETURN_NOT_OK(DoWriteV(fd_, filename_, filesize_, data));
     // Calculate the amount of data written
     size_t bytes_written = accumulate(
@@ -758,8 +826,9 @@ class PosixWritableFile : public WritableFile {
     Status s;
 
     // If we've allocated more space than we used, truncate to the
-    // actual size of the file and perform Sync().
-    if (filesize_ < pre_allocated_size_) {
+    // actual size of the file and perform Sync(). Direct writes may also have
+    // padded the last block past the end of the file.
+    if (filesize_ < pre_allocated_size_ || direct_io_) {
       int ret;
       RETRY_ON_EINTR(ret, ftruncate(fd_, filesize_));
       if (ret != 0) {
@@ -817,9 +886,13 @@ class PosixWritableFile : public WritableFile {
     ThreadRestrictions::AssertIOAllowed();
     LOG_SLOW_EXECUTION(
         WARNING, 1000, Substitute("sync call for $0", filename_)) {
-      if (pending_sync_) {
-        pending_sync_ = false;
-        RETURN_NOT_OK(DoSync(fd_, filename_));
+      if (pending_sync_.exchange(false)) {
+        Status s = DoSync(fd_, filename_);
+        if (PREDICT_FALSE(!s.ok())) {
+          // What was appended still needs syncing.
+          pending_sync_ = true;
+          return s;
+        }
       }
     }
     return Status::OK();
@@ -829,19 +902,223 @@ class PosixWritableFile : public WritableFile {
     return filesize_;
   }
 
+  virtual size_t direct_io_alignment() const override {
+    return direct_io_ ? kDirectIOAlignment : 0;
+  }
+
   virtual const string& filename() const override {
     return filename_;
   }
 
- private:
+ protected:
+  // Writes 'data' with O_DIRECT, along with the partial block at the end of
+  // the file.
+  Status AppendVDirect(ArrayView<const Slice> data) {
+    uint64_t block_start = filesize_ - filesize_ % kDirectIOAlignment;
+    size_t tail_len = filesize_ - block_start;
+    size_t data_len = 0;
+    for (const Slice& slice : data) {
+      data_len += slice.size();
+    }
+    size_t len = tail_len + data_len;
+    size_t padded_len = KUDU_ALIGN_UP(len, kDirectIOAlignment);
+    RETURN_NOT_OK(ReserveStaging(padded_len));
+
+    uint8_t* dst = staging_.get() + tail_len;
+    for (const Slice& slice : data) {
+      memcpy(dst, slice.data(), slice.size());
+      dst += slice.size();
+    }
+    memset(dst, 0, padded_len - len);
+    RETURN_NOT_OK(DoWriteDirect(block_start, padded_len));
+
+    // Keep the new partial block, if any, at the start of the buffer.
+    filesize_ += data_len;
+    size_t new_tail_len = filesize_ % kDirectIOAlignment;
+    if (new_tail_len > 0) {
+      memmove(
+          staging_.get(),
+          staging_.get() + len - new_tail_len,
+          new_tail_len);
+    }
+    pending_sync_ = true;
+    return Status::OK();
+  }
+
+  // Writes the first 'len' bytes of the staging buffer at 'offset', both of
+  // which are aligned. A short write is resumed from the start of the block it
+  // stopped in, so that the retry stays aligned as O_DIRECT requires.
+  Status DoWriteDirect(uint64_t offset, size_t len) {
+    MAYBE_RETURN_EIO(filename_, IOError(Env::kInjectedFailureStatusMsg, EIO));
+    DCHECK_EQ(0, offset % kDirectIOAlignment);
+    DCHECK_EQ(0, len % kDirectIOAlignment);
+    size_t done = 0;
+    while (done < len) {
+      ssize_t w;
+      RETRY_ON_EINTR(
+          w,
+          pwrite(fd_, staging_.get() + done, len - done, offset + done));
+      if (PREDICT_FALSE(w < 0)) {
+        return IOError(filename_, errno);
+      }
+      if (PREDICT_TRUE(static_cast<size_t>(w) == len - done)) {
+        return Status::OK();
+      }
+      size_t resume = KUDU_ALIGN_DOWN(done + w, kDirectIOAlignment);
+      if (PREDICT_FALSE(resume == done)) {
+        // Not even one block went through, so retrying would likely loop.
+        return Status::IOError(Substitute(
+            "$0: short direct write of $1 bytes at offset $2",
+            filename_,
+            w,
+            offset + done));
+      }
+      done = resume;
+    }
+    return Status::OK();
+  }
+
+  // Makes sure the staging buffer holds at least 'size' bytes, preserving the
+  // partial block at its start.
+  Status ReserveStaging(size_t size) {
+    if (size <= staging_capacity_) {
+      return Status::OK();
+    }
+    size_t capacity = std::max(size, staging_capacity_ * 2);
+    void* buf;
+    int err = posix_memalign(&buf, kDirectIOAlignment, capacity);
+    if (err != 0) {
+      return Status::RuntimeError(
+          "could not allocate direct I/O buffer", ErrnoToString(err), err);
+    }
+    if (staging_) {
+      memcpy(buf, staging_.get(), filesize_ % kDirectIOAlignment);
+    }
+    staging_.reset(static_cast<uint8_t*>(buf));
+    staging_capacity_ = capacity;
+    return Status::OK();
+  }
+
   const string filename_;
   const int fd_;
   const bool sync_on_close_;
 
   uint64_t filesize_;
   uint64_t pre_allocated_size_;
-  bool pending_sync_;
+  // Atomic since Sync() may run concurrently with appends.
+  std::atomic<bool> pending_sync_;
   bool closed_;
+
+  // Whether writes bypass the page cache. See EnableDirectIO().
+  bool direct_io_;
+  unique_ptr<uint8_t, FreeDeleter> staging_;
+  size_t staging_capacity_;
+};
+
+// A PosixWritableFile whose syncs are issued through io_uring(7).
+//
+// Appends still use pwritev(2): the data has to be in the file before the
+// caller can expose it to readers, so there's nothing to be gained from queuing
+// them. What SyncAsync() buys is that the caller can go on appending while a
+// sync is in flight.
+class IoUringWritableFile : public PosixWritableFile {
+ public:
+  IoUringWritableFile(
+      string fname,
+      int fd,
+      uint64_t file_size,
+      bool sync_on_close,
+      shared_ptr<IoUring> ring)
+      : PosixWritableFile(std::move(fname), fd, file_size, sync_on_close),
+        ring_(std::move(ring)),
+        in_flight_(std::make_shared<SyncsInFlight>()) {}
+
+  ~IoUringWritableFile() {
+    WARN_NOT_OK(Close(), "Failed to close " + filename_);
+  }
+
+  virtual Status Close() override {
+    if (closed_) {
+      return Status::OK();
+    }
+    WaitForSyncsInFlight();
+    Status s = PosixWritableFile::Close();
+    ring_.reset();
+    return s;
+  }
+
+  virtual Status Sync() override {
+    TRACE_EVENT1("io", "IoUringWritableFile::Sync", "path", filename_);
+    LOG_SLOW_EXECUTION(
+        WARNING, 1000, Substitute("sync call for $0", filename_)) {
+      Synchronizer sync;
+      SyncAsync(sync.AsStdStatusCallback());
+      RETURN_NOT_OK(sync.Wait());
+    }
+    return Status::OK();
+  }
+
+  virtual void SyncAsync(const StdStatusCallback& cb) override {
+    TRACE_EVENT1("io", "IoUringWritableFile::SyncAsync", "path", filename_);
+    Status injected = MaybeInjectEIO();
+    if (PREDICT_FALSE(!injected.ok())) {
+      WaitForSyncsInFlight();
+      cb(injected);
+      return;
+    }
+    if (!pending_sync_ || FLAGS_never_fsync) {
+      // Nothing to sync, but don't overtake the callbacks of earlier syncs.
+      WaitForSyncsInFlight();
+      cb(Status::OK());
+      return;
+    }
+    pending_sync_.store(false);
+    TRACE_COUNTER_INCREMENT(FLAGS_env_use_fsync ? "fsync" : "fdatasync", 1);
+    {
+      MutexLock l(in_flight_->lock);
+      in_flight_->num_syncs++;
+    }
+    // The completion holds on to 'in_flight_' rather than using 'this': once
+    // the count drops, Close() may return and the file be destroyed while the
+    // reaper thread is still unlocking.
+    ring_->SubmitFsync(
+        fd_,
+        !FLAGS_env_use_fsync,
+        [this, cb, in_flight = in_flight_](int32_t res) {
+          if (res < 0) {
+            // What was appended still needs syncing.
+            pending_sync_ = true;
+          }
+          cb(res < 0 ? IOError(filename_, -res) : Status::OK());
+          MutexLock l(in_flight->lock);
+          in_flight->num_syncs--;
+          in_flight->cond.Broadcast();
+        });
+  }
+
+ private:
+  struct SyncsInFlight {
+    SyncsInFlight() : cond(&lock) {}
+
+    Mutex lock;
+    ConditionVariable cond;
+    int num_syncs = 0;
+  };
+
+  Status MaybeInjectEIO() {
+    MAYBE_RETURN_EIO(filename_, IOError(Env::kInjectedFailureStatusMsg, EIO));
+    return Status::OK();
+  }
+
+  void WaitForSyncsInFlight() {
+    MutexLock l(in_flight_->lock);
+    while (in_flight_->num_syncs > 0) {
+      in_flight_->cond.Wait();
+    }
+  }
+
+  shared_ptr<IoUring> ring_;
+  const shared_ptr<SyncsInFlight> in_flight_;
 };
 
 class PosixRWFile : public RWFile {
@@ -1818,6 +2095,18 @@ class PosixEnv : public Env {
     return DoIsOnXfsFilesystem(path, result);
   }
 
+  virtual Status GetFileSystemId(const string& path, uint64_t* id) override {
+    TRACE_EVENT1("io", "PosixEnv::GetFileSystemId", "path", path);
+    MAYBE_RETURN_EIO(path, IOError(Env::kInjectedFailureStatusMsg, EIO));
+    ThreadRestrictions::AssertIOAllowed();
+    struct stat sbuf;
+    if (stat(path.c_str(), &sbuf) != 0) {
+      return IOError(path, errno);
+    }
+    *id = sbuf.st_dev;
+    return Status::OK();
+  }
+
   virtual string GetKernelRelease() override {
     // There's no reason for this to ever fail.
     struct utsname u;
@@ -1909,8 +2198,24 @@ class PosixEnv : public Env {
     if (opts.mode == OPEN_EXISTING) {
       RETURN_NOT_OK(GetFileSize(fname, &file_size));
     }
-    result->reset(
-        new PosixWritableFile(fname, fd, file_size, opts.sync_on_close));
+    unique_ptr<PosixWritableFile> file;
+    if (opts.io_uring) {
+      file.reset(new IoUringWritableFile(
+          fname, fd, file_size, opts.sync_on_close, opts.io_uring));
+    } else {
+      file.reset(
+          new PosixWritableFile(fname, fd, file_size, opts.sync_on_close));
+    }
+    if (opts.use_direct_io) {
+      Status s = file->EnableDirectIO();
+      if (s.IsNotSupported()) {
+        KLOG_FIRST_N(WARNING, 1) << "Could not enable direct I/O, falling back "
+                                 << "to buffered writes: " << s.ToString();
+      } else {
+        RETURN_NOT_OK(s);
+      }
+    }
+    *result = std::move(file);
     return Status::OK();
   }
 
@@ -0,0 +1,337 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "kudu/util/io_uring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && \
+    __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define KUDU_HAVE_IO_URING 1
+#endif
+
+#include <glog/logging.h>
+
+#include "kudu/gutil/port.h"
+#include "kudu/util/errno.h"
+#include "kudu/util/thread.h"
+
+namespace kudu {
+
+#if defined(KUDU_HAVE_IO_URING)
+
+namespace {
+
+int SysIoUringSetup(uint32_t entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int SysIoUringEnter(
+    int fd,
+    unsigned to_submit,
+    unsigned min_complete,
+    unsigned flags) {
+  return static_cast<int>(syscall(
+      __NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+template <typename T>
+T* RingPtr(void* ring, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<uint8_t*>(ring) + offset);
+}
+
+} // anonymous namespace
+
+IoUring::IoUring()
+    : ring_fd_(-1),
+      sq_ring_(MAP_FAILED),
+      sq_ring_size_(0),
+      cq_ring_(MAP_FAILED),
+      cq_ring_size_(0),
+      sqes_(nullptr),
+      sqes_size_(0),
+      sq_tail_(nullptr),
+      sq_mask_(nullptr),
+      sq_array_(nullptr),
+      sq_entries_(0),
+      cq_head_(nullptr),
+      cq_tail_(nullptr),
+      cq_mask_(nullptr),
+      cqes_(nullptr),
+      not_full_(&lock_),
+      num_in_flight_(0) {}
+
+Status IoUring::Create(uint32_t queue_depth, std::unique_ptr<IoUring>* ring) {
+  std::unique_ptr<IoUring> new_ring(new IoUring());
+  RETURN_NOT_OK(new_ring->Init(queue_depth));
+  *ring = std::move(new_ring);
+  return Status::OK();
+}
+
+Status IoUring::Init(uint32_t queue_depth) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = SysIoUringSetup(queue_depth, &params);
+  if (ring_fd_ < 0) {
+    int err = errno;
+    if (err == ENOSYS || err == EPERM) {
+      return Status::NotSupported(
+          "io_uring is not available", ErrnoToString(err), err);
+    }
+    return Status::IOError("io_uring_setup failed", ErrnoToString(err), err);
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+
+  sq_ring_ = mmap(
+      nullptr,
+      sq_ring_size_,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE,
+      ring_fd_,
+      IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    int err = errno;
+    Release();
+    return Status::IOError("could not map SQ ring", ErrnoToString(err), err);
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(
+        nullptr,
+        cq_ring_size_,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        ring_fd_,
+        IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      int err = errno;
+      Release();
+      return Status::IOError("could not map CQ ring", ErrnoToString(err), err);
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(
+      nullptr,
+      sqes_size_,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE,
+      ring_fd_,
+      IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    int err = errno;
+    Release();
+    return Status::IOError("could not map SQEs", ErrnoToString(err), err);
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  sq_tail_ = RingPtr<unsigned>(sq_ring_, params.sq_off.tail);
+  sq_mask_ = RingPtr<unsigned>(sq_ring_, params.sq_off.ring_mask);
+  sq_array_ = RingPtr<unsigned>(sq_ring_, params.sq_off.array);
+  sq_entries_ = params.sq_entries;
+  cq_head_ = RingPtr<unsigned>(cq_ring_, params.cq_off.head);
+  cq_tail_ = RingPtr<unsigned>(cq_ring_, params.cq_off.tail);
+  cq_mask_ = RingPtr<unsigned>(cq_ring_, params.cq_off.ring_mask);
+  cqes_ = RingPtr<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+  Status s = Thread::Create(
+      "io_uring", "reaper", &IoUring::ReapCompletions, this, &reaper_);
+  if (!s.ok()) {
+    Release();
+    return s;
+  }
+  return Status::OK();
+}
+
+IoUring::~IoUring() {
+  if (reaper_) {
+    // A drained no-op only completes after everything submitted before it, so
+    // once the reaper sees it there's nothing left in flight.
+    Submit(
+        [](io_uring_sqe* sqe) {
+          sqe->opcode = IORING_OP_NOP;
+          sqe->flags = IOSQE_IO_DRAIN;
+        },
+        nullptr);
+    CHECK_OK(ThreadJoiner(reaper_.get()).Join());
+  }
+  Release();
+}
+
+void IoUring::Release() {
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqes_size_);
+    sqes_ = nullptr;
+  }
+  if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  cq_ring_ = MAP_FAILED;
+  if (sq_ring_ != MAP_FAILED) {
+    munmap(sq_ring_, sq_ring_size_);
+    sq_ring_ = MAP_FAILED;
+  }
+  if (ring_fd_ >= 0) {
+    close(ring_fd_);
+    ring_fd_ = -1;
+  }
+}
+
+void IoUring::SubmitFsync(int fd, bool datasync, CompletionCallback cb) {
+  DCHECK(cb);
+  Submit(
+      [&](io_uring_sqe* sqe) {
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fd;
+        sqe->flags = IOSQE_IO_DRAIN;
+        sqe->fsync_flags = datasync ? IORING_FSYNC_DATASYNC : 0;
+      },
+      std::move(cb));
+}
+
+void IoUring::Submit(
+    const std::function<void(io_uring_sqe*)>& prep,
+    CompletionCallback cb) {
+  // Ownership of the callback passes to the reaper thread via 'user_data'.
+  // A null 'user_data' tells the reaper to exit.
+  CompletionCallback* user_data =
+      cb ? new CompletionCallback(std::move(cb)) : nullptr;
+
+  MutexLock l(lock_);
+  // Bounding the number of in-flight operations by the SQ size also keeps the
+  // CQ, which is at least twice as large, from overflowing.
+  while (num_in_flight_ >= sq_entries_) {
+    not_full_.Wait();
+  }
+  unsigned tail = *sq_tail_;
+  unsigned idx = tail & *sq_mask_;
+  io_uring_sqe* sqe = &sqes_[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  prep(sqe);
+  sqe->user_data = reinterpret_cast<uint64_t>(user_data);
+  sq_array_[idx] = idx;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  num_in_flight_++;
+
+  while (true) {
+    int ret = SysIoUringEnter(ring_fd_, 1, 0, 0);
+    if (PREDICT_TRUE(ret >= 0)) {
+      break;
+    }
+    // The SQE stays in the ring until the kernel consumes it, so transient
+    // failures can simply be retried.
+    int err = errno;
+    if (err != EINTR && err != EAGAIN && err != EBUSY) {
+      LOG(FATAL) << "io_uring_enter failed: " << ErrnoToString(err);
+    }
+  }
+}
+
+void IoUring::ReapCompletions() {
+  std::vector<std::pair<CompletionCallback*, int32_t>> completions;
+  bool stop = false;
+  while (!stop) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      int ret = SysIoUringEnter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+      if (PREDICT_FALSE(ret < 0 && errno != EINTR)) {
+        LOG(FATAL) << "io_uring_enter failed: " << ErrnoToString(errno);
+      }
+      continue;
+    }
+    for (; head != tail; head++) {
+      const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+      completions.emplace_back(
+          reinterpret_cast<CompletionCallback*>(cqe.user_data), cqe.res);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+    for (auto& completion : completions) {
+      if (completion.first == nullptr) {
+        stop = true;
+        continue;
+      }
+      (*completion.first)(completion.second);
+      delete completion.first;
+    }
+    {
+      MutexLock l(lock_);
+      num_in_flight_ -= completions.size();
+      not_full_.Broadcast();
+    }
+    completions.clear();
+  }
+}
+
+#else // !defined(KUDU_HAVE_IO_URING)
+
+IoUring::IoUring()
+    : ring_fd_(-1),
+      sq_ring_(nullptr),
+      sq_ring_size_(0),
+      cq_ring_(nullptr),
+      cq_ring_size_(0),
+      sqes_(nullptr),
+      sqes_size_(0),
+      sq_tail_(nullptr),
+      sq_mask_(nullptr),
+      sq_array_(nullptr),
+      sq_entries_(0),
+      cq_head_(nullptr),
+      cq_tail_(nullptr),
+      cq_mask_(nullptr),
+      cqes_(nullptr),
+      not_full_(&lock_),
+      num_in_flight_(0) {}
+
+IoUring::~IoUring() {}
+
+Status IoUring::Create(
+    uint32_t /* queue_depth */,
+    std::unique_ptr<IoUring>* /* ring */) {
+  return Status::NotSupported("io_uring is not supported on this platform");
+}
+
+void IoUring::SubmitFsync(
+    int /* fd */,
+    bool /* datasync */,
+    CompletionCallback /* cb */) {
+  LOG(FATAL) << "io_uring is not supported on this platform";
+}
+
+#endif // defined(KUDU_HAVE_IO_URING)
+
+} // namespace kudu
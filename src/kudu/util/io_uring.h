@@ -0,0 +1,118 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "kudu/gutil/macros.h"
+#include "kudu/gutil/ref_counted.h"
+#include "kudu/util/condition_variable.h"
+#include "kudu/util/mutex.h"
+#include "kudu/util/status.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace kudu {
+
+class Thread;
+
+// A minimal io_uring(7) instance, driven directly through the
+// io_uring_setup(2) and io_uring_enter(2) system calls so that no additional
+// library is required.
+//
+// Operations may be submitted from any thread. Their completions are reaped by
+// a dedicated thread owned by the ring, which invokes each operation's callback
+// in completion order. Callbacks must be short and must not block, since they
+// hold up every other completion.
+//
+// This class is thread-safe.
+class IoUring {
+ public:
+  // Invoked with the result of the operation: the same value the equivalent
+  // system call would have returned, or -errno on failure.
+  typedef std::function<void(int32_t res)> CompletionCallback;
+
+  // Creates a ring able to hold 'queue_depth' operations in flight.
+  //
+  // Returns Status::NotSupported() if io_uring is not available, e.g. because
+  // the kernel is too old or because it was disabled by a seccomp policy.
+  static Status Create(uint32_t queue_depth, std::unique_ptr<IoUring>* ring);
+
+  // Waits for all the in-flight operations to complete.
+  ~IoUring();
+
+  // Submits an fsync(2) of 'fd', or an fdatasync(2) if 'datasync' is true.
+  //
+  // The sync only starts once every previously submitted operation has
+  // completed. Hence, syncs complete in submission order.
+  void SubmitFsync(int fd, bool datasync, CompletionCallback cb);
+
+ private:
+  IoUring();
+
+  Status Init(uint32_t queue_depth);
+
+  // Fills in and submits a single SQE, blocking while the ring is full.
+  // 'cb' may be null, in which case the completion stops the reaper thread.
+  void Submit(
+      const std::function<void(io_uring_sqe*)>& prep,
+      CompletionCallback cb);
+
+  // Body of the reaper thread.
+  void ReapCompletions();
+
+  // Unmaps the rings and closes the ring's file descriptor.
+  void Release();
+
+  int ring_fd_;
+
+  // Memory-mapped ring buffers shared with the kernel.
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  // Pointers into 'sq_ring_'.
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  uint32_t sq_entries_;
+
+  // Pointers into 'cq_ring_'.
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  io_uring_cqe* cqes_;
+
+  // Protects the submission queue and 'num_in_flight_'.
+  Mutex lock_;
+  ConditionVariable not_full_;
+
+  // Number of submitted operations whose completion hasn't been reaped yet.
+  uint32_t num_in_flight_;
+
+  scoped_refptr<Thread> reaper_;
+
+  DISALLOW_COPY_AND_ASSIGN(IoUring);
+};
+
+} // namespace kudu
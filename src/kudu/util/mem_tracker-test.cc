@@ -27,6 +27,7 @@
 #include <utility>
 #include <vector>
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
@@ -34,6 +35,8 @@
 #include "kudu/util/monotime.h"
 #include "kudu/util/test_util.h"
 
+DECLARE_int64(mem_tracker_cpu_credit_bytes);
+
 namespace kudu {
 
 using std::equal_to;
@@ -287,4 +290,96 @@ TEST(MemTrackerTest, TestMultiThreadedCreateFind) {
   }
 }
 
+TEST(MemTrackerTest, TestCpuCredits) {
+  gflags::FlagSaver saver;
+  FLAGS_mem_tracker_cpu_credit_bytes = 100;
+  shared_ptr<MemTracker> p = MemTracker::CreateTracker(1000, "p");
+  shared_ptr<MemTracker> c = MemTracker::CreateTracker(-1, "c", p);
+
+  // A batch is charged along with the consumption.
+  c->Consume(10);
+  EXPECT_GE(c->consumption(), 110);
+  EXPECT_EQ(c->consumption(), p->consumption());
+
+  // Credits are never charged past a limit.
+  c->Release(10);
+  ASSERT_TRUE(c->TryConsume(1000));
+  EXPECT_FALSE(c->TryConsume(1));
+  EXPECT_EQ(1000, p->consumption());
+  EXPECT_FALSE(p->LimitExceeded());
+
+  // Only a batch is kept as credit.
+  c->Release(1000);
+  EXPECT_EQ(100, p->consumption());
+
+  // Credits are given back when the tracker goes away.
+  c.reset();
+  EXPECT_EQ(0, p->consumption());
+}
+
+// Tests that limit checks close to a limit aren't thrown off by the credits.
+TEST(MemTrackerTest, TestCpuCreditsFlushedNearLimit) {
+  gflags::FlagSaver saver;
+  FLAGS_mem_tracker_cpu_credit_bytes = 100;
+  shared_ptr<MemTracker> p = MemTracker::CreateTracker(1000, "p");
+  shared_ptr<MemTracker> c = MemTracker::CreateTracker(-1, "c", p);
+
+  // Each of these charges a batch on top of the consumption, which takes the
+  // shared consumption past the limit.
+  c->Consume(10);
+  c->Consume(880);
+  ASSERT_GT(p->consumption(), 1000);
+
+  EXPECT_FALSE(p->LimitExceeded());
+  EXPECT_EQ(890, p->consumption());
+  EXPECT_EQ(110, c->SpareCapacity());
+  EXPECT_TRUE(c->TryConsume(110));
+  EXPECT_FALSE(c->TryConsume(1));
+  EXPECT_EQ(1000, p->consumption());
+
+  c->Release(1000);
+  p->FlushCredits();
+  EXPECT_EQ(0, p->consumption());
+}
+
+// Measures how fast threads consume and release memory through a small
+// hierarchy of trackers, with and without per-CPU credits.
+TEST(MemTrackerTest, TestMultiThreadedConsumeReleaseThroughput) {
+  gflags::FlagSaver saver;
+  const int kNumThreads = 8;
+  const int kNumIterations = AllowSlowTests() ? 1000000 : 100000;
+  for (int64_t credit_bytes : {0, 64 * 1024}) {
+    FLAGS_mem_tracker_cpu_credit_bytes = credit_bytes;
+    shared_ptr<MemTracker> p = MemTracker::CreateTracker(-1, "p");
+    shared_ptr<MemTracker> c1 = MemTracker::CreateTracker(-1, "c1", p);
+    shared_ptr<MemTracker> c2 = MemTracker::CreateTracker(-1, "c2", c1);
+
+    MonoTime start = MonoTime::Now();
+    vector<std::thread> threads;
+    for (int i = 0; i < kNumThreads; i++) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < kNumIterations; j++) {
+          int64_t bytes = 64 + (i + j) % 1024;
+          c2->Consume(bytes);
+          c2->Release(bytes);
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    MonoDelta elapsed = MonoTime::Now() - start;
+    LOG(INFO) << Substitute(
+        "$0 byte credits: $1 consume/release pairs per second",
+        credit_bytes,
+        static_cast<int64_t>(
+            kNumThreads * kNumIterations / elapsed.ToSeconds()));
+
+    // Only credits are left, and they go away with the tracker.
+    EXPECT_GE(p->consumption(), 0);
+    c2.reset();
+    EXPECT_EQ(0, p->consumption());
+  }
+}
+
 } // namespace kudu
@@ -18,6 +18,7 @@
 #include "kudu/util/mem_tracker.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <deque>
 #include <limits>
@@ -25,12 +26,32 @@
 #include <memory>
 #include <ostream>
 
+#include <gflags/gflags.h>
+#ifndef __APPLE__
+#include <sched.h>
+#endif
+
 #include "kudu/gutil/once.h"
 #include "kudu/gutil/port.h"
 #include "kudu/gutil/strings/substitute.h"
+#include "kudu/gutil/sysinfo.h"
+#include "kudu/util/flag_tags.h"
 #include "kudu/util/mutex.h"
 #include "kudu/util/process_memory.h"
 
+DEFINE_int64(
+    mem_tracker_cpu_credit_bytes,
+    0,
+    "If positive, memory trackers created afterwards charge consumption to "
+    "themselves and their ancestors in batches of this many bytes, kept as "
+    "a per-CPU credit, instead of walking up the tracker tree on every "
+    "Consume() and Release(). Reported consumption may then exceed the "
+    "actual one by less than two batches per CPU and tracker, except when "
+    "checked against a limit it's close to, which gives the credits back "
+    "first.");
+TAG_FLAG(mem_tracker_cpu_credit_bytes, advanced);
+TAG_FLAG(mem_tracker_cpu_credit_bytes, experimental);
+
 namespace kudu {
 
 // NOTE: this class has been adapted from Impala, so the code style varies
@@ -49,6 +70,24 @@ using strings::Substitute;
 static shared_ptr<MemTracker> root_tracker;
 static GoogleOnceType root_tracker_once = GOOGLE_ONCE_INIT;
 
+// The largest credit batch of any tracker created so far, or 0 if no tracker
+// has per-CPU credits.
+static std::atomic<int64_t> max_credit_batch_bytes(0);
+
+static bool CreditsInUse() {
+  return max_credit_batch_bytes.load(std::memory_order_relaxed) > 0;
+}
+
+// An upper bound on the bytes a single tracker may hold as credits.
+static int64_t MaxCreditBytes() {
+  int64_t batch_bytes = max_credit_batch_bytes.load(std::memory_order_relaxed);
+#if defined(__APPLE__)
+  return 2 * batch_bytes;
+#else
+  return 2 * batch_bytes * (base::MaxCPUIndex() + 1);
+#endif
+}
+
 void MemTracker::CreateRootTracker() {
   root_tracker.reset(new MemTracker(-1, "root", shared_ptr<MemTracker>()));
   root_tracker->Init();
@@ -79,12 +118,30 @@ MemTracker::MemTracker(
       id_(id),
       descr_(Substitute("memory consumption for $0", id)),
       parent_(std::move(parent)),
-      consumption_(0) {
+      consumption_(0),
+      num_cpu_credits_(0),
+      credit_batch_bytes_(FLAGS_mem_tracker_cpu_credit_bytes) {
   VLOG(1) << "Creating tracker " << ToString();
+  if (credit_batch_bytes_ > 0) {
+    int64_t max_batch_bytes =
+        max_credit_batch_bytes.load(std::memory_order_relaxed);
+    while (max_batch_bytes < credit_batch_bytes_ &&
+           !max_credit_batch_bytes.compare_exchange_weak(
+               max_batch_bytes, credit_batch_bytes_)) {
+    }
+#if defined(__APPLE__)
+    // OSX doesn't have a way to get the index of the CPU running this thread.
+    num_cpu_credits_ = 1;
+#else
+    num_cpu_credits_ = base::MaxCPUIndex() + 1;
+#endif
+    cpu_credits_.reset(new PaddedCredit[num_cpu_credits_]);
+  }
 }
 
 MemTracker::~MemTracker() {
   VLOG(1) << "Destroying tracker " << ToString();
+  ReturnCredits();
   if (parent_) {
     DCHECK(consumption() == 0)
         << "Memory tracker " << ToString() << " has unreleased consumption "
@@ -205,9 +262,16 @@ void MemTracker::Consume(int64_t bytes) {
   if (bytes == 0) {
     return;
   }
-  for (auto& tracker : all_trackers_) {
-    tracker->consumption_.IncrementBy(bytes);
+  if (cpu_credits_ && TakeCredit(bytes)) {
+    return;
   }
+  if (cpu_credits_) {
+    // Charge a whole batch, and keep what isn't consumed yet as credit.
+    IncrementAll(bytes + credit_batch_bytes_);
+    CpuCredit()->fetch_add(credit_batch_bytes_, std::memory_order_relaxed);
+    return;
+  }
+  IncrementAll(bytes);
 }
 
 bool MemTracker::TryConsume(int64_t bytes) {
@@ -216,6 +280,40 @@ bool MemTracker::TryConsume(int64_t bytes) {
     return true;
   }
 
+  if (!cpu_credits_) {
+    return TryConsumeFlushingCredits(bytes);
+  }
+  // The credit was charged against the limits already.
+  if (TakeCredit(bytes)) {
+    return true;
+  }
+  if (TryConsumeShared(bytes + credit_batch_bytes_)) {
+    CpuCredit()->fetch_add(credit_batch_bytes_, std::memory_order_relaxed);
+    return true;
+  }
+  // Close to a limit: give this CPU's credit back and try the exact amount.
+  IncrementAll(-CpuCredit()->exchange(0));
+  return TryConsumeFlushingCredits(bytes);
+}
+
+bool MemTracker::TryConsumeFlushingCredits(int64_t bytes) {
+  if (TryConsumeShared(bytes)) {
+    return true;
+  }
+  if (!CreditsInUse()) {
+    return false;
+  }
+  // The credits held under the limits in the way may account for the
+  // shortfall.
+  for (const auto& tracker : limit_trackers_) {
+    if (tracker->limit() - tracker->consumption() < bytes) {
+      tracker->FlushCredits();
+    }
+  }
+  return TryConsumeShared(bytes);
+}
+
+bool MemTracker::TryConsumeShared(int64_t bytes) {
   int i = 0;
   // Walk the tracker tree top-down, consuming memory from each in turn.
   for (i = all_trackers_.size() - 1; i >= 0; --i) {
@@ -254,12 +352,106 @@ void MemTracker::Release(int64_t bytes) {
     return;
   }
 
-  for (auto& tracker : all_trackers_) {
-    tracker->consumption_.IncrementBy(-bytes);
+  if (cpu_credits_) {
+    AddCredit(bytes);
+  } else {
+    IncrementAll(-bytes);
   }
   process_memory::MaybeGCAfterRelease(bytes);
 }
 
+void MemTracker::FlushCredits() {
+  if (!CreditsInUse()) {
+    return;
+  }
+  deque<shared_ptr<MemTracker>> to_process;
+  to_process.push_front(shared_from_this());
+  while (!to_process.empty()) {
+    shared_ptr<MemTracker> t = to_process.back();
+    to_process.pop_back();
+
+    t->ReturnCredits();
+    {
+      MutexLock l(t->child_trackers_lock_);
+      for (const auto& child_weak : t->child_trackers_) {
+        shared_ptr<MemTracker> child = child_weak.lock();
+        if (child) {
+          to_process.emplace_back(std::move(child));
+        }
+      }
+    }
+  }
+}
+
+void MemTracker::ReturnCredits() {
+  int64_t credits = 0;
+  for (int i = 0; i < num_cpu_credits_; i++) {
+    credits += cpu_credits_[i].bytes.exchange(0, std::memory_order_relaxed);
+  }
+  IncrementAll(-credits);
+}
+
+void MemTracker::IncrementAll(int64_t bytes) {
+  if (bytes == 0) {
+    return;
+  }
+  for (auto& tracker : all_trackers_) {
+    tracker->consumption_.IncrementBy(bytes);
+  }
+}
+
+std::atomic<int64_t>* MemTracker::CpuCredit() {
+  DCHECK(cpu_credits_);
+#if defined(__APPLE__)
+  int cpu = 0;
+#else
+  int cpu = sched_getcpu();
+  if (PREDICT_FALSE(cpu < 0 || cpu >= num_cpu_credits_)) {
+    cpu = 0;
+  }
+#endif
+  return &cpu_credits_[cpu].bytes;
+}
+
+bool MemTracker::TakeCredit(int64_t bytes) {
+  // The thread may have moved to another CPU since CpuCredit() returned, so
+  // the credit is shared and must never go negative.
+  std::atomic<int64_t>* credit = CpuCredit();
+  int64_t available = credit->load(std::memory_order_relaxed);
+  while (available >= bytes) {
+    if (credit->compare_exchange_weak(
+            available, available - bytes, std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void MemTracker::AddCredit(int64_t bytes) {
+  std::atomic<int64_t>* credit = CpuCredit();
+  int64_t available =
+      credit->fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  while (available > 2 * credit_batch_bytes_) {
+    if (credit->compare_exchange_weak(
+            available, credit_batch_bytes_, std::memory_order_relaxed)) {
+      IncrementAll(credit_batch_bytes_ - available);
+      return;
+    }
+  }
+}
+
+bool MemTracker::LimitExceeded() {
+  if (limit_ < 0 || limit_ >= consumption()) {
+    return false;
+  }
+  if (!CreditsInUse()) {
+    return true;
+  }
+  // The credits may account for the excess.
+  FlushCredits();
+  return limit_ < consumption();
+}
+
 bool MemTracker::AnyLimitExceeded() {
   for (const auto& tracker : limit_trackers_) {
     if (tracker->LimitExceeded()) {
@@ -271,8 +463,14 @@ bool MemTracker::AnyLimitExceeded() {
 
 int64_t MemTracker::SpareCapacity() const {
   int64_t result = std::numeric_limits<int64_t>::max();
+  const int64_t max_credit_bytes = MaxCreditBytes();
   for (const auto& tracker : limit_trackers_) {
     int64_t mem_left = tracker->limit() - tracker->consumption();
+    if (mem_left < max_credit_bytes) {
+      // Close enough to the limit for the credits to matter.
+      tracker->FlushCredits();
+      mem_left = tracker->limit() - tracker->consumption();
+    }
     result = std::min(result, mem_left);
   }
   return result;
@@ -17,6 +17,7 @@
 #ifndef KUDU_UTIL_MEM_TRACKER_H
 #define KUDU_UTIL_MEM_TRACKER_H
 
+#include <atomic>
 #include <cstdint>
 #include <list>
 #include <memory>
@@ -26,6 +27,7 @@
 
 #include <glog/logging.h>
 
+#include "kudu/gutil/port.h"
 #include "kudu/util/high_water_mark.h"
 #include "kudu/util/mutex.h"
 
@@ -54,6 +56,17 @@ namespace kudu {
 // Memory consumption is tracked via calls to Consume()/Release(), either to
 // the tracker itself or to one of its descendants.
 //
+// With --mem_tracker_cpu_credit_bytes set, each tracker created afterwards
+// keeps a per-CPU credit of bytes already charged to it and its ancestors.
+// Consume() draws from the calling CPU's credit, and only walks up the tree
+// when the credit runs out, to charge another batch of bytes. Release()
+// returns bytes to the credit, and walks up the tree once the credit grows
+// past twice the batch. The shared consumption therefore overstates the
+// actual one, by less than two batches per CPU, which keeps the limits
+// conservative: TryConsume() never lets a tracker go over its limit. Close
+// to a limit, TryConsume(), LimitExceeded() and SpareCapacity() flush the
+// credits held under it first, so they don't act on the overstatement.
+//
 // This class is thread-safe.
 class MemTracker : public std::enable_shared_from_this<MemTracker> {
  public:
@@ -125,15 +138,23 @@ class MemTracker : public std::enable_shared_from_this<MemTracker> {
   // memory if the limit is exceeded by calling any added GC functions. Returns
   // true if the limit is exceeded after calling the GC functions. Returns false
   // if there is no limit.
-  bool LimitExceeded() {
-    return limit_ >= 0 && limit_ < consumption();
-  }
+  //
+  // With per-CPU credits, the credits of this tracker and its descendants are
+  // given back before reporting the limit as exceeded.
+  bool LimitExceeded();
 
   // Returns the maximum consumption that can be made without exceeding the
   // limit on this tracker or any of its parents. Returns int64_t::max() if
   // there are no limits and a negative value if any limit is already exceeded.
+  //
+  // With per-CPU credits, the credits under a limit that is close are given
+  // back first.
   int64_t SpareCapacity() const;
 
+  // Gives the per-CPU credits of this tracker and its descendants back, so
+  // that consumption() is exact, short of concurrent Consume() calls.
+  void FlushCredits();
+
   int64_t limit() const {
     return limit_;
   }
@@ -144,7 +165,8 @@ class MemTracker : public std::enable_shared_from_this<MemTracker> {
     return id_;
   }
 
-  // Returns the memory consumed in bytes.
+  // Returns the memory consumed in bytes. With per-CPU credits, this includes
+  // the credits of this tracker and its descendants.
   int64_t consumption() const {
     return consumption_.current_value();
   }
@@ -185,6 +207,29 @@ class MemTracker : public std::enable_shared_from_this<MemTracker> {
   // Creates the root tracker.
   static void CreateRootTracker();
 
+  // Charges or credits 'bytes' to this tracker and its ancestors.
+  void IncrementAll(int64_t bytes);
+
+  // TryConsume() without the per-CPU credits.
+  bool TryConsumeShared(int64_t bytes);
+
+  // TryConsumeShared(), retried after flushing the credits under the limits
+  // that were in the way.
+  bool TryConsumeFlushingCredits(int64_t bytes);
+
+  // Gives all of this tracker's per-CPU credits back.
+  void ReturnCredits();
+
+  // Returns the calling CPU's credit. Requires per-CPU credits.
+  std::atomic<int64_t>* CpuCredit();
+
+  // Takes 'bytes' from the calling CPU's credit. Returns false if it's short.
+  bool TakeCredit(int64_t bytes);
+
+  // Adds 'bytes' to the calling CPU's credit, giving the excess back to this
+  // tracker and its ancestors if it grows too large.
+  void AddCredit(int64_t bytes);
+
   int64_t limit_;
   const std::string id_;
   const std::string descr_;
@@ -197,6 +242,16 @@ class MemTracker : public std::enable_shared_from_this<MemTracker> {
   // all_trackers_ with valid limits
   std::vector<MemTracker*> limit_trackers_;
 
+  // Bytes charged to all_trackers_ but not consumed yet, per CPU. Empty if
+  // the tracker has no per-CPU credits.
+  struct PaddedCredit {
+    std::atomic<int64_t> bytes{0};
+  } CACHELINE_ALIGNED;
+  std::unique_ptr<PaddedCredit[]> cpu_credits_;
+  int num_cpu_credits_;
+  // Bytes charged at once when a CPU's credit runs out.
+  int64_t credit_batch_bytes_;
+
   // All the child trackers of this tracker. Used for error reporting and
   // listing only (i.e. updating the consumption of a parent tracker does not
   // update that of its children).
@@ -0,0 +1,157 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "kudu/util/phi_accrual_failure_detector.h"
+
+#include <gtest/gtest.h>
+
+#include "kudu/util/monotime.h"
+#include "kudu/util/random.h"
+#include "kudu/util/test_util.h"
+
+namespace kudu {
+
+class PhiAccrualFailureDetectorTest : public KuduTest {
+ protected:
+  static PhiAccrualFailureDetector::Options DefaultOptions() {
+    PhiAccrualFailureDetector::Options opts;
+    opts.max_samples = 100;
+    opts.min_samples = 10;
+    opts.min_std_dev = MonoDelta::FromMilliseconds(10);
+    return opts;
+  }
+
+  // Feeds 'n' heartbeats to 'detector', 'interval_ms' apart plus up to
+  // 'jitter_ms' of uniform jitter. Returns the time of the last one.
+  MonoTime FeedHeartbeats(
+      PhiAccrualFailureDetector* detector,
+      MonoTime start,
+      int n,
+      int interval_ms,
+      int jitter_ms) {
+    Random rng(SeedRandom());
+    MonoTime now = start;
+    for (int i = 0; i < n; i++) {
+      if (i > 0) {
+        int delta_ms = interval_ms;
+        if (jitter_ms > 0) {
+          delta_ms += rng.Uniform(jitter_ms);
+        }
+        now += MonoDelta::FromMilliseconds(delta_ms);
+      }
+      detector->HeartbeatArrived(now);
+    }
+    return now;
+  }
+};
+
+TEST_F(PhiAccrualFailureDetectorTest, TestPhiAndDeviationAreInverses) {
+  for (double phi : {0.1, 0.5, 1.0, 3.0, 8.0, 16.0}) {
+    SCOPED_TRACE(phi);
+    double std_devs = PhiAccrualFailureDetector::DeviationForPhi(phi);
+    EXPECT_NEAR(
+        phi, PhiAccrualFailureDetector::PhiForDeviation(std_devs), 1e-6);
+  }
+  // At the mean, half of the heartbeats are still to come.
+  EXPECT_NEAR(0.301, PhiAccrualFailureDetector::PhiForDeviation(0), 1e-3);
+  EXPECT_LT(
+      PhiAccrualFailureDetector::PhiForDeviation(1),
+      PhiAccrualFailureDetector::PhiForDeviation(2));
+}
+
+TEST_F(PhiAccrualFailureDetectorTest, TestNotEnoughSamples) {
+  PhiAccrualFailureDetector detector(DefaultOptions());
+  MonoTime now = MonoTime::Now();
+  ASSERT_FALSE(detector.HasEnoughSamples());
+  now = FeedHeartbeats(&detector, now, 10, 100, 0);
+  // Ten heartbeats are nine intervals.
+  ASSERT_FALSE(detector.HasEnoughSamples());
+  ASSERT_EQ(0, detector.Phi(now + MonoDelta::FromSeconds(10)));
+  detector.HeartbeatArrived(now + MonoDelta::FromMilliseconds(100));
+  ASSERT_TRUE(detector.HasEnoughSamples());
+  ASSERT_EQ(10, detector.num_samples());
+}
+
+TEST_F(PhiAccrualFailureDetectorTest, TestSuspicionGrowsWithSilence) {
+  PhiAccrualFailureDetector detector(DefaultOptions());
+  MonoTime last = FeedHeartbeats(&detector, MonoTime::Now(), 50, 100, 0);
+  ASSERT_EQ(100, detector.mean().ToMilliseconds());
+  ASSERT_EQ(10, detector.std_dev().ToMilliseconds());
+
+  double prev_phi = 0;
+  for (int ms = 50; ms <= 300; ms += 50) {
+    double phi = detector.Phi(last + MonoDelta::FromMilliseconds(ms));
+    ASSERT_GT(phi, prev_phi);
+    prev_phi = phi;
+  }
+
+  // The time to reach a suspicion level is consistent with Phi().
+  MonoDelta time_to_phi = detector.TimeToPhi(8);
+  ASSERT_NEAR(8, detector.Phi(last + time_to_phi), 0.01);
+}
+
+// A jittery link takes longer to be suspected than a steady one with the same
+// mean interval.
+TEST_F(PhiAccrualFailureDetectorTest, TestJitterDelaysSuspicion) {
+  PhiAccrualFailureDetector steady(DefaultOptions());
+  PhiAccrualFailureDetector jittery(DefaultOptions());
+  const MonoTime start = MonoTime::Now();
+  FeedHeartbeats(&steady, start, 100, 150, 0);
+  FeedHeartbeats(&jittery, start, 100, 100, 100);
+
+  ASSERT_NEAR(
+      steady.mean().ToMilliseconds(), jittery.mean().ToMilliseconds(), 15);
+  ASSERT_GT(jittery.std_dev(), steady.std_dev());
+  ASSERT_GT(jittery.TimeToPhi(8), steady.TimeToPhi(8));
+}
+
+TEST_F(PhiAccrualFailureDetectorTest, TestWindowAndReset) {
+  PhiAccrualFailureDetector detector(DefaultOptions());
+  MonoTime last = FeedHeartbeats(&detector, MonoTime::Now(), 200, 500, 0);
+  // Only the last 100 intervals are kept, so the slower ones are forgotten.
+  last = FeedHeartbeats(
+      &detector, last + MonoDelta::FromMilliseconds(100), 200, 100, 0);
+  ASSERT_EQ(100, detector.num_samples());
+  ASSERT_EQ(100, detector.mean().ToMilliseconds());
+
+  detector.Reset();
+  ASSERT_FALSE(detector.HasEnoughSamples());
+  ASSERT_EQ(0, detector.num_samples());
+}
+
+TEST_F(PhiAccrualFailureDetectorTest, TestForgetLastHeartbeat) {
+  PhiAccrualFailureDetector detector(DefaultOptions());
+  MonoTime last = FeedHeartbeats(&detector, MonoTime::Now(), 50, 100, 0);
+  detector.ForgetLastHeartbeat();
+  // The pause isn't recorded as an interval, and the ones before are kept.
+  ASSERT_FALSE(
+      detector.HeartbeatArrived(last + MonoDelta::FromSeconds(60))
+          .Initialized());
+  ASSERT_EQ(49, detector.num_samples());
+  ASSERT_EQ(100, detector.mean().ToMilliseconds());
+}
+
+TEST_F(PhiAccrualFailureDetectorTest, TestAcceptablePause) {
+  PhiAccrualFailureDetector::Options opts = DefaultOptions();
+  opts.acceptable_pause = MonoDelta::FromMilliseconds(200);
+  PhiAccrualFailureDetector detector(opts);
+  MonoTime last = FeedHeartbeats(&detector, MonoTime::Now(), 50, 100, 0);
+  ASSERT_EQ(300, detector.mean().ToMilliseconds());
+  ASSERT_LT(detector.Phi(last + MonoDelta::FromMilliseconds(250)), 1);
+}
+
+} // namespace kudu
@@ -0,0 +1,203 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "kudu/util/phi_accrual_failure_detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <utility>
+
+#include <glog/logging.h>
+
+namespace kudu {
+
+namespace {
+
+// The logistic approximation of the normal distribution's CDF is
+// 1 / (1 + exp(-g(y))) with g(y) = y * (kLinear + kCubic * y * y).
+const double kLinear = 1.5976;
+const double kCubic = 0.070566;
+
+// Phi levels are kept within bounds where the tail probability is neither 1
+// nor underflows.
+const double kMinPhi = 0.01;
+const double kMaxPhi = 300;
+
+} // anonymous namespace
+
+PhiAccrualFailureDetector::PhiAccrualFailureDetector(Options options)
+    : options_(std::move(options)),
+      next_interval_(0),
+      sum_(0),
+      sum_of_squares_(0) {
+  CHECK_GT(options_.max_samples, 0);
+  CHECK_GT(options_.min_samples, 0);
+  intervals_.reserve(options_.max_samples);
+}
+
+MonoDelta PhiAccrualFailureDetector::HeartbeatArrived(MonoTime now) {
+  std::lock_guard<simple_spinlock> l(lock_);
+  if (!last_heartbeat_.Initialized()) {
+    last_heartbeat_ = now;
+    return MonoDelta();
+  }
+  if (now < last_heartbeat_) {
+    return MonoDelta();
+  }
+  const MonoDelta delta = now - last_heartbeat_;
+  const int64_t interval = delta.ToMicroseconds();
+  last_heartbeat_ = now;
+
+  const double value = static_cast<double>(interval);
+  if (intervals_.size() < static_cast<size_t>(options_.max_samples)) {
+    intervals_.push_back(interval);
+  } else {
+    const double old_value = static_cast<double>(intervals_[next_interval_]);
+    sum_ -= old_value;
+    sum_of_squares_ -= old_value * old_value;
+    intervals_[next_interval_] = interval;
+    next_interval_ = (next_interval_ + 1) % intervals_.size();
+  }
+  sum_ += value;
+  sum_of_squares_ += value * value;
+  return delta;
+}
+
+void PhiAccrualFailureDetector::Reset() {
+  std::lock_guard<simple_spinlock> l(lock_);
+  intervals_.clear();
+  next_interval_ = 0;
+  sum_ = 0;
+  sum_of_squares_ = 0;
+  last_heartbeat_ = MonoTime();
+}
+
+void PhiAccrualFailureDetector::ForgetLastHeartbeat() {
+  std::lock_guard<simple_spinlock> l(lock_);
+  last_heartbeat_ = MonoTime();
+}
+
+bool PhiAccrualFailureDetector::HasEnoughSamples() const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  return intervals_.size() >= static_cast<size_t>(options_.min_samples);
+}
+
+double PhiAccrualFailureDetector::Phi(MonoTime now) const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  if (intervals_.size() < static_cast<size_t>(options_.min_samples) ||
+      now < last_heartbeat_) {
+    return 0;
+  }
+  double mean;
+  double std_dev;
+  GetDistributionUnlocked(&mean, &std_dev);
+  const double elapsed =
+      static_cast<double>((now - last_heartbeat_).ToMicroseconds());
+  return PhiForDeviation((elapsed - mean) / std_dev);
+}
+
+MonoDelta PhiAccrualFailureDetector::TimeToPhi(double phi) const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  DCHECK_GE(intervals_.size(), static_cast<size_t>(options_.min_samples));
+  double mean;
+  double std_dev;
+  GetDistributionUnlocked(&mean, &std_dev);
+  const double micros = mean + std_dev * DeviationForPhi(phi);
+  return MonoDelta::FromMicroseconds(
+      static_cast<int64_t>(std::max(micros, 0.0)));
+}
+
+MonoDelta PhiAccrualFailureDetector::mean() const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  double mean;
+  double std_dev;
+  GetDistributionUnlocked(&mean, &std_dev);
+  return MonoDelta::FromMicroseconds(static_cast<int64_t>(mean));
+}
+
+MonoDelta PhiAccrualFailureDetector::std_dev() const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  double mean;
+  double std_dev;
+  GetDistributionUnlocked(&mean, &std_dev);
+  return MonoDelta::FromMicroseconds(static_cast<int64_t>(std_dev));
+}
+
+int PhiAccrualFailureDetector::num_samples() const {
+  std::lock_guard<simple_spinlock> l(lock_);
+  return static_cast<int>(intervals_.size());
+}
+
+void PhiAccrualFailureDetector::GetDistributionUnlocked(
+    double* mean,
+    double* std_dev) const {
+  DCHECK(lock_.is_locked());
+  const double min_std_dev =
+      static_cast<double>(options_.min_std_dev.ToMicroseconds());
+  const double acceptable_pause =
+      static_cast<double>(options_.acceptable_pause.ToMicroseconds());
+  if (intervals_.empty()) {
+    *mean = acceptable_pause;
+    *std_dev = min_std_dev;
+    return;
+  }
+  const double n = static_cast<double>(intervals_.size());
+  const double m = sum_ / n;
+  // Rounding may make the variance slightly negative.
+  const double variance = std::max(sum_of_squares_ / n - m * m, 0.0);
+  *mean = m + acceptable_pause;
+  *std_dev = std::max(std::sqrt(variance), min_std_dev);
+}
+
+double PhiAccrualFailureDetector::PhiForDeviation(double std_devs) {
+  const double e =
+      std::exp(-std_devs * (kLinear + kCubic * std_devs * std_devs));
+  // Both branches compute -log10(e / (1 + e)), the second one without losing
+  // precision when e is large.
+  double phi;
+  if (std_devs > 0) {
+    phi = -std::log10(e / (1.0 + e));
+  } else {
+    phi = -std::log10(1.0 - 1.0 / (1.0 + e));
+  }
+  return std::min(phi, kMaxPhi);
+}
+
+double PhiAccrualFailureDetector::DeviationForPhi(double phi) {
+  phi = std::min(std::max(phi, kMinPhi), kMaxPhi);
+  // Solve g(y) = ln((1 - p) / p) for y, with p = 10^-phi the probability of
+  // a later heartbeat. g is odd and strictly increasing, so solve for |g|
+  // with Newton's method, which converges from above on the convex positive
+  // half of g.
+  const double p = std::pow(10.0, -phi);
+  const double target = std::log((1.0 - p) / p);
+  const double g = std::fabs(target);
+  double y = g / kLinear;
+  for (int i = 0; i < 50; i++) {
+    const double f = y * (kLinear + kCubic * y * y) - g;
+    const double next = y - f / (kLinear + 3 * kCubic * y * y);
+    if (std::fabs(next - y) < 1e-9) {
+      y = next;
+      break;
+    }
+    y = next;
+  }
+  return target < 0 ? -y : y;
+}
+
+} // namespace kudu
@@ -0,0 +1,125 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "kudu/gutil/macros.h"
+#include "kudu/util/locks.h"
+#include "kudu/util/monotime.h"
+
+namespace kudu {
+
+// A phi accrual failure detector, as described in "The phi Accrual Failure
+// Detector" (Hayashibara et al.).
+//
+// Rather than suspecting a process once a fixed timeout has passed since its
+// last heartbeat, the detector keeps a window of the intervals between
+// recent heartbeats, models them as a normal distribution, and expresses the
+// suspicion that the process failed as
+//
+//   phi(t) = -log10(P(the next heartbeat arrives later than t))
+//
+// where t is the time since the last heartbeat. A phi of 1 means a 10% chance
+// of being wrong when suspecting the process, a phi of 3 a 0.1% chance, and
+// so on. On a steady link the suspicion builds up quickly, while on a jittery
+// one it builds up slowly, without having to tune a timeout for either.
+//
+// The normal distribution's tail is approximated with a logistic function,
+// as Akka and Cassandra do.
+//
+// This class is thread-safe.
+class PhiAccrualFailureDetector {
+ public:
+  struct Options {
+    // Number of intervals the distribution is estimated from. Older intervals
+    // are forgotten first.
+    int max_samples = 1000;
+    // Number of intervals needed before the estimate is trusted.
+    int min_samples = 10;
+    // Lower bound of the standard deviation, so that a very regular link
+    // doesn't make the detector suspect on the slightest delay.
+    MonoDelta min_std_dev = MonoDelta::FromMilliseconds(50);
+    // Added to the mean interval, to tolerate pauses (e.g. garbage collection
+    // or disk stalls) the intervals don't capture.
+    MonoDelta acceptable_pause = MonoDelta::FromMilliseconds(0);
+  };
+
+  explicit PhiAccrualFailureDetector(Options options);
+
+  // Records the arrival of a heartbeat at 'now'. Returns the interval since
+  // the previous heartbeat, or an uninitialized MonoDelta if there is none.
+  MonoDelta HeartbeatArrived(MonoTime now);
+
+  // Forgets all heartbeats, e.g. because they're now expected from another
+  // process.
+  void Reset();
+
+  // Forgets when the last heartbeat arrived, but not the intervals recorded
+  // so far, so that the interval until the next heartbeat isn't recorded.
+  // Useful when the process deliberately pauses its heartbeats.
+  void ForgetLastHeartbeat();
+
+  // Returns true if enough intervals were recorded to estimate their
+  // distribution.
+  bool HasEnoughSamples() const;
+
+  // Returns the suspicion level at 'now', or 0 if there isn't enough data.
+  double Phi(MonoTime now) const;
+
+  // Returns the time after the last heartbeat at which the suspicion level
+  // reaches 'phi'. Requires HasEnoughSamples().
+  MonoDelta TimeToPhi(double phi) const;
+
+  // The estimated distribution of the intervals between heartbeats.
+  MonoDelta mean() const;
+  MonoDelta std_dev() const;
+  int num_samples() const;
+
+  // Returns -log10 of the probability that a heartbeat arrives more than
+  // 'std_devs' standard deviations after the mean.
+  static double PhiForDeviation(double std_devs);
+
+  // The inverse of PhiForDeviation().
+  static double DeviationForPhi(double phi);
+
+ private:
+  // Returns the mean and standard deviation of the intervals, in
+  // microseconds.
+  void GetDistributionUnlocked(double* mean, double* std_dev) const;
+
+  const Options options_;
+
+  mutable simple_spinlock lock_;
+
+  // Ring of the most recent intervals, in microseconds, and the position of
+  // the next one.
+  std::vector<int64_t> intervals_;
+  size_t next_interval_;
+
+  // Sum of the intervals and of their squares.
+  double sum_;
+  double sum_of_squares_;
+
+  // Uninitialized until the first heartbeat.
+  MonoTime last_heartbeat_;
+
+  DISALLOW_COPY_AND_ASSIGN(PhiAccrualFailureDetector);
+};
+
+} // namespace kudu